@@ -0,0 +1,180 @@
+// compiles a few kernels to x86-64 twice, once with every value in a stack
+// slot (what -O0 does) and once with linear scan register allocation, links
+// both against the runtime with the system compiler and times the programs.
+// run it from the repository root, after `make release`, so build/runtime.o
+// exists:
+//
+//   $ make bench && ./build/bench/codegen_bench [runs]
+#include "arena.h"
+#include "ast.h"
+#include "lexer.h"
+#include "lower.h"
+#include "opt.h"
+#include "x86.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RUNTIME "build/runtime.o"
+
+typedef struct {
+  const char *name;
+  const char *source;
+} kernel;
+
+static const kernel kernels[] = {
+    {"loops", "fn main(argc, argv)\n"
+              "    total = 0\n"
+              "    for i from 0 to 3000\n"
+              "        for j from 0 to 3000\n"
+              "            total = total + (i * j + i - j) % 7\n"
+              "    print total\n"
+              "    return 0\n"},
+    {"collatz", "fn steps(n)\n"
+                "    count = 0\n"
+                "    while n != 1\n"
+                "        if n % 2 == 0\n"
+                "            n = n / 2\n"
+                "        else\n"
+                "            n = 3 * n + 1\n"
+                "        count = count + 1\n"
+                "    return count\n"
+                "fn main(argc, argv)\n"
+                "    best = 0\n"
+                "    for i from 1 to 300000\n"
+                "        s = steps(i)\n"
+                "        if s > best\n"
+                "            best = s\n"
+                "    print best\n"
+                "    return 0\n"},
+    {"fib", "fn fib(n)\n"
+            "    if n < 2\n"
+            "        return n\n"
+            "    return fib(n - 1) + fib(n - 2)\n"
+            "fn main(argc, argv)\n"
+            "    print fib(32)\n"
+            "    return 0\n"},
+    {"float", "fn main(argc, argv)\n"
+              "    x = 0.5\n"
+              "    y = 1.25\n"
+              "    for i from 0 to 2000000\n"
+              "        x = x * 0.999 + y * 0.001\n"
+              "        y = y * 0.999 + x / 2000\n"
+              "    print x\n"
+              "    print y\n"
+              "    return 0\n"},
+};
+
+typedef struct {
+  double seconds;
+  size_t insts;
+  uint32_t spills;
+} result;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int run(const char *cmd) {
+  int status = system(cmd);
+  return status == -1 || !WIFEXITED(status) ? -1 : WEXITSTATUS(status);
+}
+
+// writes the kernel's assembly and links it; returns 0 on success
+static int build(const kernel *k, const char *dir, int naive, result *r) {
+  char path[512], cmd[2048];
+  snprintf(path, sizeof(path), "%s/%s.boop", dir, k->name);
+  FILE *src = fopen(path, "w");
+  if (!src) return 1;
+  fputs(k->source, src);
+  fclose(src);
+
+  lexer_result *l = lex(path);
+  if (!l) return 1;
+  arena *ast_arena = create_arena("ast", 1 << 16), *ir_arena = create_arena("ir", 1 << 16);
+  ir_module *ir = gen_ir(gen_ast(l->tokens, l->interns, ast_arena), ir_arena);
+  if (!ir) return 1;
+  opt_options opt = {.level = 2};
+  optimize_module(ir, &opt);
+  x86_module *m = gen_x86(ir, ir_arena, naive);
+  r->insts = 0;
+  r->spills = 0;
+  for (uint32_t i = 0; i < m->nfuncs; i++) {
+    if (!m->funcs[i]) continue;
+    r->spills += m->funcs[i]->spills;
+    for (size_t b = 0; b < m->funcs[i]->blocks.size; b++)
+      r->insts += m->funcs[i]->blocks.data[b].insts.size;
+  }
+
+  snprintf(path, sizeof(path), "%s/%s-%s.s", dir, k->name, naive ? "naive" : "scan");
+  FILE *out = fopen(path, "w");
+  if (!out) return 1;
+  print_x86(out, m);
+  fclose(out);
+  destroy_arena(ir_arena);
+  destroy_arena(ast_arena);
+  destroy_lexer_result(l);
+
+  snprintf(cmd, sizeof(cmd), "cc -nostdlib -static -o %s/%s-%s %s " RUNTIME, dir, k->name,
+           naive ? "naive" : "scan", path);
+  return run(cmd);
+}
+
+static double time_program(const kernel *k, const char *dir, int naive, int runs) {
+  char cmd[1024];
+  snprintf(cmd, sizeof(cmd), "%s/%s-%s > /dev/null", dir, k->name, naive ? "naive" : "scan");
+  double best = 1e9;
+  for (int i = 0; i < runs; i++) {
+    double t0 = now();
+    if (run(cmd) != 0) return -1;
+    double dt = now() - t0;
+    if (dt < best) best = dt;
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  int runs = argc > 1 ? atoi(argv[1]) : 3;
+  if (access(RUNTIME, R_OK) != 0) {
+    fprintf(stderr, "%s is missing: run `make release` from the repository root first\n", RUNTIME);
+    return 1;
+  }
+  char dir[] = "/tmp/boop_codegen_bench_XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("failed to create a temporary directory");
+    return 1;
+  }
+
+  printf("%-8s %12s %9s %12s %9s %8s\n", "kernel", "naive insts", "ms", "scan insts", "ms",
+         "speedup");
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+    const kernel *k = &kernels[i];
+    result naive, scan;
+    if (build(k, dir, 1, &naive) || build(k, dir, 0, &scan)) {
+      fprintf(stderr, "%s: failed to build\n", k->name);
+      failed = 1;
+      continue;
+    }
+    naive.seconds = time_program(k, dir, 1, runs);
+    scan.seconds = time_program(k, dir, 0, runs);
+    if (naive.seconds < 0 || scan.seconds < 0) {
+      fprintf(stderr, "%s: failed to run\n", k->name);
+      failed = 1;
+      continue;
+    }
+    printf("%-8s %12zu %9.1f %12zu %9.1f %7.2fx  (%u spills)\n", k->name, naive.insts,
+           naive.seconds * 1e3, scan.insts, scan.seconds * 1e3, naive.seconds / scan.seconds,
+           scan.spills);
+  }
+
+  char cmd[512];
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  run(cmd);
+  return failed;
+}
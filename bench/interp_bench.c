@@ -0,0 +1,162 @@
+// runs a few loops in the style of examples/basic.boop on the bytecode
+// interpreter and on native code compiled into memory (--run), reporting the
+// time to get each ready and the time to run it.
+//
+//   $ make bench && ./build/bench/interp_bench [runs]
+#include "arena.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "lexer.h"
+#include "lower.h"
+#include "opt.h"
+#include "x86.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  const char *name;
+  const char *source;
+} kernel;
+
+static const kernel kernels[] = {
+    {"while", "fn main(argc, argv)\n"
+              "    total = 0\n"
+              "    i = 0\n"
+              "    while i < 20000000\n"
+              "        total = total + i % 7\n"
+              "        i = i + 1\n"
+              "    print total\n"
+              "    return 0\n"},
+    {"nested", "fn main(argc, argv)\n"
+               "    total = 0\n"
+               "    for i from 0 to 3000\n"
+               "        for j from 0 to 3000\n"
+               "            total = total + (i * j + i - j) % 7\n"
+               "    print total\n"
+               "    return 0\n"},
+    {"float", "fn main(argc, argv)\n"
+              "    x = 0.5\n"
+              "    for i from 1 to 6000000 by 0.5\n"
+              "        x = x * 0.999 + i / 1000000\n"
+              "    print x\n"
+              "    return 0\n"},
+    {"fib", "fn fib(n)\n"
+            "    if n < 2\n"
+            "        return n\n"
+            "    return fib(n - 1) + fib(n - 2)\n"
+            "fn main(argc, argv)\n"
+            "    print fib(27)\n"
+            "    return 0\n"},
+};
+
+typedef struct {
+  double prepare, run;  // best of the runs, in seconds
+} timing;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static ir_module *compile(const char *path, arena *ast_arena, arena *ir_arena) {
+  lexer_result *l = lex(path);
+  if (!l) return NULL;
+  ir_module *ir = gen_ir(gen_ast(l->tokens, l->interns, ast_arena), ir_arena);
+  destroy_lexer_result(l);
+  if (!ir) return NULL;
+  opt_options opt = {.level = 2};
+  optimize_module(ir, &opt);
+  return ir;
+}
+
+static void keep_best(timing *best, double prepare, double run) {
+  if (prepare < best->prepare) best->prepare = prepare;
+  if (run < best->run) best->run = run;
+}
+
+// native code writes straight to file descriptor 1, so that goes to /dev/null
+// for the duration
+static int time_jit(ir_module *ir, arena *a, int runs, timing *best) {
+  int null = open("/dev/null", O_WRONLY), saved = dup(1);
+  int failed = 0;
+  fflush(stdout);
+  dup2(null, 1);
+  for (int i = 0; i < runs && !failed; i++) {
+    double t0 = now();
+    jit_program p;
+    if (jit_load(gen_x86(ir, a, 0), &p)) {
+      failed = 1;
+      break;
+    }
+    double t1 = now();
+    char *argv[] = {"bench", NULL};
+    failed = jit_run(&p, 1, argv) != 0;
+    keep_best(best, t1 - t0, now() - t1);
+    jit_unload(&p);
+  }
+  dup2(saved, 1);
+  close(saved);
+  close(null);
+  return failed;
+}
+
+static int time_interp(ir_module *ir, arena *a, FILE *sink, int runs, timing *best) {
+  for (int i = 0; i < runs; i++) {
+    double t0 = now();
+    bc_module *m = gen_bytecode(ir, a, 0);
+    double t1 = now();
+    char *argv[] = {"bench", NULL};
+    int64_t status;
+    if (run_bytecode(m, 1, argv, sink, stderr, &status) || status != 0) return 1;
+    keep_best(best, t1 - t0, now() - t1);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int runs = argc > 1 ? atoi(argv[1]) : 3;
+  char dir[] = "/tmp/boop_interp_bench_XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("failed to create a temporary directory");
+    return 1;
+  }
+  FILE *sink = fopen("/dev/null", "w");
+  if (!sink) return 1;
+
+  printf("%-8s %14s %10s %14s %10s %9s\n", "kernel", "bytecode (us)", "run (ms)", "native (us)",
+         "run (ms)", "slowdown");
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+    const kernel *k = &kernels[i];
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.boop", dir, k->name);
+    FILE *src = fopen(path, "w");
+    if (!src) return 1;
+    fputs(k->source, src);
+    fclose(src);
+
+    arena *ast_arena = create_arena("ast", 1 << 16), *ir_arena = create_arena("ir", 1 << 16);
+    ir_module *ir = compile(path, ast_arena, ir_arena);
+    timing interp = {1e9, 1e9}, native = {1e9, 1e9};
+    if (!ir || time_interp(ir, ir_arena, sink, runs, &interp) ||
+        time_jit(ir, ir_arena, runs, &native)) {
+      fprintf(stderr, "%s: failed\n", k->name);
+      failed = 1;
+    } else {
+      printf("%-8s %14.1f %10.1f %14.1f %10.1f %8.1fx\n", k->name, interp.prepare * 1e6,
+             interp.run * 1e3, native.prepare * 1e6, native.run * 1e3, interp.run / native.run);
+    }
+    destroy_arena(ir_arena);
+    destroy_arena(ast_arena);
+    remove(path);
+  }
+  fclose(sink);
+  rmdir(dir);
+  return failed;
+}
@@ -0,0 +1,169 @@
+// compares the vector scanners in src/scan.c against their scalar versions on
+// a synthetic .boop corpus, then times the full lexer on the same input.
+//
+//   $ make bench && ./build/bench/lex_bench [megabytes]
+#include "lexer.h"
+#include "scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  const char *(*ident)(const char *, const char *);
+  const char *(*number)(const char *, const char *);
+  const char *(*space)(const char *, const char *);
+  const char *(*line_end)(const char *, const char *);
+  const char *(*string)(const char *, const char *);
+} scanner_set;
+
+static const scanner_set scalar = {scan_ident_scalar, scan_number_scalar, scan_space_scalar,
+                                   scan_line_end_scalar, scan_string_scalar};
+static const scanner_set simd = {scan_ident, scan_number, scan_space, scan_line_end,
+                                   scan_string};
+
+static unsigned long rng = 88172645463325252UL;
+
+static unsigned long next_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static const char *words[] = {"accumulator",    "i",     "value",          "total_sum",
+                              "generated_node", "x",     "counter_index",  "tmp",
+                              "matrix_row",     "delta", "very_long_identifier_name_from_codegen"};
+
+static void append_word(char **p) {
+  const char *w = words[next_rand() % (sizeof(words) / sizeof(words[0]))];
+  *p += sprintf(*p, "%s%lu", w, next_rand() % 100);
+}
+
+// builds `size` bytes of plausible, lexable booplang with long generated lines
+static char *make_corpus(size_t size, size_t *out_len) {
+  char *buf = malloc(size + 4096);
+  char *p = buf;
+  p += sprintf(p, "fn main(argc, argv)\n");
+  while ((size_t)(p - buf) < size) {
+    p += sprintf(p, "    ");
+    append_word(&p);
+    p += sprintf(p, " = ");
+    int terms = 2 + next_rand() % 24;
+    for (int i = 0; i < terms; i++) {
+      if (i) p += sprintf(p, " %c ", "+-*/"[next_rand() % 4]);
+      switch (next_rand() % 4) {
+      case 0: p += sprintf(p, "%lu.%lu", next_rand() % 100000, next_rand() % 1000); break;
+      case 1: p += sprintf(p, "%lu", next_rand() % 1000000); break;
+      default: append_word(&p);
+      }
+    }
+    if (next_rand() % 3 == 0) p += sprintf(p, " ; generated comment for this long statement");
+    p += sprintf(p, "\n");
+    if (next_rand() % 8 == 0) p += sprintf(p, "    print \"progress marker for the benchmark\"\n");
+  }
+  *out_len = p - buf;
+  return buf;
+}
+
+// the lexer's dispatch loop without the token bookkeeping
+static size_t walk(const scanner_set *s, const char *p, const char *end) {
+  size_t tokens = 0;
+  while (p < end) {
+    char c = *p;
+    if (c == '\n') {
+      p++;
+      tokens++;
+    } else if (c == ';') {
+      p = s->line_end(p, end);
+    } else if (char_is(c, CC_SPACE)) {
+      p = s->space(p, end);
+    } else if (char_is(c, CC_ALPHA)) {
+      p = s->ident(p, end);
+      tokens++;
+    } else if (char_is(c, CC_DIGIT)) {
+      p = s->number(p, end);
+      tokens++;
+    } else if (c == '"') {
+      p = s->string(p + 1, end);
+      if (p < end && *p == '"') p++;
+      tokens++;
+    } else {
+      p++;
+      tokens++;
+    }
+  }
+  return tokens;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double time_walk(const scanner_set *s, const char *buf, size_t len, size_t *tokens) {
+  double best = 1e9;
+  for (int run = 0; run < 5; run++) {
+    double t0 = now();
+    *tokens = walk(s, buf, buf + len);
+    double dt = now() - t0;
+    if (dt < best) best = dt;
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 32;
+  size_t len;
+  char *corpus = make_corpus(mb << 20, &len);
+
+  size_t scalar_tokens, vector_tokens;
+  double ts = time_walk(&scalar, corpus, len, &scalar_tokens);
+  double tv = time_walk(&simd, corpus, len, &vector_tokens);
+  if (scalar_tokens != vector_tokens) {
+    fprintf(stderr, "token count mismatch: %zu vs %zu\n", scalar_tokens, vector_tokens);
+    return 1;
+  }
+
+  printf("corpus: %.1f MB, %zu tokens\n", len / 1048576.0, scalar_tokens);
+  printf("scan walk  scalar: %8.2f ms  %7.1f Mtok/s\n", ts * 1e3, scalar_tokens / ts / 1e6);
+  printf("scan walk  %-6s: %8.2f ms  %7.1f Mtok/s  (%.2fx)\n", scan_impl_name(), tv * 1e3,
+         vector_tokens / tv / 1e6, ts / tv);
+
+  char path[] = "/tmp/boop_lex_bench_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1 || write(fd, corpus, len) != (ssize_t)len) {
+    perror("failed to write corpus");
+    return 1;
+  }
+  close(fd);
+
+  double t0 = now();
+  lexer_result *l = lex(path);
+  double tl = now() - t0;
+  if (!l) return 1;
+
+  printf("full lex(): %8.2f ms  %7.1f Mtok/s  %7.1f MB/s\n", tl * 1e3, token_count(l->tokens) / tl / 1e6,
+         len / tl / 1048576.0);
+
+  t0 = now();
+  lexer_result *p = lex_parallel(path, 0);
+  double tp = now() - t0;
+  unlink(path);
+  if (!p) return 1;
+
+  printf("parallel:   %8.2f ms  %7.1f Mtok/s  %7.1f MB/s  (%.2fx, %ld cores)\n", tp * 1e3,
+         token_count(p->tokens) / tp / 1e6, len / tp / 1048576.0, tl / tp,
+         sysconf(_SC_NPROCESSORS_ONLN));
+  if (token_count(p->tokens) != token_count(l->tokens)) {
+    fprintf(stderr, "parallel lex produced a different token count\n");
+    return 1;
+  }
+  destroy_lexer_result(p);
+  destroy_lexer_result(l);
+
+  free(corpus);
+  return 0;
+}
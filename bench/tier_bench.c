@@ -0,0 +1,147 @@
+// runs a few kernels on the bytecode interpreter three ways: the ir as
+// lowered, tiered (tier.h) and optimized ahead of time, reporting the time
+// each takes to get ready and to run, and for tiering the part of the run
+// spent optimizing hot code.
+//
+//   $ make bench && ./build/bench/tier_bench [runs]
+#include "arena.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "lexer.h"
+#include "lower.h"
+#include "opt.h"
+#include "tier.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  const char *name;
+  const char *source;
+} kernel;
+
+static const kernel kernels[] = {
+    {"float", "fn main(argc, argv)\n"
+              "    x = 0.5\n"
+              "    for i from 1 to 6000000 by 0.5\n"
+              "        x = x * 0.999 + i / 1000000\n"
+              "    print x\n"
+              "    return 0\n"},
+    {"nested", "fn main(argc, argv)\n"
+               "    total = 0\n"
+               "    for i from 0 to 3000\n"
+               "        for j from 0 to 3000\n"
+               "            total = total + (i * j + i - j) % 7\n"
+               "    print total\n"
+               "    return 0\n"},
+    {"calls", "fn step(x, i)\n"
+              "    return (x * 31 + i) % 1000003\n"
+              "fn main(argc, argv)\n"
+              "    x = 1\n"
+              "    for i from 0 to 3000000\n"
+              "        x = step(x, i)\n"
+              "    print x\n"
+              "    return 0\n"},
+    {"fib", "fn fib(n)\n"
+            "    if n < 2\n"
+            "        return n\n"
+            "    return fib(n - 1) + fib(n - 2)\n"
+            "fn main(argc, argv)\n"
+            "    print fib(27)\n"
+            "    return 0\n"},
+};
+
+enum { LOWERED, TIERED, OPTIMIZED, MODES };
+
+typedef struct {
+  double prepare, run, tier;  // best of the runs, in seconds
+} timing;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static ir_module *lower(const char *path, arena *ast_arena, arena *ir_arena) {
+  lexer_result *l = lex(path);
+  if (!l) return NULL;
+  ir_module *ir = gen_ir(gen_ast(l->tokens, l->interns, ast_arena), ir_arena);
+  destroy_lexer_result(l);
+  return ir;
+}
+
+// one run from source, since optimizing ahead of time and tiering both
+// change what they're given
+static int time_mode(const char *path, int mode, FILE *sink, timing *best) {
+  arena *ast_arena = create_arena("ast", 1 << 16), *ir_arena = create_arena("ir", 1 << 16);
+  ir_module *ir = lower(path, ast_arena, ir_arena);
+  int failed = 1;
+  if (ir) {
+    opt_options opt = {.level = 2};
+    tier *t = NULL;
+    double t0 = now();
+    if (mode == OPTIMIZED) optimize_module(ir, &opt);
+    if (mode == TIERED) t = create_tier(ir, ir_arena, &opt, 0);
+    bc_module *m = t ? t->bc : gen_bytecode(ir, ir_arena, 0);
+    double t1 = now();
+    char *argv[] = {"bench", NULL};
+    int64_t status;
+    failed = run_bytecode(m, 1, argv, sink, stderr, &status) || status != 0;
+    double run = now() - t1;
+    if (t1 - t0 < best->prepare) best->prepare = t1 - t0;
+    if (run < best->run) {
+      best->run = run;
+      best->tier = t ? t->ns * 1e-9 : 0;
+    }
+    if (t) destroy_tier(t);
+  }
+  destroy_arena(ir_arena);
+  destroy_arena(ast_arena);
+  return failed;
+}
+
+int main(int argc, char *argv[]) {
+  int runs = argc > 1 ? atoi(argv[1]) : 3;
+  char dir[] = "/tmp/boop_tier_bench_XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("failed to create a temporary directory");
+    return 1;
+  }
+  FILE *sink = fopen("/dev/null", "w");
+  if (!sink) return 1;
+
+  printf("%-8s %12s %12s %13s %14s %10s %9s\n", "kernel", "-O0 (ms)", "tiered (ms)",
+         "tier-up (ms)", "optimize (us)", "-O2 (ms)", "vs tiered");
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+    const kernel *k = &kernels[i];
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.boop", dir, k->name);
+    FILE *src = fopen(path, "w");
+    if (!src) return 1;
+    fputs(k->source, src);
+    fclose(src);
+
+    timing t[MODES];
+    int bad = 0;
+    for (int mode = 0; mode < MODES; mode++) {
+      t[mode] = (timing){1e9, 1e9, 0};
+      for (int r = 0; r < runs && !bad; r++)
+        bad = time_mode(path, mode, sink, &t[mode]);
+    }
+    if (bad) {
+      fprintf(stderr, "%s: failed\n", k->name);
+      failed = 1;
+    } else {
+      printf("%-8s %12.1f %12.1f %13.3f %14.1f %10.1f %8.2fx\n", k->name, t[LOWERED].run * 1e3,
+             t[TIERED].run * 1e3, t[TIERED].tier * 1e3, t[OPTIMIZED].prepare * 1e6,
+             t[OPTIMIZED].run * 1e3, t[OPTIMIZED].run / t[TIERED].run);
+    }
+    remove(path);
+  }
+  fclose(sink);
+  rmdir(dir);
+  return failed;
+}
@@ -0,0 +1,192 @@
+// compares the typed vectors from vector.h against the old void*/elem_size
+// vector (kept here as the baseline) on token appends and parser-style reads,
+// then times the real lexer and parser on a generated program.
+//
+//   $ make bench && ./build/bench/vector_bench [million tokens]
+#include "ast.h"
+#include "lexer.h"
+#include "vector.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// the generic vector as it was before vector.h became macro-generated
+typedef struct {
+  void *data;
+  size_t size;
+  size_t capacity;
+  size_t elem_size;
+} old_vector;
+
+static old_vector *create_vector(size_t elem_size, int initial_size) {
+  old_vector *arr = malloc(sizeof(old_vector));
+  arr->data = malloc(elem_size * initial_size);
+  arr->size = 0;
+  arr->capacity = initial_size;
+  arr->elem_size = elem_size;
+  return arr;
+}
+
+static void add_element(old_vector *arr, void *element) {
+  if (arr->size >= arr->capacity) {
+    arr->capacity *= 2;
+    arr->data = realloc(arr->data, arr->capacity * arr->elem_size);
+  }
+  memcpy((char *)arr->data + (arr->size * arr->elem_size), element, arr->elem_size);
+  arr->size++;
+}
+
+static void *get_element(old_vector *arr, size_t index) {
+  if (index >= arr->size) return NULL;
+  return (char *)arr->data + (index * arr->elem_size);
+}
+
+static void free_vector(old_vector *arr) {
+  free(arr->data);
+  free(arr);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static volatile size_t sink;
+
+static double bench_old_append(size_t n) {
+  double t0 = now();
+  old_vector *types = create_vector(sizeof(uint8_t), 128);
+  old_vector *offsets = create_vector(sizeof(uint32_t), 128);
+  for (size_t i = 0; i < n; i++) {
+    uint8_t t = i % END;
+    uint32_t off = (uint32_t)i * 3;
+    add_element(types, &t);
+    add_element(offsets, &off);
+  }
+  double dt = now() - t0;
+  sink = types->size + offsets->size;
+  free_vector(types);
+  free_vector(offsets);
+  return dt;
+}
+
+static double bench_new_append(size_t n) {
+  double t0 = now();
+  u8_vec types;
+  u32_vec offsets;
+  u8_vec_init(&types, NULL, 128);
+  u32_vec_init(&offsets, NULL, 128);
+  for (size_t i = 0; i < n; i++) {
+    u8_vec_push(&types, i % END);
+    u32_vec_push(&offsets, (uint32_t)i * 3);
+  }
+  double dt = now() - t0;
+  sink = types.size + offsets.size;
+  u8_vec_free(&types);
+  u32_vec_free(&offsets);
+  return dt;
+}
+
+// the parser's access pattern: look at the current and next token's type
+static double bench_old_peek(size_t n) {
+  old_vector *types = create_vector(sizeof(uint8_t), 128);
+  for (size_t i = 0; i < n; i++) {
+    uint8_t t = i % END;
+    add_element(types, &t);
+  }
+  double t0 = now();
+  size_t acc = 0;
+  for (size_t i = 0; i + 1 < n; i++) {
+    uint8_t *cur = get_element(types, i);
+    uint8_t *ahead = get_element(types, i + 1);
+    if (cur && ahead && *cur == IDENTIFIER && *ahead == LPAREN) acc++;
+    acc += *cur;
+  }
+  double dt = now() - t0;
+  sink = acc;
+  free_vector(types);
+  return dt;
+}
+
+static double bench_new_peek(size_t n) {
+  u8_vec types;
+  u8_vec_init(&types, NULL, 128);
+  for (size_t i = 0; i < n; i++)
+    u8_vec_push(&types, i % END);
+  double t0 = now();
+  size_t acc = 0;
+  for (size_t i = 0; i + 1 < n; i++) {
+    uint8_t cur = *u8_vec_get(&types, i);
+    uint8_t ahead = *u8_vec_get(&types, i + 1);
+    if (cur == IDENTIFIER && ahead == LPAREN) acc++;
+    acc += cur;
+  }
+  double dt = now() - t0;
+  sink = acc;
+  u8_vec_free(&types);
+  return dt;
+}
+
+static double best_of(double (*fn)(size_t), size_t n) {
+  double best = 1e9;
+  for (int run = 0; run < 5; run++) {
+    double dt = fn(n);
+    if (dt < best) best = dt;
+  }
+  return best;
+}
+
+static void report(const char *what, double old_t, double new_t, size_t n) {
+  printf("%-14s old: %8.2f ms  typed: %8.2f ms  %6.1f Mops/s  (%.2fx)\n", what, old_t * 1e3,
+         new_t * 1e3, n / new_t / 1e6, old_t / new_t);
+}
+
+static char *write_program(size_t statements) {
+  static char path[] = "/tmp/boop_vector_bench_XXXXXX";
+  int fd = mkstemp(path);
+  FILE *f = fd == -1 ? NULL : fdopen(fd, "w");
+  if (!f) {
+    perror("failed to write program");
+    exit(1);
+  }
+  fprintf(f, "fn helper(a, b)\n    return a * b + 1\n\nfn main(argc, argv)\n");
+  for (size_t i = 0; i < statements; i++) {
+    switch (i % 4) {
+    case 0: fprintf(f, "    x%zu = (y + %zu) * helper(z, %zu) - 3\n", i % 64, i, i % 7); break;
+    case 1: fprintf(f, "    if x%zu < %zu\n        print x%zu\n", i % 64, i, i % 64); break;
+    case 2: fprintf(f, "    y = y + x%zu / 2.5\n", i % 64); break;
+    default: fprintf(f, "    while y > %zu\n        y = y - 1\n", i % 100); break;
+    }
+  }
+  fclose(f);
+  return path;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = (argc > 1 ? strtoul(argv[1], NULL, 10) : 20) * 1000000;
+
+  report("token append", best_of(bench_old_append, n), best_of(bench_new_append, n), n);
+  report("peek/peek+1", best_of(bench_old_peek, n), best_of(bench_new_peek, n), n);
+
+  char *path = write_program(n / 12);
+  double t0 = now();
+  lexer_result *l = lex(path);
+  double t1 = now();
+  arena *a = create_arena("ast", 1 << 20);
+  ast *tree = gen_ast(l->tokens, l->interns, a);
+  double t2 = now();
+  unlink(path);
+  if (!tree) return 1;
+
+  size_t tokens = token_count(l->tokens);
+  printf("lex            %8.2f ms  %6.1f Mtok/s\n", (t1 - t0) * 1e3, tokens / (t1 - t0) / 1e6);
+  printf("parse          %8.2f ms  %6.1f Mtok/s  (%zu nodes)\n", (t2 - t1) * 1e3,
+         tokens / (t2 - t1) / 1e6, tree->nodes.size);
+
+  destroy_arena(a);
+  destroy_lexer_result(l);
+  return 0;
+}
@@ -0,0 +1,340 @@
+// the booplang runtime: what generated code calls for printing, num
+// arithmetic, conversions and runtime errors, plus the program entry point.
+// it uses no libc at all, so a program is just its own code and this file.
+// output is buffered and goes out with the write system call; floats are
+// printed exactly as printf's "%.6f" would, digits and rounding included.
+#include "num.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define SYS_WRITE 1
+#define SYS_EXIT_GROUP 231
+#define OUT_SIZE 8192
+
+// the process starts here with argc at the top of the stack and argv above it
+__asm__(".text\n"
+        ".globl _start\n"
+        "_start:\n"
+        "  xor %ebp, %ebp\n"
+        "  mov (%rsp), %rdi\n"
+        "  lea 8(%rsp), %rsi\n"
+        "  and $-16, %rsp\n"
+        "  call main\n"
+        "  mov %rax, %rdi\n"
+        "  call boop_rt_exit\n");
+
+static char out[OUT_SIZE];
+static size_t out_len;
+
+static long syscall3(long n, long a, long b, long c) {
+  long r;
+  __asm__ volatile("syscall" : "=a"(r) : "a"(n), "D"(a), "S"(b), "d"(c) : "rcx", "r11", "memory");
+  return r;
+}
+
+static void write_all(int fd, const char *p, size_t n) {
+  while (n) {
+    long w = syscall3(SYS_WRITE, fd, (long)p, (long)n);
+    if (w <= 0) return;
+    p += w;
+    n -= (size_t)w;
+  }
+}
+
+void boop_rt_flush(void) {
+  write_all(1, out, out_len);
+  out_len = 0;
+}
+
+__attribute__((noreturn)) void boop_rt_exit(int64_t status) {
+  boop_rt_flush();
+  for (;;)
+    syscall3(SYS_EXIT_GROUP, status, 0, 0);
+}
+
+__attribute__((noreturn)) void boop_rt_error(const char *msg) {
+  static const char prefix[] = "runtime error: ";
+  size_t len = 0;
+  while (msg[len])
+    len++;
+  boop_rt_flush();
+  write_all(2, prefix, sizeof(prefix) - 1);
+  write_all(2, msg, len);
+  write_all(2, "\n", 1);
+  boop_rt_exit(1);
+}
+
+static void emit(const char *p, size_t n) {
+  while (n) {
+    if (out_len == OUT_SIZE) boop_rt_flush();
+    size_t room = OUT_SIZE - out_len, k = n < room ? n : room;
+    for (size_t i = 0; i < k; i++)
+      out[out_len + i] = p[i];
+    out_len += k;
+    p += k;
+    n -= k;
+  }
+}
+
+/* printing */
+
+void boop_rt_print_i64(int64_t v) {
+  char buf[24];
+  char *p = buf + sizeof(buf);
+  uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+  *--p = '\n';
+  do {
+    *--p = (char)('0' + u % 10);
+    u /= 10;
+  } while (u);
+  if (v < 0) *--p = '-';
+  emit(p, (size_t)(buf + sizeof(buf) - p));
+}
+
+void boop_rt_print_str(const char *s) {
+  size_t len = 0;
+  while (s[len])
+    len++;
+  emit(s, len);
+  emit("\n", 1);
+}
+
+// a big unsigned integer in 32-bit limbs, least significant first; enough
+// for the largest double times 10^6
+#define BIG_LIMBS 40
+
+typedef struct {
+  uint32_t limb[BIG_LIMBS];
+  int n;
+} big;
+
+static void big_mul_small(big *b, uint32_t m) {
+  uint64_t carry = 0;
+  for (int i = 0; i < b->n; i++) {
+    uint64_t v = (uint64_t)b->limb[i] * m + carry;
+    b->limb[i] = (uint32_t)v;
+    carry = v >> 32;
+  }
+  if (carry) b->limb[b->n++] = (uint32_t)carry;
+}
+
+static void big_shl(big *b, int s) {
+  int words = s / 32, bits = s % 32;
+  for (int i = b->n - 1; i >= 0; i--) {
+    uint64_t v = (uint64_t)b->limb[i] << bits;
+    b->limb[i + words + 1] |= (uint32_t)(v >> 32);
+    b->limb[i + words] = (uint32_t)v;
+  }
+  for (int i = 0; i < words; i++)
+    b->limb[i] = 0;
+  b->n += words + 1;
+  while (b->n && !b->limb[b->n - 1])
+    b->n--;
+}
+
+static int big_bit(const big *b, int i) {
+  return i / 32 < b->n && (b->limb[i / 32] >> (i % 32) & 1);
+}
+
+// shifts right by s, rounding to nearest with ties to even
+static void big_shr_round(big *b, int s) {
+  int half = big_bit(b, s - 1), below = 0;
+  for (int i = 0; i < s - 1 && i / 32 < b->n && !below; i++)
+    below = big_bit(b, i);
+  int words = s / 32, bits = s % 32;
+  int n = b->n - words;
+  for (int i = 0; i < n; i++) {
+    uint64_t v = b->limb[i + words];
+    if (i + words + 1 < b->n) v |= (uint64_t)b->limb[i + words + 1] << 32;
+    b->limb[i] = (uint32_t)(v >> bits);
+  }
+  b->n = n > 0 ? n : 0;
+  while (b->n && !b->limb[b->n - 1])
+    b->n--;
+  if (half && (below || big_bit(b, 0))) {
+    for (int i = 0; i <= b->n; i++) {
+      if (i == b->n) {
+        b->limb[b->n++] = 1;
+        break;
+      }
+      if (++b->limb[i]) break;
+    }
+  }
+}
+
+static uint32_t big_div_small(big *b, uint32_t d) {
+  uint64_t rem = 0;
+  for (int i = b->n - 1; i >= 0; i--) {
+    uint64_t cur = rem << 32 | b->limb[i];
+    b->limb[i] = (uint32_t)(cur / d);
+    rem = cur % d;
+  }
+  while (b->n && !b->limb[b->n - 1])
+    b->n--;
+  return (uint32_t)rem;
+}
+
+// up to six decimals, trailing zeros removed but one kept
+void boop_rt_print_f64(double d) {
+  if (d != d) {
+    emit("nan\n", 4);
+    return;
+  }
+  uint64_t bits = num_from_float(d);
+  int neg = (int)(bits >> 63);
+  if (d == INFINITY || d == -INFINITY) {
+    emit(neg ? "-inf\n" : "inf\n", neg ? 5 : 4);
+    return;
+  }
+  // |d| * 10^6 = m * 10^6 * 2^e, rounded to an integer
+  uint64_t m = bits & ((UINT64_C(1) << 52) - 1);
+  int e = (int)(bits >> 52 & 0x7ff);
+  if (e)
+    m |= UINT64_C(1) << 52;
+  else
+    e = 1;
+  e -= 1075;
+  big b = {{(uint32_t)m, (uint32_t)(m >> 32)}, 2};
+  while (b.n && !b.limb[b.n - 1])
+    b.n--;
+  big_mul_small(&b, 1000000);
+  if (e > 0) big_shl(&b, e);
+  if (e < 0) big_shr_round(&b, -e);
+
+  char buf[360];
+  char *end = buf + sizeof(buf), *p = end;
+  *--p = '\n';
+  int digits = 0;
+  do {
+    *--p = (char)('0' + big_div_small(&b, 10));
+    if (++digits == 6) *--p = '.';
+  } while (b.n || digits < 7);
+  if (neg) *--p = '-';
+  // the fraction is the six digits before the newline
+  char *last = end - 2;
+  while (last[0] == '0' && last[-1] != '.')
+    last--;
+  last[1] = '\n';
+  emit(p, (size_t)(last + 2 - p));
+}
+
+void boop_rt_print_num(uint64_t v) {
+  if (num_is_int(v))
+    boop_rt_print_i64(num_int(v));
+  else if (num_is_ptr(v))
+    boop_rt_print_str(num_ptr(v));
+  else
+    boop_rt_print_f64(num_float_bits(v));
+}
+
+/* arithmetic that can fail or needs more than a few instructions */
+
+int64_t boop_rt_div_i64(int64_t a, int64_t b) {
+  if (!b) boop_rt_error("division by zero");
+  return boop_div(a, b);
+}
+
+int64_t boop_rt_mod_i64(int64_t a, int64_t b) {
+  if (!b) boop_rt_error("division by zero");
+  return boop_mod(a, b);
+}
+
+int64_t boop_rt_pow_i64(int64_t a, int64_t b) {
+  return boop_pow(a, b);
+}
+
+double boop_rt_mod_f64(double a, double b) {
+  return boop_fmod(a, b);
+}
+
+double boop_rt_pow_f64(double a, double b) {
+  return boop_fpow(a, b);
+}
+
+static void check_numbers(uint64_t a, uint64_t b) {
+  if (num_is_ptr(a) || num_is_ptr(b)) boop_rt_error("expected a number");
+}
+
+uint64_t boop_rt_num_add(uint64_t a, uint64_t b) {
+  check_numbers(a, b);
+  return num_add(a, b);
+}
+
+uint64_t boop_rt_num_sub(uint64_t a, uint64_t b) {
+  check_numbers(a, b);
+  return num_sub(a, b);
+}
+
+uint64_t boop_rt_num_mul(uint64_t a, uint64_t b) {
+  check_numbers(a, b);
+  return num_mul(a, b);
+}
+
+uint64_t boop_rt_num_div(uint64_t a, uint64_t b) {
+  check_numbers(a, b);
+  if (num_div_by_zero(a, b)) boop_rt_error("division by zero");
+  return num_div(a, b);
+}
+
+uint64_t boop_rt_num_mod(uint64_t a, uint64_t b) {
+  check_numbers(a, b);
+  if (num_div_by_zero(a, b)) boop_rt_error("division by zero");
+  return num_mod(a, b);
+}
+
+uint64_t boop_rt_num_pow(uint64_t a, uint64_t b) {
+  check_numbers(a, b);
+  return num_pow(a, b);
+}
+
+uint64_t boop_rt_num_neg(uint64_t a) {
+  check_numbers(a, a);
+  return num_neg(a);
+}
+
+int64_t boop_rt_num_eq(uint64_t a, uint64_t b) {
+  return num_equal(a, b);
+}
+
+int64_t boop_rt_num_lt(uint64_t a, uint64_t b) {
+  check_numbers(a, b);
+  return num_less(a, b);
+}
+
+int64_t boop_rt_num_le(uint64_t a, uint64_t b) {
+  check_numbers(a, b);
+  return num_less(a, b) || num_equal(a, b);
+}
+
+/* conversions to and from num */
+
+uint64_t boop_rt_box_i64(int64_t v) {
+  return num_from_int(v);
+}
+
+uint64_t boop_rt_box_f64(double v) {
+  return num_from_float(v);
+}
+
+uint64_t boop_rt_box_ptr(const void *p) {
+  return num_from_ptr(p);
+}
+
+int64_t boop_rt_truthy(uint64_t v) {
+  return num_truthy(v);
+}
+
+int64_t boop_rt_unbox_i64(uint64_t v) {
+  check_numbers(v, v);
+  return num_to_int(v);
+}
+
+double boop_rt_unbox_f64(uint64_t v) {
+  check_numbers(v, v);
+  return num_to_float(v);
+}
+
+const void *boop_rt_unbox_ptr(uint64_t v) {
+  if (!num_is_ptr(v)) boop_rt_error("expected a string");
+  return num_ptr(v);
+}
@@ -0,0 +1,112 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+
+typedef struct arena_block {
+  struct arena_block *prev;
+  size_t size;
+  size_t used;
+  _Alignas(ARENA_ALIGN) unsigned char data[];
+} arena_block;
+
+struct arena {
+  const char *name;
+  size_t block_size;
+  arena_block *head;
+  arena_stats stats;
+};
+
+static arena_block *new_block(arena *a, size_t min_size) {
+  size_t size = a->block_size > min_size ? a->block_size : min_size;
+  arena_block *b = malloc(sizeof(arena_block) + size);
+  if (!b) {
+    fprintf(stderr, "failed to allocate %zu byte block for arena '%s'\n", size, a->name);
+    exit(EXIT_FAILURE);
+  }
+  b->size = size;
+  b->used = 0;
+  b->prev = a->head;
+  a->head = b;
+
+  a->stats.blocks++;
+  a->stats.reserved += size;
+  if (a->stats.reserved > a->stats.peak) a->stats.peak = a->stats.reserved;
+  return b;
+}
+
+arena *create_arena(const char *name, size_t block_size) {
+  arena *a = calloc(1, sizeof(arena));
+  if (!a) {
+    fprintf(stderr, "failed to allocate arena\n");
+    exit(EXIT_FAILURE);
+  }
+  a->name = name;
+  a->block_size = block_size;
+  return a;
+}
+
+void *arena_alloc(arena *a, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  arena_block *b = a->head;
+  if (!b || b->size - b->used < size) b = new_block(a, size);
+
+  void *p = b->data + b->used;
+  b->used += size;
+  a->stats.used += size;
+  a->stats.allocations++;
+  return p;
+}
+
+void *arena_calloc(arena *a, size_t count, size_t size) {
+  void *p = arena_alloc(a, count * size);
+  memset(p, 0, count * size);
+  return p;
+}
+
+char *arena_strndup(arena *a, const char *s, size_t len) {
+  char *p = arena_alloc(a, len + 1);
+  memcpy(p, s, len);
+  p[len] = '\0';
+  return p;
+}
+
+// frees every block but the newest, which is kept for the next unit of work
+void reset_arena(arena *a) {
+  if (!a->head) return;
+  arena_block *b = a->head->prev;
+  while (b) {
+    arena_block *prev = b->prev;
+    a->stats.reserved -= b->size;
+    free(b);
+    b = prev;
+  }
+  a->head->prev = NULL;
+  a->head->used = 0;
+  a->stats.blocks = 1;
+  a->stats.used = 0;
+  a->stats.allocations = 0;
+}
+
+void destroy_arena(arena *a) {
+  if (!a) return;
+  arena_block *b = a->head;
+  while (b) {
+    arena_block *prev = b->prev;
+    free(b);
+    b = prev;
+  }
+  free(a);
+}
+
+arena_stats get_arena_stats(const arena *a) {
+  return a->stats;
+}
+
+void print_arena_stats(const arena *a, FILE *out) {
+  const arena_stats *s = &a->stats;
+  fprintf(out, "  %-8s %8zu allocs %10zu bytes used %10zu reserved %10zu peak %4zu blocks\n",
+          a->name, s->allocations, s->used, s->reserved, s->peak, s->blocks);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct arena arena;
+
+typedef struct {
+  size_t allocations;  // calls to arena_alloc since the last reset
+  size_t used;         // bytes handed out, including alignment padding
+  size_t reserved;     // bytes currently held from malloc
+  size_t peak;         // largest `reserved` seen over the arena's lifetime
+  size_t blocks;
+} arena_stats;
+
+// a bump allocator owned by one compiler phase. everything allocated from it
+// is released at once by reset_arena() or destroy_arena().
+arena *create_arena(const char *name, size_t block_size);
+void *arena_alloc(arena *a, size_t size);
+void *arena_calloc(arena *a, size_t count, size_t size);
+char *arena_strndup(arena *a, const char *s, size_t len);
+void reset_arena(arena *a);
+void destroy_arena(arena *a);
+arena_stats get_arena_stats(const arena *a);
+void print_arena_stats(const arena *a, FILE *out);
@@ -1,43 +1,46 @@
 #include "ast.h"
+#include "diag.h"
 #include "lexer.h"
 #include "token.h"
 #include "vector.h"
 #include <stdio.h>
 #include <string.h>
 
+_Static_assert(sizeof(ast_node) == 24, "ast_node should stay at 24 bytes");
+
 typedef struct {
-  vector *tokens;
+  token_stream *tokens;
+  ast *tree;
+  u32_vec /* node_id */ scratch;  // children of the blocks currently being parsed
   int current;
+  int text;  // index into tokens->strs of the first text token at or after current
   int has_main;
-  vector /* scope_table */ scopes;
   int in_func;
-  int line;
-  int col;
   int error_count;
 } parser_state;
 
-static int is_unary_op(token *t);
-static int is_binary_op(token *t);
+static int is_unary_op(token_type t);
+static int is_binary_op(token_type t);
 static void throw_error(parser_state *state, const char *msg);
-static void print_indent(int depth);
-static token *next(parser_state *state);
-static token *peek(parser_state *state, int ahead);
-static token *expect(parser_state *state, token_type type);
-static ast_node *create_node(node_type type);
-static ast_node *parse_function(parser_state *state);
-static ast_node *parse_if(parser_state *state);
-static ast_node *parse_while(parser_state *state);
-static ast_node *parse_for(parser_state *state);
-static ast_node *parse_assignment(parser_state *state);
-static ast_node *parse_print(parser_state *state);
-static ast_node *parse_expression(parser_state *state);
-static ast_node *parse_binary_expression(parser_state *state, int min_precedence);
-static ast_node *parse_statement(parser_state *state);
-static void parse_block(parser_state *state, vector *children);
+static void print_indent(FILE *out, int depth);
+static token_type next(parser_state *state);
+static token_type peek(parser_state *state, int ahead);
+static int expect(parser_state *state, token_type type);
+static node_id create_node(parser_state *state, node_type type);
+static node_id parse_function(parser_state *state);
+static node_id parse_if(parser_state *state);
+static node_id parse_while(parser_state *state);
+static node_id parse_for(parser_state *state);
+static node_id parse_assignment(parser_state *state);
+static node_id parse_print(parser_state *state);
+static node_id parse_expression(parser_state *state);
+static node_id parse_binary_expression(parser_state *state, int min_precedence);
+static node_id parse_statement(parser_state *state);
+static void parse_block(parser_state *state);
 static int precedence(token_type op);
 
-static int is_unary_op(token *t) {
-  switch (t->type) {
+static int is_unary_op(token_type t) {
+  switch (t) {
   case SUB_ONE:
   case ADD_ONE:
   case NOT:
@@ -47,8 +50,8 @@ static int is_unary_op(token *t) {
   }
 }
 
-static int is_binary_op(token *t) {
-  switch (t->type) {
+static int is_binary_op(token_type t) {
+  switch (t) {
   case ADD:
   case SUB:
   case MUL:
@@ -70,499 +73,556 @@ static int is_binary_op(token *t) {
 }
 
 static void throw_error(parser_state *state, const char *msg) {
-  fprintf(stderr, "%s at line %d:%d (%s) \n", msg, state->line, state->col,
-          token_type_str(peek(state, 0)->type));
+  size_t at = (size_t)state->current < token_count(state->tokens) ? (size_t)state->current
+                                                                    : token_count(state->tokens) - 1;
+  source_pos pos = token_position(state->tokens, at);
+  diag_error("%s at line %d:%d (%s) \n", msg, pos.line, pos.col,
+             token_type_str(peek(state, 0)));
   if (++state->error_count > 10) {
-    fprintf(stderr, "too many errors, aborting. \n");
-    exit(1);
+    diag_fatal("too many errors, aborting. \n");
   }
 }
 
-static void print_indent(int depth) {
+static void print_indent(FILE *out, int depth) {
   for (int i = 0; i < depth; i++)
-    printf("  ");
+    fprintf(out, "  ");
+}
+
+static void print_children(FILE *out, const ast *tree, const ast_node *node, uint32_t from,
+                           int depth) {
+  for (uint32_t i = from; i < node->count; i++)
+    pretty_print_ast(out, tree, ast_child(tree, node, i), depth);
 }
 
-void pretty_print_ast(ast_node *node, int depth) {
-  if (!node) return;
-  print_indent(depth);
+void pretty_print_ast(FILE *out, const ast *tree, node_id id, int depth) {
+  if (!tree || !id) return;
+  const ast_node *node = ast_get(tree, id);
+  uint32_t body = 0;  // first child that belongs to the body
+  print_indent(out, depth);
 
   switch (node->type) {
-  case NODE_PROGRAM: printf("program\n"); break;
+  case NODE_PROGRAM: fprintf(out, "program\n"); break;
 
   case NODE_FUNCTION:
-    printf("function: %s\n", node->data.function.name);
-    print_indent(depth + 1);
-    printf("parameters (%zu):\n", node->data.function.params->size);
-    for (size_t i = 0; i < node->data.function.params->size; i++) {
-      ast_node *param = *(ast_node **)get_element(node->data.function.params, i);
-      print_indent(depth + 2);
-      if (param && param->data.string) {
-        printf("%s\n", param->data.string);
-      }
+    fprintf(out, "function: %s\n", ast_str(tree, node->data.function.name));
+    print_indent(out, depth + 1);
+    fprintf(out, "parameters (%u):\n", node->nparams);
+    for (uint32_t i = 0; i < node->nparams; i++) {
+      const ast_node *param = ast_get(tree, ast_child(tree, node, i));
+      print_indent(out, depth + 2);
+      fprintf(out, "%s\n", ast_str(tree, param->data.string));
     }
+    body = node->nparams;
     break;
 
   case NODE_IF:
-    printf("if\n");
-    print_indent(depth + 1);
-    printf("condition:\n");
-    pretty_print_ast(node->data.control.condition, depth + 2);
+    fprintf(out, "if\n");
+    print_indent(out, depth + 1);
+    fprintf(out, "condition:\n");
+    pretty_print_ast(out, tree, node->data.control.condition, depth + 2);
     if (node->data.control.else_body) {
-      print_indent(depth + 1);
-      printf("else:\n");
-      pretty_print_ast(node->data.control.else_body, depth + 2);
+      print_indent(out, depth + 1);
+      fprintf(out, "else:\n");
+      pretty_print_ast(out, tree, node->data.control.else_body, depth + 2);
     }
     break;
 
   case NODE_WHILE:
-    printf("while\n");
-    print_indent(depth + 1);
-    printf("condition:\n");
-    pretty_print_ast(node->data.control.condition, depth + 2);
+    fprintf(out, "while\n");
+    print_indent(out, depth + 1);
+    fprintf(out, "condition:\n");
+    pretty_print_ast(out, tree, node->data.control.condition, depth + 2);
     break;
 
   case NODE_FOR:
-    printf("for\n");
-    if (node->data.control.initializer) {
-      print_indent(depth + 1);
-      printf("initializer:\n");
-      pretty_print_ast(node->data.control.initializer, depth + 2);
+    fprintf(out, "for\n");
+    if (node->data.loop.initializer) {
+      print_indent(out, depth + 1);
+      fprintf(out, "initializer:\n");
+      pretty_print_ast(out, tree, node->data.loop.initializer, depth + 2);
     }
-    if (node->data.control.condition) {
-      print_indent(depth + 1);
-      printf("end condition:\n");
-      pretty_print_ast(node->data.control.condition, depth + 2);
+    if (node->data.loop.condition) {
+      print_indent(out, depth + 1);
+      fprintf(out, "end condition:\n");
+      pretty_print_ast(out, tree, node->data.loop.condition, depth + 2);
     }
-    if (node->data.control.step) {
-      print_indent(depth + 1);
-      printf("step:\n");
-      pretty_print_ast(node->data.control.step, depth + 2);
+    if (node->data.loop.step) {
+      print_indent(out, depth + 1);
+      fprintf(out, "step:\n");
+      pretty_print_ast(out, tree, node->data.loop.step, depth + 2);
     }
     break;
 
   case NODE_ASSIGNMENT:
-    printf("assignment: %s =\n", node->data.assignment.var_name);
-    print_indent(depth + 1);
-    printf("value:\n");
-    pretty_print_ast(node->data.assignment.value, depth + 2);
+    fprintf(out, "assignment: %s =\n", ast_str(tree, node->data.assignment.var_name));
+    print_indent(out, depth + 1);
+    fprintf(out, "value:\n");
+    pretty_print_ast(out, tree, node->data.assignment.value, depth + 2);
     break;
 
   case NODE_BINARY_OP:
-    printf("binary operation: %s\n", token_type_str(node->data.binary.op));
-    print_indent(depth + 1);
-    printf("left:\n");
-    pretty_print_ast(node->data.binary.left, depth + 2);
-    print_indent(depth + 1);
-    printf("right:\n");
-    pretty_print_ast(node->data.binary.right, depth + 2);
+    fprintf(out, "binary operation: %s\n", token_type_str(node->op));
+    print_indent(out, depth + 1);
+    fprintf(out, "left:\n");
+    pretty_print_ast(out, tree, node->data.binary.left, depth + 2);
+    print_indent(out, depth + 1);
+    fprintf(out, "right:\n");
+    pretty_print_ast(out, tree, node->data.binary.right, depth + 2);
     break;
 
   case NODE_UNARY_OP:
-    printf("unary operation: %s\n", token_type_str(node->data.binary.op));
-    print_indent(depth + 1);
-    printf("operand:\n");
-    pretty_print_ast(node->data.binary.left, depth + 2);
+    fprintf(out, "unary operation: %s\n", token_type_str(node->op));
+    print_indent(out, depth + 1);
+    fprintf(out, "operand:\n");
+    pretty_print_ast(out, tree, node->data.binary.left, depth + 2);
     break;
 
   case NODE_CALL:
-    printf("function call: %s\n", node->data.string);
-    if (node->children->size > 0) {
-      print_indent(depth + 1);
-      printf("arguments:\n");
-      for (size_t i = 0; i < node->children->size; i++) {
-        ast_node *arg = *(ast_node **)get_element(node->children, i);
-        pretty_print_ast(arg, depth + 2);
-      }
+    fprintf(out, "function call: %s\n", ast_str(tree, node->data.function.name));
+    if (node->count > 0) {
+      print_indent(out, depth + 1);
+      fprintf(out, "arguments:\n");
+      print_children(out, tree, node, 0, depth + 2);
     }
-    break;
+    return;
 
   case NODE_RETURN:
-    printf("return\n");
+    fprintf(out, "return\n");
     if (node->data.expression) {
-      print_indent(depth + 1);
-      printf("value:\n");
-      pretty_print_ast(node->data.expression, depth + 2);
+      print_indent(out, depth + 1);
+      fprintf(out, "value:\n");
+      pretty_print_ast(out, tree, node->data.expression, depth + 2);
     }
     break;
 
-  case NODE_IDENTIFIER:
-    printf("identifier: %s\n", node->data.string ? node->data.string : "(null)");
-    break;
+  case NODE_IDENTIFIER: fprintf(out, "identifier: %s\n", ast_str(tree, node->data.string)); break;
 
-  case NODE_NUMBER:
-    if (node->data.number.num_type == TYPE_INT) {
-      printf("number: %ld\n", (long)node->data.number.value);
+  case NODE_NUMBER: {
+    number_value num = ast_number(tree, node);
+    if (num.num_type == TYPE_INT) {
+      fprintf(out, "number: %ld\n", (long)num.value);
     } else {
-      printf("number: %f\n", node->data.number.value);
+      fprintf(out, "number: %f\n", num.value);
     }
     break;
+  }
 
-  case NODE_STRING:
-    printf("string: \"%s\"\n", node->data.string ? node->data.string : "(null)");
-    break;
+  case NODE_STRING: fprintf(out, "string: \"%s\"\n", ast_str(tree, node->data.string)); break;
 
   case NODE_PRINT:
-    printf("print\n");
-    print_indent(depth + 1);
-    printf("expression:\n");
-    pretty_print_ast(node->data.expression, depth + 2);
+    fprintf(out, "print\n");
+    print_indent(out, depth + 1);
+    fprintf(out, "expression:\n");
+    pretty_print_ast(out, tree, node->data.expression, depth + 2);
     break;
 
-  default: printf("unknown node type: %d\n", node->type); break;
+  default: fprintf(out, "unknown node type: %d\n", node->type); break;
   }
 
-  if (node->children && node->children->size > 0) {
-    print_indent(depth + 1);
-    printf("body:\n");
-    for (size_t i = 0; i < node->children->size; i++) {
-      ast_node *child = *(ast_node **)get_element(node->children, i);
-      pretty_print_ast(child, depth + 2);
-    }
+  if (node->count > body) {
+    print_indent(out, depth + 1);
+    fprintf(out, "body:\n");
+    print_children(out, tree, node, body, depth + 2);
   }
 }
 
-static token *next(parser_state *state) {
-  if ((size_t)state->current + 1 >= state->tokens->size) return NULL;
-  token *n = get_element(state->tokens, ++state->current);
-  state->col = n->col;
-  state->line = n->line;
-  return n;
+static token_type peek(parser_state *state, int ahead) {
+  if ((size_t)state->current + ahead >= token_count(state->tokens)) {
+    return END;
+  }
+  return token_at(state->tokens, state->current + ahead);
 }
 
-static token *peek(parser_state *state, int ahead) {
-  if ((size_t)state->current + ahead >= state->tokens->size) {
-    return NULL;
-  }
-  return get_element(state->tokens, state->current + ahead);
+// intern id of the current token, which must carry text
+static str_id current_text(parser_state *state) {
+  return token_text_id(state->tokens, state->text);
+}
+
+static void advance(parser_state *state) {
+  if (token_has_text(peek(state, 0))) state->text++;
+  state->current++;
 }
 
-static token *expect(parser_state *state, token_type type) {
-  token *t = peek(state, 0);
-  if (!t || t->type != type) {
+static token_type next(parser_state *state) {
+  if ((size_t)state->current + 1 >= token_count(state->tokens)) return END;
+  advance(state);
+  return peek(state, 0);
+}
+
+static int expect(parser_state *state, token_type type) {
+  if (peek(state, 0) != type) {
     throw_error(state, "unexpected token type");
-    return NULL;
+    return 0;
   }
-  state->current++;
-  state->line = t->line;
-  state->col = t->col;
-  return t;
+  advance(state);
+  return 1;
 }
 
-static ast_node *create_node(node_type type) {
-  ast_node *node = calloc(1, sizeof(ast_node));
-  node->type = type;
-  node->children = create_vector(sizeof(ast_node *), 8);
-  return node;
+static node_id create_node(parser_state *state, node_type type) {
+  ast_node node = {.type = type};
+  ast_node_vec_push(&state->tree->nodes, node);
+  return (node_id)state->tree->nodes.size - 1;
+}
+
+// pool pointers move when the pool grows, so re-fetch after any nested parse
+static ast_node *node_at(parser_state *state, node_id id) {
+  return ast_get(state->tree, id);
+}
+
+static void push_child(parser_state *state, node_id child) {
+  u32_vec_push(&state->scratch, child);
 }
 
-static ast_node *parse_return(parser_state *state) {
-  ast_node *node = create_node(NODE_RETURN);
-  node->data.expression = parse_expression(state);
+// moves everything pushed since `mark` into the edge array as id's children
+static void finish_children(parser_state *state, node_id id, size_t mark) {
+  ast_node *node = node_at(state, id);
+  node->first = (uint32_t)state->tree->edges.size;
+  node->count = (uint32_t)(state->scratch.size - mark);
+  u32_vec_push_many(&state->tree->edges, state->scratch.data + mark, node->count);
+  state->scratch.size = mark;
+}
+
+static node_id parse_return(parser_state *state) {
+  node_id node = create_node(state, NODE_RETURN);
+  node_id value = parse_expression(state);
+  node_at(state, node)->data.expression = value;
   return node;
 }
 
-static ast_node *parse_function(parser_state *state) {
+static node_id parse_function(parser_state *state) {
   if (state->in_func) {
     throw_error(state, "nested functions are not allowed.");
-    return NULL;
+    return 0;
   }
   state->in_func = 1;
 
-  token *t = peek(state, 0);
-  if (!t || t->type != IDENTIFIER) {
+  token_type t = peek(state, 0);
+  if (t != IDENTIFIER) {
     throw_error(state, "function name must be identifier");
-    return NULL;
+    return 0;
   }
-  ast_node *func = create_node(NODE_FUNCTION);
-  func->data.function.name = t->ident;
-  if (strcmp(t->ident, "main") == 0) state->has_main = 1;
-  t = next(state);
+  node_id func = create_node(state, NODE_FUNCTION);
+  node_at(state, func)->data.function.name = current_text(state);
+  if (strcmp(ast_str(state->tree, current_text(state)), "main") == 0) state->has_main = 1;
+  next(state);
 
-  if (!(t = expect(state, LPAREN))) return NULL;
+  if (!expect(state, LPAREN)) return 0;
 
-  func->data.function.params = create_vector(sizeof(ast_node *), 1);
+  size_t mark = state->scratch.size;
   int expect_comma = 0;
+  uint16_t nparams = 0;
 
   t = peek(state, 0);
-  while (t && t->type != RPAREN) {
-    if (t->type == IDENTIFIER) {
-      ast_node *param = create_node(NODE_IDENTIFIER);
-      param->data.string = t->ident;
-      add_element(func->data.function.params, &param);
+  while (t != RPAREN) {
+    if (t == IDENTIFIER) {
+      node_id param = create_node(state, NODE_IDENTIFIER);
+      node_at(state, param)->data.string = current_text(state);
+      push_child(state, param);
+      nparams++;
       expect_comma = 1;
       next(state);
-    } else if (t->type == COMMA && expect_comma) {
+    } else if (t == COMMA && expect_comma) {
       next(state);
       expect_comma = 0;
     } else {
       throw_error(state, "unexpected token in function parameter list.");
-      return NULL;
+      return 0;
     }
     t = peek(state, 0);
   }
 
-  if (!expect(state, RPAREN)) return NULL;
+  if (!expect(state, RPAREN)) return 0;
 
-  parse_block(state, func->children);
+  // parameters and body share one child range
+  parse_block(state);
+  finish_children(state, func, mark);
+  node_at(state, func)->nparams = nparams;
 
   state->in_func = 0;
   return func;
 }
 
-static ast_node *parse_if(parser_state *state) {
-  ast_node *node = create_node(NODE_IF);
+static node_id parse_if(parser_state *state) {
+  node_id node = create_node(state, NODE_IF);
 
-  node->data.control.condition = parse_expression(state);
-  if (!node->data.control.condition) {
+  node_id condition = parse_expression(state);
+  if (!condition) {
     throw_error(state, "invalid condition in if statement");
-    return NULL;
+    return 0;
   }
+  node_at(state, node)->data.control.condition = condition;
 
-  parse_block(state, node->children);
+  size_t mark = state->scratch.size;
+  parse_block(state);
+  finish_children(state, node, mark);
 
-  ast_node *last_branch = node;
-  while (peek(state, 0) && (peek(state, 0)->type == ELSE_IF || peek(state, 0)->type == ELSE)) {
-    token *t = next(state);
-    ast_node *branch = create_node(NODE_IF);
+  node_id last_branch = node;
+  while (peek(state, 0) == ELSE_IF || peek(state, 0) == ELSE) {
+    token_type t = peek(state, 0);
+    next(state);
+    node_id branch = create_node(state, NODE_IF);
 
-    if (t->type == ELSE_IF) {
-      branch->data.control.condition = parse_expression(state);
-      if (!branch->data.control.condition) {
+    if (t == ELSE_IF) {
+      condition = parse_expression(state);
+      if (!condition) {
         throw_error(state, "invalid condition in elif statement");
-        return NULL;
+        return 0;
       }
+      node_at(state, branch)->data.control.condition = condition;
     }
-    parse_block(state, branch->children);
+    mark = state->scratch.size;
+    parse_block(state);
+    finish_children(state, branch, mark);
 
-    last_branch->data.control.else_body = branch;
+    node_at(state, last_branch)->data.control.else_body = branch;
     last_branch = branch;
   }
   return node;
 }
 
-static ast_node *parse_while(parser_state *state) {
-  ast_node *w = create_node(NODE_WHILE);
-  w->data.control.condition = parse_expression(state);
-  parse_block(state, w->children);
+static node_id parse_while(parser_state *state) {
+  node_id w = create_node(state, NODE_WHILE);
+  node_id condition = parse_expression(state);
+  node_at(state, w)->data.control.condition = condition;
+
+  size_t mark = state->scratch.size;
+  parse_block(state);
+  finish_children(state, w, mark);
   return w;
 }
 
-static ast_node *parse_for(parser_state *state) {
-  ast_node *for_node = create_node(NODE_FOR);
-  token *t = peek(state, 0);
+static node_id create_number(parser_state *state, int num_type, double value) {
+  number_value num = {.num_type = num_type, .value = value};
+  node_id node = create_node(state, NODE_NUMBER);
+  node_at(state, node)->data.number = (uint32_t)state->tree->numbers.size;
+  number_vec_push(&state->tree->numbers, num);
+  return node;
+}
+
+static node_id parse_for(parser_state *state) {
+  node_id for_node = create_node(state, NODE_FOR);
+  token_type t = peek(state, 0);
 
-  if (!t || t->type != IDENTIFIER) {
+  if (t != IDENTIFIER) {
     throw_error(state, "expected iterator variable in for loop");
-    return NULL;
+    return 0;
   }
 
-  for_node->data.control.initializer = create_node(NODE_ASSIGNMENT);
-  for_node->data.control.initializer->data.assignment.var_name = t->ident;
+  node_id initializer = create_node(state, NODE_ASSIGNMENT);
+  node_at(state, initializer)->data.assignment.var_name = current_text(state);
+  node_at(state, for_node)->data.loop.initializer = initializer;
   next(state);
 
-  if (!expect(state, FROM)) return NULL;
+  if (!expect(state, FROM)) return 0;
 
-  ast_node *start_expr = parse_expression(state);
+  node_id start_expr = parse_expression(state);
   if (!start_expr) {
     throw_error(state, "invalid start value in for loop");
-    return NULL;
+    return 0;
   }
-  for_node->data.control.initializer->data.assignment.value = start_expr;
+  node_at(state, initializer)->data.assignment.value = start_expr;
 
-  if (!expect(state, TO)) return NULL;
+  if (!expect(state, TO)) return 0;
 
-  ast_node *end_expr = parse_expression(state);
+  node_id end_expr = parse_expression(state);
   if (!end_expr) {
     throw_error(state, "invalid end value in for loop");
-    return NULL;
+    return 0;
   }
 
-  ast_node *step_expr = NULL;
+  node_id step_expr = 0;
   t = peek(state, 0);
-  if (t && t->type == BY) {
+  if (t == BY) {
     next(state);
     step_expr = parse_expression(state);
     if (!step_expr) {
       throw_error(state, "invalid step expression in for loop");
-      return NULL;
+      return 0;
     }
   } else {
-    if (!(start_expr->type == NODE_NUMBER && end_expr->type == NODE_NUMBER)) {
+    if (!(node_at(state, start_expr)->type == NODE_NUMBER &&
+          node_at(state, end_expr)->type == NODE_NUMBER)) {
       throw_error(state, "missing 'by' clause in for loop with non-numeric boundaries");
-      return NULL;
+      return 0;
     }
-    step_expr = create_node(NODE_NUMBER);
-    step_expr->data.number.num_type = t->type == INTEGER ? TYPE_INT : TYPE_FLOAT;
-    step_expr->data.number.value = 1.0;
+    // by defaults to 1, or -1 when counting down, and is an int if both bounds are
+    number_value from = ast_number(state->tree, node_at(state, start_expr));
+    number_value to = ast_number(state->tree, node_at(state, end_expr));
+    int ints = from.num_type == TYPE_INT && to.num_type == TYPE_INT;
+    step_expr =
+        create_number(state, ints ? TYPE_INT : TYPE_FLOAT, from.value > to.value ? -1.0 : 1.0);
   }
 
-  for_node->data.control.condition = end_expr;
-  for_node->data.control.step = step_expr;
+  node_at(state, for_node)->data.loop.condition = end_expr;
+  node_at(state, for_node)->data.loop.step = step_expr;
 
-  parse_block(state, for_node->children);
+  size_t mark = state->scratch.size;
+  parse_block(state);
+  finish_children(state, for_node, mark);
   return for_node;
 }
 
-static ast_node *parse_assignment(parser_state *state) {
-  token *t = peek(state, 0);
-  if (!t || t->type != IDENTIFIER) {
+static node_id parse_assignment(parser_state *state) {
+  token_type t = peek(state, 0);
+  if (t != IDENTIFIER) {
     throw_error(state, "expected variable name in assignment");
-    return NULL;
+    return 0;
   }
-  ast_node *node = create_node(NODE_ASSIGNMENT);
-  node->data.assignment.var_name = t->ident;
+  node_id node = create_node(state, NODE_ASSIGNMENT);
+  node_at(state, node)->data.assignment.var_name = current_text(state);
   next(state);
 
-  if (!expect(state, EQ)) return NULL;
+  if (!expect(state, EQ)) return 0;
 
-  node->data.assignment.value = parse_expression(state);
-  if (!node->data.assignment.value) {
+  node_id value = parse_expression(state);
+  if (!value) {
     throw_error(state, "invalid expression on right side of assignment");
-    return NULL;
+    return 0;
   }
+  node_at(state, node)->data.assignment.value = value;
 
   return node;
 }
 
-static ast_node *parse_print(parser_state *state) {
-  ast_node *node = create_node(NODE_PRINT);
-  node->data.expression = parse_expression(state);
-  if (!node->data.expression) {
+static node_id parse_print(parser_state *state) {
+  node_id node = create_node(state, NODE_PRINT);
+  node_id expression = parse_expression(state);
+  if (!expression) {
     throw_error(state, "Expected an expression to print.");
-    return NULL;
+    return 0;
   }
+  node_at(state, node)->data.expression = expression;
   return node;
 }
 
-static ast_node *parse_function_call(parser_state *state) {
-  ast_node *call = create_node(NODE_CALL);
-  token *t = peek(state, 0);
-  if (!t || t->type != IDENTIFIER) {
+static node_id parse_function_call(parser_state *state) {
+  node_id call = create_node(state, NODE_CALL);
+  token_type t = peek(state, 0);
+  if (t != IDENTIFIER) {
     throw_error(state, "expected function name in function call");
-    return NULL;
+    return 0;
   }
-  call->data.string = t->ident;
+  node_at(state, call)->data.function.name = current_text(state);
   next(state);
 
-  if (!expect(state, LPAREN)) return NULL;
+  if (!expect(state, LPAREN)) return 0;
 
-  if (peek(state, 0) && peek(state, 0)->type != RPAREN) {
+  size_t mark = state->scratch.size;
+  if (peek(state, 0) != RPAREN) {
     while (1) {
-      ast_node *arg = parse_expression(state);
+      node_id arg = parse_expression(state);
       if (!arg) {
         throw_error(state, "invalid function argument");
-        return NULL;
+        return 0;
       }
-      add_element(call->children, &arg);
+      push_child(state, arg);
 
       t = peek(state, 0);
-      if (t && t->type == COMMA) {
+      if (t == COMMA) {
         next(state);
       } else {
         break;
       }
     }
   }
+  finish_children(state, call, mark);
 
-  if (!expect(state, RPAREN)) return NULL;
+  if (!expect(state, RPAREN)) return 0;
   return call;
 }
 
-static ast_node *parse_expression(parser_state *state) {
+static node_id parse_expression(parser_state *state) {
   return parse_binary_expression(state, 0);
 }
 
-static ast_node *parse_binary_expression(parser_state *state, int min_prec) {
-  ast_node *lhs = NULL;
-  token *t = peek(state, 0);
-  if (!t) {
+static node_id parse_binary_expression(parser_state *state, int min_prec) {
+  node_id lhs = 0;
+  token_type t = peek(state, 0);
+  if (t == END) {
     throw_error(state, "unexpected end of tokens in expression");
-    return NULL;
+    return 0;
   }
 
-  if (t->type == NEWLINE) {
+  if (t == NEWLINE) {
     throw_error(state, "unexpected newline in expression");
-    return NULL;
+    return 0;
   }
 
   if (is_unary_op(t)) {
-    token *op = t;
+    token_type op = t;
     next(state);
-    ast_node *operand = parse_binary_expression(state, precedence(op->type) + 1);
+    node_id operand = parse_binary_expression(state, precedence(op) + 1);
     if (!operand) {
       throw_error(state, "invalid operand for unary op");
-      return NULL;
+      return 0;
     }
-    lhs = create_node(NODE_UNARY_OP);
-    lhs->data.binary.op = op->type;
-    lhs->data.binary.left = operand;
-  } else if (t->type == LPAREN) {
+    lhs = create_node(state, NODE_UNARY_OP);
+    node_at(state, lhs)->op = op;
+    node_at(state, lhs)->data.binary.left = operand;
+  } else if (t == LPAREN) {
     next(state);
     lhs = parse_binary_expression(state, 0);
     if (!lhs) {
       throw_error(state, "invalid expression in parentheses");
-      return NULL;
+      return 0;
     }
     t = peek(state, 0);
-    if (!t || t->type != RPAREN) {
+    if (t != RPAREN) {
       throw_error(state, "missing closing parenthesis");
       return lhs;
     }
     next(state);
-  } else if (t->type == IDENTIFIER) {
-    if (peek(state, 1) && peek(state, 1)->type == LPAREN) {
+  } else if (t == IDENTIFIER) {
+    if (peek(state, 1) == LPAREN) {
       lhs = parse_function_call(state);
     } else {
-      lhs = create_node(NODE_IDENTIFIER);
-      lhs->data.string = t->ident;
+      lhs = create_node(state, NODE_IDENTIFIER);
+      node_at(state, lhs)->data.string = current_text(state);
       next(state);
     }
-  } else if (t->type == INTEGER) {
-    lhs = create_node(NODE_NUMBER);
-    lhs->data.number.num_type = TYPE_INT;
-    lhs->data.number.value = strtod(t->ident, NULL);  // store as float, but mark as int
+  } else if (t == INTEGER) {
+    lhs = create_number(state, TYPE_INT, strtod(ast_str(state->tree, current_text(state)), NULL));  // store as float, but mark as int
     next(state);
-  } else if (t->type == FLOAT) {
-    lhs = create_node(NODE_NUMBER);
-    lhs->data.number.num_type = TYPE_FLOAT;
-    lhs->data.number.value = strtod(t->ident, NULL);
+  } else if (t == FLOAT) {
+    lhs = create_number(state, TYPE_FLOAT, strtod(ast_str(state->tree, current_text(state)), NULL));
     next(state);
-  } else if (t->type == STRING) {
-    lhs = create_node(NODE_STRING);
-    lhs->data.string = t->ident;
+  } else if (t == STRING) {
+    lhs = create_node(state, NODE_STRING);
+    node_at(state, lhs)->data.string = current_text(state);
     next(state);
   } else {
     throw_error(state, "unexpected token in expression");
-    return NULL;
+    return 0;
   }
 
   while (1) {
-    token *op = peek(state, 0);
-    if (!op) break;
-    if (op->type == COMMA || op->type == RPAREN || op->type == NEWLINE) break;
+    token_type op = peek(state, 0);
+    if (op == END) break;
+    if (op == COMMA || op == RPAREN || op == NEWLINE) break;
     if (!is_binary_op(op)) break;
-    int op_prec = precedence(op->type);
+    token_type op_type = op;
+    int op_prec = precedence(op_type);
     if (op_prec < min_prec) break;
 
     next(state);
     int next_min_prec = op_prec + 1;
-    ast_node *rhs = parse_binary_expression(state, next_min_prec);
+    node_id rhs = parse_binary_expression(state, next_min_prec);
     if (!rhs) {
       throw_error(state, "invalid rhs in binary expression");
       return lhs;
     }
 
-    if ((lhs->type == NODE_STRING || rhs->type == NODE_STRING) &&
-        (op->type != ADD && op->type != COMP_EQ && op->type != NOT_EQ)) {
+    if ((node_at(state, lhs)->type == NODE_STRING || node_at(state, rhs)->type == NODE_STRING) &&
+        (op_type != ADD && op_type != COMP_EQ && op_type != NOT_EQ)) {
       throw_error(state, "operator not permitted for string operands");
       return lhs;
     }
 
-    ast_node *bin = create_node(NODE_BINARY_OP);
-    bin->data.binary.left = lhs;
-    bin->data.binary.right = rhs;
-    bin->data.binary.op = op->type;
+    node_id bin = create_node(state, NODE_BINARY_OP);
+    ast_node *node = node_at(state, bin);
+    node->data.binary.left = lhs;
+    node->data.binary.right = rhs;
+    node->op = op_type;
     lhs = bin;
   }
 
@@ -573,7 +633,7 @@ static int precedence(token_type op) {
   switch (op) {
   case OR: return 1;
   case AND: return 2;
-  case EQ:
+  case COMP_EQ:
   case NOT_EQ: return 3;
   case LT:
   case LTE:
@@ -589,41 +649,43 @@ static int precedence(token_type op) {
   }
 }
 
-static ast_node *parse_statement(parser_state *state) {
-  token *t = peek(state, 0);
+static node_id parse_statement(parser_state *state) {
+  token_type t = peek(state, 0);
 
-  while (t && t->type == NEWLINE) {
+  while (t == NEWLINE) {
     next(state);
     t = peek(state, 0);
   }
 
-  if (!t || t->type == END) {
-    return NULL;
+  if (t == END) {
+    return 0;
   }
 
-  switch (t->type) {
+  switch (t) {
   case FN: next(state); return parse_function(state);
   case IF: next(state); return parse_if(state);
   case FOR: next(state); return parse_for(state);
   case WHILE: next(state); return parse_while(state);
   case PRINT: next(state); return parse_print(state);
   case IDENTIFIER:
-    if (peek(state, 1) && peek(state, 1)->type == EQ) {
+    if (peek(state, 1) == EQ) {
       return parse_assignment(state);
-    } else if (peek(state, 1) && peek(state, 1)->type == LPAREN) {
+    } else if (peek(state, 1) == LPAREN) {
       return parse_function_call(state);
     } else {
       return parse_expression(state);
     }
-  case MATCH: return NULL;
+  case MATCH: return 0;
   case RETURN: next(state); return parse_return(state);
   case DEDENT:
-  case INDENT: next(state); return NULL;
-  default: throw_error(state, "unexpected token in statement"); return NULL;
+  case INDENT: next(state); return 0;
+  default: throw_error(state, "unexpected token in statement"); return 0;
   }
 }
 
-static void parse_block(parser_state *state, vector *children) {
+// pushes the block's statements onto the scratch stack; the caller turns them
+// into a child range with finish_children()
+static void parse_block(parser_state *state) {
   if (!expect(state, NEWLINE)) {
     throw_error(state, "expected newline before block");
     return;
@@ -634,66 +696,72 @@ static void parse_block(parser_state *state, vector *children) {
   }
 
   while (1) {
-    token *t = peek(state, 0);
-    while (t && t->type == NEWLINE) {
+    token_type t = peek(state, 0);
+    while (t == NEWLINE) {
       next(state);
       t = peek(state, 0);
     }
 
-    if (!t || t->type == END) break;
+    if (t == END) break;
 
-    if (t->type == DEDENT) {
+    if (t == DEDENT) {
       next(state);
       return;
     }
 
-    ast_node *stmt = parse_statement(state);
-    if (stmt) add_element(children, &stmt);
+    node_id stmt = parse_statement(state);
+    if (stmt) push_child(state, stmt);
   }
 
-  token *t = peek(state, 0);
-  if (t && t->type != END) {
+  token_type t = peek(state, 0);
+  if (t != END) {
     if (!expect(state, DEDENT)) throw_error(state, "expected dedent at end of block");
   }
 }
 
-ast_node *gen_ast(vector *tokens) {
+ast *gen_ast(token_stream *tokens, intern_table *strings, arena *arena) {
+  ast *tree = arena_alloc(arena, sizeof(ast));
+  ast_node_vec_init(&tree->nodes, arena, 1024);
+  u32_vec_init(&tree->edges, arena, 1024);
+  number_vec_init(&tree->numbers, arena, 64);
+  tree->strings = strings;
+
   parser_state state = {
       .current = 0,
       .tokens = tokens,
+      .tree = tree,
+
       .has_main = 0,
       .in_func = 0,
       .error_count = 0,
-      .line = 0,
-      .col = 0,
   };
 
-  ast_node *program = create_node(NODE_PROGRAM);
-  program->children = create_vector(sizeof(ast_node *), 8);
+  u32_vec_init(&state.scratch, arena, 256);
+  create_node(&state, NODE_PROGRAM);  // index 0 is reserved for "no node"
+  tree->root = create_node(&state, NODE_PROGRAM);
 
   while (1) {
-    token *t = peek(&state, 0);
+    token_type t = peek(&state, 0);
 
-    if (!t || t->type == END || state.current >= (int)tokens->size) {
+    if (t == END || state.current >= (int)token_count(tokens)) {
       break;
     }
 
-    ast_node *stmt = parse_statement(&state);
-    if (stmt) {
-      add_element(program->children, &stmt);
-    }
+    node_id stmt = parse_statement(&state);
+    if (stmt) push_child(&state, stmt);
   }
+  finish_children(&state, tree->root, 0);
 
   // ensure "main" function exists
   if (!state.has_main) {
-    fprintf(stderr, "your program has no entry point. please define a main function.");
+    diag_error("your program has no entry point. please define a main function.\n");
     return NULL;
   }
 
   if (state.error_count) {
-    fprintf(stderr, "unable to compile due to above errors.\n");
+    diag_error("unable to compile due to above errors.\n");
     return NULL;
   }
 
-  return program;
+  return tree;
 }
@@ -1,6 +1,10 @@
 #pragma once
+#include "arena.h"
+#include "intern.h"
+#include "lexer.h"
 #include "token.h"
 #include "vector.h"
+#include <stdint.h>
 
 typedef enum {
   NODE_PROGRAM,
@@ -24,42 +28,80 @@ typedef struct {
   double value;
 } number_value;
 
-typedef struct ast_node {
-  node_type type;
+typedef uint32_t node_id;  // index into ast.nodes, 0 means "no node"
+typedef uint32_t str_id;   // id in the lexer's intern table
+
+// nodes live in one contiguous pool and refer to each other by index. a
+// node's children (block bodies, call arguments, function parameters) are the
+// range edges[first, first + count).
+typedef struct {
+  uint8_t type;      // node_type
+  uint8_t op;        // token_type of unary and binary operators
+  uint16_t nparams;  // functions: the first nparams children are parameters
+
   union {
-    number_value number;
-    char *string;
+    uint32_t number;  // index into ast.numbers
+    str_id string;    // identifiers, strings, and call targets
 
     struct {
-      struct ast_node *left;
-      struct ast_node *right;
-      token_type op;
+      node_id left;
+      node_id right;
     } binary;
 
     struct {
-      char *var_name;
-      struct ast_node *value;
+      str_id var_name;
+      node_id value;
     } assignment;
 
     struct {
-      char *name;
-      vector /* ast_node */ *params;
-      token_type return_type;
+      str_id name;
     } function;
 
     struct {
-      struct ast_node *condition;
-      struct ast_node *else_body;
-      struct ast_node *initializer;
-      struct ast_node *step;
-    } control;
+      node_id condition;
+      node_id else_body;
+    } control;  // if, while
 
-    struct ast_node *expression;
+    struct {
+      node_id initializer;
+      node_id condition;
+      node_id step;
+    } loop;  // for
 
+    node_id expression;
   } data;
 
-  vector /* ast_node */ *children;
+  uint32_t first;
+  uint32_t count;
 } ast_node;
 
-void pretty_print_ast(ast_node *node, int depth);
-ast_node *gen_ast(vector *tokens);
+VEC_DECL(ast_node_vec, ast_node)
+VEC_DECL(number_vec, number_value)
+
+typedef struct {
+  ast_node_vec nodes;
+  u32_vec /* node_id */ edges;
+  number_vec numbers;
+  intern_table *strings;
+  node_id root;
+} ast;
+
+static inline ast_node *ast_get(const ast *tree, node_id id) {
+  return &tree->nodes.data[id];
+}
+
+static inline node_id ast_child(const ast *tree, const ast_node *node, uint32_t i) {
+  return tree->edges.data[node->first + i];
+}
+
+static inline number_value ast_number(const ast *tree, const ast_node *node) {
+  return tree->numbers.data[node->data.number];
+}
+
+static inline const char *ast_str(const ast *tree, str_id id) {
+  return intern_lookup(tree->strings, id);
+}
+
+void pretty_print_ast(FILE *out, const ast *tree, node_id node, int depth);
+// the tree and its pools are allocated from `arena`, which the caller owns
+ast *gen_ast(token_stream *tokens, intern_table *strings, arena *arena);
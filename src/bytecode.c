@@ -0,0 +1,567 @@
+#include "bytecode.h"
+#include "loops.h"
+#include "vector.h"
+#include <ctype.h>
+#include <string.h>
+
+// lowering to bytecode, in one pass over each function in layout order.
+// phis become copies on their incoming edges, the same way isel.c does it: at
+// the end of the predecessor, or for the taken side of a conditional branch,
+// in a stub after the function's last block. a comparison whose only use is
+// the branch after it fuses with it, and an integer constant that fits in 32
+// bits rides along as an immediate where an instruction takes one. counting
+// code (for tier.c) starts with an ENTER and has a LOOP at the top of every
+// loop header, and keeps the map from values to registers that entering it
+// halfway through needs.
+
+#define BC_INFO(name, operands) {#name, operands},
+static const struct {
+  const char *name;
+  const char *operands;
+} bc_info[] = {BC_OPS(BC_INFO)};
+#undef BC_INFO
+
+typedef struct {
+  uint32_t at;  // the operand to patch
+  const ir_block *from, *to;
+} bc_edge;
+
+VEC_DECL(bc_edge_vec, bc_edge)
+
+typedef struct {
+  arena *arena;  // the module's
+  arena *temp;   // this function's
+  ir_func *f;
+  bc_func *out;
+  u32_vec code;
+  uint32_t *reg;    // value id -> register; for an alloca, its address
+  uint32_t *slot;   // alloca id -> the register holding its value
+  uint32_t *uses;   // value id -> operand uses
+  uint32_t *addrs;  // alloca id -> uses other than as a load or store address
+  uint32_t *block;  // block id -> code offset
+  bc_edge_vec jumps;  // jumps to blocks, patched at the end
+  bc_edge_vec stubs;  // jumps to phi copies for an edge, emitted after the blocks
+  uint32_t scratch;   // breaks cycles of phi copies; the result of void calls
+  uint32_t *counters;  // the module's ncounters when counting, else NULL
+} builder;
+
+static void emit_word(builder *b, uint32_t w) {
+  u32_vec_push(&b->code, w);
+}
+
+// the opcode and as many of the operands as it takes
+static void emit(builder *b, bc_op op, uint32_t x, uint32_t y, uint32_t z) {
+  uint32_t operands[] = {x, y, z};
+  emit_word(b, op);
+  for (size_t i = 0; bc_info[op].operands[i]; i++)
+    emit_word(b, operands[i]);
+}
+
+static void emit_jump_to(builder *b, const ir_block *to) {
+  bc_edge e = {(uint32_t)b->code.size - 1, NULL, to};
+  bc_edge_vec_push(&b->jumps, e);
+}
+
+static int has_phis(const ir_block *b) {
+  return b->first && b->first->op == OP_PHI;
+}
+
+// an integer constant that fits an immediate operand
+static int small_const(const ir_inst *v, int32_t *k) {
+  if (v->op != OP_CONST || (v->type != IR_I64 && v->type != IR_BOOL)) return 0;
+  if (v->imm.i < INT32_MIN || v->imm.i > INT32_MAX) return 0;
+  *k = (int32_t)v->imm.i;
+  return 1;
+}
+
+/* phi copies */
+
+typedef struct {
+  uint32_t dst, src;
+} bc_move;
+
+// the copies into `to`'s phis along the edge from `from`, as one parallel
+// move: a copy goes once nothing still pending reads its destination, and a
+// cycle is broken by saving one destination in the scratch register
+static void emit_phi_moves(builder *b, const ir_block *from, const ir_block *to) {
+  uint32_t n = 0;
+  for (ir_inst *phi = to->first; phi && phi->op == OP_PHI; phi = phi->next)
+    n++;
+  if (!n) return;
+  bc_move *moves = arena_alloc(b->temp, n * sizeof(bc_move));
+  n = 0;
+  for (ir_inst *phi = to->first; phi && phi->op == OP_PHI; phi = phi->next)
+    for (uint32_t i = 0; i < phi->nargs; i++)
+      if (phi->imm.incoming[i] == from && b->reg[phi->id] != b->reg[phi->args[i]->id])
+        moves[n++] = (bc_move){b->reg[phi->id], b->reg[phi->args[i]->id]};
+
+  while (n) {
+    uint32_t i, k;
+    for (i = 0; i < n; i++) {
+      for (k = 0; k < n && moves[k].src != moves[i].dst; k++)
+        ;
+      if (k == n) break;
+    }
+    if (i == n) {
+      // every destination is still read: a cycle
+      i = 0;
+      emit(b, BC_MOV, b->scratch, moves[0].dst, 0);
+      for (k = 0; k < n; k++)
+        if (moves[k].src == moves[0].dst) moves[k].src = b->scratch;
+    }
+    emit(b, BC_MOV, moves[i].dst, moves[i].src, 0);
+    moves[i] = moves[--n];
+  }
+}
+
+/* branches */
+
+// a conditional jump to the last operand, taken when `cmp` holds, or when it
+// doesn't if `negate` is set. cmp is fusable()
+static void emit_compare_jump(builder *b, const ir_inst *cmp, int negate) {
+  static const ir_op negated[] = {[OP_EQ] = OP_NEQ, [OP_NEQ] = OP_EQ, [OP_LT] = OP_GE,
+                                  [OP_LE] = OP_GT,  [OP_GT] = OP_LE,  [OP_GE] = OP_LT};
+  static const ir_op mirrored[] = {[OP_EQ] = OP_EQ, [OP_NEQ] = OP_NEQ, [OP_LT] = OP_GT,
+                                   [OP_LE] = OP_GE, [OP_GT] = OP_LT,   [OP_GE] = OP_LE};
+  static const bc_op with_imm[] = {[OP_EQ] = BC_JEQ_IK, [OP_NEQ] = BC_JNE_IK, [OP_LT] = BC_JLT_IK,
+                                   [OP_LE] = BC_JLE_IK, [OP_GT] = BC_JGT_IK,  [OP_GE] = BC_JGE_IK};
+  ir_op op = cmp->op;
+  const ir_inst *x = cmp->args[0], *y = cmp->args[1];
+  ir_type t = x->type;
+  int32_t k;
+
+  if (t == IR_F64) {
+    // a negated float compare is true on nan, so it keeps its own opcodes
+    if (op == OP_GT || op == OP_GE) {
+      const ir_inst *tmp = x;
+      x = y;
+      y = tmp;
+      op = mirrored[op];
+    }
+    bc_op j = op == OP_LT ? (negate ? BC_JNLT_F : BC_JLT_F) : (negate ? BC_JNLE_F : BC_JLE_F);
+    emit(b, j, b->reg[x->id], b->reg[y->id], 0);
+    return;
+  }
+
+  if (negate) op = negated[op];
+  if (!small_const(y, &k) && small_const(x, &k)) {
+    y = x;
+    x = cmp->args[1];
+    op = mirrored[op];
+  }
+  if (small_const(y, &k)) {
+    emit(b, with_imm[op], b->reg[x->id], (uint32_t)k, 0);
+    return;
+  }
+  if (op == OP_GT || op == OP_GE) {
+    const ir_inst *tmp = x;
+    x = y;
+    y = tmp;
+    op = mirrored[op];
+  }
+  bc_op j = op == OP_EQ ? BC_JEQ_I : op == OP_NEQ ? BC_JNE_I : op == OP_LT ? BC_JLT_I : BC_JLE_I;
+  emit(b, j, b->reg[x->id], b->reg[y->id], 0);
+}
+
+// a compare of integers, or an ordering of floats, used by nothing but the
+// branch that ends its block
+static int fusable(const builder *b, const ir_inst *cond, const ir_inst *br) {
+  return cond->op >= OP_EQ && cond->op <= OP_GE && cond->block == br->block &&
+         b->uses[cond->id] == 1 &&
+         (cond->args[0]->type == IR_I64 || cond->args[0]->type == IR_BOOL ||
+          (cond->args[0]->type == IR_F64 && cond->op != OP_EQ && cond->op != OP_NEQ));
+}
+
+// jumps to `to` from the end of `from`, through a stub when there are phi
+// copies to make on the way; the jump's target is the last word emitted
+static void branch_target(builder *b, const ir_block *from, const ir_block *to) {
+  bc_edge e = {(uint32_t)b->code.size - 1, from, to};
+  bc_edge_vec_push(has_phis(to) ? &b->stubs : &b->jumps, e);
+}
+
+// the phi copies for the edge and a jump, unless `to` comes next anyway
+static void emit_goto(builder *b, const ir_block *from, const ir_block *to) {
+  emit_phi_moves(b, from, to);
+  if (from->next == to) return;
+  emit(b, BC_JMP, 0, 0, 0);
+  emit_jump_to(b, to);
+}
+
+static void emit_branch(builder *b, const ir_inst *br, const ir_inst *fused) {
+  const ir_block *from = br->block, *taken = br->imm.target[0], *other = br->imm.target[1];
+  // fall through into the next block if either side is it
+  int negate = from->next == taken;
+  if (negate) {
+    taken = br->imm.target[1];
+    other = br->imm.target[0];
+  }
+  if (fused)
+    emit_compare_jump(b, fused, negate);
+  else
+    emit(b, negate ? BC_JF : BC_JT, b->reg[br->args[0]->id], 0, 0);
+  branch_target(b, from, taken);
+  emit_goto(b, from, other);
+}
+
+/* instructions */
+
+static void emit_arith(builder *b, const ir_inst *inst) {
+  static const bc_op ops[][OP_NEG + 1] = {
+      [IR_I64] = {[OP_ADD] = BC_ADD_I, [OP_SUB] = BC_SUB_I, [OP_MUL] = BC_MUL_I,
+                  [OP_DIV] = BC_DIV_I, [OP_MOD] = BC_MOD_I, [OP_POW] = BC_POW_I,
+                  [OP_NEG] = BC_NEG_I},
+      [IR_F64] = {[OP_ADD] = BC_ADD_F, [OP_SUB] = BC_SUB_F, [OP_MUL] = BC_MUL_F,
+                  [OP_DIV] = BC_DIV_F, [OP_MOD] = BC_MOD_F, [OP_POW] = BC_POW_F,
+                  [OP_NEG] = BC_NEG_F},
+      [IR_NUM] = {[OP_ADD] = BC_ADD_N, [OP_SUB] = BC_SUB_N, [OP_MUL] = BC_MUL_N,
+                  [OP_DIV] = BC_DIV_N, [OP_MOD] = BC_MOD_N, [OP_POW] = BC_POW_N,
+                  [OP_NEG] = BC_NEG_N},
+  };
+  uint32_t d = b->reg[inst->id], x = b->reg[inst->args[0]->id];
+  ir_type t = inst->type == IR_BOOL ? IR_I64 : inst->type;
+  if (inst->op == OP_NEG) {
+    emit(b, ops[t][OP_NEG], d, x, 0);
+    return;
+  }
+
+  const ir_inst *y = inst->args[1];
+  int32_t k;
+  if (t == IR_I64 && (inst->op == OP_ADD || inst->op == OP_SUB)) {
+    if (small_const(y, &k) && (inst->op == OP_ADD || k != INT32_MIN)) {
+      emit(b, BC_ADD_IK, d, x, (uint32_t)(inst->op == OP_ADD ? k : -k));
+      return;
+    }
+    if (inst->op == OP_ADD && small_const(inst->args[0], &k)) {
+      emit(b, BC_ADD_IK, d, b->reg[y->id], (uint32_t)k);
+      return;
+    }
+  }
+  emit(b, ops[t][inst->op], d, x, b->reg[y->id]);
+}
+
+static void emit_compare(builder *b, const ir_inst *inst) {
+  static const bc_op ops[][4] = {
+      [IR_I64] = {BC_EQ_I, BC_NE_I, BC_LT_I, BC_LE_I},
+      [IR_F64] = {BC_EQ_F, BC_NE_F, BC_LT_F, BC_LE_F},
+      [IR_NUM] = {BC_EQ_N, BC_NE_N, BC_LT_N, BC_LE_N},
+  };
+  ir_type t = inst->args[0]->type;
+  if (t == IR_BOOL || t == IR_PTR) t = IR_I64;
+  uint32_t x = b->reg[inst->args[0]->id], y = b->reg[inst->args[1]->id];
+  // a > b is b < a, and a >= b is b <= a, for every type
+  ir_op op = inst->op;
+  if (op == OP_GT || op == OP_GE) {
+    uint32_t tmp = x;
+    x = y;
+    y = tmp;
+    op = op == OP_GT ? OP_LT : OP_LE;
+  }
+  emit(b, ops[t][op - OP_EQ], b->reg[inst->id], x, y);
+}
+
+static void emit_conv(builder *b, const ir_inst *inst) {
+  uint32_t d = b->reg[inst->id], x = b->reg[inst->args[0]->id];
+  ir_type from = inst->args[0]->type, to = inst->type;
+  bc_op op = BC_MOV;
+  switch (to) {
+  case IR_BOOL:
+    op = from == IR_F64 ? BC_TRUTHY_F : from == IR_NUM ? BC_TRUTHY_N : BC_TRUTHY_I;
+    break;
+  case IR_I64:
+    if (from == IR_F64) op = BC_FTOI;
+    if (from == IR_NUM) op = BC_UNBOX_I;
+    break;
+  case IR_F64:
+    if (from == IR_NUM) op = BC_UNBOX_F;
+    if (from == IR_I64 || from == IR_BOOL) op = BC_ITOF;
+    break;
+  case IR_NUM:
+    if (from == IR_F64) op = BC_BOX_F;
+    if (from == IR_PTR) op = BC_BOX_P;
+    if (from == IR_I64 || from == IR_BOOL) op = BC_BOX_I;
+    break;
+  default:
+    if (from == IR_NUM) op = BC_UNBOX_P;
+    break;
+  }
+  if (op != BC_MOV || d != x) emit(b, op, d, x, 0);
+}
+
+static void emit_inst(builder *b, const ir_inst *inst, const ir_inst *fused) {
+  static const bc_op prints[] = {[IR_BOOL] = BC_PRINT_I, [IR_I64] = BC_PRINT_I,
+                                 [IR_F64] = BC_PRINT_F,  [IR_PTR] = BC_PRINT_S,
+                                 [IR_NUM] = BC_PRINT_N};
+  static const bc_op bitwise[] = {[OP_AND] = BC_AND, [OP_OR] = BC_OR,   [OP_XOR] = BC_XOR,
+                                  [OP_SHL] = BC_SHL, [OP_SHR] = BC_SHR};
+  uint32_t d = b->reg[inst->id];
+  switch (inst->op) {
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+  case OP_POW:
+  case OP_NEG: emit_arith(b, inst); return;
+  case OP_AND:
+  case OP_OR:
+  case OP_XOR:
+  case OP_SHL:
+  case OP_SHR:
+    emit(b, bitwise[inst->op], d, b->reg[inst->args[0]->id], b->reg[inst->args[1]->id]);
+    return;
+  case OP_NOT:
+    emit(b, inst->type == IR_BOOL ? BC_NOT_B : BC_NOT_I, d, b->reg[inst->args[0]->id], 0);
+    return;
+  case OP_EQ:
+  case OP_NEQ:
+  case OP_LT:
+  case OP_LE:
+  case OP_GT:
+  case OP_GE:
+    if (inst != fused) emit_compare(b, inst);
+    return;
+  case OP_CONV: emit_conv(b, inst); return;
+  case OP_ALLOCA:
+    if (b->addrs[inst->id]) emit(b, BC_ADDR, d, b->slot[inst->id], 0);
+    return;
+  case OP_LOAD: {
+    const ir_inst *addr = inst->args[0];
+    if (addr->op == OP_ALLOCA)
+      emit(b, BC_MOV, d, b->slot[addr->id], 0);
+    else
+      emit(b, BC_LOAD, d, b->reg[addr->id], 0);
+    return;
+  }
+  case OP_STORE: {
+    const ir_inst *addr = inst->args[0];
+    uint32_t v = b->reg[inst->args[1]->id];
+    if (addr->op == OP_ALLOCA)
+      emit(b, BC_MOV, b->slot[addr->id], v, 0);
+    else
+      emit(b, BC_STORE, b->reg[addr->id], v, 0);
+    return;
+  }
+  case OP_CALL:
+    emit(b, BC_CALL, inst->type == IR_VOID ? b->scratch : d, inst->imm.callee->id, inst->nargs);
+    for (uint32_t i = 0; i < inst->nargs; i++)
+      emit_word(b, b->reg[inst->args[i]->id]);
+    return;
+  case OP_PRINT: emit(b, prints[inst->args[0]->type], b->reg[inst->args[0]->id], 0, 0); return;
+  case OP_JMP: emit_goto(b, inst->block, inst->imm.target[0]); return;
+  case OP_BR:
+    if (inst->imm.target[0] == inst->imm.target[1])
+      emit_goto(b, inst->block, inst->imm.target[0]);
+    else
+      emit_branch(b, inst, fused);
+    return;
+  case OP_RET:
+    if (inst->nargs)
+      emit(b, BC_RET, b->reg[inst->args[0]->id], 0, 0);
+    else
+      emit(b, BC_RET_VOID, 0, 0, 0);
+    return;
+  default: return;  // constants, strings, parameters and phis have their registers already
+  }
+}
+
+// registers: constants and strings, the parameters, then every other value
+// and the allocas' contents, then the scratch register
+static void assign_registers(builder *b, const ir_module *ir) {
+  ir_func *f = b->f;
+  bc_func *out = b->out;
+  uint32_t next = 0;
+  for (ir_block *bl = f->first; bl; bl = bl->next)
+    for (ir_inst *inst = bl->first; inst; inst = inst->next)
+      if (inst->op == OP_CONST || inst->op == OP_STR) next++;
+  out->nconsts = next;
+  out->consts = arena_alloc(b->arena, (next ? next : 1) * sizeof(uint64_t));
+
+  next = 0;
+  for (ir_block *bl = f->first; bl; bl = bl->next) {
+    for (ir_inst *inst = bl->first; inst; inst = inst->next) {
+      if (inst->op == OP_CONST) {
+        out->consts[next] = (uint64_t)ir_const_value(inst).i;
+      } else if (inst->op == OP_STR) {
+        out->consts[next] = (uint64_t)(uintptr_t)ir->strings.data[inst->imm.index];
+      } else {
+        continue;
+      }
+      b->reg[inst->id] = next++;
+    }
+  }
+  out->nparams = f->nparams;
+  for (uint32_t i = 0; i < f->nparams; i++)
+    b->reg[f->params[i]->id] = next++;
+  for (ir_block *bl = f->first; bl; bl = bl->next) {
+    for (ir_inst *inst = bl->first; inst; inst = inst->next) {
+      if (inst->op == OP_CONST || inst->op == OP_STR) continue;
+      if (inst->op == OP_ALLOCA) b->slot[inst->id] = next++;
+      if (inst->type != IR_VOID) b->reg[inst->id] = next++;
+    }
+  }
+  b->scratch = next++;
+  out->nregs = next;
+}
+
+// whether a value can be computed straight into phi's register: the phi's
+// only source on an edge that is the only way out of the value's block, and
+// nothing later on that block, its own copies included, reads the phi's old
+// value. that takes the copies out of most loops
+static int coalescable(const builder *b, const ir_inst *phi, const ir_inst *v,
+                       const ir_block *from) {
+  ir_inst *term = ir_terminator(from);
+  if (v->block != from || !term || term->op != OP_JMP || b->uses[v->id] != 1) return 0;
+  if (v->op == OP_PHI || v->op == OP_CONST || v->op == OP_STR || v->op == OP_ALLOCA) return 0;
+  for (const ir_inst *inst = v->next; inst; inst = inst->next)
+    for (uint32_t i = 0; i < inst->nargs; i++)
+      if (inst->args[i] == phi) return 0;
+  for (const ir_inst *other = phi->block->first; other && other->op == OP_PHI; other = other->next)
+    for (uint32_t i = 0; i < other->nargs; i++)
+      if (other->args[i] == phi && other->imm.incoming[i] == from) return 0;
+  return 1;
+}
+
+static void coalesce_phis(builder *b) {
+  for (ir_block *bl = b->f->first; bl; bl = bl->next)
+    for (ir_inst *phi = bl->first; phi && phi->op == OP_PHI; phi = phi->next)
+      for (uint32_t i = 0; i < phi->nargs; i++)
+        if (coalescable(b, phi, phi->args[i], phi->imm.incoming[i]))
+          b->reg[phi->args[i]->id] = b->reg[phi->id];
+}
+
+// marks the loop headers of a function with blocks, by id
+static uint8_t *find_headers(builder *b) {
+  ir_func *f = b->f;
+  uint8_t *header = arena_calloc(b->temp, f->nblocks, 1);
+  ir_compute_preds(f);
+  loop_forest *lf = create_loop_forest(f);
+  for (uint32_t i = 0; i < lf->count; i++)
+    header[lf->loops[i]->header->id] = 1;
+  destroy_loop_forest(lf);
+  return header;
+}
+
+static void lower_func(builder *b, const ir_module *ir) {
+  ir_func *f = b->f;
+  for (ir_block *bl = f->first; bl; bl = bl->next) {
+    for (ir_inst *inst = bl->first; inst; inst = inst->next) {
+      for (uint32_t i = 0; i < inst->nargs; i++) {
+        b->uses[inst->args[i]->id]++;
+        if (inst->args[i]->op == OP_ALLOCA &&
+            !(i == 0 && (inst->op == OP_LOAD || inst->op == OP_STORE)))
+          b->addrs[inst->args[i]->id]++;
+      }
+    }
+  }
+  assign_registers(b, ir);
+  coalesce_phis(b);
+
+  uint8_t *header = NULL;
+  if (b->counters && f->first) {
+    header = find_headers(b);
+    emit(b, BC_ENTER, f->id, 0, 0);
+  }
+  for (ir_block *bl = f->first; bl; bl = bl->next) {
+    b->block[bl->id] = (uint32_t)b->code.size;
+    if (header && header[bl->id]) emit(b, BC_LOOP, (*b->counters)++, bl->id, 0);
+    ir_inst *term = ir_terminator(bl), *fused = NULL;
+    if (term && term->op == OP_BR && term->imm.target[0] != term->imm.target[1] &&
+        fusable(b, term->args[0], term))
+      fused = term->args[0];
+    for (ir_inst *inst = bl->first; inst; inst = inst->next)
+      emit_inst(b, inst, fused);
+  }
+
+  for (size_t i = 0; i < b->stubs.size; i++) {
+    bc_edge *e = &b->stubs.data[i];
+    b->code.data[e->at] = (uint32_t)b->code.size;
+    emit_phi_moves(b, e->from, e->to);
+    emit(b, BC_JMP, 0, 0, 0);
+    emit_jump_to(b, e->to);
+  }
+  for (size_t i = 0; i < b->jumps.size; i++)
+    b->code.data[b->jumps.data[i].at] = b->block[b->jumps.data[i].to->id];
+}
+
+static void gen_func(ir_module *ir, ir_func *f, arena *a, arena *scratch, bc_func *out,
+                     uint32_t *counters) {
+  uint32_t nvalues = f->nvalues ? f->nvalues : 1;
+  out->name = f->name;
+  builder b = {.arena = a, .temp = scratch, .f = f, .out = out, .counters = counters};
+  b.reg = arena_calloc(scratch, nvalues, sizeof(uint32_t));
+  b.slot = arena_calloc(scratch, nvalues, sizeof(uint32_t));
+  b.uses = arena_calloc(scratch, nvalues, sizeof(uint32_t));
+  b.addrs = arena_calloc(scratch, nvalues, sizeof(uint32_t));
+  b.block = arena_calloc(scratch, f->nblocks ? f->nblocks : 1, sizeof(uint32_t));
+  u32_vec_init(&b.code, a, 64);
+  bc_edge_vec_init(&b.jumps, scratch, 16);
+  bc_edge_vec_init(&b.stubs, scratch, 16);
+  lower_func(&b, ir);
+  out->code = b.code.data;
+  out->size = (uint32_t)b.code.size;
+  if (!counters) return;
+  out->regs = arena_alloc(a, nvalues * sizeof(uint32_t));
+  for (ir_block *bl = f->first; bl; bl = bl->next)
+    for (ir_inst *inst = bl->first; inst; inst = inst->next)
+      out->regs[inst->id] = inst->op == OP_ALLOCA ? b.slot[inst->id] : b.reg[inst->id];
+  for (uint32_t i = 0; i < f->nparams; i++)
+    out->regs[f->params[i]->id] = b.reg[f->params[i]->id];
+}
+
+bc_module *gen_bytecode(ir_module *ir, arena *a, int counting) {
+  bc_module *m = arena_calloc(a, 1, sizeof(bc_module));
+  m->nfuncs = ir->nfuncs;
+  m->funcs = arena_calloc(a, ir->nfuncs ? ir->nfuncs : 1, sizeof(bc_func));
+  ir_func *main = ir_find_func(ir, "main");
+  m->main = main ? main->id : UINT32_MAX;
+  if (counting) m->ncounters = ir->nfuncs;
+
+  arena *scratch = create_arena("bytecode", 16 * 1024);
+  for (ir_func *f = ir->first; f; f = f->next) {
+    gen_func(ir, f, a, scratch, &m->funcs[f->id], counting ? &m->ncounters : NULL);
+    reset_arena(scratch);
+  }
+  destroy_arena(scratch);
+  return m;
+}
+
+void gen_bytecode_func(ir_module *ir, ir_func *f, arena *a, bc_func *out) {
+  arena *scratch = create_arena("bytecode", 16 * 1024);
+  gen_func(ir, f, a, scratch, out, NULL);
+  destroy_arena(scratch);
+}
+
+void print_bytecode(FILE *out, const bc_module *m) {
+  for (uint32_t i = 0; i < m->nfuncs; i++) {
+    const bc_func *f = &m->funcs[i];
+    if (!f->name) continue;
+    fprintf(out, "fn %s: %u registers, %u params\n", f->name, f->nregs, f->nparams);
+    for (uint32_t k = 0; k < f->nconsts; k++)
+      fprintf(out, "  r%-4u = 0x%016llx\n", k, (unsigned long long)f->consts[k]);
+    for (uint32_t pc = 0; pc < f->size;) {
+      bc_op op = f->code[pc];
+      char name[16];
+      size_t len = strlen(bc_info[op].name);
+      for (size_t k = 0; k <= len; k++)
+        name[k] = (char)tolower((unsigned char)bc_info[op].name[k]);
+      fprintf(out, "  %04u  %-9s", pc, name);
+      const char *kinds = bc_info[op].operands;
+      uint32_t extra = 0;
+      pc++;
+      for (size_t k = 0; kinds[k]; k++, pc++) {
+        uint32_t v = f->code[pc];
+        const char *sep = k ? ", " : " ";
+        switch (kinds[k]) {
+        case 'r': fprintf(out, "%sr%u", sep, v); break;
+        case 'k': fprintf(out, "%s%d", sep, (int32_t)v); break;
+        case 't': fprintf(out, "%s@%04u", sep, v); break;
+        case 'f': fprintf(out, "%s%s", sep, m->funcs[v].name); break;
+        default: extra = v; break;
+        }
+      }
+      for (; extra; extra--, pc++)
+        fprintf(out, ", r%u", f->code[pc]);
+      fprintf(out, "\n");
+    }
+  }
+}
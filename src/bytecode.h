@@ -0,0 +1,152 @@
+#pragma once
+#include "arena.h"
+#include "ir.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// a register bytecode for running BoopIR without generating machine code.
+// every ir value gets a 64-bit register in its function's frame; since the ir
+// is typed, a register holds a raw i64, f64 or pointer, or a NaN-boxed num
+// (num.h), and each opcode knows which. constants and strings live in the
+// first registers of the frame, copied in on every call.
+//
+// an instruction is a 32-bit opcode followed by its operands, one 32-bit word
+// each.
+
+// X(name, operands): r a register, k a 32-bit immediate, t a code offset,
+// f a function index and n an argument count, followed by that many registers
+#define BC_OPS(X)                                                                                  \
+  X(MOV, "rr")                                                                                     \
+  /* i64 (and bool) arithmetic */                                                                  \
+  X(ADD_I, "rrr")                                                                                  \
+  X(ADD_IK, "rrk") /* register + immediate */                                                      \
+  X(SUB_I, "rrr")                                                                                  \
+  X(MUL_I, "rrr")                                                                                  \
+  X(DIV_I, "rrr")                                                                                  \
+  X(MOD_I, "rrr")                                                                                  \
+  X(POW_I, "rrr")                                                                                  \
+  X(NEG_I, "rr")                                                                                   \
+  X(AND, "rrr")                                                                                    \
+  X(OR, "rrr")                                                                                     \
+  X(XOR, "rrr")                                                                                    \
+  X(NOT_I, "rr")                                                                                   \
+  X(NOT_B, "rr")                                                                                   \
+  X(SHL, "rrr")                                                                                    \
+  X(SHR, "rrr")                                                                                    \
+  X(EQ_I, "rrr")                                                                                   \
+  X(NE_I, "rrr")                                                                                   \
+  X(LT_I, "rrr")                                                                                   \
+  X(LE_I, "rrr")                                                                                   \
+  /* f64 */                                                                                        \
+  X(ADD_F, "rrr")                                                                                  \
+  X(SUB_F, "rrr")                                                                                  \
+  X(MUL_F, "rrr")                                                                                  \
+  X(DIV_F, "rrr")                                                                                  \
+  X(MOD_F, "rrr")                                                                                  \
+  X(POW_F, "rrr")                                                                                  \
+  X(NEG_F, "rr")                                                                                   \
+  X(EQ_F, "rrr")                                                                                   \
+  X(NE_F, "rrr")                                                                                   \
+  X(LT_F, "rrr")                                                                                   \
+  X(LE_F, "rrr")                                                                                   \
+  /* num, with the runtime's checks */                                                             \
+  X(ADD_N, "rrr")                                                                                  \
+  X(SUB_N, "rrr")                                                                                  \
+  X(MUL_N, "rrr")                                                                                  \
+  X(DIV_N, "rrr")                                                                                  \
+  X(MOD_N, "rrr")                                                                                  \
+  X(POW_N, "rrr")                                                                                  \
+  X(NEG_N, "rr")                                                                                   \
+  X(EQ_N, "rrr")                                                                                   \
+  X(NE_N, "rrr")                                                                                   \
+  X(LT_N, "rrr")                                                                                   \
+  X(LE_N, "rrr")                                                                                   \
+  /* conversions */                                                                                \
+  X(TRUTHY_I, "rr")                                                                                \
+  X(TRUTHY_F, "rr")                                                                                \
+  X(TRUTHY_N, "rr")                                                                                \
+  X(ITOF, "rr")                                                                                    \
+  X(FTOI, "rr")                                                                                    \
+  X(BOX_I, "rr")                                                                                   \
+  X(BOX_F, "rr")                                                                                   \
+  X(BOX_P, "rr")                                                                                   \
+  X(UNBOX_I, "rr")                                                                                 \
+  X(UNBOX_F, "rr")                                                                                 \
+  X(UNBOX_P, "rr")                                                                                 \
+  /* memory: the address of a stack slot, and loads and stores through one */                      \
+  X(ADDR, "rr")                                                                                    \
+  X(LOAD, "rr")                                                                                    \
+  X(STORE, "rr")                                                                                   \
+  /* calls: dst, function, argument count, then the arguments */                                   \
+  X(CALL, "rfn")                                                                                   \
+  X(RET, "r")                                                                                      \
+  X(RET_VOID, "")                                                                                  \
+  X(PRINT_I, "r")                                                                                  \
+  X(PRINT_F, "r")                                                                                  \
+  X(PRINT_S, "r")                                                                                  \
+  X(PRINT_N, "r")                                                                                  \
+  /* control flow */                                                                               \
+  X(JMP, "t")                                                                                      \
+  X(JT, "rt") /* if the bool register is set */                                                    \
+  X(JF, "rt")                                                                                      \
+  /* superinstructions: a compare and the branch on it, jumping if it holds */                     \
+  X(JEQ_I, "rrt")                                                                                  \
+  X(JNE_I, "rrt")                                                                                  \
+  X(JLT_I, "rrt")                                                                                  \
+  X(JLE_I, "rrt")                                                                                  \
+  X(JEQ_IK, "rkt") /* against an immediate */                                                      \
+  X(JNE_IK, "rkt")                                                                                 \
+  X(JLT_IK, "rkt")                                                                                 \
+  X(JLE_IK, "rkt")                                                                                 \
+  X(JGT_IK, "rkt")                                                                                 \
+  X(JGE_IK, "rkt")                                                                                 \
+  X(JLT_F, "rrt")                                                                                  \
+  X(JLE_F, "rrt")                                                                                  \
+  X(JNLT_F, "rrt") /* unordered too, so a negated float compare stays exact */                     \
+  X(JNLE_F, "rrt")                                                                                 \
+  /* tiering (tier.h): counting code counts calls into counter k, and                              \
+     iterations of the loop headed by block k2 (by ir id) into counter k */                        \
+  X(ENTER, "k")                                                                                    \
+  X(LOOP, "kk")
+
+#define BC_ENUM(name, operands) BC_##name,
+typedef enum { BC_OPS(BC_ENUM) BC_OP_COUNT } bc_op;
+#undef BC_ENUM
+
+typedef struct {
+  const char *name;
+  uint32_t nregs;    // frame size
+  uint32_t nconsts;  // registers 0 .. nconsts-1, initialized from `consts`
+  uint32_t nparams;  // the registers right after the constants
+  uint64_t *consts;
+  uint32_t *code;
+  uint32_t size;     // code words
+  uint32_t *regs;    // counting code only: ir value id -> register, an alloca's contents for one
+  uint32_t specializing;  // optimized tiered code: bit i if param i is a num (tier_specialize())
+} bc_func;
+
+typedef struct {
+  bc_func *funcs;  // by ir function id
+  uint32_t nfuncs;
+  uint32_t main;       // function index, or UINT32_MAX
+  uint32_t ncounters;  // counting code: the first nfuncs count calls, the rest loops
+  struct tier *tier;   // counting code: what gets told about hot code
+} bc_module;
+
+// lowers an optimized (or not) module; everything lives in `a`. with
+// `counting` set, functions count their calls and loop iterations (ENTER and
+// LOOP) for tiering
+bc_module *gen_bytecode(ir_module *ir, arena *a, int counting);
+
+// lowers one more function of a module made by gen_bytecode(), without
+// counting; f may be a copy outside the module (ir_clone_func())
+void gen_bytecode_func(ir_module *ir, ir_func *f, arena *a, bc_func *out);
+
+void print_bytecode(FILE *out, const bc_module *m);
+
+// runs main(argc, argv) with the computed-goto interpreter (interp.c).
+// printed values go to `out`; a runtime error is reported on `err` the way the
+// native runtime reports it. returns 0 and main's result in *status, or 1
+// after a runtime error.
+int run_bytecode(const bc_module *m, int argc, char **argv, FILE *out, FILE *err,
+                 int64_t *status);
@@ -0,0 +1,106 @@
+#include "calls.h"
+
+#define UNVISITED UINT32_MAX
+
+typedef struct {
+  call_graph *cg;
+  uint32_t *start;  // function id -> its first callee in `callees`
+  uint32_t *callees;
+  uint32_t *index, *low, *next;  // tarjan state per function id
+  uint8_t *on_stack;
+  uint32_t *stack, *frames;
+  uint32_t nstack, nframes, counter, ncomponents, nordered;
+  ir_func **funcs;  // function id -> function
+} tarjan;
+
+static void enter(tarjan *t, uint32_t v) {
+  t->index[v] = t->low[v] = t->counter++;
+  t->next[v] = t->start[v];
+  t->stack[t->nstack++] = v;
+  t->on_stack[v] = 1;
+  t->frames[t->nframes++] = v;
+}
+
+static void pop_component(tarjan *t, uint32_t v) {
+  call_graph *cg = t->cg;
+  uint32_t first = t->nordered, w;
+  do {
+    w = t->stack[--t->nstack];
+    t->on_stack[w] = 0;
+    cg->scc[w] = t->ncomponents;
+    cg->order[t->nordered++] = t->funcs[w];
+  } while (w != v);
+  if (t->nordered - first > 1)
+    for (uint32_t i = first; i < t->nordered; i++)
+      cg->recursive[cg->order[i]->id] = 1;
+  t->ncomponents++;
+}
+
+// depth first with an explicit stack of frames, so long call chains can't
+// run out of native stack
+static void visit(tarjan *t, uint32_t root) {
+  enter(t, root);
+  while (t->nframes) {
+    uint32_t v = t->frames[t->nframes - 1];
+    if (t->next[v] < t->start[v + 1]) {
+      uint32_t w = t->callees[t->next[v]++];
+      if (w == v) t->cg->recursive[v] = 1;
+      if (t->index[w] == UNVISITED)
+        enter(t, w);
+      else if (t->on_stack[w] && t->index[w] < t->low[v])
+        t->low[v] = t->index[w];
+      continue;
+    }
+    t->nframes--;
+    if (t->nframes) {
+      uint32_t u = t->frames[t->nframes - 1];
+      if (t->low[v] < t->low[u]) t->low[u] = t->low[v];
+    }
+    if (t->low[v] == t->index[v]) pop_component(t, v);
+  }
+}
+
+call_graph *create_call_graph(ir_module *m) {
+  arena *a = create_arena("calls", 4096);
+  call_graph *cg = arena_calloc(a, 1, sizeof(call_graph));
+  uint32_t n = m->nfuncs, size = n ? n : 1;
+  cg->arena = a;
+  cg->count = n;
+  cg->order = arena_alloc(a, size * sizeof(ir_func *));
+  cg->scc = arena_alloc(a, size * sizeof(uint32_t));
+  cg->recursive = arena_calloc(a, size, 1);
+
+  tarjan t = {.cg = cg};
+  t.funcs = arena_alloc(a, size * sizeof(ir_func *));
+  t.start = arena_calloc(a, n + 1, sizeof(uint32_t));
+  for (ir_func *f = m->first; f; f = f->next) {
+    t.funcs[f->id] = f;
+    for (ir_block *b = f->first; b; b = b->next)
+      for (ir_inst *inst = b->first; inst; inst = inst->next)
+        if (inst->op == OP_CALL) t.start[f->id + 1]++;
+  }
+  for (uint32_t i = 0; i < n; i++)
+    t.start[i + 1] += t.start[i];
+  t.callees = arena_alloc(a, (t.start[n] + 1) * sizeof(uint32_t));
+  uint32_t fill = 0;
+  for (uint32_t i = 0; i < n; i++)
+    for (ir_block *b = t.funcs[i]->first; b; b = b->next)
+      for (ir_inst *inst = b->first; inst; inst = inst->next)
+        if (inst->op == OP_CALL) t.callees[fill++] = inst->imm.callee->id;
+
+  t.index = arena_alloc(a, size * sizeof(uint32_t));
+  t.low = arena_alloc(a, size * sizeof(uint32_t));
+  t.next = arena_alloc(a, size * sizeof(uint32_t));
+  t.on_stack = arena_calloc(a, size, 1);
+  t.stack = arena_alloc(a, size * sizeof(uint32_t));
+  t.frames = arena_alloc(a, size * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; i++)
+    t.index[i] = UNVISITED;
+  for (uint32_t i = 0; i < n; i++)
+    if (t.index[i] == UNVISITED) visit(&t, i);
+  return cg;
+}
+
+void destroy_call_graph(call_graph *cg) {
+  if (cg) destroy_arena(cg->arena);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "ir.h"
+
+// the module's call graph cut into strongly connected components (tarjan).
+// components come out callees first, so walking `order` reaches every
+// function after the ones it calls, except for calls around a cycle.
+// inlining only adds calls a function could already reach, so the
+// components stay valid while bodies are copied around.
+typedef struct {
+  arena *arena;
+  uint32_t count;      // m->nfuncs when built; the tables have this length
+  ir_func **order;     // callees before their callers
+  uint32_t *scc;       // function id -> component
+  uint8_t *recursive;  // function id -> on a cycle of calls, a call to itself included
+} call_graph;
+
+call_graph *create_call_graph(ir_module *m);
+void destroy_call_graph(call_graph *cg);
@@ -0,0 +1,246 @@
+#include "opt.h"
+#include "vector.h"
+
+// control flow cleanup driven by a worklist of blocks: branches on constants
+// and branches whose targets agree become jumps, blocks nothing leads to are
+// dropped, a block is merged into its only predecessor when that predecessor
+// jumps straight to it, and a block that does nothing but jump is bypassed.
+// preds are kept up to date along the way, so a change only requeues the
+// blocks around it.
+
+VEC_DECL(block_vec, ir_block *)
+
+typedef struct {
+  ir_func *f;
+  arena *arena;
+  block_vec work;
+  uint8_t *queued;   // block id -> on the worklist
+  uint8_t *removed;  // block id -> merged away or bypassed
+  ir_inst **repl;    // value id -> what a phi of a merged block was replaced with
+  uint32_t nrepl;
+} cfg;
+
+static void push(cfg *c, ir_block *b) {
+  if (c->queued[b->id]) return;
+  c->queued[b->id] = 1;
+  block_vec_push(&c->work, b);
+}
+
+static ir_inst *resolve(const cfg *c, ir_inst *v) {
+  while (v->id < c->nrepl && c->repl[v->id])
+    v = c->repl[v->id];
+  return v;
+}
+
+static int has_pred(const ir_block *b, const ir_block *p) {
+  for (uint32_t i = 0; i < b->npreds; i++)
+    if (b->preds[i] == p) return 1;
+  return 0;
+}
+
+static void add_pred(cfg *c, ir_block *b, ir_block *p) {
+  ir_block **preds = arena_alloc(c->f->module->arena, (b->npreds + 1) * sizeof(ir_block *));
+  for (uint32_t i = 0; i < b->npreds; i++)
+    preds[i] = b->preds[i];
+  preds[b->npreds++] = p;
+  b->preds = preds;
+}
+
+// drops the edge p -> b, along with what b's phis get over it
+static void remove_pred(ir_block *b, ir_block *p) {
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < b->npreds; i++)
+    if (b->preds[i] != p) b->preds[kept++] = b->preds[i];
+  b->npreds = kept;
+  for (ir_inst *phi = b->first; phi && phi->op == OP_PHI; phi = phi->next) {
+    kept = 0;
+    for (uint32_t i = 0; i < phi->nargs; i++) {
+      if (phi->imm.incoming[i] == p) continue;
+      phi->args[kept] = phi->args[i];
+      phi->imm.incoming[kept++] = phi->imm.incoming[i];
+    }
+    phi->nargs = kept;
+  }
+}
+
+// the edge from `from` now comes from `to`
+static void replace_pred(ir_block *b, ir_block *from, ir_block *to) {
+  for (uint32_t i = 0; i < b->npreds; i++)
+    if (b->preds[i] == from) b->preds[i] = to;
+  for (ir_inst *phi = b->first; phi && phi->op == OP_PHI; phi = phi->next)
+    for (uint32_t i = 0; i < phi->nargs; i++)
+      if (phi->imm.incoming[i] == from) phi->imm.incoming[i] = to;
+}
+
+static void retarget(ir_inst *t, ir_block *from, ir_block *to) {
+  for (int i = 0; i < (t->op == OP_BR ? 2 : 1); i++)
+    if (t->imm.target[i] == from) t->imm.target[i] = to;
+}
+
+static void drop_block(cfg *c, ir_block *b) {
+  c->removed[b->id] = 1;
+  ir_remove_block(c->f, b);
+}
+
+static int fold_branch(cfg *c, ir_block *b, ir_inst *br) {
+  ir_block *then = br->imm.target[0], *other = br->imm.target[1];
+  if (then != other) {
+    if (br->args[0]->op != OP_CONST) return 0;
+    ir_block *dead = br->args[0]->imm.i ? other : then;
+    if (dead == then) br->imm.target[0] = other;
+    remove_pred(dead, b);
+    push(c, dead);
+  }
+  br->op = OP_JMP;
+  br->nargs = 0;
+  return 1;
+}
+
+// b jumps to s and is the only way into s: s's instructions move into b
+static void merge(cfg *c, ir_block *b, ir_block *s) {
+  ir_inst *next;
+  ir_remove(b->last);
+  for (ir_inst *inst = s->first; inst; inst = next) {
+    next = inst->next;
+    ir_remove(inst);
+    if (inst->op == OP_PHI) {
+      if (inst->id < c->nrepl) c->repl[inst->id] = resolve(c, inst->args[0]);
+      continue;
+    }
+    ir_append(b, inst);
+  }
+
+  ir_block *succ[2];
+  int n = ir_succs(b, succ);
+  for (int i = 0; i < n; i++) {
+    replace_pred(succ[i], s, b);
+    push(c, succ[i]);
+  }
+  drop_block(c, s);
+  push(c, b);
+}
+
+// b is nothing but `jmp s`: its predecessors jump to s directly. a phi in s
+// can't tell two edges from one block apart, so when s has phis, no
+// predecessor of b may already lead to s
+static int bypass(cfg *c, ir_block *b, ir_block *s) {
+  int phis = s->first->op == OP_PHI;
+  for (uint32_t i = 0; i < b->npreds; i++)
+    if (phis && has_pred(s, b->preds[i])) return 0;
+
+  for (uint32_t i = 0; i < b->npreds; i++) {
+    ir_block *p = b->preds[i];
+    retarget(p->last, b, s);
+    if (!has_pred(s, p)) add_pred(c, s, p);
+    for (ir_inst *phi = s->first; phi && phi->op == OP_PHI; phi = phi->next)
+      for (uint32_t j = 0, n = phi->nargs; j < n; j++)
+        if (phi->imm.incoming[j] == b) ir_add_incoming(c->f, phi, phi->args[j], p);
+    push(c, p);
+  }
+  remove_pred(s, b);
+  drop_block(c, b);
+  push(c, s);
+  return 1;
+}
+
+// a block nothing leads to any more goes, and its successors lose an edge
+static void remove_dead(cfg *c, ir_block *b) {
+  ir_block *succ[2];
+  int n = ir_succs(b, succ);
+  for (int i = 0; i < n; i++) {
+    remove_pred(succ[i], b);
+    push(c, succ[i]);
+  }
+  drop_block(c, b);
+}
+
+static int simplify_block(cfg *c, ir_block *b) {
+  ir_inst *t = ir_terminator(b);
+  if (!b->npreds && b != c->f->first) {
+    remove_dead(c, b);
+    return 1;
+  }
+  if (!t) return 0;
+  if (t->op == OP_BR) {
+    if (!fold_branch(c, b, t)) return 0;
+    push(c, b);
+    return 1;
+  }
+  if (t->op != OP_JMP) return 0;
+
+  ir_block *s = t->imm.target[0];
+  if (s == b) return 0;
+  if (s->npreds == 1 && s != c->f->first) {
+    merge(c, b, s);
+    return 1;
+  }
+  if (b->first == t && b != c->f->first) return bypass(c, b, s);
+  return 0;
+}
+
+// drops every block the entry can't reach, unreachable loops included, and
+// the phi operands that flowed in from them
+static int remove_unreachable(cfg *c) {
+  ir_func *f = c->f;
+  uint8_t *reached = arena_calloc(c->arena, f->nblocks, 1);
+  block_vec stack;
+  block_vec_init(&stack, c->arena, 16);
+  reached[f->first->id] = 1;
+  block_vec_push(&stack, f->first);
+  while (stack.size) {
+    ir_block *b = stack.data[--stack.size], *succ[2];
+    int n = ir_succs(b, succ);
+    for (int i = 0; i < n; i++) {
+      if (reached[succ[i]->id]) continue;
+      reached[succ[i]->id] = 1;
+      block_vec_push(&stack, succ[i]);
+    }
+  }
+
+  int changed = 0;
+  ir_block *next;
+  for (ir_block *b = f->first; b; b = next) {
+    next = b->next;
+    if (reached[b->id]) continue;
+    ir_block *succ[2];
+    int n = ir_succs(b, succ);
+    for (int i = 0; i < n; i++)
+      if (reached[succ[i]->id]) remove_pred(succ[i], b);
+    drop_block(c, b);
+    changed = 1;
+  }
+  return changed;
+}
+
+int simplify_cfg(ir_func *f) {
+  if (!f->first) return 0;
+  ir_compute_preds(f);
+  cfg c = {.f = f, .arena = create_arena("cfg", 4096), .nrepl = f->nvalues};
+  c.queued = arena_calloc(c.arena, f->nblocks, 1);
+  c.removed = arena_calloc(c.arena, f->nblocks, 1);
+  c.repl = arena_calloc(c.arena, f->nvalues, sizeof(ir_inst *));
+  block_vec_init(&c.work, c.arena, f->nblocks);
+
+  int changed = remove_unreachable(&c);
+  for (ir_block *b = f->last; b; b = b->prev)
+    push(&c, b);
+  while (c.work.size) {
+    ir_block *b = c.work.data[--c.work.size];
+    c.queued[b->id] = 0;
+    if (!c.removed[b->id]) changed |= simplify_block(&c, b);
+  }
+  if (!changed) {
+    destroy_arena(c.arena);
+    return 0;
+  }
+
+  // folded branches can cut off whole loops, which still have preds
+  remove_unreachable(&c);
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        inst->args[i] = resolve(&c, inst->args[i]);
+  ir_compute_preds(f);
+  destroy_arena(c.arena);
+  return 1;
+}
@@ -0,0 +1,139 @@
+#include "opt.h"
+#include "uses.h"
+#include "vector.h"
+
+// dead code: everything starts out dead, then liveness spreads from the
+// instructions that matter on their own (side effects, terminators, anything
+// that may fail at run time) to their operands. whatever is still dead
+// afterwards, dead phi cycles included, is deleted.
+
+VEC_DECL(inst_vec, ir_inst *)
+
+int eliminate_dead_code(ir_func *f) {
+  if (!f->first) return 0;
+  arena *a = create_arena("dce", 4096);
+  uint8_t *live = arena_calloc(a, f->nvalues, 1);
+  inst_vec work;
+  inst_vec_init(&work, a, 64);
+
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      if (ir_has_side_effects(inst->op) || ir_may_fail(inst)) {
+        live[inst->id] = 1;
+        inst_vec_push(&work, inst);
+      }
+
+  while (work.size) {
+    ir_inst *inst = work.data[--work.size];
+    for (uint32_t i = 0; i < inst->nargs; i++) {
+      ir_inst *arg = inst->args[i];
+      if (live[arg->id]) continue;
+      live[arg->id] = 1;
+      inst_vec_push(&work, arg);
+    }
+  }
+
+  int changed = 0;
+  for (ir_block *b = f->first; b; b = b->next) {
+    ir_inst *next;
+    for (ir_inst *inst = b->first; inst; inst = next) {
+      next = inst->next;
+      if (live[inst->id]) continue;
+      ir_remove(inst);
+      changed = 1;
+    }
+  }
+  destroy_arena(a);
+  return changed;
+}
+
+// dead stores to stack slots whose address never escapes. a slot that is
+// never loaded loses all its stores. otherwise each block is walked
+// backwards: a store is dead if the same slot is stored again before any
+// load, or if the block returns without loading it.
+
+typedef struct {
+  use_map *uses;
+  uint8_t *local;  // value id -> alloca whose address is only loaded from and stored to
+  // slot id -> what comes next in the block being swept: 2 * block id + 1 for a
+  // store, 2 * block id for a load, anything else for no access at all
+  uint32_t *next_access;
+} dse;
+
+// classifies each alloca from its users; returns whether the slot is loaded
+static int scan_slot(dse *d, ir_inst *slot) {
+  ir_inst **users = uses_of(d->uses, slot);
+  int loaded = 0;
+  d->local[slot->id] = 1;
+  for (uint32_t i = 0, n = use_count(d->uses, slot); i < n; i++) {
+    ir_inst *user = users[i];
+    if (user->op == OP_LOAD) {
+      loaded = 1;
+    } else if (user->op != OP_STORE || user->args[0] != slot || user->args[1] == slot) {
+      d->local[slot->id] = 0;
+      return 1;
+    }
+  }
+  return loaded;
+}
+
+static void remove_unloaded(dse *d, ir_inst *slot) {
+  ir_inst **users = uses_of(d->uses, slot);
+  for (uint32_t i = 0, n = use_count(d->uses, slot); i < n; i++)
+    ir_remove(users[i]);
+  ir_remove(slot);
+}
+
+static int sweep_block(dse *d, ir_block *b) {
+  int changed = 0, returns = b->last && b->last->op == OP_RET;
+  uint32_t store = 2 * b->id + 1, load = 2 * b->id;
+  ir_inst *prev;
+  for (ir_inst *inst = b->last; inst; inst = prev) {
+    prev = inst->prev;
+    if (inst->op != OP_LOAD && inst->op != OP_STORE) continue;
+    ir_inst *slot = inst->args[0];
+    if (slot->op != OP_ALLOCA || !d->local[slot->id]) continue;
+    uint32_t *next = &d->next_access[slot->id];
+    if (inst->op == OP_LOAD) {
+      *next = load;
+      continue;
+    }
+    if (*next == store || (returns && *next != load)) {
+      ir_remove(inst);
+      changed = 1;
+    }
+    *next = store;
+  }
+  return changed;
+}
+
+int eliminate_dead_stores(ir_func *f) {
+  if (!f->first) return 0;
+  arena *a = create_arena("dse", 4096);
+  dse d = {.uses = create_use_map(f)};
+  d.local = arena_calloc(a, f->nvalues, 1);
+  d.next_access = arena_calloc(a, f->nvalues, sizeof(uint32_t));
+
+  inst_vec unloaded;
+  inst_vec_init(&unloaded, a, 0);
+  int any = 0;
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      if (inst->op != OP_ALLOCA) continue;
+      if (scan_slot(&d, inst))
+        any |= d.local[inst->id];
+      else
+        inst_vec_push(&unloaded, inst);
+    }
+
+  int changed = unloaded.size != 0;
+  for (size_t i = 0; i < unloaded.size; i++)
+    remove_unloaded(&d, unloaded.data[i]);
+  if (any)
+    for (ir_block *b = f->first; b; b = b->next)
+      changed |= sweep_block(&d, b);
+
+  destroy_use_map(d.uses);
+  destroy_arena(a);
+  return changed;
+}
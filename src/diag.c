@@ -0,0 +1,36 @@
+#include "diag.h"
+#include <stdarg.h>
+#include <stdlib.h>
+
+static _Thread_local diag_sink *current;
+
+void diag_set_sink(diag_sink *sink) {
+  current = sink;
+}
+
+diag_sink *diag_get_sink(void) {
+  return current;
+}
+
+static void report(const char *fmt, va_list args) {
+  FILE *out = current ? current->out : stderr;
+  if (current && current->name) fprintf(out, "%s: ", current->name);
+  vfprintf(out, fmt, args);
+}
+
+void diag_error(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  report(fmt, args);
+  va_end(args);
+}
+
+void diag_fatal(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  report(fmt, args);
+  va_end(args);
+
+  if (current) longjmp(current->bail, 1);
+  exit(1);
+}
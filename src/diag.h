@@ -0,0 +1,21 @@
+#pragma once
+#include <setjmp.h>
+#include <stdio.h>
+
+// diagnostics go to the sink installed on the calling thread. with none
+// installed they go straight to stderr and fatal errors exit, which is what a
+// single-file compile wants. the batch driver installs one per unit, so the
+// messages can be replayed in input order and a fatal error only ends that unit.
+typedef struct {
+  FILE *out;
+  const char *name;  // prefixed to every message when set
+  jmp_buf bail;      // fatal errors longjmp here
+} diag_sink;
+
+void diag_set_sink(diag_sink *sink);
+diag_sink *diag_get_sink(void);
+
+// reports an error and returns to the caller
+void diag_error(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+// reports an error and abandons the current unit
+_Noreturn void diag_fatal(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
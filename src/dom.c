@@ -0,0 +1,226 @@
+#include "dom.h"
+#include <string.h>
+
+// iterative dfs from the entry; `order` is filled back to front so it ends up
+// in reverse postorder
+static void compute_rpo(dom_tree *dt, ir_func *f) {
+  ir_block **stack = arena_alloc(dt->arena, dt->nblocks * sizeof(ir_block *));
+  uint8_t *next = arena_calloc(dt->arena, dt->nblocks, 1);  // successors already pushed
+  uint32_t sp = 0, n = 0;
+  ir_block **post = arena_alloc(dt->arena, dt->nblocks * sizeof(ir_block *));
+
+  stack[sp++] = f->first;
+  dt->rpo[f->first->id] = 0;
+  while (sp) {
+    ir_block *b = stack[sp - 1], *succ[2];
+    int count = ir_succs(b, succ);
+    if (next[b->id] < count) {
+      ir_block *s = succ[next[b->id]++];
+      if (dt->rpo[s->id] == UINT32_MAX) {
+        dt->rpo[s->id] = 0;
+        stack[sp++] = s;
+      }
+      continue;
+    }
+    post[n++] = b;
+    sp--;
+  }
+
+  dt->count = n;
+  dt->order = arena_alloc(dt->arena, (n ? n : 1) * sizeof(ir_block *));
+  for (uint32_t i = 0; i < n; i++) {
+    dt->order[i] = post[n - 1 - i];
+    dt->rpo[dt->order[i]->id] = i;
+  }
+}
+
+static ir_block *intersect(const dom_tree *dt, ir_block *a, ir_block *b) {
+  while (a != b) {
+    while (dt->rpo[a->id] > dt->rpo[b->id])
+      a = dt->idom[a->id];
+    while (dt->rpo[b->id] > dt->rpo[a->id])
+      b = dt->idom[b->id];
+  }
+  return a;
+}
+
+static void compute_idoms(dom_tree *dt) {
+  ir_block *entry = dt->order[0];
+  dt->idom[entry->id] = entry;
+
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (uint32_t i = 1; i < dt->count; i++) {
+      ir_block *b = dt->order[i], *idom = NULL;
+      for (uint32_t p = 0; p < b->npreds; p++) {
+        ir_block *pred = b->preds[p];
+        if (!dom_reachable(dt, pred) || !dt->idom[pred->id]) continue;
+        idom = idom ? intersect(dt, pred, idom) : pred;
+      }
+      if (idom != dt->idom[b->id]) {
+        dt->idom[b->id] = idom;
+        changed = 1;
+      }
+    }
+  }
+  dt->idom[entry->id] = NULL;
+}
+
+// children are linked in reverse postorder, then the tree is walked once to
+// number it
+static void number_tree(dom_tree *dt) {
+  for (uint32_t i = dt->count; i-- > 1;) {
+    ir_block *b = dt->order[i], *parent = dt->idom[b->id];
+    dt->sibling[b->id] = dt->child[parent->id];
+    dt->child[parent->id] = b;
+  }
+
+  ir_block **stack = dt->stack;
+  uint8_t *entered = arena_calloc(dt->arena, dt->nblocks, 1);
+  uint32_t sp = 0, clock = 0;
+  stack[sp++] = dt->order[0];
+  while (sp) {
+    ir_block *b = stack[sp - 1];
+    if (entered[b->id]) {
+      dt->post[b->id] = clock - 1;
+      sp--;
+      continue;
+    }
+    entered[b->id] = 1;
+    dt->pre[b->id] = clock++;
+    ir_block *idom = dt->idom[b->id];
+    dt->level[b->id] = idom ? dt->level[idom->id] + 1 : 0;
+    for (ir_block *c = dt->child[b->id]; c; c = dt->sibling[c->id])
+      stack[sp++] = c;
+  }
+
+  // children come after their parent in preorder, so a reverse sweep sees
+  // every subtree before its root
+  ir_block **pre = arena_alloc(dt->arena, dt->count * sizeof(ir_block *));
+  dom_preorder(dt, pre);
+  for (uint32_t i = dt->count; i-- > 0;) {
+    ir_block *b = pre[i], *succ[2];
+    uint32_t min = UINT32_MAX;
+    int n = ir_succs(b, succ);
+    for (int j = 0; j < n; j++)
+      if (dt->idom[succ[j]->id] != b && dt->level[succ[j]->id] < min) min = dt->level[succ[j]->id];
+    for (ir_block *c = dt->child[b->id]; c; c = dt->sibling[c->id])
+      if (dt->jlevel[c->id] < min) min = dt->jlevel[c->id];
+    dt->jlevel[b->id] = min;
+  }
+}
+
+dom_tree *create_dom_tree(ir_func *f) {
+  arena *a = create_arena("dom", 16 * 1024);
+  dom_tree *dt = arena_calloc(a, 1, sizeof(dom_tree));
+  uint32_t n = f->nblocks;
+  dt->arena = a;
+  dt->nblocks = n;
+  dt->rpo = arena_alloc(a, n * sizeof(uint32_t));
+  memset(dt->rpo, 0xff, n * sizeof(uint32_t));
+  dt->idom = arena_calloc(a, n, sizeof(ir_block *));
+  dt->child = arena_calloc(a, n, sizeof(ir_block *));
+  dt->sibling = arena_calloc(a, n, sizeof(ir_block *));
+  dt->level = arena_calloc(a, n, sizeof(uint32_t));
+  dt->jlevel = arena_calloc(a, n, sizeof(uint32_t));
+  dt->pre = arena_calloc(a, n, sizeof(uint32_t));
+  dt->post = arena_calloc(a, n, sizeof(uint32_t));
+  dt->is_def = arena_calloc(a, n, sizeof(uint32_t));
+  dt->is_live = arena_calloc(a, n, sizeof(uint32_t));
+  dt->queued = arena_calloc(a, n, sizeof(uint32_t));
+  dt->walked = arena_calloc(a, n, sizeof(uint32_t));
+  dt->heap = arena_alloc(a, n * sizeof(ir_block *));
+  dt->stack = arena_alloc(a, n * 2 * sizeof(ir_block *));
+
+  compute_rpo(dt, f);
+  compute_idoms(dt);
+  number_tree(dt);
+  return dt;
+}
+
+void destroy_dom_tree(dom_tree *dt) {
+  if (dt) destroy_arena(dt->arena);
+}
+
+void dom_preorder(const dom_tree *dt, ir_block **out) {
+  for (uint32_t i = 0; i < dt->count; i++) {
+    ir_block *b = dt->order[i];
+    out[dt->pre[b->id]] = b;
+  }
+}
+
+// max-heap of blocks ordered by tree level, deepest first; ties are broken
+// by preorder so the result doesn't depend on the order of `defs`
+static int deeper(const dom_tree *dt, const ir_block *a, const ir_block *b) {
+  uint32_t la = dt->level[a->id], lb = dt->level[b->id];
+  return la != lb ? la > lb : dt->pre[a->id] < dt->pre[b->id];
+}
+
+static void heap_push(dom_tree *dt, uint32_t *size, ir_block *b) {
+  uint32_t i = (*size)++;
+  while (i && deeper(dt, b, dt->heap[(i - 1) / 2])) {
+    dt->heap[i] = dt->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  dt->heap[i] = b;
+}
+
+static ir_block *heap_pop(dom_tree *dt, uint32_t *size) {
+  ir_block *top = dt->heap[0], *last = dt->heap[--*size];
+  uint32_t i = 0;
+  for (;;) {
+    uint32_t c = 2 * i + 1;
+    if (c >= *size) break;
+    if (c + 1 < *size && deeper(dt, dt->heap[c + 1], dt->heap[c])) c++;
+    if (!deeper(dt, dt->heap[c], last)) break;
+    dt->heap[i] = dt->heap[c];
+    i = c;
+  }
+  dt->heap[i] = last;
+  return top;
+}
+
+uint32_t dom_iterated_frontier(dom_tree *dt, ir_block **defs, uint32_t ndefs, ir_block **live,
+                               uint32_t nlive, ir_block **out) {
+  uint32_t stamp = ++dt->stamp, nheap = 0, nout = 0;
+  for (uint32_t i = 0; i < nlive; i++)
+    dt->is_live[live[i]->id] = stamp;
+  for (uint32_t i = 0; i < ndefs; i++) {
+    ir_block *b = defs[i];
+    if (!dom_reachable(dt, b) || dt->is_def[b->id] == stamp) continue;
+    dt->is_def[b->id] = stamp;
+    heap_push(dt, &nheap, b);
+  }
+
+  // take the deepest pending block and walk its subtree. a j-edge (one that
+  // isn't a tree edge) leaving the subtree to a block no deeper than the root
+  // lands in the frontier. deeper roots go first, so a subtree that was
+  // already walked never needs walking again, and subtrees without such an
+  // edge aren't entered at all.
+  while (nheap) {
+    ir_block *root = heap_pop(dt, &nheap);
+    uint32_t level = dt->level[root->id], sp = 0;
+    if (dt->jlevel[root->id] > level) continue;
+    dt->stack[sp++] = root;
+    dt->walked[root->id] = stamp;
+    while (sp) {
+      ir_block *b = dt->stack[--sp], *succ[2];
+      int n = ir_succs(b, succ);
+      for (int i = 0; i < n; i++) {
+        ir_block *s = succ[i];
+        if (dt->idom[s->id] == b || dt->level[s->id] > level) continue;
+        if (dt->queued[s->id] == stamp) continue;
+        dt->queued[s->id] = stamp;
+        if (live && dt->is_live[s->id] != stamp) continue;
+        out[nout++] = s;
+        if (dt->is_def[s->id] != stamp) heap_push(dt, &nheap, s);
+      }
+      for (ir_block *c = dt->child[b->id]; c; c = dt->sibling[c->id]) {
+        if (dt->walked[c->id] == stamp || dt->jlevel[c->id] > level) continue;
+        dt->walked[c->id] = stamp;
+        dt->stack[sp++] = c;
+      }
+    }
+  }
+  return nout;
+}
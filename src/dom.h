@@ -0,0 +1,53 @@
+#pragma once
+#include "arena.h"
+#include "ir.h"
+
+// dominator tree of a function's reachable blocks, indexed by block id. built
+// with the cooper-harvey-kennedy iteration over reverse postorder, which in
+// practice converges in two or three sweeps even for thousands of blocks.
+// invalidated by any change to the cfg.
+typedef struct dom_tree {
+  arena *arena;
+  uint32_t nblocks;   // f->nblocks when computed; every table has this length
+  uint32_t count;     // reachable blocks
+  ir_block **order;   // reachable blocks in reverse postorder, entry first
+  uint32_t *rpo;      // block id -> index in `order`, UINT32_MAX if unreachable
+  ir_block **idom;    // block id -> immediate dominator, NULL for the entry
+  ir_block **child;   // block id -> first child in the tree
+  ir_block **sibling; // block id -> next child of the same parent
+  uint32_t *level;    // block id -> depth in the tree, 0 for the entry
+  uint32_t *jlevel;   // block id -> shallowest target of a non-tree edge in its subtree
+  uint32_t *pre;      // block id -> index in a preorder walk of the tree
+  uint32_t *post;     // block id -> largest preorder index in its subtree
+
+  // scratch for dom_iterated_frontier(): per-block stamps instead of flag
+  // arrays, so a query never pays for clearing blocks it doesn't touch
+  uint32_t stamp;
+  uint32_t *is_def, *is_live, *queued, *walked;
+  ir_block **heap, **stack;
+} dom_tree;
+
+// needs up to date preds, see ir_compute_preds()
+dom_tree *create_dom_tree(ir_func *f);
+void destroy_dom_tree(dom_tree *dt);
+
+static inline int dom_reachable(const dom_tree *dt, const ir_block *b) {
+  return b->id < dt->nblocks && dt->rpo[b->id] != UINT32_MAX;
+}
+
+// does a dominate b? every block dominates itself
+static inline int dominates(const dom_tree *dt, const ir_block *a, const ir_block *b) {
+  return dt->pre[a->id] <= dt->pre[b->id] && dt->pre[b->id] <= dt->post[a->id];
+}
+
+// blocks in dominator tree preorder; `out` must hold dt->count blocks
+void dom_preorder(const dom_tree *dt, ir_block **out);
+
+// iterated dominance frontier of the `ndefs` blocks in `defs`: where phis for
+// a variable assigned in those blocks go. with `live` set, only blocks in that
+// list (the ones the variable is live into) are considered, which gives pruned
+// ssa. uses the dj-graph walk of sreedhar and gao, so frontiers are never
+// materialized and a query costs time linear in the blocks it visits. returns
+// how many blocks were written to `out`, which must hold dt->count blocks.
+uint32_t dom_iterated_frontier(dom_tree *dt, ir_block **defs, uint32_t ndefs, ir_block **live,
+                               uint32_t nlive, ir_block **out);
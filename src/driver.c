@@ -0,0 +1,406 @@
+#include "driver.h"
+#include "arena.h"
+#include "ast.h"
+#include "bytecode.h"
+#include "diag.h"
+#include "intern.h"
+#include "ir.h"
+#include "jit.h"
+#include "lexer.h"
+#include "link.h"
+#include "lower.h"
+#include "opt.h"
+#include "pool.h"
+#include "tier.h"
+#include "utils.h"
+#include "vector.h"
+#include "x86.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SOURCE_EXT ".boop"
+
+VEC_DECL(path_vec, char *)
+
+// one input file and everything it printed
+typedef struct {
+  const char *path;
+  char *out;
+  size_t out_size;
+  char *err;
+  size_t err_size;
+  int failed;
+} compile_unit;
+
+typedef struct {
+  compile_unit *units;
+  const compiler_options *options;
+  arena **arenas;     // one ast arena per worker, reset between units
+  arena **ir_arenas;  // likewise for the ir
+} batch;
+
+static void print_token_stream(FILE *out, lexer_result *l) {
+  if (!l || !l->tokens) return;
+
+  fprintf(out, "\n=== token stream ===\n");
+  size_t text = 0;
+  for (size_t i = 0; i < token_count(l->tokens); ++i) {
+    token_type type = token_at(l->tokens, i);
+    const char *ident =
+        token_has_text(type) ? intern_lookup(l->interns, token_text_id(l->tokens, text++)) : NULL;
+    print_token(out, type, ident, token_position(l->tokens, i));
+  }
+}
+
+static void print_memory_stats(FILE *out, lexer_result *l, arena *ast_arena, arena *ir_arena) {
+  fprintf(out, "\n=== memory ===\n");
+  token_stream *ts = l->tokens;
+  size_t token_bytes = ts->types.capacity * sizeof(uint8_t) +
+                       ts->offsets.capacity * sizeof(uint32_t) +
+                       ts->strs.capacity * sizeof(uint32_t);
+  fprintf(out, "  tokens   %8zu tokens %10zu bytes\n", token_count(ts), token_bytes);
+  print_arena_stats(intern_arena(l->interns), out);
+  print_arena_stats(ast_arena, out);
+  print_arena_stats(ir_arena, out);
+}
+
+// writes the ir next to the source: foo.boop -> foo.boopir
+static void save_ir(const char *path, const ir_module *ir) {
+  char *text = NULL;
+  size_t size = 0;
+  FILE *mem = open_memstream(&text, &size);
+  if (!mem) return;
+  print_ir(mem, ir);
+  fclose(mem);
+
+  size_t len = strlen(path);
+  if (len > strlen(SOURCE_EXT) && strcmp(path + len - strlen(SOURCE_EXT), SOURCE_EXT) == 0)
+    len -= strlen(SOURCE_EXT);
+  char *out = malloc(len + sizeof(SOURCE_EXT "ir"));
+  memcpy(out, path, len);
+  strcpy(out + len, SOURCE_EXT "ir");
+  if (strcmp(path, "-") == 0 ? fwrite(text, 1, size, stdout) != size : write_file(out, text, size))
+    diag_error("failed to write %s\n", out);
+  free(out);
+  free(text);
+}
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void print_times(FILE *err, double compile, double run) {
+  fprintf(err, "\n=== time ===\n  compile %10.3f ms\n  run     %10.3f ms\n", compile, run);
+}
+
+// compiles the module into memory and calls its main with the source path as
+// argv[0]; returns 1 if it couldn't run or main returned nonzero
+static int run_module(const char *path, const x86_module *m, double start, int time, FILE *err) {
+  jit_program p;
+  if (jit_load(m, &p)) return 1;
+  double compiled = now_ms();
+  char *argv[] = {(char *)path, NULL};
+  int64_t status = jit_run(&p, 1, argv);
+  double ran = now_ms();
+  jit_unload(&p);
+  if (time) print_times(err, compiled - start, ran - compiled);
+  return status != 0;
+}
+
+// like run_module(), on the bytecode interpreter. printed values go to `out`
+// with the rest of the unit's output, so batches can interpret in parallel.
+// tiered, the module is as lowered and `opt` is for the code that gets hot
+static int interpret_module(const char *path, ir_module *ir, arena *a,
+                            const compiler_options *options, const opt_options *opt,
+                            double start, FILE *out, FILE *err) {
+  tier *t = options->tiered ? create_tier(ir, a, opt, options->tier_threshold) : NULL;
+  bc_module *m = t ? t->bc : gen_bytecode(ir, a, 0);
+  if (options->emit_bytecode) print_bytecode(out, m);
+  int failed = 0;
+  if (options->interpret) {
+    double compiled = now_ms();
+    char *argv[] = {(char *)path, NULL};
+    int64_t status = 0;
+    failed = run_bytecode(m, 1, argv, out, err, &status) || status != 0;
+    double ran = now_ms();
+    if (options->time) print_times(err, compiled - start, ran - compiled);
+    if (options->time && t)
+      fprintf(err, "  tier-up %10.3f ms of it, %u functions, %u loops and %u specializations"
+              " optimized\n", t->ns / 1e6, t->nfuncs, t->nloops, t->nspecs);
+  }
+  if (t) destroy_tier(t);
+  return failed;
+}
+
+// links the module into an executable next to the source: foo.boop -> foo,
+// anything else -> <input>.out and standard input -> a.out
+static void save_executable(const char *path, const x86_module *m) {
+  x86_code code;
+  encode_x86(m, &code);
+
+  size_t len = strlen(path);
+  int plain = len > strlen(SOURCE_EXT) && strcmp(path + len - strlen(SOURCE_EXT), SOURCE_EXT) == 0;
+  char *out = malloc(len + sizeof(".out"));
+  if (strcmp(path, "-") == 0) {
+    strcpy(out, "a.out");
+  } else {
+    memcpy(out, path, len);
+    strcpy(out + (plain ? len - strlen(SOURCE_EXT) : len), plain ? "" : ".out");
+  }
+  write_executable(out, m, &code);
+  free(out);
+}
+
+// lex -> parse -> ir for one file. with a sink installed, a fatal diagnostic
+// longjmps back here and only this unit fails.
+static int compile_file(const char *path, const compiler_options *options, int lex_threads,
+                        arena *ast_arena, arena *ir_arena, FILE *out, FILE *err) {
+  diag_sink *sink = diag_get_sink();
+  lexer_result *volatile l = NULL;
+  volatile int failed = 1;
+  double start = now_ms();
+
+  if (!sink || setjmp(sink->bail) == 0) {
+    l = lex_parallel(path, lex_threads);
+    if (!l) {
+      diag_error("error: lexing failed.\n");
+      return 1;
+    }
+
+    if (options->emit_tokens) print_token_stream(out, l);
+
+    ast *program = gen_ast(l->tokens, l->interns, ast_arena);
+    if (options->emit_ast && program) pretty_print_ast(out, program, program->root, 0);
+
+    ir_module *ir = gen_ir(program, ir_arena);
+    opt_stats stats = {0};
+    opt_options opt = {.level = options->opt_level,
+                       .inline_threshold = options->inline_threshold,
+                       .stats = options->opt_stats ? &stats : NULL};
+    if (ir && !options->tiered) optimize_module(ir, &opt);
+    if (options->emit_ir && ir) print_ir(out, ir);
+    if (options->save_ir && ir) save_ir(path, ir);
+    int ran = 0;
+    if ((options->emit_asm || options->compile || options->run) && ir) {
+      x86_module *m = gen_x86(ir, ir_arena, options->opt_level == 0);
+      if (options->emit_asm) print_x86(out, m);
+      if (options->compile) save_executable(path, m);
+      if (options->run) ran = run_module(path, m, start, options->time, err);
+    }
+    if ((options->interpret || options->emit_bytecode) && ir)
+      ran |= interpret_module(path, ir, ir_arena, options, &opt, start, out, err);
+    if (options->time && !options->run && !options->interpret)
+      fprintf(err, "\n=== time ===\n  compile %10.3f ms\n", now_ms() - start);
+
+    if (options->mem_stats) print_memory_stats(err, l, ast_arena, ir_arena);
+    if (ir && opt.stats) print_opt_stats(err, opt.stats);
+    failed = ir == NULL || ran;
+  }
+
+  destroy_lexer_result(l);
+  return failed;
+}
+
+static void compile_task(void *ctx, size_t index, int worker) {
+  batch *b = ctx;
+  compile_unit *u = &b->units[index];
+
+  FILE *out = open_memstream(&u->out, &u->out_size);
+  FILE *err = open_memstream(&u->err, &u->err_size);
+  if (!out || !err) {
+    fprintf(stderr, "failed to allocate output buffers\n");
+    exit(EXIT_FAILURE);
+  }
+
+  diag_sink sink = {.out = err, .name = u->path};
+  diag_set_sink(&sink);
+  u->failed =
+      compile_file(u->path, b->options, 1, b->arenas[worker], b->ir_arenas[worker], out, err);
+  diag_set_sink(NULL);
+
+  reset_arena(b->arenas[worker]);
+  reset_arena(b->ir_arenas[worker]);
+  fclose(out);
+  fclose(err);
+}
+
+static int has_source_ext(const char *name) {
+  size_t len = strlen(name), ext = strlen(SOURCE_EXT);
+  return len > ext && strcmp(name + len - ext, SOURCE_EXT) == 0;
+}
+
+static int compare_paths(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static char *join_path(const char *dir, const char *name) {
+  size_t len = strlen(dir) + strlen(name) + 2;
+  char *path = malloc(len);
+  snprintf(path, len, "%s/%s", dir, name);
+  return path;
+}
+
+static void add_input(path_vec *paths, const char *input);
+
+// every source file under dir, sorted so the unit order doesn't depend on the
+// file system
+static void add_directory(path_vec *paths, const char *dir) {
+  DIR *d = opendir(dir);
+  if (!d) {
+    fprintf(stderr, "failed to open directory %s: %s\n", dir, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  path_vec entries;
+  path_vec_init(&entries, NULL, 16);
+  struct dirent *e;
+  while ((e = readdir(d))) {
+    if (e->d_name[0] == '.') continue;
+    path_vec_push(&entries, join_path(dir, e->d_name));
+  }
+  closedir(d);
+
+  qsort(entries.data, entries.size, sizeof(char *), compare_paths);
+  for (size_t i = 0; i < entries.size; i++) {
+    struct stat st;
+    char *path = entries.data[i];
+    if (stat(path, &st) == 0 && (S_ISDIR(st.st_mode) || has_source_ext(path)))
+      add_input(paths, path);
+    free(path);
+  }
+  path_vec_free(&entries);
+}
+
+// one path per line; blank lines and lines starting with '#' are skipped
+static void add_manifest(path_vec *paths, const char *manifest) {
+  FILE *f = fopen(manifest, "r");
+  if (!f) {
+    fprintf(stderr, "failed to open manifest %s: %s\n", manifest, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  while ((len = getline(&line, &cap, f)) != -1) {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' '))
+      line[--len] = '\0';
+    if (len == 0 || line[0] == '#') continue;
+    add_input(paths, line);
+  }
+  free(line);
+  fclose(f);
+}
+
+static void add_input(path_vec *paths, const char *input) {
+  struct stat st;
+  if (input[0] == '@') {
+    add_manifest(paths, input + 1);
+  } else if (stat(input, &st) == 0 && S_ISDIR(st.st_mode)) {
+    add_directory(paths, input);
+  } else {
+    path_vec_push(paths, strdup(input));
+  }
+}
+
+static int compile_batch(path_vec *paths, const compiler_options *options) {
+  int jobs = options->jobs > 0 ? options->jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (jobs < 1) jobs = 1;
+
+  batch b = {calloc(paths->size, sizeof(compile_unit)), options, malloc(jobs * sizeof(arena *)),
+             malloc(jobs * sizeof(arena *))};
+  if (!b.units || !b.arenas || !b.ir_arenas) {
+    fprintf(stderr, "failed to allocate the batch\n");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < paths->size; i++)
+    b.units[i].path = paths->data[i];
+  for (int i = 0; i < jobs; i++) {
+    b.arenas[i] = create_arena("ast", 64 * 1024);
+    b.ir_arenas[i] = create_arena("ir", 64 * 1024);
+  }
+
+  run_pool(paths->size, jobs, compile_task, &b);
+
+  // replay in input order, so the output doesn't depend on scheduling
+  int failed = 0;
+  for (size_t i = 0; i < paths->size; i++) {
+    compile_unit *u = &b.units[i];
+    fwrite(u->out, 1, u->out_size, stdout);
+    fwrite(u->err, 1, u->err_size, stderr);
+    failed += u->failed;
+    free(u->out);
+    free(u->err);
+  }
+  if (failed) fprintf(stderr, "%d of %zu files failed to compile.\n", failed, paths->size);
+
+  for (int i = 0; i < jobs; i++) {
+    destroy_arena(b.arenas[i]);
+    destroy_arena(b.ir_arenas[i]);
+  }
+  free(b.ir_arenas);
+  free(b.arenas);
+  free(b.units);
+  return failed;
+}
+
+// programs write straight to stdout, so running them on the pool would mix
+// their output with the replayed compiler output
+static int run_serially(path_vec *paths, const compiler_options *options) {
+  arena *ast_arena = create_arena("ast", 64 * 1024);
+  arena *ir_arena = create_arena("ir", 64 * 1024);
+  int failed = 0;
+  for (size_t i = 0; i < paths->size; i++) {
+    diag_sink sink = {.out = stderr, .name = paths->data[i]};
+    diag_set_sink(&sink);
+    failed += compile_file(paths->data[i], options, options->lex_threads, ast_arena, ir_arena,
+                           stdout, stderr);
+    diag_set_sink(NULL);
+    reset_arena(ast_arena);
+    reset_arena(ir_arena);
+  }
+  if (failed)
+    fprintf(stderr, "%d of %zu programs failed or returned nonzero.\n", failed, paths->size);
+  destroy_arena(ir_arena);
+  destroy_arena(ast_arena);
+  return failed;
+}
+
+int compile_inputs(char **inputs, int count, const compiler_options *options) {
+  path_vec paths;
+  path_vec_init(&paths, NULL, count);
+  for (int i = 0; i < count; i++)
+    add_input(&paths, inputs[i]);
+
+  int failed;
+  struct stat st;
+  int single = count == 1 && inputs[0][0] != '@' &&
+               !(stat(inputs[0], &st) == 0 && S_ISDIR(st.st_mode));
+
+  if (single) {
+    // each phase's memory goes away in one shot
+    arena *ast_arena = create_arena("ast", 64 * 1024);
+    arena *ir_arena = create_arena("ir", 64 * 1024);
+    failed = compile_file(paths.data[0], options, options->lex_threads, ast_arena, ir_arena, stdout,
+                          stderr);
+    destroy_arena(ir_arena);
+    destroy_arena(ast_arena);
+  } else if (options->run) {
+    failed = run_serially(&paths, options);
+  } else {
+    failed = compile_batch(&paths, options);
+  }
+
+  for (size_t i = 0; i < paths.size; i++)
+    free(paths.data[i]);
+  path_vec_free(&paths);
+  return failed;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+typedef struct {
+  int emit_ast;
+  int emit_tokens;
+  int emit_ir;
+  int save_ir;
+  int emit_asm;  // x86-64 assembly, needs runtime/runtime.c to link
+  int compile;   // an executable next to each input: foo.boop -> foo
+  int run;       // run each input in process once it's compiled
+  int interpret;      // run each input on the bytecode interpreter instead
+  int tiered;         // ... optimizing code only once it gets hot, see tier.h
+  int tier_threshold; // 0 for TIER_THRESHOLD
+  int emit_bytecode;
+  int time;      // report compile and run times
+  int mem_stats;
+  int opt_level;  // see optimize_module()
+  int opt_stats;
+  int inline_threshold;  // 0 for the default, negative to turn inlining off
+  int lex_threads;
+  int jobs;  // worker threads for batch compiles, 0 for one per core
+} compiler_options;
+
+// compiles every input, expanding directories (every .boop file beneath them)
+// and @manifest files (one path per line). a single plain file is compiled on
+// the calling thread; anything more goes to a pool of `jobs` workers, and each
+// unit's output and diagnostics are printed in input order once all are done.
+// with `run` the units go one at a time, since the programs write straight to
+// stdout. returns the number of units that failed, counting programs whose
+// main returned nonzero.
+int compile_inputs(char **inputs, int count, const compiler_options *options);
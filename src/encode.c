@@ -0,0 +1,380 @@
+#include "diag.h"
+#include "x86.h"
+
+// machine code for x86_insts after register allocation, so operands are
+// physical registers, [base + disp], rip-relative symbols and immediates.
+// each block's instructions up to its closing jumps are encoded once into a
+// scratch buffer; the jumps start out in their 2-byte form and grow to rel32
+// until every one reaches, then the blocks are copied into place.
+
+typedef struct {
+  u8_vec *out;
+  x86_reloc_vec *relocs;  // offsets into out
+  int pending;            // reloc of the current instruction still needing its addend, or -1
+} encoder;
+
+static void byte(encoder *e, uint8_t b) {
+  u8_vec_push(e->out, b);
+}
+
+static void imm32(encoder *e, int64_t v) {
+  for (int i = 0; i < 4; i++)
+    byte(e, (uint8_t)((uint64_t)v >> (8 * i)));
+}
+
+static void imm64(encoder *e, int64_t v) {
+  for (int i = 0; i < 8; i++)
+    byte(e, (uint8_t)((uint64_t)v >> (8 * i)));
+}
+
+static int fits8(int64_t v) {
+  return v >= -128 && v <= 127;
+}
+
+// the 4-bit register number in its class
+static uint32_t num(uint32_t r) {
+  return r >= XMM0 ? r - XMM0 : r;
+}
+
+static void reloc(encoder *e, uint32_t sym) {
+  x86_reloc_vec_push(e->relocs, (x86_reloc){(uint32_t)e->out->size, sym, 0});
+  e->pending = (int)e->relocs->size - 1;
+  imm32(e, 0);
+}
+
+// a rip-relative displacement is from the end of the instruction, which may
+// still have an immediate after it
+static void end_inst(encoder *e) {
+  if (e->pending < 0) return;
+  x86_reloc *r = &e->relocs->data[e->pending];
+  r->addend = -(int32_t)(e->out->size - r->offset);
+  e->pending = -1;
+}
+
+// rex, when anything needs it. `byte_regs` asks for one whenever a byte
+// register would otherwise mean ah, ch, dh or bh
+static void rex(encoder *e, int w, uint32_t reg, const x86_operand *rm, int byte_regs) {
+  uint8_t bits = (uint8_t)(w << 3 | (num(reg) >> 3) << 2);
+  int low_byte = byte_regs && reg >= RSP && reg <= RDI;
+  if (rm->kind == XO_REG || rm->kind == XO_MEM) {
+    bits |= (uint8_t)(num(rm->reg) >> 3);
+    low_byte |= byte_regs && rm->kind == XO_REG && rm->reg >= RSP && rm->reg <= RDI;
+  }
+  if (bits || low_byte) byte(e, 0x40 | bits);
+}
+
+static void modrm(encoder *e, uint32_t reg, const x86_operand *rm) {
+  uint8_t r = (uint8_t)((num(reg) & 7) << 3);
+  if (rm->kind == XO_REG) {
+    byte(e, 0xc0 | r | (num(rm->reg) & 7));
+  } else if (rm->kind == XO_SYM) {
+    byte(e, 0x05 | r);
+    reloc(e, rm->index);
+  } else {
+    uint8_t base = (uint8_t)(rm->reg & 7);
+    int64_t disp = rm->imm;
+    uint8_t mod = disp == 0 && base != 5 ? 0x00 : fits8(disp) ? 0x40 : 0x80;
+    byte(e, mod | r | base);
+    if (base == 4) byte(e, 0x24);  // rsp and r12 need a sib byte
+    if (mod == 0x40)
+      byte(e, (uint8_t)disp);
+    else if (mod == 0x80)
+      imm32(e, disp);
+  }
+}
+
+// [prefix] [rex] opcode modrm; opcodes above 0xff are 0x0f escapes
+static void op_rm(encoder *e, uint8_t prefix, int w, uint32_t opcode, uint32_t reg,
+                  const x86_operand *rm, int byte_regs) {
+  if (prefix) byte(e, prefix);
+  rex(e, w, reg, rm, byte_regs);
+  if (opcode > 0xff) byte(e, (uint8_t)(opcode >> 8));
+  byte(e, (uint8_t)opcode);
+  modrm(e, reg, rm);
+}
+
+static int is_xmm(const x86_operand *o) {
+  return o->kind == XO_REG && o->reg >= XMM0;
+}
+
+static void encode_mov(encoder *e, const x86_operand *d, const x86_operand *s) {
+  if (d->kind == XO_REG && s->kind == XO_REG && d->reg == s->reg) return;
+  if (is_xmm(d)) {
+    if (is_xmm(s))
+      op_rm(e, 0x66, 0, 0x0f28, d->reg, s, 0);  // movapd
+    else if (s->kind == XO_REG)
+      op_rm(e, 0x66, 1, 0x0f6e, d->reg, s, 0);  // movq xmm, r64
+    else
+      op_rm(e, 0xf2, 0, 0x0f10, d->reg, s, 0);  // movsd xmm, m64
+    return;
+  }
+  if (is_xmm(s)) {
+    if (d->kind == XO_REG)
+      op_rm(e, 0x66, 1, 0x0f7e, s->reg, d, 0);  // movq r64, xmm
+    else
+      op_rm(e, 0xf2, 0, 0x0f11, s->reg, d, 0);  // movsd m64, xmm
+    return;
+  }
+  if (s->kind == XO_IMM) {
+    if (d->kind == XO_REG && s->imm >= 0 && s->imm <= UINT32_MAX) {
+      // writing the low half zeroes the rest
+      if (d->reg >= R8) byte(e, 0x41);
+      byte(e, (uint8_t)(0xb8 + (d->reg & 7)));
+      imm32(e, s->imm);
+    } else if (x86_fits_imm32(s->imm)) {
+      op_rm(e, 0, 1, 0xc7, 0, d, 0);
+      imm32(e, s->imm);
+    } else {
+      byte(e, (uint8_t)(0x48 | (d->reg >= R8)));
+      byte(e, (uint8_t)(0xb8 + (d->reg & 7)));
+      imm64(e, s->imm);
+    }
+    return;
+  }
+  if (s->kind == XO_REG)
+    op_rm(e, 0, 1, 0x89, s->reg, d, 0);
+  else
+    op_rm(e, 0, 1, 0x8b, d->reg, s, 0);
+}
+
+// add, or, and, sub, xor and cmp share one layout: op r/m, reg; op reg, r/m;
+// and 0x81/0x83 /ext with an immediate
+static void encode_alu(encoder *e, uint8_t base, uint32_t ext, const x86_operand *d,
+                       const x86_operand *s) {
+  if (s->kind == XO_IMM) {
+    op_rm(e, 0, 1, fits8(s->imm) ? 0x83 : 0x81, ext, d, 0);
+    if (fits8(s->imm))
+      byte(e, (uint8_t)s->imm);
+    else
+      imm32(e, s->imm);
+  } else if (s->kind == XO_REG) {
+    op_rm(e, 0, 1, base + 1u, s->reg, d, 0);
+  } else {
+    op_rm(e, 0, 1, base + 3u, d->reg, s, 0);
+  }
+}
+
+static void encode_inst(encoder *e, const x86_inst *in) {
+  const x86_operand *d = &in->a[0], *s = &in->a[1];
+  switch (in->op) {
+  case X_MOV: encode_mov(e, d, s); break;
+  case X_LEA: op_rm(e, 0, 1, 0x8d, d->reg, s, 0); break;
+  case X_ADD: encode_alu(e, 0x00, 0, d, s); break;
+  case X_OR: encode_alu(e, 0x08, 1, d, s); break;
+  case X_AND: encode_alu(e, 0x20, 4, d, s); break;
+  case X_SUB: encode_alu(e, 0x28, 5, d, s); break;
+  case X_XOR: encode_alu(e, 0x30, 6, d, s); break;
+  case X_CMP: encode_alu(e, 0x38, 7, d, s); break;
+  case X_IMUL:
+    if (s->kind == XO_IMM) {
+      op_rm(e, 0, 1, fits8(s->imm) ? 0x6b : 0x69, d->reg, d, 0);
+      if (fits8(s->imm))
+        byte(e, (uint8_t)s->imm);
+      else
+        imm32(e, s->imm);
+    } else {
+      op_rm(e, 0, 1, 0x0faf, d->reg, s, 0);
+    }
+    break;
+  case X_SHL:
+  case X_SAR: {
+    uint32_t ext = in->op == X_SHL ? 4 : 7;
+    if (s->kind != XO_IMM) {
+      op_rm(e, 0, 1, 0xd3, ext, d, 0);
+    } else if (s->imm == 1) {
+      op_rm(e, 0, 1, 0xd1, ext, d, 0);
+    } else {
+      op_rm(e, 0, 1, 0xc1, ext, d, 0);
+      byte(e, (uint8_t)s->imm);
+    }
+    break;
+  }
+  case X_NEG: op_rm(e, 0, 1, 0xf7, 3, d, 0); break;
+  case X_NOT: op_rm(e, 0, 1, 0xf7, 2, d, 0); break;
+  case X_IDIV: op_rm(e, 0, 1, 0xf7, 7, d, 0); break;
+  case X_TEST:
+    if (s->kind == XO_IMM) {
+      op_rm(e, 0, 1, 0xf7, 0, d, 0);
+      imm32(e, s->imm);
+    } else {
+      op_rm(e, 0, 1, 0x85, s->reg, d, 0);
+    }
+    break;
+  case X_SETCC: op_rm(e, 0, 0, 0x0f90u + in->cc, 0, d, 1); break;
+  case X_MOVZB: op_rm(e, 0, 0, 0x0fb6, d->reg, s, 1); break;
+  case X_CQO:
+    byte(e, 0x48);
+    byte(e, 0x99);
+    break;
+  case X_ADDSD: op_rm(e, 0xf2, 0, 0x0f58, d->reg, s, 0); break;
+  case X_MULSD: op_rm(e, 0xf2, 0, 0x0f59, d->reg, s, 0); break;
+  case X_SUBSD: op_rm(e, 0xf2, 0, 0x0f5c, d->reg, s, 0); break;
+  case X_DIVSD: op_rm(e, 0xf2, 0, 0x0f5e, d->reg, s, 0); break;
+  case X_XORPD: op_rm(e, 0x66, 0, 0x0f57, d->reg, s, 0); break;
+  case X_UCOMISD: op_rm(e, 0x66, 0, 0x0f2e, d->reg, s, 0); break;
+  case X_CVTSI2SD: op_rm(e, 0xf2, 1, 0x0f2a, d->reg, s, 0); break;
+  case X_CVTTSD2SI: op_rm(e, 0xf2, 1, 0x0f2c, d->reg, s, 0); break;
+  case X_PUSH:
+    if (d->kind == XO_REG) {
+      if (d->reg >= R8) byte(e, 0x41);
+      byte(e, (uint8_t)(0x50 + (d->reg & 7)));
+    } else if (d->kind == XO_IMM) {
+      byte(e, fits8(d->imm) ? 0x6a : 0x68);
+      if (fits8(d->imm))
+        byte(e, (uint8_t)d->imm);
+      else
+        imm32(e, d->imm);
+    } else {
+      op_rm(e, 0, 0, 0xff, 6, d, 0);
+    }
+    break;
+  case X_POP:
+    if (d->kind == XO_REG) {
+      if (d->reg >= R8) byte(e, 0x41);
+      byte(e, (uint8_t)(0x58 + (d->reg & 7)));
+    } else {
+      op_rm(e, 0, 0, 0x8f, 0, d, 0);
+    }
+    break;
+  case X_CALL:
+    byte(e, 0xe8);
+    reloc(e, d->index);
+    break;
+  case X_RET: byte(e, 0xc3); break;
+  default: diag_fatal("error: cannot encode x86 instruction %d\n", in->op);
+  }
+  end_inst(e);
+}
+
+/* functions */
+
+typedef struct {
+  uint32_t body_start, body_end;  // in the scratch buffer
+  uint32_t first_reloc, end_reloc;
+  uint32_t branch;     // index of the first closing jump
+  uint8_t wide[2];     // which closing jumps need rel32
+  uint32_t offset;     // final position in the function
+} block_layout;
+
+// bytes of the closing jump i of block b
+static uint32_t jump_size(const x86_func *f, const block_layout *l, uint32_t b, uint32_t i) {
+  const x86_inst *in = &f->blocks.data[b].insts.data[l[b].branch + i];
+  if (in->op == X_JMP && in->a[0].index == b + 1) return 0;
+  if (!l[b].wide[i]) return 2;
+  return in->op == X_JMP ? 5 : 6;
+}
+
+static void encode_func(const x86_func *f, x86_code *out, u8_vec *scratch,
+                        x86_reloc_vec *relocs) {
+  uint32_t nblocks = (uint32_t)f->blocks.size;
+  block_layout *l = calloc(nblocks ? nblocks : 1, sizeof(block_layout));
+  encoder e = {scratch, relocs, -1};
+  scratch->size = 0;
+  relocs->size = 0;
+  for (uint32_t b = 0; b < nblocks; b++) {
+    const x86_inst_vec *insts = &f->blocks.data[b].insts;
+    uint32_t k = (uint32_t)insts->size;
+    while (k && (insts->data[k - 1].op == X_JMP || insts->data[k - 1].op == X_JCC))
+      k--;
+    l[b].branch = k;
+    l[b].body_start = (uint32_t)scratch->size;
+    l[b].first_reloc = (uint32_t)relocs->size;
+    for (uint32_t i = 0; i < k; i++)
+      encode_inst(&e, &insts->data[i]);
+    l[b].body_end = (uint32_t)scratch->size;
+    l[b].end_reloc = (uint32_t)relocs->size;
+    if (insts->size - k > 2) diag_fatal("error: block with more than two closing jumps\n");
+  }
+
+  // jumps only ever grow, so this settles
+  for (int changed = 1; changed;) {
+    changed = 0;
+    uint32_t at = 0;
+    for (uint32_t b = 0; b < nblocks; b++) {
+      l[b].offset = at;
+      at += l[b].body_end - l[b].body_start;
+      for (uint32_t i = 0; l[b].branch + i < f->blocks.data[b].insts.size; i++)
+        at += jump_size(f, l, b, i);
+    }
+    for (uint32_t b = 0; b < nblocks; b++) {
+      uint32_t end = l[b].offset + l[b].body_end - l[b].body_start;
+      for (uint32_t i = 0; l[b].branch + i < f->blocks.data[b].insts.size; i++) {
+        end += jump_size(f, l, b, i);
+        const x86_inst *in = &f->blocks.data[b].insts.data[l[b].branch + i];
+        int64_t disp = (int64_t)l[in->a[0].index].offset - end;
+        if (!l[b].wide[i] && jump_size(f, l, b, i) && !fits8(disp)) {
+          l[b].wide[i] = 1;
+          changed = 1;
+        }
+      }
+    }
+  }
+
+  uint32_t base = (uint32_t)out->text.size;
+  encoder final = {&out->text, &out->relocs, -1};
+  for (uint32_t b = 0; b < nblocks; b++) {
+    u8_vec_push_many(&out->text, scratch->data + l[b].body_start, l[b].body_end - l[b].body_start);
+    for (uint32_t r = l[b].first_reloc; r < l[b].end_reloc; r++) {
+      x86_reloc rel = relocs->data[r];
+      rel.offset = rel.offset - l[b].body_start + base + l[b].offset;
+      x86_reloc_vec_push(&out->relocs, rel);
+    }
+    for (uint32_t i = 0; l[b].branch + i < f->blocks.data[b].insts.size; i++) {
+      const x86_inst *in = &f->blocks.data[b].insts.data[l[b].branch + i];
+      uint32_t size = jump_size(f, l, b, i);
+      if (!size) continue;
+      int64_t disp = (int64_t)l[in->a[0].index].offset -
+                     (int64_t)(out->text.size - base + size);
+      if (in->op == X_JMP) {
+        byte(&final, size == 2 ? 0xeb : 0xe9);
+      } else if (size == 2) {
+        byte(&final, (uint8_t)(0x70 + in->cc));
+      } else {
+        byte(&final, 0x0f);
+        byte(&final, (uint8_t)(0x80 + in->cc));
+      }
+      if (size == 2)
+        byte(&final, (uint8_t)disp);
+      else
+        imm32(&final, disp);
+    }
+  }
+  free(l);
+}
+
+void encode_x86(const x86_module *m, x86_code *out) {
+  arena *a = m->arena;
+  u8_vec_init(&out->text, a, 4096);
+  u8_vec_init(&out->rodata, a, 256);
+  x86_reloc_vec_init(&out->relocs, a, 64);
+  out->offset = arena_calloc(a, m->syms.size ? m->syms.size : 1, sizeof(uint32_t));
+
+  u8_vec scratch;
+  x86_reloc_vec relocs;
+  u8_vec_init(&scratch, NULL, 4096);
+  x86_reloc_vec_init(&relocs, NULL, 64);
+  for (uint32_t i = 0; i < m->nfuncs; i++) {
+    if (!m->funcs[i]) continue;
+    while (out->text.size % 16)
+      u8_vec_push(&out->text, 0xcc);
+    out->offset[i] = (uint32_t)out->text.size;
+    encode_func(m->funcs[i], out, &scratch, &relocs);
+  }
+  u8_vec_free(&scratch);
+  x86_reloc_vec_free(&relocs);
+
+  // floats first, so they stay aligned
+  for (uint32_t i = m->nfuncs + RT_COUNT; i < m->syms.size; i++) {
+    const x86_sym *s = &m->syms.data[i];
+    if (s->kind != XS_FLOAT) continue;
+    out->offset[i] = (uint32_t)out->rodata.size;
+    for (int k = 0; k < 8; k++)
+      u8_vec_push(&out->rodata, (uint8_t)(s->value >> (8 * k)));
+  }
+  for (uint32_t i = m->nfuncs + RT_COUNT; i < m->syms.size; i++) {
+    const x86_sym *s = &m->syms.data[i];
+    if (s->kind != XS_STRING) continue;
+    out->offset[i] = (uint32_t)out->rodata.size;
+    u8_vec_push_many(&out->rodata, (const uint8_t *)s->name, strlen(s->name) + 1);
+  }
+}
@@ -0,0 +1,155 @@
+#include "fold.h"
+#include "num.h"
+#include <math.h>
+
+static int fold_int(ir_op op, int64_t a, int64_t b, int64_t *out) {
+  switch (op) {
+  case OP_ADD: *out = boop_add(a, b); break;
+  case OP_SUB: *out = boop_sub(a, b); break;
+  case OP_MUL: *out = boop_mul(a, b); break;
+  case OP_DIV:
+    if (!b) return 0;
+    *out = boop_div(a, b);
+    break;
+  case OP_MOD:
+    if (!b) return 0;
+    *out = boop_mod(a, b);
+    break;
+  case OP_POW: *out = boop_pow(a, b); break;
+  case OP_NEG: *out = boop_sub(0, a); break;
+  case OP_AND: *out = a & b; break;
+  case OP_OR: *out = a | b; break;
+  case OP_XOR: *out = a ^ b; break;
+  case OP_SHL: *out = (int64_t)((uint64_t)a << (b & 63)); break;
+  case OP_SHR: *out = a >> (b & 63); break;
+  case OP_EQ: *out = a == b; break;
+  case OP_NEQ: *out = a != b; break;
+  case OP_LT: *out = a < b; break;
+  case OP_LE: *out = a <= b; break;
+  case OP_GT: *out = a > b; break;
+  case OP_GE: *out = a >= b; break;
+  default: return 0;
+  }
+  return 1;
+}
+
+static int fold_float(ir_op op, double a, double b, ir_value *out) {
+  switch (op) {
+  case OP_ADD: out->f = a + b; break;
+  case OP_SUB: out->f = a - b; break;
+  case OP_MUL: out->f = a * b; break;
+  case OP_DIV: out->f = a / b; break;
+  case OP_MOD: out->f = boop_fmod(a, b); break;
+  case OP_POW: out->f = boop_fpow(a, b); break;
+  case OP_NEG: out->f = -a; break;
+  case OP_EQ: out->i = a == b; break;
+  case OP_NEQ: out->i = a != b; break;
+  case OP_LT: out->i = a < b; break;
+  case OP_LE: out->i = a <= b; break;
+  case OP_GT: out->i = a > b; break;
+  case OP_GE: out->i = a >= b; break;
+  default: return 0;
+  }
+  return 1;
+}
+
+static int fold_num(ir_op op, uint64_t a, uint64_t b, ir_value *out) {
+  int unary = op == OP_NEG;
+  if (num_is_ptr(a) || (!unary && num_is_ptr(b))) {
+    if (op == OP_EQ || op == OP_NEQ) {
+      out->i = num_equal(a, b) == (op == OP_EQ);
+      return 1;
+    }
+    return 0;
+  }
+
+  switch (op) {
+  case OP_ADD: out->i = (int64_t)num_add(a, b); break;
+  case OP_SUB: out->i = (int64_t)num_sub(a, b); break;
+  case OP_MUL: out->i = (int64_t)num_mul(a, b); break;
+  case OP_DIV:
+    if (num_div_by_zero(a, b)) return 0;
+    out->i = (int64_t)num_div(a, b);
+    break;
+  case OP_MOD:
+    if (num_div_by_zero(a, b)) return 0;
+    out->i = (int64_t)num_mod(a, b);
+    break;
+  case OP_POW: out->i = (int64_t)num_pow(a, b); break;
+  case OP_NEG: out->i = (int64_t)num_neg(a); break;
+  case OP_EQ: out->i = num_equal(a, b); break;
+  case OP_NEQ: out->i = !num_equal(a, b); break;
+  case OP_LT: out->i = num_less(a, b); break;
+  case OP_LE: out->i = num_less(a, b) || num_equal(a, b); break;
+  case OP_GT: out->i = num_less(b, a); break;
+  case OP_GE: out->i = num_less(b, a) || num_equal(a, b); break;
+  default: return 0;
+  }
+  return 1;
+}
+
+static int fold_conv(ir_type to, ir_type from, ir_value v, ir_value *out) {
+  uint64_t bits = (uint64_t)v.i;
+  if (from == IR_NUM && to != IR_BOOL && num_is_ptr(bits)) return 0;
+
+  switch (to) {
+  case IR_BOOL:
+    switch (from) {
+    case IR_BOOL:
+    case IR_I64: out->i = v.i != 0; return 1;
+    case IR_F64: out->i = v.f != 0.0; return 1;
+    case IR_NUM: out->i = num_truthy(bits); return 1;
+    default: return 0;
+    }
+  case IR_I64:
+    switch (from) {
+    case IR_BOOL: out->i = v.i; return 1;
+    case IR_F64: out->i = boop_ftoi(v.f); return 1;
+    case IR_NUM: out->i = num_to_int(bits); return 1;
+    default: return 0;
+    }
+  case IR_F64:
+    switch (from) {
+    case IR_BOOL:
+    case IR_I64: out->f = (double)v.i; return 1;
+    case IR_NUM: out->f = num_to_float(bits); return 1;
+    default: return 0;
+    }
+  case IR_NUM:
+    switch (from) {
+    case IR_BOOL:
+    case IR_I64: out->i = (int64_t)num_from_int(v.i); return 1;
+    case IR_F64: out->i = (int64_t)num_from_float(v.f); return 1;
+    default: return 0;
+    }
+  default: return 0;
+  }
+}
+
+int fold_op(ir_op op, ir_type type, ir_type arg_type, const ir_value *args, ir_value *out) {
+  ir_value b = op == OP_NEG || op == OP_NOT ? args[0] : args[1];
+  if (op == OP_CONV) return fold_conv(type, arg_type, args[0], out);
+  if (op == OP_NOT) {
+    out->i = arg_type == IR_BOOL ? !args[0].i : ~args[0].i;
+    return arg_type == IR_BOOL || arg_type == IR_I64;
+  }
+
+  switch (arg_type) {
+  case IR_BOOL:
+  case IR_I64: return fold_int(op, args[0].i, b.i, &out->i);
+  case IR_F64: return fold_float(op, args[0].f, b.f, out);
+  case IR_NUM: return fold_num(op, (uint64_t)args[0].i, (uint64_t)b.i, out);
+  default: return 0;
+  }
+}
+
+int fold_inst(const ir_inst *inst, ir_value *out) {
+  ir_value args[2];
+  if (inst->nargs == 0 || inst->nargs > 2) return 0;
+  if (!ir_is_pure(inst->op)) return 0;
+  for (uint32_t i = 0; i < inst->nargs; i++) {
+    if (inst->args[i]->op != OP_CONST) return 0;
+    args[i] = ir_const_value(inst->args[i]);
+  }
+  return fold_op(inst->op, inst->type, inst->args[0]->type, args, out);
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "ir.h"
+
+// evaluates `op` producing `type` over constant operands of `arg_type`, with
+// the runtime semantics of num.h. returns 0 if the operation can't be folded:
+// it would fail at run time (integer division by zero, a pointer used as a
+// number) or takes something that is never constant.
+int fold_op(ir_op op, ir_type type, ir_type arg_type, const ir_value *args, ir_value *out);
+
+// folds inst if all of its operands are constants
+int fold_inst(const ir_inst *inst, ir_value *out);
@@ -0,0 +1,146 @@
+#include "dom.h"
+#include "opt.h"
+#include "vector.h"
+
+// dominator scoped value numbering. pure instructions are hashed on opcode,
+// type and operands (and the constant for `const` and `str`) into one open
+// addressed table while the dominator tree is walked in preorder; an
+// instruction that finds an equal one already in the table is dominated by
+// it and gets replaced. leaving a subtree takes its entries out again, in
+// reverse order, which restores the table exactly as it was, so linear
+// probing needs no tombstones.
+
+VEC_DECL(slot_vec, uint32_t)
+
+typedef struct {
+  ir_func *f;
+  arena *arena;
+  dom_tree *dt;
+  ir_inst **table;
+  uint32_t mask;
+  slot_vec log;     // table slots filled, in order
+  ir_inst **repl;   // value id -> the earlier instruction it was replaced with
+  uint32_t nrepl;
+  uint32_t removed;
+} numbering;
+
+static ir_inst *resolve(const numbering *n, ir_inst *v) {
+  ir_inst *r = v->id < n->nrepl ? n->repl[v->id] : NULL;
+  return r ? r : v;
+}
+
+static int is_candidate(const ir_inst *inst) {
+  return ir_is_pure(inst->op) || inst->op == OP_CONST || inst->op == OP_STR;
+}
+
+static uint64_t mix(uint64_t h, uint64_t v) {
+  h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+  return h;
+}
+
+// operands of a commutative instruction are hashed and compared as a set
+static uint64_t hash(const ir_inst *inst) {
+  uint64_t h = mix(inst->op, inst->type);
+  if (inst->op == OP_CONST) return mix(h, (uint64_t)inst->imm.i);
+  if (inst->op == OP_STR) return mix(h, inst->imm.index);
+  if (inst->nargs == 2 && ir_is_commutative(inst->op)) {
+    uint32_t a = inst->args[0]->id, b = inst->args[1]->id;
+    return mix(mix(h, a < b ? a : b), a < b ? b : a);
+  }
+  for (uint32_t i = 0; i < inst->nargs; i++)
+    h = mix(h, inst->args[i]->id);
+  return h;
+}
+
+static int same(const ir_inst *a, const ir_inst *b) {
+  if (a->op != b->op || a->type != b->type || a->nargs != b->nargs) return 0;
+  if (a->op == OP_CONST) return a->imm.i == b->imm.i;
+  if (a->op == OP_STR) return a->imm.index == b->imm.index;
+  if (a->nargs == 2 && ir_is_commutative(a->op) && a->args[0] == b->args[1] &&
+      a->args[1] == b->args[0])
+    return 1;
+  for (uint32_t i = 0; i < a->nargs; i++)
+    if (a->args[i] != b->args[i]) return 0;
+  return 1;
+}
+
+// the equal instruction already in scope, or NULL after adding inst
+static ir_inst *lookup_or_insert(numbering *n, ir_inst *inst) {
+  uint32_t i = (uint32_t)hash(inst) & n->mask;
+  for (; n->table[i]; i = (i + 1) & n->mask)
+    if (same(n->table[i], inst)) return n->table[i];
+  n->table[i] = inst;
+  slot_vec_push(&n->log, i);
+  return NULL;
+}
+
+static void number_block(numbering *n, ir_block *b) {
+  ir_inst *next;
+  for (ir_inst *inst = b->first; inst; inst = next) {
+    next = inst->next;
+    for (uint32_t i = 0; i < inst->nargs; i++)
+      inst->args[i] = resolve(n, inst->args[i]);
+    if (!is_candidate(inst)) continue;
+    ir_inst *existing = lookup_or_insert(n, inst);
+    if (!existing) continue;
+    n->repl[inst->id] = existing;
+    ir_remove(inst);
+    n->removed++;
+  }
+}
+
+static void walk(numbering *n) {
+  dom_tree *dt = n->dt;
+  typedef struct {
+    ir_block *block;
+    size_t mark;  // log size to restore, or SIZE_MAX to enter the block
+  } frame;
+  frame *stack = arena_alloc(n->arena, 2 * dt->count * sizeof(frame));
+  uint32_t sp = 0;
+  stack[sp++] = (frame){dt->order[0], SIZE_MAX};
+
+  while (sp) {
+    frame top = stack[--sp];
+    if (top.mark != SIZE_MAX) {
+      while (n->log.size > top.mark)
+        n->table[n->log.data[--n->log.size]] = NULL;
+      continue;
+    }
+    stack[sp++] = (frame){top.block, n->log.size};
+    number_block(n, top.block);
+    for (ir_block *c = dt->child[top.block->id]; c; c = dt->sibling[c->id])
+      stack[sp++] = (frame){c, SIZE_MAX};
+  }
+}
+
+int number_values(ir_func *f) {
+  if (!f->first) return 0;
+  uint32_t count = 0;
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      count += is_candidate(inst);
+  if (count < 2) return 0;
+
+  ir_compute_preds(f);
+  numbering n = {.f = f, .arena = create_arena("gvn", 16 * 1024), .nrepl = f->nvalues};
+  n.dt = create_dom_tree(f);
+  uint32_t size = 16;
+  while (size < 2 * count)
+    size *= 2;
+  n.mask = size - 1;
+  n.table = arena_calloc(n.arena, size, sizeof(ir_inst *));
+  n.repl = arena_calloc(n.arena, f->nvalues, sizeof(ir_inst *));
+  slot_vec_init(&n.log, n.arena, 64);
+
+  walk(&n);
+  // phis on back edges use values numbered after them
+  if (n.removed)
+    for (ir_block *b = f->first; b; b = b->next)
+      for (ir_inst *inst = b->first; inst; inst = inst->next)
+        for (uint32_t i = 0; i < inst->nargs; i++)
+          inst->args[i] = resolve(&n, inst->args[i]);
+
+  destroy_dom_tree(n.dt);
+  destroy_arena(n.arena);
+  return n.removed != 0;
+}
@@ -0,0 +1,264 @@
+#include "calls.h"
+#include "loops.h"
+#include "opt.h"
+#include "vector.h"
+
+// inlining. functions are visited callees first (see calls.h), so a body
+// copied into a caller has already been optimized, and the caller is
+// optimized again afterwards with the arguments in place. a call is inlined
+// when the callee's size, less the call it saves and a bonus for every use
+// of a parameter that receives a constant, is within the threshold; each loop
+// around the call raises the threshold. calls copied along with a body are
+// looked at again in the next round, up to RECURSION_LIMIT levels deep. a
+// recursive function is only unrolled into a call site that passes it a
+// constant, which is what lets `factorial(4)` fold away completely, and only
+// if it calls back into its cycle once: unrolling `fib` doubles at each level.
+
+#define CALL_COST 1         // the call, and again for each argument
+#define CONST_ARG_BONUS 4   // per use of a parameter that gets a constant
+#define LOOP_BONUS 20       // added to the threshold per loop around the call
+#define MAX_LOOP_BONUS 3    // loops counted at most
+#define RECURSION_LIMIT 8   // inlining levels a copied call may come from
+#define CALLER_LIMIT 4000   // instructions a function may grow to by inlining
+
+VEC_DECL(inst_vec, ir_inst *)
+
+typedef struct {
+  uint8_t ready;
+  uint8_t inlinable;     // has a body that returns and an entry block without phis
+  uint32_t size;         // instructions, constants not counted
+  uint32_t cycle_calls;  // calls back into the cycle of the call graph it is on
+  uint32_t *param_uses;
+} summary;
+
+typedef struct {
+  ir_func *f;
+  arena *arena;
+  const call_graph *cg;
+  int threshold;
+  summary *summaries;  // function id -> summary, filled in when first needed
+  ir_func *self;       // f as it was when the round started, to copy calls to f from
+  ir_inst **repl;      // value id -> what a call returns, once it is inlined
+  uint32_t nrepl;
+  uint32_t size;
+} inliner;
+
+static ir_inst *resolve(const inliner *in, ir_inst *v) {
+  while (v->id < in->nrepl && in->repl[v->id])
+    v = in->repl[v->id];
+  return v;
+}
+
+static uint32_t count_size(const ir_func *f) {
+  uint32_t n = 0;
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      n += inst->op != OP_CONST && inst->op != OP_STR;
+  return n;
+}
+
+static summary *summarize(inliner *in, ir_func *g) {
+  summary *s = &in->summaries[g->id];
+  if (s->ready) return s;
+  if (g == in->f) g = in->self;
+  s->ready = 1;
+  s->param_uses = arena_calloc(in->arena, g->nparams ? g->nparams : 1, sizeof(uint32_t));
+  int returns = 0;
+  for (ir_block *b = g->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      s->size += inst->op != OP_CONST && inst->op != OP_STR;
+      returns |= inst->op == OP_RET;
+      if (inst->op == OP_CALL && in->cg->scc[inst->imm.callee->id] == in->cg->scc[g->id])
+        s->cycle_calls++;
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        if (inst->args[i]->op == OP_PARAM) s->param_uses[inst->args[i]->imm.index]++;
+    }
+  s->inlinable = returns && g->first->first->op != OP_PHI;
+  return s;
+}
+
+static int worth_inlining(inliner *in, ir_inst *call, uint32_t loops) {
+  ir_func *g = call->imm.callee;
+  const call_graph *cg = in->cg;
+  if (call->flags >= RECURSION_LIMIT || !g->first) return 0;
+  summary *s = summarize(in, g);
+  if (!s->inlinable || in->size + s->size > CALLER_LIMIT) return 0;
+
+  int64_t bonus = 0;
+  for (uint32_t i = 0; i < call->nargs; i++) {
+    ir_op op = resolve(in, call->args[i])->op;
+    if (op == OP_CONST || op == OP_STR) bonus += CONST_ARG_BONUS * s->param_uses[i];
+  }
+  // unrolling a recursion only pays when a constant can stop it
+  if (cg->recursive[g->id] && (call->flags || cg->scc[g->id] == cg->scc[in->f->id]) &&
+      (!bonus || s->cycle_calls > 1))
+    return 0;
+
+  int64_t cost = (int64_t)s->size - CALL_COST * (1 + call->nargs) - bonus;
+  int64_t limit = in->threshold + LOOP_BONUS * (loops < MAX_LOOP_BONUS ? loops : MAX_LOOP_BONUS);
+  return cost <= limit;
+}
+
+// copies the body of `from` into `to` in front of `before` (at the end for
+// NULL) with parameter i reading args[i], and returns the copied entry. calls
+// come out `depth` levels deeper, allocas go to the start of `slots` if it is
+// set, and the copied rets are left in place and collected in `rets`.
+static ir_block *copy_body(inliner *in, ir_func *to, const ir_func *from, ir_inst **args,
+                           ir_block *before, uint16_t depth, ir_block *slots, inst_vec *rets) {
+  ir_inst **value = arena_calloc(in->arena, from->nvalues, sizeof(ir_inst *));
+  ir_block **block = arena_calloc(in->arena, from->nblocks, sizeof(ir_block *));
+  for (uint32_t i = 0; i < from->nparams; i++)
+    value[from->params[i]->id] = args[i];
+
+  for (ir_block *b = from->first; b; b = b->next) {
+    ir_block *copy = before ? ir_add_block_before(to, before) : ir_add_block(to);
+    block[b->id] = copy;
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      ir_inst *c = ir_new_inst(to, inst->op, inst->type, inst->op == OP_PHI ? 0 : inst->nargs);
+      if (inst->op != OP_PHI) c->imm = inst->imm;
+      c->flags = inst->op == OP_CALL ? inst->flags + depth : inst->flags;
+      if (inst->op == OP_ALLOCA && slots)
+        ir_insert_before(slots->first, c);
+      else
+        ir_append(copy, c);
+      value[inst->id] = c;
+    }
+  }
+
+  // operands can refer forward, through phis
+  for (ir_block *b = from->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      ir_inst *c = value[inst->id];
+      if (inst->op == OP_PHI) {
+        for (uint32_t i = 0; i < inst->nargs; i++)
+          ir_add_incoming(to, c, value[inst->args[i]->id], block[inst->imm.incoming[i]->id]);
+        continue;
+      }
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        c->args[i] = value[inst->args[i]->id];
+      if (inst->op == OP_JMP || inst->op == OP_BR) {
+        c->imm.target[0] = block[inst->imm.target[0]->id];
+        if (inst->op == OP_BR) c->imm.target[1] = block[inst->imm.target[1]->id];
+      }
+      if (inst->op == OP_RET && rets) inst_vec_push(rets, c);
+    }
+  return block[from->first->id];
+}
+
+// f as it is now, in a function of its own that isn't part of the module
+static ir_func *snapshot(inliner *in) {
+  ir_func *f = in->f;
+  ir_module *m = arena_calloc(in->arena, 1, sizeof(ir_module));
+  m->arena = in->arena;
+  ir_func *copy = arena_calloc(in->arena, 1, sizeof(ir_func));
+  *copy = (ir_func){.id = f->id, .name = f->name, .ret = f->ret, .module = m, .nvalues = 1,
+                    .nblocks = 1, .nparams = f->nparams};
+  copy->params = arena_alloc(in->arena, (f->nparams ? f->nparams : 1) * sizeof(ir_inst *));
+  for (uint32_t i = 0; i < f->nparams; i++) {
+    copy->params[i] = ir_new_inst(copy, OP_PARAM, f->params[i]->type, 0);
+    copy->params[i]->imm.index = i;
+  }
+  copy_body(in, copy, f, copy->params, NULL, 0, NULL, NULL);
+  return copy;
+}
+
+// splits the call's block after the call, puts a copy of the callee in
+// between and sends its returns to the second half
+static void inline_call(inliner *in, ir_inst *call) {
+  ir_func *f = in->f, *g = call->imm.callee == f ? in->self : call->imm.callee;
+  ir_block *b = call->block;
+  ir_block *rest = b->next ? ir_add_block_before(f, b->next) : ir_add_block(f);
+  while (call->next) {
+    ir_inst *inst = call->next;
+    ir_remove(inst);
+    ir_append(rest, inst);
+  }
+  ir_block *succ[2];
+  int n = ir_succs(rest, succ);
+  for (int i = 0; i < n; i++)
+    for (ir_inst *phi = succ[i]->first; phi && phi->op == OP_PHI; phi = phi->next)
+      for (uint32_t j = 0; j < phi->nargs; j++)
+        if (phi->imm.incoming[j] == b) phi->imm.incoming[j] = rest;
+
+  ir_inst **args = arena_alloc(in->arena, (call->nargs ? call->nargs : 1) * sizeof(ir_inst *));
+  for (uint32_t i = 0; i < call->nargs; i++)
+    args[i] = resolve(in, call->args[i]);
+  inst_vec rets;
+  inst_vec_init(&rets, in->arena, 4);
+  ir_block *entry = copy_body(in, f, g, args, rest, call->flags + 1, f->first, &rets);
+  ir_remove(call);
+  ir_emit_jmp(f, b, entry);
+
+  ir_inst *result = NULL;
+  if (call->type != IR_VOID && rets.size > 1) {
+    result = ir_new_inst(f, OP_PHI, call->type, 0);
+    ir_insert_before(rest->first, result);
+  }
+  for (size_t i = 0; i < rets.size; i++) {
+    ir_inst *ret = rets.data[i];
+    ir_block *from = ret->block;
+    ir_inst *v = ret->nargs ? ret->args[0] : NULL;
+    ir_remove(ret);
+    ir_emit_jmp(f, from, rest);
+    if (call->type == IR_VOID) continue;
+    if (result)
+      ir_add_incoming(f, result, v, from);
+    else
+      result = v;
+  }
+  if (result) in->repl[call->id] = result;
+  in->size += in->summaries[g->id].size;
+}
+
+typedef struct {
+  ir_inst *call;
+  uint32_t loops;
+} call_site;
+
+VEC_DECL(site_vec, call_site)
+
+int inline_calls(ir_func *f, const call_graph *cg, int threshold) {
+  if (!f->first || threshold < 0) return 0;
+  arena *a = create_arena("inline", 16 * 1024);
+  site_vec sites;
+  site_vec_init(&sites, a, 16);
+  int recursive = 0;
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      if (inst->op == OP_CALL) {
+        site_vec_push(&sites, (call_site){inst, 0});
+        recursive |= inst->imm.callee == f;
+      }
+  if (!sites.size) {
+    destroy_arena(a);
+    return 0;
+  }
+
+  ir_compute_preds(f);
+  loop_forest *lf = create_loop_forest(f);
+  for (size_t i = 0; i < sites.size; i++)
+    sites.data[i].loops = loop_depth(lf, sites.data[i].call->block);
+  destroy_loop_forest(lf);
+
+  inliner in = {.f = f, .arena = a, .cg = cg, .threshold = threshold, .nrepl = f->nvalues};
+  in.summaries = arena_calloc(a, cg->count, sizeof(summary));
+  in.repl = arena_calloc(a, f->nvalues, sizeof(ir_inst *));
+  in.size = count_size(f);
+  if (recursive) in.self = snapshot(&in);
+
+  int changed = 0;
+  for (size_t i = 0; i < sites.size; i++) {
+    if (!worth_inlining(&in, sites.data[i].call, sites.data[i].loops)) continue;
+    inline_call(&in, sites.data[i].call);
+    changed = 1;
+  }
+  if (changed) {
+    for (ir_block *b = f->first; b; b = b->next)
+      for (ir_inst *inst = b->first; inst; inst = inst->next)
+        for (uint32_t i = 0; i < inst->nargs; i++)
+          inst->args[i] = resolve(&in, inst->args[i]);
+    ir_compute_preds(f);
+  }
+  destroy_arena(a);
+  return changed;
+}
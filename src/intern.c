@@ -1,171 +1,181 @@
 #include "intern.h"
+#include "arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define EMPTY_SLOT 0
-#define TOMBSTONE ((char *)-1)
+
+// strings live in a dense entry array; the hash index only stores the hash and
+// entry number, so a probe touches one 8-byte slot until the hashes match.
+typedef struct {
+  char *key;
+  uint32_t len;
+  token_type value;
+} intern_entry;
+
+typedef struct {
+  uint32_t hash;
+  uint32_t entry;  // entry index + 1, EMPTY_SLOT if unused
+} intern_slot;
 
 struct intern_table {
-  int capacity;
+  uint32_t capacity;  // always a power of two
+  uint32_t mask;
+  uint32_t size;
   double load_factor;
-  int size;
-  int tombstone_count;
-  char **keys;
-  token_type *values;
+  intern_slot *slots;
+  intern_entry *entries;
+  uint32_t entry_capacity;
+  arena *strings;  // backing store for every key
 };
 
-static unsigned long hash1(const char *str) {
-  unsigned long h = 5381;
-  int c;
-  while ((c = *str++))
-    h = ((h << 5) + h) + c;
-  return h;
-}
+#define K0 0xa0761d6478bd642full
+#define K1 0xe7037ed1a0b428dbull
+#define K2 0x8ebc6af09c88c6e3ull
 
-static unsigned long hash2(const char *str, int capacity) {
-  unsigned long h = 0;
-  int c;
-  while ((c = *str++))
-    h = (h * 31 + c) % (capacity - 1);
-  return (h | 1);
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+  a *= b;
+  return a ^ (a >> 32);
 }
 
-static int find_slot(intern_table *t, const char *str, int for_insert) {
-  unsigned long h1v = hash1(str) % t->capacity;
-  unsigned long h2v = hash2(str, t->capacity);
-  int slot = (int)h1v;
-  int first_tomb = -1;
-
-  for (int i = 0; i < t->capacity; i++) {
-    char *k = t->keys[slot];
-    if (k == EMPTY_SLOT) {
-      if (for_insert && first_tomb != -1) return first_tomb;
-      return slot;
-    } else if (k == TOMBSTONE) {
-      if (for_insert && first_tomb == -1) first_tomb = slot;
-    } else if (strcmp(k, str) == 0) {
-      return slot;
-    }
-    slot = (slot + h2v) % t->capacity;
+// one pass over (ptr, len), eight bytes at a time
+static uint64_t hash_bytes(const char *s, size_t len) {
+  uint64_t h = K0 ^ (len * K1);
+  while (len >= 8) {
+    uint64_t w;
+    memcpy(&w, s, 8);
+    h = mix(h ^ w, K1);
+    s += 8;
+    len -= 8;
+  }
+  if (len) {
+    uint64_t w = 0;
+    memcpy(&w, s, len);
+    h = mix(h ^ w, K2);
   }
-  return -1;  // table is full
+  return mix(h, K0);
 }
 
-static void resize(intern_table *t) {
-  int oldcap = t->capacity;
-  char **oldkeys = t->keys;
-  token_type *oldvalues = t->values;
-
-  int newcap = t->capacity * 2;
-  char **newkeys = calloc(newcap, sizeof(char *));
-  token_type *newvalues = calloc(newcap, sizeof(token_type));
-  if (!newkeys || !newvalues) {
-    fprintf(stderr, "failed to allocate new intern table arrays\n");
-    free(newkeys);
-    free(newvalues);
+static void *checked_calloc(size_t count, size_t size) {
+  void *p = calloc(count, size);
+  if (!p) {
+    fprintf(stderr, "failed to allocate intern table arrays\n");
     exit(EXIT_FAILURE);
   }
+  return p;
+}
 
-  t->capacity = newcap;
-  t->size = 0;
-  t->tombstone_count = 0;
-  t->keys = newkeys;
-  t->values = newvalues;
-
-  // reinsert old entries into new table
-  for (int i = 0; i < oldcap; i++) {
-    char *k = oldkeys[i];
-    if (k && k != EMPTY_SLOT && k != TOMBSTONE) {
-      int slot = find_slot(t, k, 1);
-      if (slot == -1) {
-        fprintf(stderr, "unexpected error during rehashing\n");
-        continue;
-      }
-      t->keys[slot] = k;
-      t->values[slot] = oldvalues[i];
-      t->size++;
+static intern_slot *find_slot(intern_table *t, const char *str, size_t len, uint32_t hash) {
+  uint32_t i = hash & t->mask;
+  for (;;) {
+    intern_slot *slot = &t->slots[i];
+    if (slot->entry == EMPTY_SLOT) return slot;
+    if (slot->hash == hash) {
+      intern_entry *e = &t->entries[slot->entry - 1];
+      if (e->len == len && memcmp(e->key, str, len) == 0) return slot;
     }
+    i = (i + 1) & t->mask;
   }
-  free(oldkeys);
-  free(oldvalues);
 }
 
-intern_result intern_string(intern_table *t, const char *start, size_t len, token_type value) {
-  // use strndup directly to allocate and null-terminate
-  char *temp = strndup(start, len);
-  if (!temp) {
-    fprintf(stderr, "failed to allocate string in intern_string\n");
-    exit(EXIT_FAILURE);
+static void resize(intern_table *t) {
+  intern_slot *old = t->slots;
+  uint32_t oldcap = t->capacity;
+
+  t->capacity *= 2;
+  t->mask = t->capacity - 1;
+  t->slots = checked_calloc(t->capacity, sizeof(intern_slot));
+
+  // the stored hashes make rehashing a pure index shuffle
+  for (uint32_t i = 0; i < oldcap; i++) {
+    if (old[i].entry == EMPTY_SLOT) continue;
+    uint32_t j = old[i].hash & t->mask;
+    while (t->slots[j].entry != EMPTY_SLOT)
+      j = (j + 1) & t->mask;
+    t->slots[j] = old[i];
   }
+  free(old);
+}
+
+intern_result intern_string(intern_table *t, const char *start, size_t len, token_type value) {
+  uint32_t hash = (uint32_t)hash_bytes(start, len);
+  intern_slot *slot = find_slot(t, start, len, hash);
 
-  int slot = find_slot(t, temp, 0);
-  if (slot != -1 && t->keys[slot] != EMPTY_SLOT && t->keys[slot] != TOMBSTONE) {
-    // already interned; free our duplicate and return existing entry
-    free(temp);
-    return (intern_result){t->keys[slot], t->values[slot]};
+  if (slot->entry != EMPTY_SLOT) {
+    intern_entry *e = &t->entries[slot->entry - 1];
+    return (intern_result){e->key, e->value, slot->entry - 1};
   }
 
-  double ratio = (double)t->size / t->capacity;
-  double tomb_ratio = (double)t->tombstone_count / t->capacity;
-  if (ratio >= t->load_factor || tomb_ratio >= 0.4) {
-    resize(t);
-    // recompute slot after resize
-    slot = find_slot(t, temp, 1);
-    if (slot == -1) {
-      fprintf(stderr, "couldn't find a slot after resizing\n");
-      free(temp);
-      exit(EXIT_FAILURE);
-    }
-  } else if (slot == -1) {
-    // fallback in case find_slot didn't return a valid slot
-    slot = find_slot(t, temp, 1);
-    if (slot == -1) {
-      fprintf(stderr, "couldn't find a slot for insertion\n");
-      free(temp);
+  // only copy on a miss
+  char *key = arena_strndup(t->strings, start, len);
+
+  if (t->size == t->entry_capacity) {
+    t->entry_capacity *= 2;
+    t->entries = realloc(t->entries, t->entry_capacity * sizeof(intern_entry));
+    if (!t->entries) {
+      fprintf(stderr, "failed to grow intern table entries\n");
       exit(EXIT_FAILURE);
     }
   }
 
-  if (t->keys[slot] == EMPTY_SLOT) {
-    t->size++;
-  } else if (t->keys[slot] == TOMBSTONE) {
-    t->tombstone_count--;
+  uint32_t id = t->size++;
+  t->entries[id] = (intern_entry){key, (uint32_t)len, value};
+  slot->hash = hash;
+  slot->entry = id + 1;
+
+  if (t->size >= t->capacity * t->load_factor) resize(t);
+  return (intern_result){key, value, id};
+}
+
+void intern_merge(intern_table *dst, intern_table *src, uint32_t first, uint32_t *remap) {
+  for (uint32_t i = first; i < src->size; i++) {
+    intern_entry *e = &src->entries[i];
+    remap[i] = intern_string(dst, e->key, e->len, e->value).id;
   }
-  t->keys[slot] = temp;
-  t->values[slot] = value;
-  return (intern_result){temp, value};
+}
+
+token_type get_interned_value(intern_table *t, const char *str) {
+  size_t len = strlen(str);
+  intern_slot *slot = find_slot(t, str, len, (uint32_t)hash_bytes(str, len));
+  if (slot->entry == EMPTY_SLOT) return IDENTIFIER;
+  return t->entries[slot->entry - 1].value;
+}
+
+const char *intern_lookup(intern_table *t, uint32_t id) {
+  return id < t->size ? t->entries[id].key : NULL;
+}
+
+uint32_t intern_count(intern_table *t) {
+  return t->size;
+}
+
+const arena *intern_arena(intern_table *t) {
+  return t->strings;
 }
 
 intern_table *create_intern_table(int capacity, double load_factor) {
-  intern_table *tbl = calloc(1, sizeof(*tbl));
-  if (!tbl) {
-    fprintf(stderr, "failed to allocate intern_table\n");
-    exit(EXIT_FAILURE);
-  }
-  tbl->capacity = capacity;
+  intern_table *tbl = checked_calloc(1, sizeof(*tbl));
+
+  uint32_t cap = 16;
+  while (cap < (uint32_t)capacity)
+    cap *= 2;
+
+  tbl->capacity = cap;
+  tbl->mask = cap - 1;
   tbl->load_factor = load_factor;
   tbl->size = 0;
-  tbl->tombstone_count = 0;
-  tbl->keys = calloc(capacity, sizeof(char *));
-  tbl->values = calloc(capacity, sizeof(token_type));
-  if (!tbl->keys || !tbl->values) {
-    fprintf(stderr, "failed to allocate intern_table arrays\n");
-    free(tbl->keys);
-    free(tbl->values);
-    free(tbl);
-    exit(EXIT_FAILURE);
-  }
+  tbl->slots = checked_calloc(cap, sizeof(intern_slot));
+  tbl->entry_capacity = cap;
+  tbl->entries = checked_calloc(cap, sizeof(intern_entry));
+  tbl->strings = create_arena("strings", 64 * 1024);
   return tbl;
 }
 
 void destroy_intern_table(intern_table *t) {
   if (!t) return;
-  for (int i = 0; i < t->capacity; i++) {
-    char *k = t->keys[i];
-    if (k && k != EMPTY_SLOT && k != TOMBSTONE) free(k);
-  }
-  free(t->keys);
-  free(t->values);
+  destroy_arena(t->strings);
+  free(t->slots);
+  free(t->entries);
   free(t);
 }
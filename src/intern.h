@@ -1,15 +1,24 @@
 #pragma once
+#include "arena.h"
 #include "token.h"
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct intern_table intern_table;
 
 typedef struct {
   char *key;
   token_type value;
+  uint32_t id;  // dense, in insertion order; stable for the life of the table
 } intern_result;
 
 intern_table *create_intern_table(int capacity, double load_factor);
 intern_result intern_string(intern_table *t, const char *start, size_t len, token_type value);
 void destroy_intern_table(intern_table *t);
+// interns src's entries from `first` on into dst, in id order, storing each
+// one's new id in remap[old id]
+void intern_merge(intern_table *dst, intern_table *src, uint32_t first, uint32_t *remap);
 token_type get_interned_value(intern_table *t, const char *str);
+const char *intern_lookup(intern_table *t, uint32_t id);
+uint32_t intern_count(intern_table *t);
+const arena *intern_arena(intern_table *t);
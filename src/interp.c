@@ -0,0 +1,442 @@
+#include "bytecode.h"
+#include "diag.h"
+#include "num.h"
+#include "tier.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the bytecode interpreter. with gcc or clang every handler ends in an
+// indirect jump of its own through a table of label addresses (computed
+// goto), which predicts much better than one shared switch; other compilers
+// get the switch. frames sit back to back on one register stack, and the
+// return addresses on a separate call stack. calls go through a table of
+// each function's current code, which tiering (tier.h) points at optimized
+// code as functions get hot.
+
+#define VM_STACK_REGS (1u << 22)
+#define VM_MAX_DEPTH (1u << 18)
+
+typedef union {
+  int64_t i;
+  double f;
+  uint64_t n;  // num
+  const void *p;
+} vm_value;
+
+typedef struct {
+  const uint32_t *pc;  // where to continue in the caller
+  const bc_func *func;
+  vm_value *regs;
+  uint32_t dst;
+} vm_call;
+
+static void print_int(FILE *out, int64_t v) {
+  fprintf(out, "%" PRId64 "\n", v);
+}
+
+// matches the runtime's: six decimals, trailing zeros removed but one kept
+static void print_float(FILE *out, double d) {
+  char buf[400];
+  if (d != d) {
+    fputs("nan\n", out);
+    return;
+  }
+  int n = snprintf(buf, sizeof(buf), "%.6f", d);
+  while (n > 2 && buf[n - 1] == '0' && buf[n - 2] != '.')
+    n--;
+  buf[n++] = '\n';
+  fwrite(buf, 1, (size_t)n, out);
+}
+
+static void print_str(FILE *out, const char *s) {
+  fputs(s, out);
+  fputc('\n', out);
+}
+
+#define R(k) regs[pc[k]]
+
+// what the call at pc runs instead of callee, optimized code of a function
+// with num parameters: a specialization for the kinds of its arguments if
+// there is one. a boxed float's bits are already the f64's, so the arguments
+// carry over as they are
+static const bc_func *specialized(tier *t, const bc_func *callee, const uint32_t *pc,
+                                  const vm_value *regs) {
+  uint32_t floats = 0;
+  for (uint32_t i = 0; i < pc[3] && i < TIER_SPEC_PARAMS; i++)
+    if (callee->specializing >> i & 1 && num_is_float(R(4 + i).n)) floats |= 1u << i;
+  const bc_func *s = floats ? tier_specialize(t, pc[2], floats) : NULL;
+  return s ? s : callee;
+}
+#define IMM(k) ((int64_t)(int32_t)pc[k])
+#define FAIL(msg)                                                                                  \
+  do {                                                                                             \
+    error = msg;                                                                                   \
+    goto fail;                                                                                     \
+  } while (0)
+#define CHECK_NUMS(a, b)                                                                           \
+  if (num_is_ptr(a) || num_is_ptr(b)) FAIL("expected a number")
+
+#if defined(__GNUC__)
+#define CASE(name) L_##name
+#define DISPATCH() __extension__({ goto *labels[*pc]; })
+#else
+#define CASE(name) case BC_##name
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT(words)                                                                                \
+  do {                                                                                             \
+    pc += (words);                                                                                 \
+    DISPATCH();                                                                                    \
+  } while (0)
+#define JUMP_IF(cond, words)                                                                       \
+  do {                                                                                             \
+    pc = (cond) ? code + pc[(words) - 1] : pc + (words);                                           \
+    DISPATCH();                                                                                    \
+  } while (0)
+
+// a binary operation on two registers of one type
+#define BINARY(name, type, field, result, expr)                                                    \
+  CASE(name): {                                                                                    \
+    type a = R(2).field, b = R(3).field;                                                           \
+    R(1).result = (expr);                                                                          \
+    NEXT(4);                                                                                       \
+  }
+
+int run_bytecode(const bc_module *m, int argc, char **argv, FILE *out, FILE *err,
+                 int64_t *status) {
+  if (m->main == UINT32_MAX) {
+    diag_error("error: there is no main function to run\n");
+    return 1;
+  }
+  vm_value *stack = malloc(VM_STACK_REGS * sizeof(vm_value));
+  vm_call *calls = malloc(VM_MAX_DEPTH * sizeof(vm_call));
+  const bc_func **table = malloc((m->nfuncs ? m->nfuncs : 1) * sizeof(bc_func *));
+  uint32_t *counts = calloc(m->ncounters ? m->ncounters : 1, sizeof(uint32_t));
+  if (!stack || !calls || !table || !counts) {
+    free(stack);
+    free(calls);
+    free(table);
+    free(counts);
+    diag_error("error: failed to allocate the interpreter's stacks\n");
+    return 1;
+  }
+
+  const bc_func *funcs = m->funcs, *cur = &funcs[m->main];
+  for (uint32_t i = 0; i < m->nfuncs; i++)
+    table[i] = &funcs[i];
+  tier *t = m->tier;
+  uint32_t threshold = t ? t->threshold : UINT32_MAX;
+  const vm_value *stack_end = stack + VM_STACK_REGS;
+  const char *error = NULL;
+  vm_call *top = calls;
+  vm_value *regs = stack;
+  const uint32_t *code = cur->code, *pc = code;
+  if (cur->nregs > VM_STACK_REGS) FAIL("stack overflow");
+  memcpy(regs, cur->consts, cur->nconsts * sizeof(vm_value));
+  if (cur->nparams > 0) regs[cur->nconsts].i = argc;
+  if (cur->nparams > 1) regs[cur->nconsts + 1].p = argv;
+
+#if defined(__GNUC__)
+#define BC_LABEL(name, operands) [BC_##name] = __extension__ && L_##name,
+  static const void *const labels[] = {BC_OPS(BC_LABEL)};
+#undef BC_LABEL
+  DISPATCH();
+  {
+#else
+dispatch:
+  switch ((bc_op)*pc) {
+#endif
+  CASE(MOV):
+    R(1) = R(2);
+    NEXT(3);
+
+  /* i64 */
+  BINARY(ADD_I, int64_t, i, i, boop_add(a, b))
+  BINARY(SUB_I, int64_t, i, i, boop_sub(a, b))
+  BINARY(MUL_I, int64_t, i, i, boop_mul(a, b))
+  BINARY(POW_I, int64_t, i, i, boop_pow(a, b))
+  BINARY(AND, int64_t, i, i, a & b)
+  BINARY(OR, int64_t, i, i, a | b)
+  BINARY(XOR, int64_t, i, i, a ^ b)
+  BINARY(SHL, int64_t, i, i, (int64_t)((uint64_t)a << (b & 63)))
+  BINARY(SHR, int64_t, i, i, a >> (b & 63))
+  BINARY(EQ_I, int64_t, i, i, a == b)
+  BINARY(NE_I, int64_t, i, i, a != b)
+  BINARY(LT_I, int64_t, i, i, a < b)
+  BINARY(LE_I, int64_t, i, i, a <= b)
+  CASE(ADD_IK):
+    R(1).i = boop_add(R(2).i, IMM(3));
+    NEXT(4);
+  CASE(DIV_I):
+    if (!R(3).i) FAIL("division by zero");
+    R(1).i = boop_div(R(2).i, R(3).i);
+    NEXT(4);
+  CASE(MOD_I):
+    if (!R(3).i) FAIL("division by zero");
+    R(1).i = boop_mod(R(2).i, R(3).i);
+    NEXT(4);
+  CASE(NEG_I):
+    R(1).i = boop_sub(0, R(2).i);
+    NEXT(3);
+  CASE(NOT_I):
+    R(1).i = ~R(2).i;
+    NEXT(3);
+  CASE(NOT_B):
+    R(1).i = !R(2).i;
+    NEXT(3);
+
+  /* f64; comparisons store an i64 */
+  BINARY(ADD_F, double, f, f, a + b)
+  BINARY(SUB_F, double, f, f, a - b)
+  BINARY(MUL_F, double, f, f, a * b)
+  BINARY(DIV_F, double, f, f, a / b)
+  BINARY(MOD_F, double, f, f, boop_fmod(a, b))
+  BINARY(POW_F, double, f, f, boop_fpow(a, b))
+  CASE(NEG_F):
+    R(1).f = -R(2).f;
+    NEXT(3);
+  CASE(EQ_F):
+    R(1).i = R(2).f == R(3).f;
+    NEXT(4);
+  CASE(NE_F):
+    R(1).i = R(2).f != R(3).f;
+    NEXT(4);
+  CASE(LT_F):
+    R(1).i = R(2).f < R(3).f;
+    NEXT(4);
+  CASE(LE_F):
+    R(1).i = R(2).f <= R(3).f;
+    NEXT(4);
+
+  /* num */
+  CASE(ADD_N):
+    CHECK_NUMS(R(2).n, R(3).n);
+    R(1).n = num_add(R(2).n, R(3).n);
+    NEXT(4);
+  CASE(SUB_N):
+    CHECK_NUMS(R(2).n, R(3).n);
+    R(1).n = num_sub(R(2).n, R(3).n);
+    NEXT(4);
+  CASE(MUL_N):
+    CHECK_NUMS(R(2).n, R(3).n);
+    R(1).n = num_mul(R(2).n, R(3).n);
+    NEXT(4);
+  CASE(DIV_N):
+    CHECK_NUMS(R(2).n, R(3).n);
+    if (num_div_by_zero(R(2).n, R(3).n)) FAIL("division by zero");
+    R(1).n = num_div(R(2).n, R(3).n);
+    NEXT(4);
+  CASE(MOD_N):
+    CHECK_NUMS(R(2).n, R(3).n);
+    if (num_div_by_zero(R(2).n, R(3).n)) FAIL("division by zero");
+    R(1).n = num_mod(R(2).n, R(3).n);
+    NEXT(4);
+  CASE(POW_N):
+    CHECK_NUMS(R(2).n, R(3).n);
+    R(1).n = num_pow(R(2).n, R(3).n);
+    NEXT(4);
+  CASE(NEG_N):
+    CHECK_NUMS(R(2).n, R(2).n);
+    R(1).n = num_neg(R(2).n);
+    NEXT(3);
+  CASE(EQ_N):
+    R(1).i = num_equal(R(2).n, R(3).n);
+    NEXT(4);
+  CASE(NE_N):
+    R(1).i = !num_equal(R(2).n, R(3).n);
+    NEXT(4);
+  CASE(LT_N):
+    CHECK_NUMS(R(2).n, R(3).n);
+    R(1).i = num_less(R(2).n, R(3).n);
+    NEXT(4);
+  CASE(LE_N):
+    CHECK_NUMS(R(2).n, R(3).n);
+    R(1).i = num_less(R(2).n, R(3).n) || num_equal(R(2).n, R(3).n);
+    NEXT(4);
+
+  /* conversions */
+  CASE(TRUTHY_I):
+    R(1).i = R(2).i != 0;
+    NEXT(3);
+  CASE(TRUTHY_F):
+    R(1).i = R(2).f != 0.0;
+    NEXT(3);
+  CASE(TRUTHY_N):
+    R(1).i = num_truthy(R(2).n);
+    NEXT(3);
+  CASE(ITOF):
+    R(1).f = (double)R(2).i;
+    NEXT(3);
+  CASE(FTOI):
+    R(1).i = boop_ftoi(R(2).f);
+    NEXT(3);
+  CASE(BOX_I):
+    R(1).n = num_from_int(R(2).i);
+    NEXT(3);
+  CASE(BOX_F):
+    R(1).n = num_from_float(R(2).f);
+    NEXT(3);
+  CASE(BOX_P):
+    R(1).n = num_from_ptr(R(2).p);
+    NEXT(3);
+  CASE(UNBOX_I):
+    CHECK_NUMS(R(2).n, R(2).n);
+    R(1).i = num_to_int(R(2).n);
+    NEXT(3);
+  CASE(UNBOX_F):
+    CHECK_NUMS(R(2).n, R(2).n);
+    R(1).f = num_to_float(R(2).n);
+    NEXT(3);
+  CASE(UNBOX_P):
+    if (!num_is_ptr(R(2).n)) FAIL("expected a string");
+    R(1).p = num_ptr(R(2).n);
+    NEXT(3);
+
+  /* memory */
+  CASE(ADDR):
+    R(1).p = &R(2);
+    NEXT(3);
+  CASE(LOAD):
+    R(1) = *(const vm_value *)R(2).p;
+    NEXT(3);
+  CASE(STORE):
+    *(vm_value *)R(1).p = R(2);
+    NEXT(3);
+
+  /* calls */
+  CASE(CALL): {
+    const bc_func *callee = table[pc[2]];
+    if (callee->specializing) callee = specialized(t, callee, pc, regs);
+    vm_value *next = regs + cur->nregs;
+    if (next + callee->nregs > stack_end || top == calls + VM_MAX_DEPTH) FAIL("stack overflow");
+    memcpy(next, callee->consts, callee->nconsts * sizeof(vm_value));
+    for (uint32_t i = 0; i < pc[3]; i++)
+      next[callee->nconsts + i] = R(4 + i);
+    *top++ = (vm_call){pc + 4 + pc[3], cur, regs, pc[1]};
+    cur = callee;
+    regs = next;
+    code = pc = cur->code;
+    DISPATCH();
+  }
+  CASE(RET): {
+    vm_value v = R(1);
+    if (top == calls) {
+      *status = v.i;
+      goto done;
+    }
+    top--;
+    cur = top->func;
+    code = cur->code;
+    pc = top->pc;
+    regs = top->regs;
+    regs[top->dst] = v;
+    DISPATCH();
+  }
+  CASE(RET_VOID):
+    if (top == calls) {
+      *status = 0;
+      goto done;
+    }
+    top--;
+    cur = top->func;
+    code = cur->code;
+    pc = top->pc;
+    regs = top->regs;
+    DISPATCH();
+  CASE(PRINT_I):
+    print_int(out, R(1).i);
+    NEXT(2);
+  CASE(PRINT_F):
+    print_float(out, R(1).f);
+    NEXT(2);
+  CASE(PRINT_S):
+    print_str(out, R(1).p);
+    NEXT(2);
+  CASE(PRINT_N): {
+    uint64_t v = R(1).n;
+    if (num_is_int(v))
+      print_int(out, num_int(v));
+    else if (num_is_ptr(v))
+      print_str(out, num_ptr(v));
+    else
+      print_float(out, num_float_bits(v));
+    NEXT(2);
+  }
+
+  /* control flow */
+  CASE(JMP):
+    pc = code + pc[1];
+    DISPATCH();
+  CASE(JT):
+    JUMP_IF(R(1).i, 3);
+  CASE(JF):
+    JUMP_IF(!R(1).i, 3);
+  CASE(JEQ_I):
+    JUMP_IF(R(1).i == R(2).i, 4);
+  CASE(JNE_I):
+    JUMP_IF(R(1).i != R(2).i, 4);
+  CASE(JLT_I):
+    JUMP_IF(R(1).i < R(2).i, 4);
+  CASE(JLE_I):
+    JUMP_IF(R(1).i <= R(2).i, 4);
+  CASE(JEQ_IK):
+    JUMP_IF(R(1).i == IMM(2), 4);
+  CASE(JNE_IK):
+    JUMP_IF(R(1).i != IMM(2), 4);
+  CASE(JLT_IK):
+    JUMP_IF(R(1).i < IMM(2), 4);
+  CASE(JLE_IK):
+    JUMP_IF(R(1).i <= IMM(2), 4);
+  CASE(JGT_IK):
+    JUMP_IF(R(1).i > IMM(2), 4);
+  CASE(JGE_IK):
+    JUMP_IF(R(1).i >= IMM(2), 4);
+  CASE(JLT_F):
+    JUMP_IF(R(1).f < R(2).f, 4);
+  CASE(JLE_F):
+    JUMP_IF(R(1).f <= R(2).f, 4);
+  CASE(JNLT_F):
+    JUMP_IF(!(R(1).f < R(2).f), 4);
+  CASE(JNLE_F):
+    JUMP_IF(!(R(1).f <= R(2).f), 4);
+
+  /* tiering; the current call stays in counting code, and later ones don't */
+  CASE(ENTER):
+    if (++counts[pc[1]] == threshold) table[pc[1]] = tier_optimize(t, pc[1]);
+    NEXT(2);
+  CASE(LOOP): {
+    if (++counts[pc[1]] < threshold) NEXT(3);
+    const tier_entry *e = tier_enter_loop(t, (uint32_t)(cur - funcs), pc[2]);
+    if (!e->code) {
+      counts[pc[1]] = 0;
+      NEXT(3);
+    }
+    // the frame becomes the entry's in place; its arguments go through the
+    // registers past both
+    const bc_func *to = e->code;
+    vm_value *args = regs + (cur->nregs > to->nregs ? cur->nregs : to->nregs);
+    if (args + e->nargs > stack_end) FAIL("stack overflow");
+    for (uint32_t i = 0; i < e->nargs; i++)
+      args[i] = regs[e->from[i]];
+    memcpy(regs, to->consts, to->nconsts * sizeof(vm_value));
+    memcpy(regs + to->nconsts, args, e->nargs * sizeof(vm_value));
+    cur = to;
+    code = pc = cur->code;
+    DISPATCH();
+  }
+#if !defined(__GNUC__)
+  default: FAIL("bad bytecode");
+#endif
+  }
+
+fail:
+  fflush(out);
+  fprintf(err, "runtime error: %s\n", error);
+done:
+  free(stack);
+  free(calls);
+  free(table);
+  free(counts);
+  return error != NULL;
+}
@@ -1,6 +1,508 @@
 #include "ir.h"
-#include <stdio.h>
+#include "num.h"
+#include <stdlib.h>
+#include <string.h>
 
-void gen_ir(char *filename, int save_ir, ast_node *root) {
-  printf("%s\n", "hello, world");
+ir_module *create_ir_module(arena *arena) {
+  ir_module *m = arena_calloc(arena, 1, sizeof(ir_module));
+  m->arena = arena;
+  ir_str_vec_init(&m->strings, arena, 16);
+  return m;
+}
+
+ir_func *ir_add_func(ir_module *m, const char *name, ir_type ret, uint32_t nparams,
+                     const ir_type *params) {
+  ir_func *f = arena_calloc(m->arena, 1, sizeof(ir_func));
+  f->id = m->nfuncs++;
+  f->name = arena_strndup(m->arena, name, strlen(name));
+  f->ret = ret;
+  f->module = m;
+  f->nvalues = 1;  // r0 is never used, so 0 can mean "no value" in side tables
+  f->nblocks = 1;
+
+  f->nparams = nparams;
+  f->params = arena_alloc(m->arena, (nparams ? nparams : 1) * sizeof(ir_inst *));
+  for (uint32_t i = 0; i < nparams; i++) {
+    ir_inst *p = ir_new_inst(f, OP_PARAM, params[i], 0);
+    p->imm.index = i;
+    f->params[i] = p;
+  }
+
+  if (m->last)
+    m->last->next = f;
+  else
+    m->first = f;
+  m->last = f;
+  return f;
+}
+
+ir_func *ir_find_func(ir_module *m, const char *name) {
+  for (ir_func *f = m->first; f; f = f->next)
+    if (strcmp(f->name, name) == 0) return f;
+  return NULL;
+}
+
+ir_func *ir_clone_func(const ir_func *f, ir_inst **values, ir_block **blocks) {
+  ir_module *m = f->module;
+  ir_inst **value = values ? values : malloc((f->nvalues ? f->nvalues : 1) * sizeof(ir_inst *));
+  ir_block **block = blocks ? blocks : malloc((f->nblocks ? f->nblocks : 1) * sizeof(ir_block *));
+  ir_func *copy = arena_calloc(m->arena, 1, sizeof(ir_func));
+  *copy = (ir_func){.id = f->id, .name = f->name, .ret = f->ret, .module = m, .nvalues = 1,
+                    .nblocks = 1, .nparams = f->nparams};
+  copy->params = arena_alloc(m->arena, (f->nparams ? f->nparams : 1) * sizeof(ir_inst *));
+  for (uint32_t i = 0; i < f->nparams; i++) {
+    copy->params[i] = ir_new_inst(copy, OP_PARAM, f->params[i]->type, 0);
+    copy->params[i]->imm.index = i;
+    value[f->params[i]->id] = copy->params[i];
+  }
+
+  for (ir_block *b = f->first; b; b = b->next) {
+    block[b->id] = ir_add_block(copy);
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      ir_inst *c = ir_new_inst(copy, inst->op, inst->type, inst->op == OP_PHI ? 0 : inst->nargs);
+      if (inst->op != OP_PHI) c->imm = inst->imm;
+      c->flags = inst->flags;
+      ir_append(block[b->id], c);
+      value[inst->id] = c;
+    }
+  }
+  // operands can refer forward, through phis
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      ir_inst *c = value[inst->id];
+      if (inst->op == OP_PHI) {
+        for (uint32_t i = 0; i < inst->nargs; i++)
+          ir_add_incoming(copy, c, value[inst->args[i]->id], block[inst->imm.incoming[i]->id]);
+        continue;
+      }
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        c->args[i] = value[inst->args[i]->id];
+      if (inst->op == OP_JMP || inst->op == OP_BR) {
+        c->imm.target[0] = block[inst->imm.target[0]->id];
+        if (inst->op == OP_BR) c->imm.target[1] = block[inst->imm.target[1]->id];
+      }
+    }
+
+  if (!values) free(value);
+  if (!blocks) free(block);
+  return copy;
+}
+
+uint32_t ir_add_string(ir_module *m, const char *s, size_t len) {
+  for (size_t i = 0; i < m->strings.size; i++) {
+    const char *t = m->strings.data[i];
+    if (strlen(t) == len && memcmp(t, s, len) == 0) return (uint32_t)i;
+  }
+  ir_str_vec_push(&m->strings, arena_strndup(m->arena, s, len));
+  return (uint32_t)m->strings.size - 1;
+}
+
+ir_block *ir_add_block(ir_func *f) {
+  ir_block *b = arena_calloc(f->module->arena, 1, sizeof(ir_block));
+  b->id = f->nblocks++;
+  b->prev = f->last;
+  if (f->last)
+    f->last->next = b;
+  else
+    f->first = b;
+  f->last = b;
+  return b;
+}
+
+// a new block placed in the layout right before `before`
+ir_block *ir_add_block_before(ir_func *f, ir_block *before) {
+  ir_block *b = arena_calloc(f->module->arena, 1, sizeof(ir_block));
+  b->id = f->nblocks++;
+  b->next = before;
+  b->prev = before->prev;
+  if (before->prev)
+    before->prev->next = b;
+  else
+    f->first = b;
+  before->prev = b;
+  return b;
+}
+
+void ir_remove_block(ir_func *f, ir_block *b) {
+  if (b->prev)
+    b->prev->next = b->next;
+  else
+    f->first = b->next;
+  if (b->next)
+    b->next->prev = b->prev;
+  else
+    f->last = b->prev;
+  b->prev = b->next = NULL;
+}
+
+ir_inst *ir_terminator(const ir_block *b) {
+  return b->last && ir_is_terminator(b->last->op) ? b->last : NULL;
+}
+
+int ir_succs(const ir_block *b, ir_block *out[2]) {
+  ir_inst *t = ir_terminator(b);
+  if (!t || t->op == OP_RET) return 0;
+  out[0] = t->imm.target[0];
+  if (t->op == OP_JMP) return 1;
+  out[1] = t->imm.target[1];
+  return out[0] == out[1] ? 1 : 2;
+}
+
+// two passes: count, then fill, so each block gets one exact-size array
+void ir_compute_preds(ir_func *f) {
+  for (ir_block *b = f->first; b; b = b->next)
+    b->npreds = 0;
+
+  ir_block *succ[2];
+  for (ir_block *b = f->first; b; b = b->next) {
+    int n = ir_succs(b, succ);
+    for (int i = 0; i < n; i++)
+      succ[i]->npreds++;
+  }
+
+  for (ir_block *b = f->first; b; b = b->next) {
+    b->preds = arena_alloc(f->module->arena, (b->npreds ? b->npreds : 1) * sizeof(ir_block *));
+    b->npreds = 0;
+  }
+
+  for (ir_block *b = f->first; b; b = b->next) {
+    int n = ir_succs(b, succ);
+    for (int i = 0; i < n; i++)
+      succ[i]->preds[succ[i]->npreds++] = b;
+  }
+}
+
+ir_inst *ir_new_inst(ir_func *f, ir_op op, ir_type type, uint32_t nargs) {
+  ir_inst *inst = arena_calloc(f->module->arena, 1, sizeof(ir_inst));
+  inst->op = op;
+  inst->type = type;
+  inst->id = f->nvalues++;
+  inst->nargs = nargs;
+  inst->cap = nargs;
+  if (nargs) inst->args = arena_calloc(f->module->arena, nargs, sizeof(ir_inst *));
+  return inst;
+}
+
+void ir_append(ir_block *b, ir_inst *inst) {
+  inst->block = b;
+  inst->prev = b->last;
+  inst->next = NULL;
+  if (b->last)
+    b->last->next = inst;
+  else
+    b->first = inst;
+  b->last = inst;
+}
+
+void ir_insert_before(ir_inst *before, ir_inst *inst) {
+  ir_block *b = before->block;
+  inst->block = b;
+  inst->next = before;
+  inst->prev = before->prev;
+  if (before->prev)
+    before->prev->next = inst;
+  else
+    b->first = inst;
+  before->prev = inst;
+}
+
+void ir_insert_after(ir_inst *after, ir_inst *inst) {
+  if (after->next) {
+    ir_insert_before(after->next, inst);
+  } else {
+    ir_append(after->block, inst);
+  }
+}
+
+void ir_remove(ir_inst *inst) {
+  ir_block *b = inst->block;
+  if (!b) return;
+  if (inst->prev)
+    inst->prev->next = inst->next;
+  else
+    b->first = inst->next;
+  if (inst->next)
+    inst->next->prev = inst->prev;
+  else
+    b->last = inst->prev;
+  inst->prev = inst->next = NULL;
+  inst->block = NULL;
+}
+
+void ir_add_incoming(ir_func *f, ir_inst *phi, ir_inst *value, ir_block *from) {
+  if (phi->nargs == phi->cap) {
+    uint32_t cap = phi->cap ? phi->cap * 2 : 2;
+    ir_inst **args = arena_alloc(f->module->arena, cap * sizeof(ir_inst *));
+    ir_block **incoming = arena_alloc(f->module->arena, cap * sizeof(ir_block *));
+    if (phi->nargs) {
+      memcpy(args, phi->args, phi->nargs * sizeof(ir_inst *));
+      memcpy(incoming, phi->imm.incoming, phi->nargs * sizeof(ir_block *));
+    }
+    phi->args = args;
+    phi->imm.incoming = incoming;
+    phi->cap = cap;
+  }
+  phi->args[phi->nargs] = value;
+  phi->imm.incoming[phi->nargs] = from;
+  phi->nargs++;
+}
+
+// compacts value and block ids into [1, n) in layout order
+void ir_renumber(ir_func *f) {
+  uint32_t value = 1, block = 1;
+  for (uint32_t i = 0; i < f->nparams; i++)
+    f->params[i]->id = value++;
+  for (ir_block *b = f->first; b; b = b->next) {
+    b->id = block++;
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      inst->id = value++;
+  }
+  f->nvalues = value;
+  f->nblocks = block;
+}
+
+ir_inst *ir_const_int(ir_func *f, ir_block *b, ir_type type, int64_t value) {
+  ir_inst *inst = ir_new_inst(f, OP_CONST, type, 0);
+  inst->imm.i = value;
+  ir_append(b, inst);
+  return inst;
+}
+
+ir_inst *ir_const_float(ir_func *f, ir_block *b, double value) {
+  ir_inst *inst = ir_new_inst(f, OP_CONST, IR_F64, 0);
+  inst->imm.f = value;
+  ir_append(b, inst);
+  return inst;
+}
+
+ir_inst *ir_const(ir_func *f, ir_block *b, ir_type type, ir_value value) {
+  ir_inst *inst = ir_new_inst(f, OP_CONST, type, 0);
+  ir_make_const(inst, value);
+  ir_append(b, inst);
+  return inst;
+}
+
+ir_value ir_const_value(const ir_inst *c) {
+  ir_value v;
+  if (c->type == IR_F64)
+    v.f = c->imm.f;
+  else
+    v.i = c->imm.i;
+  return v;
+}
+
+void ir_make_const(ir_inst *inst, ir_value value) {
+  inst->op = OP_CONST;
+  inst->nargs = 0;
+  if (inst->type == IR_F64)
+    inst->imm.f = value.f;
+  else
+    inst->imm.i = value.i;
+}
+
+// a num that can't hold a pointer: constants, boxed numbers and the results
+// of num arithmetic, which either produce a number or fail themselves
+static int is_number(const ir_inst *v) {
+  if (v->type != IR_NUM) return v->type != IR_PTR;
+  if (v->op == OP_CONV) return v->args[0]->type != IR_PTR;
+  return v->op == OP_CONST || (v->op >= OP_ADD && v->op <= OP_NEG);
+}
+
+static int nonzero_divisor(const ir_inst *v) {
+  if (v->op != OP_CONST) return 0;
+  if (v->type == IR_NUM) return !num_is_int((uint64_t)v->imm.i) || num_int((uint64_t)v->imm.i);
+  return v->type == IR_F64 || v->imm.i != 0;
+}
+
+int ir_may_fail(const ir_inst *inst) {
+  switch (inst->op) {
+  case OP_DIV:
+  case OP_MOD:
+    if (inst->type == IR_F64) return 0;
+    if (!nonzero_divisor(inst->args[1])) return 1;
+    return inst->type == IR_NUM && !is_number(inst->args[0]);
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_POW:
+  case OP_NEG:
+  case OP_LT:
+  case OP_LE:
+  case OP_GT:
+  case OP_GE:
+    for (uint32_t i = 0; i < inst->nargs; i++)
+      if (inst->args[i]->type == IR_NUM && !is_number(inst->args[i])) return 1;
+    return 0;
+  case OP_CONV:
+    if (inst->args[0]->type != IR_NUM || inst->type == IR_BOOL || inst->type == IR_NUM) return 0;
+    return inst->type == IR_PTR || !is_number(inst->args[0]);
+  case OP_CALL: return 1;
+  default: return 0;
+  }
+}
+
+// one- and two-operand instructions; pass NULL for c to get one operand
+ir_inst *ir_emit(ir_func *f, ir_block *b, ir_op op, ir_type type, ir_inst *a, ir_inst *c) {
+  ir_inst *inst = ir_new_inst(f, op, type, c ? 2 : a ? 1 : 0);
+  if (a) inst->args[0] = a;
+  if (c) inst->args[1] = c;
+  ir_append(b, inst);
+  return inst;
+}
+
+ir_inst *ir_emit_jmp(ir_func *f, ir_block *b, ir_block *target) {
+  ir_inst *inst = ir_new_inst(f, OP_JMP, IR_VOID, 0);
+  inst->imm.target[0] = target;
+  ir_append(b, inst);
+  return inst;
+}
+
+ir_inst *ir_emit_br(ir_func *f, ir_block *b, ir_inst *cond, ir_block *then, ir_block *other) {
+  ir_inst *inst = ir_new_inst(f, OP_BR, IR_VOID, 1);
+  inst->args[0] = cond;
+  inst->imm.target[0] = then;
+  inst->imm.target[1] = other;
+  ir_append(b, inst);
+  return inst;
+}
+
+const char *ir_type_str(ir_type t) {
+  switch (t) {
+  case IR_VOID: return "void";
+  case IR_BOOL: return "bool";
+  case IR_I64: return "i64";
+  case IR_F64: return "f64";
+  case IR_PTR: return "ptr";
+  case IR_NUM: return "num";
+  default: return "unknown_type";
+  }
+}
+
+const char *ir_op_str(ir_op op) {
+  switch (op) {
+  case OP_PARAM: return "param";
+  case OP_CONST: return "const";
+  case OP_STR: return "str";
+  case OP_ADD: return "add";
+  case OP_SUB: return "sub";
+  case OP_MUL: return "mul";
+  case OP_DIV: return "div";
+  case OP_MOD: return "mod";
+  case OP_POW: return "pow";
+  case OP_NEG: return "neg";
+  case OP_AND: return "and";
+  case OP_OR: return "or";
+  case OP_XOR: return "xor";
+  case OP_NOT: return "not";
+  case OP_SHL: return "shl";
+  case OP_SHR: return "shr";
+  case OP_EQ: return "eq";
+  case OP_NEQ: return "neq";
+  case OP_LT: return "lt";
+  case OP_LE: return "le";
+  case OP_GT: return "gt";
+  case OP_GE: return "ge";
+  case OP_CONV: return "conv";
+  case OP_ALLOCA: return "alloca";
+  case OP_LOAD: return "load";
+  case OP_STORE: return "store";
+  case OP_CALL: return "call";
+  case OP_PRINT: return "print";
+  case OP_PHI: return "phi";
+  case OP_JMP: return "jmp";
+  case OP_BR: return "br";
+  case OP_RET: return "ret";
+  default: return "unknown_op";
+  }
+}
+
+// shortest form that reads back as the same double, and always looks like a float
+static void print_float(FILE *out, double value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.15g", value);
+  if (strtod(buf, NULL) != value) snprintf(buf, sizeof(buf), "%.17g", value);
+  fputs(buf, out);
+  if (!strpbrk(buf, ".eni")) fputs(".0", out);
+}
+
+static void print_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    switch (*s) {
+    case '\n': fputs("\\n", out); break;
+    case '\t': fputs("\\t", out); break;
+    case '"': fputs("\\\"", out); break;
+    case '\\': fputs("\\\\", out); break;
+    default: fputc(*s, out);
+    }
+  }
+  fputc('"', out);
+}
+
+static void print_args(FILE *out, const ir_inst *inst, uint32_t from) {
+  for (uint32_t i = from; i < inst->nargs; i++)
+    fprintf(out, "%sr%u", i > from ? ", " : "", inst->args[i]->id);
+}
+
+static void print_inst(FILE *out, const ir_func *f, const ir_inst *inst) {
+  fputs("    ", out);
+  if (inst->type != IR_VOID) fprintf(out, "r%u: %s = ", inst->id, ir_type_str(inst->type));
+
+  switch (inst->op) {
+  case OP_CONST: {
+    uint64_t bits = (uint64_t)inst->imm.i;
+    if (inst->type == IR_F64)
+      print_float(out, inst->imm.f);
+    else if (inst->type != IR_NUM || num_is_int(bits))
+      fprintf(out, "%lld", (long long)(inst->type == IR_NUM ? num_int(bits) : inst->imm.i));
+    else
+      print_float(out, num_float_bits(bits));
+    break;
+  }
+  case OP_STR: print_string(out, f->module->strings.data[inst->imm.index]); break;
+  case OP_ALLOCA: fprintf(out, "alloca %s", ir_type_str(inst->imm.slot)); break;
+  case OP_CALL:
+    fprintf(out, "call %s", inst->imm.callee->name);
+    if (inst->nargs) fputs(", ", out);
+    print_args(out, inst, 0);
+    break;
+  case OP_PHI:
+    fputs("phi(", out);
+    for (uint32_t i = 0; i < inst->nargs; i++)
+      fprintf(out, "%sr%u, L%u", i ? ", " : "", inst->args[i]->id, inst->imm.incoming[i]->id);
+    fputc(')', out);
+    break;
+  case OP_JMP: fprintf(out, "jmp L%u", inst->imm.target[0]->id); break;
+  case OP_BR:
+    fprintf(out, "br r%u, L%u, L%u", inst->args[0]->id, inst->imm.target[0]->id,
+            inst->imm.target[1]->id);
+    break;
+  default:
+    fputs(ir_op_str(inst->op), out);
+    if (inst->nargs) fputc(' ', out);
+    print_args(out, inst, 0);
+  }
+  fputc('\n', out);
+}
+
+void print_ir_func(FILE *out, const ir_func *f) {
+  fprintf(out, "function %s(", f->name);
+  for (uint32_t i = 0; i < f->nparams; i++)
+    fprintf(out, "%sr%u: %s", i ? ", " : "", f->params[i]->id, ir_type_str(f->params[i]->type));
+  fprintf(out, ") -> %s\n", ir_type_str(f->ret));
+
+  for (const ir_block *b = f->first; b; b = b->next) {
+    if (b != f->first) fputc('\n', out);
+    fprintf(out, "L%u:\n", b->id);
+    for (const ir_inst *inst = b->first; inst; inst = inst->next)
+      print_inst(out, f, inst);
+  }
+  fputs("end function\n", out);
+}
+
+void print_ir(FILE *out, const ir_module *m) {
+  for (const ir_func *f = m->first; f; f = f->next) {
+    print_ir_func(out, f);
+    if (f->next) fputc('\n', out);
+  }
 }
@@ -1,4 +1,205 @@
-#include "ast.h"
-#include <llvm-c/Core.h>
+#pragma once
+#include "arena.h"
+#include "vector.h"
+#include <stdint.h>
+#include <stdio.h>
 
-void gen_ir(char *filename, int save_ir, ast_node *root);
+// BoopIR: typed SSA with explicit basic blocks, see docs/ir.md. everything
+// is allocated from the module's arena. values (instructions and parameters)
+// and blocks get dense per-function ids, so passes can keep side tables in
+// plain arrays indexed by id.
+
+typedef enum {
+  IR_VOID,
+  IR_BOOL,
+  IR_I64,
+  IR_F64,
+  IR_PTR,  // string constants
+  IR_NUM,  // a dynamically typed value: NaN-boxed int, float or pointer
+  IR_TYPE_COUNT
+} ir_type;
+
+typedef enum {
+  OP_PARAM,  // function parameter `index`, lives outside the block lists
+  OP_CONST,  // imm.i for bool/i64, imm.i holding boxed bits for num, imm.f for f64
+  OP_STR,    // address of module string `index`
+
+  // arithmetic, both operands and the result share one type
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,  // truncating on i64
+  OP_MOD,
+  OP_POW,
+  OP_NEG,
+
+  // bitwise on i64, logical on bool
+  OP_AND,
+  OP_OR,
+  OP_XOR,
+  OP_NOT,
+  OP_SHL,
+  OP_SHR,
+
+  // comparisons produce bool
+  OP_EQ,
+  OP_NEQ,
+  OP_LT,
+  OP_LE,
+  OP_GT,
+  OP_GE,
+
+  OP_CONV,  // converts args[0] to the instruction's type; to bool means "is non-zero"
+
+  OP_ALLOCA,  // a stack slot holding one `slot` value
+  OP_LOAD,
+  OP_STORE,  // args: address, value
+
+  OP_CALL,
+  OP_PRINT,
+  OP_PHI,  // args[i] flows in from incoming[i]
+
+  // terminators
+  OP_JMP,  // target[0]
+  OP_BR,   // args[0] ? target[0] : target[1]
+  OP_RET,
+
+  OP_COUNT
+} ir_op;
+
+// the value of a constant: `i` for bool, i64 and num (NaN-boxed, see num.h),
+// `f` for f64. pointers are never constants.
+typedef union {
+  int64_t i;
+  double f;
+} ir_value;
+
+typedef struct ir_inst ir_inst;
+typedef struct ir_block ir_block;
+typedef struct ir_func ir_func;
+
+struct ir_inst {
+  uint8_t op;    // ir_op
+  uint8_t type;  // ir_type of the result, IR_VOID if there is none
+  uint16_t flags;  // on a call: how many levels of inlining it was copied through
+  uint32_t id;
+  uint32_t nargs;
+  uint32_t cap;  // allocated length of args
+  ir_inst **args;
+  ir_block *block;
+  ir_inst *prev, *next;
+
+  union {
+    int64_t i;
+    double f;
+    uint32_t index;
+    ir_type slot;
+    ir_func *callee;
+    ir_block *target[2];
+    ir_block **incoming;
+  } imm;
+};
+
+struct ir_block {
+  uint32_t id;
+  uint32_t npreds;
+  ir_inst *first, *last;
+  ir_block *prev, *next;
+  ir_block **preds;  // filled in by ir_compute_preds()
+};
+
+struct ir_func {
+  uint32_t id;  // position in the module, below nfuncs
+  const char *name;
+  ir_type ret;
+  uint32_t nparams;
+  ir_inst **params;
+  ir_block *first, *last;
+  uint32_t nvalues;  // ids handed out so far; every id is below this
+  uint32_t nblocks;
+  ir_func *next;
+  struct ir_module *module;
+};
+
+VEC_DECL(ir_str_vec, const char *)
+
+typedef struct ir_module {
+  arena *arena;
+  ir_func *first, *last;
+  uint32_t nfuncs;
+  ir_str_vec strings;
+} ir_module;
+
+// module and functions
+ir_module *create_ir_module(arena *arena);
+ir_func *ir_add_func(ir_module *m, const char *name, ir_type ret, uint32_t nparams,
+                     const ir_type *params);
+ir_func *ir_find_func(ir_module *m, const char *name);
+// a copy of f with its id and module that isn't on the module's list, so it
+// can be optimized or run on its own. if not NULL, `values` and `blocks` (f's
+// nvalues and nblocks long) map each of f's values and blocks to its copy
+ir_func *ir_clone_func(const ir_func *f, ir_inst **values, ir_block **blocks);
+uint32_t ir_add_string(ir_module *m, const char *s, size_t len);
+
+// blocks
+ir_block *ir_add_block(ir_func *f);
+ir_block *ir_add_block_before(ir_func *f, ir_block *before);
+void ir_remove_block(ir_func *f, ir_block *b);
+void ir_compute_preds(ir_func *f);
+int ir_succs(const ir_block *b, ir_block *out[2]);
+
+// instructions
+ir_inst *ir_new_inst(ir_func *f, ir_op op, ir_type type, uint32_t nargs);
+void ir_append(ir_block *b, ir_inst *inst);
+void ir_insert_before(ir_inst *before, ir_inst *inst);
+void ir_insert_after(ir_inst *after, ir_inst *inst);
+void ir_remove(ir_inst *inst);
+void ir_add_incoming(ir_func *f, ir_inst *phi, ir_inst *value, ir_block *from);
+ir_inst *ir_terminator(const ir_block *b);
+void ir_renumber(ir_func *f);
+
+// constants
+ir_value ir_const_value(const ir_inst *c);
+void ir_make_const(ir_inst *inst, ir_value value);  // turns inst into a constant in place
+static inline int ir_is_const(const ir_inst *inst, int64_t i) {
+  return inst->op == OP_CONST && inst->type != IR_F64 && inst->type != IR_NUM && inst->imm.i == i;
+}
+
+// building at the end of a block
+ir_inst *ir_const_int(ir_func *f, ir_block *b, ir_type type, int64_t value);
+ir_inst *ir_const_float(ir_func *f, ir_block *b, double value);
+ir_inst *ir_const(ir_func *f, ir_block *b, ir_type type, ir_value value);
+ir_inst *ir_emit(ir_func *f, ir_block *b, ir_op op, ir_type type, ir_inst *a, ir_inst *c);
+ir_inst *ir_emit_jmp(ir_func *f, ir_block *b, ir_block *target);
+ir_inst *ir_emit_br(ir_func *f, ir_block *b, ir_inst *cond, ir_block *then, ir_block *other);
+
+static inline int ir_is_terminator(ir_op op) {
+  return op == OP_JMP || op == OP_BR || op == OP_RET;
+}
+
+static inline int ir_is_commutative(ir_op op) {
+  return op == OP_ADD || op == OP_MUL || op == OP_AND || op == OP_OR || op == OP_XOR ||
+         op == OP_EQ || op == OP_NEQ;
+}
+
+// arithmetic, comparisons and conversions: the result depends on nothing but
+// the operands. integer div/mod and conversions from num can still fail at
+// run time, so being pure doesn't make them safe to speculate
+static inline int ir_is_pure(ir_op op) {
+  return op >= OP_ADD && op <= OP_CONV;
+}
+
+// instructions that do something besides producing their value
+static inline int ir_has_side_effects(ir_op op) {
+  return op == OP_STORE || op == OP_CALL || op == OP_PRINT || ir_is_terminator(op);
+}
+
+// whether running inst can stop the program with a runtime error: integer
+// division by zero, num arithmetic or ordering on a pointer, unboxing the
+// wrong kind of num. such an instruction has to stay even if nothing uses it
+int ir_may_fail(const ir_inst *inst);
+
+const char *ir_type_str(ir_type t);
+const char *ir_op_str(ir_op op);
+void print_ir_func(FILE *out, const ir_func *f);
+void print_ir(FILE *out, const ir_module *m);
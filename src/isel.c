@@ -0,0 +1,622 @@
+#include "x86.h"
+
+// instruction selection. every ir value gets a virtual register when it is
+// defined; constants, strings and allocas get none and are rematerialized
+// wherever they are used, as an immediate if the instruction takes one.
+// phis become copies at the end of each predecessor, through a block of
+// their own on a critical edge, sequenced so a cycle goes through one
+// temporary. a comparison whose only use is the branch right after it turns
+// into cmp + jcc. anything that can fail, num arithmetic and printing call
+// the runtime; everything else is inline.
+
+static const uint32_t gpr_args[] = {RDI, RSI, RDX, RCX, R8, R9};
+#define NGPR_ARGS 6
+#define NXMM_ARGS 8
+
+typedef struct {
+  x86_module *m;
+  x86_func *mf;
+  ir_func *f;
+  arena *arena;
+  uint32_t *vreg;   // value id -> virtual register, 0 until one is needed
+  uint32_t *uses;   // value id -> operand uses
+  uint32_t *slot;   // alloca id -> stack slot
+  uint32_t *block;  // ir block id -> machine block
+  uint32_t cur;     // machine block being filled
+} selector;
+
+static x86_class class_of(ir_type t) {
+  return t == IR_F64 ? X86_XMM : X86_GPR;
+}
+
+static void emit_cc(selector *s, x86_op op, x86_cc cc, x86_operand a, x86_operand b) {
+  x86_inst inst = {.op = op, .cc = cc, .a = {a, b}};
+  x86_inst_vec_push(&s->mf->blocks.data[s->cur].insts, inst);
+}
+
+static void emit(selector *s, x86_op op, x86_operand a, x86_operand b) {
+  emit_cc(s, op, 0, a, b);
+}
+
+static const x86_operand none = {0};
+
+static uint32_t new_block(selector *s) {
+  x86_block b;
+  x86_inst_vec_init(&b.insts, s->m->arena, 8);
+  x86_block_vec_push(&s->mf->blocks, b);
+  return (uint32_t)s->mf->blocks.size - 1;
+}
+
+static uint32_t value_reg(selector *s, const ir_inst *v) {
+  if (!s->vreg[v->id]) s->vreg[v->id] = x86_new_vreg(s->mf, class_of(v->type));
+  return s->vreg[v->id];
+}
+
+static int is_remat(const ir_inst *v) {
+  return v->op == OP_CONST || v->op == OP_STR || v->op == OP_ALLOCA;
+}
+
+// computes a constant, string or alloca address into dst
+static void materialize(selector *s, uint32_t dst, const ir_inst *v) {
+  if (v->op == OP_STR)
+    emit(s, X_LEA, x86_reg_op(dst), x86_sym_op(x86_string_sym(s->m, v->imm.index)));
+  else if (v->op == OP_ALLOCA)
+    emit(s, X_LEA, x86_reg_op(dst), x86_slot(s->slot[v->id]));
+  else if (v->type != IR_F64)
+    emit(s, X_MOV, x86_reg_op(dst), x86_imm(v->imm.i));
+  else if (ir_const_value(v).i == 0)
+    emit(s, X_XORPD, x86_reg_op(dst), x86_reg_op(dst));
+  else
+    emit(s, X_MOV, x86_reg_op(dst), x86_sym_op(x86_float_sym(s->m, (uint64_t)v->imm.i)));
+}
+
+// v in a register
+static x86_operand reg(selector *s, const ir_inst *v) {
+  if (!is_remat(v)) return x86_reg_op(value_reg(s, v));
+  uint32_t r = x86_new_vreg(s->mf, class_of(v->type));
+  materialize(s, r, v);
+  return x86_reg_op(r);
+}
+
+// v as an immediate if it fits in one, else in a register
+static x86_operand operand(selector *s, const ir_inst *v) {
+  if (v->op == OP_CONST && v->type != IR_F64 && x86_fits_imm32(v->imm.i)) return x86_imm(v->imm.i);
+  return reg(s, v);
+}
+
+// a float straight from the constant pool, else in a register
+static x86_operand float_operand(selector *s, const ir_inst *v) {
+  if (v->op == OP_CONST) return x86_sym_op(x86_float_sym(s->m, (uint64_t)v->imm.i));
+  return reg(s, v);
+}
+
+static void move_to(selector *s, uint32_t dst, const ir_inst *v) {
+  if (is_remat(v))
+    materialize(s, dst, v);
+  else
+    emit(s, X_MOV, x86_reg_op(dst), x86_reg_op(value_reg(s, v)));
+}
+
+/* calls */
+
+// passes args the system v way, integers and pointers in rdi, rsi, rdx, rcx,
+// r8, r9 and floats in xmm0-7, the rest on the stack, then calls sym
+static void emit_call(selector *s, uint32_t sym, ir_inst *const *args, uint32_t nargs) {
+  uint32_t ngpr = 0, nxmm = 0, nstack = 0;
+  for (uint32_t i = 0; i < nargs; i++) {
+    int xmm = class_of(args[i]->type) == X86_XMM;
+    if (xmm ? nxmm++ >= NXMM_ARGS : ngpr++ >= NGPR_ARGS) nstack++;
+  }
+  // the stack stays 16-byte aligned at the call
+  if (nstack & 1) emit(s, X_SUB, x86_reg_op(RSP), x86_imm(8));
+  ngpr = nxmm = 0;
+  // the argument register of each argument, or rax (never one) for the stack
+  uint32_t *place = arena_alloc(s->arena, (nargs ? nargs : 1) * sizeof(uint32_t));
+  for (uint32_t i = 0; i < nargs; i++) {
+    if (class_of(args[i]->type) == X86_XMM)
+      place[i] = nxmm < NXMM_ARGS ? XMM0 + nxmm++ : RAX;
+    else
+      place[i] = ngpr < NGPR_ARGS ? gpr_args[ngpr++] : RAX;
+  }
+  for (uint32_t i = nargs; i-- > 0;) {
+    if (place[i]) continue;
+    if (class_of(args[i]->type) == X86_XMM) {
+      emit(s, X_SUB, x86_reg_op(RSP), x86_imm(8));
+      emit(s, X_MOV, x86_mem(RSP, 0), reg(s, args[i]));
+    } else {
+      emit(s, X_PUSH, operand(s, args[i]), none);
+    }
+  }
+  for (uint32_t i = 0; i < nargs; i++)
+    if (place[i]) move_to(s, place[i], args[i]);
+  x86_inst call = {.op = X_CALL, .gpr_args = (uint8_t)ngpr, .xmm_args = (uint8_t)nxmm};
+  call.a[0] = x86_sym_op(sym);
+  x86_inst_vec_push(&s->mf->blocks.data[s->cur].insts, call);
+  if (nstack) emit(s, X_ADD, x86_reg_op(RSP), x86_imm(8 * (nstack + (nstack & 1))));
+}
+
+// calls the runtime and copies the result, if any, to inst's register
+static void call_runtime(selector *s, x86_runtime rt, const ir_inst *inst, ir_inst *a,
+                         ir_inst *b) {
+  ir_inst *args[2] = {a, b};
+  emit_call(s, x86_runtime_sym(s->m, rt), args, b ? 2 : a ? 1 : 0);
+  if (inst && inst->type != IR_VOID)
+    emit(s, X_MOV, x86_reg_op(value_reg(s, inst)),
+         x86_reg_op(class_of(inst->type) == X86_XMM ? XMM0 : RAX));
+}
+
+/* comparisons */
+
+static x86_cc int_cc(ir_op op) {
+  switch (op) {
+  case OP_EQ: return CC_E;
+  case OP_NEQ: return CC_NE;
+  case OP_LT: return CC_L;
+  case OP_LE: return CC_LE;
+  case OP_GT: return CC_G;
+  default: return CC_GE;
+  }
+}
+
+// the same comparison with the operands swapped
+static x86_cc mirror(x86_cc cc) {
+  switch (cc) {
+  case CC_L: return CC_G;
+  case CC_LE: return CC_GE;
+  case CC_G: return CC_L;
+  case CC_GE: return CC_LE;
+  default: return cc;
+  }
+}
+
+// sets the flags for a comparison on integers, bools, pointers or floats and
+// returns the condition that holds when it is true. for floats that is `a`
+// or `ae`, which unordered operands fail, with `lt` and `le` swapped into
+// `gt` and `ge`; float `eq` and `neq` still need the parity flag
+static x86_cc emit_compare(selector *s, const ir_inst *cmp) {
+  ir_inst *a = cmp->args[0], *b = cmp->args[1];
+  if (a->type == IR_F64) {
+    int swap = cmp->op == OP_LT || cmp->op == OP_LE;
+    x86_operand l = reg(s, swap ? b : a), r = float_operand(s, swap ? a : b);
+    emit(s, X_UCOMISD, l, r);
+    switch (cmp->op) {
+    case OP_EQ: return CC_E;
+    case OP_NEQ: return CC_NE;
+    case OP_LT:
+    case OP_GT: return CC_A;
+    default: return CC_AE;
+    }
+  }
+  x86_cc cc = int_cc(cmp->op);
+  if (a->op == OP_CONST && b->op != OP_CONST) {
+    ir_inst *t = a;
+    a = b;
+    b = t;
+    cc = mirror(cc);
+  }
+  x86_operand l = reg(s, a);
+  emit(s, X_CMP, l, operand(s, b));
+  return cc;
+}
+
+static int fusable(const selector *s, const ir_inst *cmp, const ir_inst *br) {
+  if (cmp->op < OP_EQ || cmp->op > OP_GE || cmp->block != br->block || s->uses[cmp->id] != 1)
+    return 0;
+  ir_type t = cmp->args[0]->type;
+  return t != IR_NUM && !(t == IR_F64 && (cmp->op == OP_EQ || cmp->op == OP_NEQ));
+}
+
+// d = the comparison as a bool
+static void select_compare(selector *s, const ir_inst *inst) {
+  uint32_t d = value_reg(s, inst);
+  ir_inst *a = inst->args[0], *b = inst->args[1];
+  if (a->type == IR_NUM) {
+    switch (inst->op) {
+    case OP_EQ:
+    case OP_NEQ: call_runtime(s, RT_NUM_EQ, inst, a, b); break;
+    case OP_LT: call_runtime(s, RT_NUM_LT, inst, a, b); break;
+    case OP_LE: call_runtime(s, RT_NUM_LE, inst, a, b); break;
+    case OP_GT: call_runtime(s, RT_NUM_LT, inst, b, a); break;
+    default: call_runtime(s, RT_NUM_LE, inst, b, a); break;
+    }
+    if (inst->op == OP_NEQ) emit(s, X_XOR, x86_reg_op(d), x86_imm(1));
+    return;
+  }
+  x86_cc cc = emit_compare(s, inst);
+  emit_cc(s, X_SETCC, cc, x86_reg_op(d), none);
+  if (a->type == IR_F64 && (inst->op == OP_EQ || inst->op == OP_NEQ)) {
+    // unordered sets the parity flag: never equal, always not equal
+    uint32_t t = x86_new_vreg(s->mf, X86_GPR);
+    emit_cc(s, X_SETCC, inst->op == OP_EQ ? CC_NP : CC_P, x86_reg_op(t), none);
+    emit(s, inst->op == OP_EQ ? X_AND : X_OR, x86_reg_op(d), x86_reg_op(t));
+  }
+  emit(s, X_MOVZB, x86_reg_op(d), x86_reg_op(d));
+}
+
+/* arithmetic */
+
+static x86_op int_op(ir_op op) {
+  switch (op) {
+  case OP_ADD: return X_ADD;
+  case OP_SUB: return X_SUB;
+  case OP_MUL: return X_IMUL;
+  case OP_AND: return X_AND;
+  case OP_OR: return X_OR;
+  case OP_XOR: return X_XOR;
+  case OP_SHL: return X_SHL;
+  default: return X_SAR;
+  }
+}
+
+static void select_int(selector *s, const ir_inst *inst) {
+  uint32_t d = value_reg(s, inst);
+  ir_inst *a = inst->args[0], *b = inst->nargs > 1 ? inst->args[1] : NULL;
+  switch (inst->op) {
+  case OP_DIV:
+  case OP_MOD:
+    // only a constant divisor other than 0 and -1 is safe for idiv
+    if (b->op == OP_CONST && b->imm.i != 0 && b->imm.i != -1) {
+      x86_operand divisor = reg(s, b);
+      move_to(s, RAX, a);
+      emit(s, X_CQO, none, none);
+      emit(s, X_IDIV, divisor, none);
+      emit(s, X_MOV, x86_reg_op(d), x86_reg_op(inst->op == OP_DIV ? RAX : RDX));
+    } else {
+      call_runtime(s, inst->op == OP_DIV ? RT_DIV_I64 : RT_MOD_I64, inst, a, b);
+    }
+    return;
+  case OP_POW: call_runtime(s, RT_POW_I64, inst, a, b); return;
+  case OP_NEG:
+    move_to(s, d, a);
+    emit(s, X_NEG, x86_reg_op(d), none);
+    return;
+  case OP_NOT:
+    move_to(s, d, a);
+    if (inst->type == IR_BOOL)
+      emit(s, X_XOR, x86_reg_op(d), x86_imm(1));
+    else
+      emit(s, X_NOT, x86_reg_op(d), none);
+    return;
+  case OP_SHL:
+  case OP_SHR:
+    if (b->op == OP_CONST) {
+      move_to(s, d, a);
+      emit(s, int_op(inst->op), x86_reg_op(d), x86_imm(b->imm.i & 63));
+    } else {
+      move_to(s, RCX, b);
+      move_to(s, d, a);
+      emit(s, int_op(inst->op), x86_reg_op(d), x86_reg_op(RCX));
+    }
+    return;
+  default: break;
+  }
+  if (ir_is_commutative(inst->op) && a->op == OP_CONST && b->op != OP_CONST) {
+    ir_inst *t = a;
+    a = b;
+    b = t;
+  }
+  move_to(s, d, a);
+  emit(s, int_op(inst->op), x86_reg_op(d), operand(s, b));
+}
+
+static void select_float(selector *s, const ir_inst *inst) {
+  uint32_t d = value_reg(s, inst);
+  ir_inst *a = inst->args[0], *b = inst->nargs > 1 ? inst->args[1] : NULL;
+  x86_op op;
+  switch (inst->op) {
+  case OP_ADD: op = X_ADDSD; break;
+  case OP_SUB: op = X_SUBSD; break;
+  case OP_MUL: op = X_MULSD; break;
+  case OP_DIV: op = X_DIVSD; break;
+  case OP_MOD: call_runtime(s, RT_MOD_F64, inst, a, b); return;
+  case OP_POW: call_runtime(s, RT_POW_F64, inst, a, b); return;
+  default: {
+    // negation flips the sign bit
+    uint32_t bits = x86_new_vreg(s->mf, X86_GPR), mask = x86_new_vreg(s->mf, X86_XMM);
+    emit(s, X_MOV, x86_reg_op(bits), x86_imm(INT64_MIN));
+    emit(s, X_MOV, x86_reg_op(mask), x86_reg_op(bits));
+    move_to(s, d, a);
+    emit(s, X_XORPD, x86_reg_op(d), x86_reg_op(mask));
+    return;
+  }
+  }
+  if ((inst->op == OP_ADD || inst->op == OP_MUL) && a->op == OP_CONST && b->op != OP_CONST) {
+    ir_inst *t = a;
+    a = b;
+    b = t;
+  }
+  x86_operand r = float_operand(s, b);
+  move_to(s, d, a);
+  emit(s, op, x86_reg_op(d), r);
+}
+
+static void select_num(selector *s, const ir_inst *inst) {
+  static const x86_runtime rts[] = {
+      [OP_ADD] = RT_NUM_ADD, [OP_SUB] = RT_NUM_SUB, [OP_MUL] = RT_NUM_MUL, [OP_DIV] = RT_NUM_DIV,
+      [OP_MOD] = RT_NUM_MOD, [OP_POW] = RT_NUM_POW, [OP_NEG] = RT_NUM_NEG,
+  };
+  call_runtime(s, rts[inst->op], inst, inst->args[0], inst->nargs > 1 ? inst->args[1] : NULL);
+}
+
+static void select_conv(selector *s, const ir_inst *inst) {
+  uint32_t d = value_reg(s, inst);
+  ir_inst *a = inst->args[0];
+  ir_type from = a->type, to = inst->type;
+  if (from == to || (to == IR_I64 && from == IR_BOOL)) {
+    move_to(s, d, a);
+    return;
+  }
+  switch (to) {
+  case IR_BOOL:
+    if (from == IR_NUM) {
+      call_runtime(s, RT_TRUTHY, inst, a, NULL);
+    } else if (from == IR_F64) {
+      // nan is non-zero too
+      uint32_t zero = x86_new_vreg(s->mf, X86_XMM), t = x86_new_vreg(s->mf, X86_GPR);
+      emit(s, X_XORPD, x86_reg_op(zero), x86_reg_op(zero));
+      emit(s, X_UCOMISD, reg(s, a), x86_reg_op(zero));
+      emit_cc(s, X_SETCC, CC_NE, x86_reg_op(d), none);
+      emit_cc(s, X_SETCC, CC_P, x86_reg_op(t), none);
+      emit(s, X_OR, x86_reg_op(d), x86_reg_op(t));
+      emit(s, X_MOVZB, x86_reg_op(d), x86_reg_op(d));
+    } else {
+      x86_operand r = reg(s, a);
+      emit(s, X_TEST, r, r);
+      emit_cc(s, X_SETCC, CC_NE, x86_reg_op(d), none);
+      emit(s, X_MOVZB, x86_reg_op(d), x86_reg_op(d));
+    }
+    return;
+  case IR_I64:
+    if (from == IR_F64)
+      emit(s, X_CVTTSD2SI, x86_reg_op(d), reg(s, a));
+    else
+      call_runtime(s, RT_UNBOX_I64, inst, a, NULL);
+    return;
+  case IR_F64:
+    if (from == IR_NUM)
+      call_runtime(s, RT_UNBOX_F64, inst, a, NULL);
+    else
+      emit(s, X_CVTSI2SD, x86_reg_op(d), reg(s, a));
+    return;
+  case IR_NUM:
+    call_runtime(s, from == IR_F64 ? RT_BOX_F64 : from == IR_PTR ? RT_BOX_PTR : RT_BOX_I64, inst, a,
+                 NULL);
+    return;
+  default: call_runtime(s, RT_UNBOX_PTR, inst, a, NULL); return;
+  }
+}
+
+/* control flow */
+
+typedef struct {
+  uint32_t dst;
+  uint32_t src;         // a register, or 0 for a value that is rematerialized
+  const ir_inst *value;
+} phi_move;
+
+// the copies into `to`'s phis along the edge from `from`, as one parallel move
+static void emit_phi_moves(selector *s, const ir_block *from, const ir_block *to) {
+  uint32_t n = 0;
+  for (ir_inst *phi = to->first; phi && phi->op == OP_PHI; phi = phi->next)
+    n++;
+  if (!n) return;
+  phi_move *moves = arena_alloc(s->arena, n * sizeof(phi_move));
+  n = 0;
+  for (ir_inst *phi = to->first; phi && phi->op == OP_PHI; phi = phi->next)
+    for (uint32_t i = 0; i < phi->nargs; i++) {
+      if (phi->imm.incoming[i] != from) continue;
+      const ir_inst *v = phi->args[i];
+      uint32_t src = is_remat(v) ? 0 : value_reg(s, v), dst = value_reg(s, phi);
+      if (src != dst) moves[n++] = (phi_move){dst, src, v};
+      break;
+    }
+
+  // a register move can go once no other move still reads its destination;
+  // when only cycles are left, one destination is saved to a temporary first
+  uint32_t pending = 0;
+  for (uint32_t i = 0; i < n; i++)
+    pending += moves[i].src != 0;
+  while (pending) {
+    int progress = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      if (!moves[i].dst || !moves[i].src) continue;
+      int blocked = 0;
+      for (uint32_t j = 0; j < n && !blocked; j++)
+        blocked = j != i && moves[j].dst && moves[j].src == moves[i].dst;
+      if (blocked) continue;
+      emit(s, X_MOV, x86_reg_op(moves[i].dst), x86_reg_op(moves[i].src));
+      moves[i].dst = 0;
+      pending--;
+      progress = 1;
+    }
+    if (progress) continue;
+    uint32_t i = 0;
+    while (!moves[i].dst || !moves[i].src)
+      i++;
+    uint32_t saved = moves[i].dst, t = x86_new_vreg(s->mf, x86_reg_class(s->mf, saved));
+    emit(s, X_MOV, x86_reg_op(t), x86_reg_op(saved));
+    for (uint32_t j = 0; j < n; j++)
+      if (moves[j].dst && moves[j].src == saved) moves[j].src = t;
+  }
+  // rematerialized values read no registers and go last
+  for (uint32_t i = 0; i < n; i++)
+    if (moves[i].dst) move_to(s, moves[i].dst, moves[i].value);
+}
+
+static int has_phis(const ir_block *b) {
+  return b->first && b->first->op == OP_PHI;
+}
+
+// the machine block a branch from b to target goes to: target itself, or a
+// block of its own holding the phi copies
+static uint32_t edge_block(selector *s, const ir_block *b, const ir_block *target) {
+  if (!has_phis(target)) return s->block[target->id];
+  uint32_t saved = s->cur, split = new_block(s);
+  s->cur = split;
+  emit_phi_moves(s, b, target);
+  emit(s, X_JMP, x86_block_op(s->block[target->id]), none);
+  s->cur = saved;
+  return split;
+}
+
+static void select_branch(selector *s, const ir_inst *br, const ir_inst *fused) {
+  const ir_block *b = br->block;
+  ir_block *t0 = br->imm.target[0], *t1 = br->imm.target[1];
+  x86_cc cc = CC_NE;
+  if (fused) {
+    cc = emit_compare(s, fused);
+  } else if (br->args[0]->op == OP_CONST) {
+    const ir_block *t = br->args[0]->imm.i ? t0 : t1;
+    emit_phi_moves(s, b, t);
+    emit(s, X_JMP, x86_block_op(s->block[t->id]), none);
+    return;
+  } else {
+    x86_operand c = reg(s, br->args[0]);
+    emit(s, X_TEST, c, c);
+  }
+  uint32_t to0 = edge_block(s, b, t0), to1 = edge_block(s, b, t1);
+  // fall through to the next block where possible
+  if (to0 == s->cur + 1) {
+    uint32_t t = to0;
+    to0 = to1;
+    to1 = t;
+    cc ^= 1;
+  }
+  emit_cc(s, X_JCC, cc, x86_block_op(to0), none);
+  emit(s, X_JMP, x86_block_op(to1), none);
+}
+
+static void select_inst(selector *s, const ir_inst *inst) {
+  switch (inst->op) {
+  case OP_CONST:
+  case OP_STR:
+  case OP_ALLOCA:
+  case OP_PHI:
+  case OP_PARAM: return;
+  case OP_ADD:
+  case OP_SUB:
+  case OP_MUL:
+  case OP_DIV:
+  case OP_MOD:
+  case OP_POW:
+  case OP_NEG:
+    if (inst->type == IR_F64)
+      select_float(s, inst);
+    else if (inst->type == IR_NUM)
+      select_num(s, inst);
+    else
+      select_int(s, inst);
+    return;
+  case OP_AND:
+  case OP_OR:
+  case OP_XOR:
+  case OP_NOT:
+  case OP_SHL:
+  case OP_SHR: select_int(s, inst); return;
+  case OP_EQ:
+  case OP_NEQ:
+  case OP_LT:
+  case OP_LE:
+  case OP_GT:
+  case OP_GE: select_compare(s, inst); return;
+  case OP_CONV: select_conv(s, inst); return;
+  case OP_LOAD: {
+    ir_inst *addr = inst->args[0];
+    x86_operand from = addr->op == OP_ALLOCA ? x86_slot(s->slot[addr->id])
+                                             : x86_mem(reg(s, addr).reg, 0);
+    emit(s, X_MOV, x86_reg_op(value_reg(s, inst)), from);
+    return;
+  }
+  case OP_STORE: {
+    ir_inst *addr = inst->args[0], *v = inst->args[1];
+    x86_operand value = class_of(v->type) == X86_XMM ? reg(s, v) : operand(s, v);
+    x86_operand to = addr->op == OP_ALLOCA ? x86_slot(s->slot[addr->id])
+                                           : x86_mem(reg(s, addr).reg, 0);
+    emit(s, X_MOV, to, value);
+    return;
+  }
+  case OP_CALL:
+    emit_call(s, inst->imm.callee->id, inst->args, inst->nargs);
+    if (inst->type != IR_VOID)
+      emit(s, X_MOV, x86_reg_op(value_reg(s, inst)),
+           x86_reg_op(class_of(inst->type) == X86_XMM ? XMM0 : RAX));
+    return;
+  case OP_PRINT: {
+    static const x86_runtime rts[] = {[IR_BOOL] = RT_PRINT_I64, [IR_I64] = RT_PRINT_I64,
+                                      [IR_F64] = RT_PRINT_F64,  [IR_PTR] = RT_PRINT_STR,
+                                      [IR_NUM] = RT_PRINT_NUM};
+    call_runtime(s, rts[inst->args[0]->type], NULL, inst->args[0], NULL);
+    return;
+  }
+  case OP_JMP:
+    emit_phi_moves(s, inst->block, inst->imm.target[0]);
+    emit(s, X_JMP, x86_block_op(s->block[inst->imm.target[0]->id]), none);
+    return;
+  case OP_RET:
+    if (inst->nargs)
+      move_to(s, class_of(inst->args[0]->type) == X86_XMM ? XMM0 : RAX, inst->args[0]);
+    emit(s, X_RET, none, none);
+    return;
+  default: return;
+  }
+}
+
+// the parameters, from where the caller put them
+static void select_params(selector *s) {
+  ir_func *f = s->f;
+  uint32_t ngpr = 0, nxmm = 0, nstack = 0;
+  for (uint32_t i = 0; i < f->nparams; i++) {
+    x86_operand from;
+    if (class_of(f->params[i]->type) == X86_XMM)
+      from = nxmm < NXMM_ARGS ? x86_reg_op(XMM0 + nxmm++) : x86_mem(RBP, 16 + 8 * nstack++);
+    else
+      from = ngpr < NGPR_ARGS ? x86_reg_op(gpr_args[ngpr++]) : x86_mem(RBP, 16 + 8 * nstack++);
+    emit(s, X_MOV, x86_reg_op(value_reg(s, f->params[i])), from);
+  }
+}
+
+x86_func *select_instructions(x86_module *m, ir_func *f) {
+  x86_func *mf = arena_calloc(m->arena, 1, sizeof(x86_func));
+  mf->name = f->name;
+  mf->sym = f->id;
+  mf->ret_class = f->ret == IR_VOID ? X86_NO_CLASS : class_of(f->ret);
+  x86_block_vec_init(&mf->blocks, m->arena, f->nblocks + 4);
+  u8_vec_init(&mf->vregs, m->arena, f->nvalues + 16);
+
+  selector s = {.m = m, .mf = mf, .f = f, .arena = create_arena("isel", 16 * 1024)};
+  s.vreg = arena_calloc(s.arena, f->nvalues, sizeof(uint32_t));
+  s.uses = arena_calloc(s.arena, f->nvalues, sizeof(uint32_t));
+  s.slot = arena_calloc(s.arena, f->nvalues, sizeof(uint32_t));
+  s.block = arena_calloc(s.arena, f->nblocks, sizeof(uint32_t));
+  for (ir_block *b = f->first; b; b = b->next) {
+    s.block[b->id] = new_block(&s);
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        s.uses[inst->args[i]->id]++;
+      if (inst->op == OP_ALLOCA) s.slot[inst->id] = mf->nslots++;
+    }
+  }
+
+  s.cur = 0;
+  select_params(&s);
+  for (ir_block *b = f->first; b; b = b->next) {
+    s.cur = s.block[b->id];
+    ir_inst *term = ir_terminator(b), *fused = NULL;
+    if (term && term->op == OP_BR && term->imm.target[0] != term->imm.target[1] &&
+        fusable(&s, term->args[0], term))
+      fused = term->args[0];
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      if (inst == fused) continue;
+      if (inst->op != OP_BR) {
+        select_inst(&s, inst);
+      } else if (inst->imm.target[0] == inst->imm.target[1]) {
+        emit_phi_moves(&s, b, inst->imm.target[0]);
+        emit(&s, X_JMP, x86_block_op(s.block[inst->imm.target[0]->id]), none);
+      } else {
+        select_branch(&s, inst, fused);
+      }
+    }
+  }
+  destroy_arena(s.arena);
+  return mf;
+}
@@ -0,0 +1,360 @@
+#include "fold.h"
+#include "loops.h"
+#include "num.h"
+#include "opt.h"
+#include "uses.h"
+#include <math.h>
+
+// induction variables. a basic induction variable is a header phi that
+// enters from the preheader with `init` and comes back from the only latch
+// as `phi + step` (or `phi - step`) with `step` invariant. on those:
+//
+// - integer `i * k` with k invariant becomes a phi of its own that starts at
+//   `init * k` and grows by `step * k`; wrapping arithmetic keeps that exact.
+// - a float or num counter that starts at an integer, moves by an integer
+//   and is tested against a constant it reaches well within exact range is
+//   rewritten to count in i64. a variable's type is per function, so one
+//   `by 0.5` loop would otherwise turn every loop over the same name into
+//   float arithmetic.
+//
+// separately, a comparison in a block only reachable through one edge of a
+// branch is folded when that branch already decided it, such as a repeat of
+// the loop test inside the body, and a branch there on the same condition
+// becomes a jump.
+
+#define EXACT_LIMIT (INT64_C(1) << 46)  // well inside both f64 and num int range
+#define STEP_LIMIT (INT64_C(1) << 20)
+
+typedef struct {
+  ir_func *f;
+  loop_forest *lf;
+  use_map *uses;
+  ir_inst **repl;  // value id -> what replaced a rewritten instruction
+  uint32_t nrepl;
+} iv_pass;
+
+typedef struct {
+  ir_inst *phi;
+  ir_inst *init;  // from the preheader
+  ir_inst *next;  // from the latch: phi + step or phi - step
+  ir_inst *step;
+} induction;
+
+static ir_inst *resolve(const iv_pass *p, ir_inst *v) {
+  while (v->id < p->nrepl && p->repl[v->id])
+    v = p->repl[v->id];
+  return v;
+}
+
+static void replace(iv_pass *p, ir_inst *old, ir_inst *with) {
+  if (old->id < p->nrepl) p->repl[old->id] = with;
+  ir_remove(old);
+}
+
+static int invariant(const iv_pass *p, const ir_loop *l, const ir_inst *v) {
+  return v->op == OP_PARAM || !loop_contains(p->lf, l, v->block);
+}
+
+static ir_inst *emit_before(iv_pass *p, ir_inst *at, ir_op op, ir_type type, ir_inst *a,
+                            ir_inst *c) {
+  ir_inst *inst = ir_new_inst(p->f, op, type, c ? 2 : 1);
+  inst->args[0] = a;
+  if (c) inst->args[1] = c;
+  ir_value folded;
+  if (fold_inst(inst, &folded)) ir_make_const(inst, folded);
+  ir_insert_before(at, inst);
+  return inst;
+}
+
+static ir_inst *const_before(iv_pass *p, ir_inst *at, ir_type type, int64_t i) {
+  ir_inst *inst = ir_new_inst(p->f, OP_CONST, type, 0);
+  inst->imm.i = i;
+  ir_insert_before(at, inst);
+  return inst;
+}
+
+static int match(const iv_pass *p, const ir_loop *l, ir_inst *phi, induction *iv) {
+  if (phi->nargs != 2) return 0;
+  int latch = phi->imm.incoming[1] == l->latches[0];
+  if (phi->imm.incoming[latch] != l->latches[0] || phi->imm.incoming[!latch] != l->preheader)
+    return 0;
+  ir_inst *next = phi->args[latch], *step;
+  if (next->op != OP_ADD && next->op != OP_SUB) return 0;
+  if (next->args[0] == phi)
+    step = next->args[1];
+  else if (next->args[1] == phi && next->op == OP_ADD)
+    step = next->args[0];
+  else
+    return 0;
+  if (step == phi || !invariant(p, l, step)) return 0;
+  *iv = (induction){phi, phi->args[!latch], next, step};
+  return 1;
+}
+
+// i * k -> a phi stepping by step * k
+static int reduce_multiplies(iv_pass *p, const ir_loop *l, const induction *iv) {
+  ir_inst **users = uses_of(p->uses, iv->phi);
+  ir_inst *at = l->preheader->last, *scaled_step = NULL, *k = NULL;
+  int changed = 0;
+  for (uint32_t i = 0, n = use_count(p->uses, iv->phi); i < n; i++) {
+    ir_inst *mul = users[i];
+    if (!mul->block || mul->op != OP_MUL || !loop_contains(p->lf, l, mul->block)) continue;
+    ir_inst *factor = mul->args[0] == iv->phi ? mul->args[1] : mul->args[0];
+    if (factor == iv->phi || !invariant(p, l, factor)) continue;
+    if (factor != k) {
+      k = factor;
+      scaled_step = emit_before(p, at, OP_MUL, IR_I64, iv->step, k);
+    }
+
+    ir_inst *phi = ir_new_inst(p->f, OP_PHI, IR_I64, 0);
+    ir_insert_before(l->header->first, phi);
+    ir_inst *next = ir_new_inst(p->f, iv->next->op, IR_I64, 2);
+    next->args[0] = phi;
+    next->args[1] = scaled_step;
+    ir_insert_after(iv->next, next);
+    ir_add_incoming(p->f, phi, emit_before(p, at, OP_MUL, IR_I64, iv->init, k), l->preheader);
+    ir_add_incoming(p->f, phi, next, l->latches[0]);
+    replace(p, mul, phi);
+    changed = 1;
+  }
+  return changed;
+}
+
+// an integer a float or num constant holds exactly, within `limit`
+static int integral(const ir_inst *c, int64_t limit, int64_t *out) {
+  if (c->op != OP_CONST) return 0;
+  if (c->type == IR_NUM) {
+    if (!num_is_int((uint64_t)c->imm.i)) return 0;
+    *out = num_int((uint64_t)c->imm.i);
+  } else {
+    double d = c->imm.f;
+    if (!(d >= -(double)limit && d <= (double)limit) || d != (double)(int64_t)d) return 0;
+    *out = (int64_t)d;
+    if (num_from_float(d) != num_from_float((double)*out)) return 0;  // -0.0
+  }
+  return *out >= -limit && *out <= limit;
+}
+
+static ir_op swapped(ir_op op) {
+  switch (op) {
+  case OP_LT: return OP_GT;
+  case OP_LE: return OP_GE;
+  case OP_GT: return OP_LT;
+  case OP_GE: return OP_LE;
+  default: return op;
+  }
+}
+
+// the exit test `phi op bound`, true while the loop runs; bound as a double
+static int exit_test(const iv_pass *p, const ir_loop *l, const induction *iv, ir_inst **test,
+                     ir_op *op, double *bound) {
+  ir_inst *br = l->header->last;
+  if (br->op != OP_BR || !loop_contains(p->lf, l, br->imm.target[0]) ||
+      loop_contains(p->lf, l, br->imm.target[1]))
+    return 0;
+  ir_inst *cond = br->args[0];
+  if (cond->op < OP_LT || cond->op > OP_GE) return 0;
+  ir_inst *c = cond->args[cond->args[0] == iv->phi];
+  if (cond->args[0] != iv->phi && cond->args[1] != iv->phi) return 0;
+  if (c->op != OP_CONST || c->type != iv->phi->type) return 0;
+  *op = cond->args[0] == iv->phi ? cond->op : swapped(cond->op);
+  *bound = c->type == IR_NUM ? num_to_float((uint64_t)c->imm.i) : c->imm.f;
+  *test = cond;
+  return *bound >= -(double)EXACT_LIMIT && *bound <= (double)EXACT_LIMIT;
+}
+
+// a float or num counter with integer start and step, counting towards a
+// constant bound, runs in i64 and is converted where it is used. every value
+// it takes lies between the start and the bound plus one step, all exact
+static int specialize(iv_pass *p, const ir_loop *l, const induction *iv) {
+  int64_t init, step;
+  ir_inst *test;
+  ir_op op;
+  double bound;
+  if (!integral(iv->init, EXACT_LIMIT, &init) || !integral(iv->step, STEP_LIMIT, &step) ||
+      !step || !exit_test(p, l, iv, &test, &op, &bound))
+    return 0;
+  if (iv->next->op == OP_SUB) step = -step;
+  if (step > 0 ? op != OP_LT && op != OP_LE : op != OP_GT && op != OP_GE) return 0;
+
+  // for integers, i < 2.5 is i < 3 and i <= 2.5 is i <= 2
+  int64_t limit = (int64_t)(op == OP_LT || op == OP_GE ? ceil(bound) : floor(bound));
+  ir_type t = iv->phi->type;
+  ir_inst *at = l->preheader->last;
+  ir_inst *phi = ir_new_inst(p->f, OP_PHI, IR_I64, 0);
+  ir_insert_before(l->header->first, phi);
+  ir_inst *next = ir_new_inst(p->f, OP_ADD, IR_I64, 2);
+  next->args[0] = phi;
+  next->args[1] = const_before(p, at, IR_I64, step);
+  ir_insert_after(iv->next, next);
+  ir_add_incoming(p->f, phi, const_before(p, at, IR_I64, init), l->preheader);
+  ir_add_incoming(p->f, phi, next, l->latches[0]);
+
+  ir_inst *after_phis = l->header->first;
+  while (after_phis->op == OP_PHI)
+    after_phis = after_phis->next;
+  ir_inst *value = emit_before(p, after_phis, OP_CONV, t, phi, NULL);
+  ir_inst *next_value = ir_new_inst(p->f, OP_CONV, t, 1);
+  next_value->args[0] = next;
+  ir_insert_after(next, next_value);
+  ir_inst *cmp = ir_new_inst(p->f, op, IR_BOOL, 2);
+  cmp->args[0] = phi;
+  cmp->args[1] = const_before(p, at, IR_I64, limit);
+  ir_insert_after(test, cmp);
+
+  replace(p, iv->phi, value);
+  replace(p, iv->next, next_value);
+  replace(p, test, cmp);
+  return 1;
+}
+
+static int optimize_loop(iv_pass *p, const ir_loop *l) {
+  if (!l->preheader || l->nlatches != 1) return 0;
+  int changed = 0;
+  ir_inst *following;
+  for (ir_inst *phi = l->header->first; phi && phi->op == OP_PHI; phi = following) {
+    following = phi->next;
+    induction iv;
+    if (!match(p, l, phi, &iv)) continue;
+    if (phi->type == IR_I64)
+      changed |= reduce_multiplies(p, l, &iv);
+    else if (phi->type == IR_F64 || phi->type == IR_NUM)
+      changed |= specialize(p, l, &iv);
+  }
+  return changed;
+}
+
+// what `a op b` is when `a known b` holds: 1, 0, or -1 if it doesn't follow.
+// an ordered comparison that held rules out NaN and pointers; equality of two
+// nums doesn't, since pointers compare equal to themselves
+static int implied(ir_op known, ir_op op, ir_type t) {
+  if (op == known) return 1;
+  switch (known) {
+  case OP_LT:
+  case OP_GT:
+    if (op == OP_NEQ || op == (known == OP_LT ? OP_LE : OP_GE)) return 1;
+    return op == OP_EQ || op == swapped(known) || op == (known == OP_LT ? OP_GE : OP_LE) ? 0 : -1;
+  case OP_LE: return op == OP_GT ? 0 : -1;
+  case OP_GE: return op == OP_LT ? 0 : -1;
+  case OP_EQ:
+    if (op == OP_NEQ) return 0;
+    if (t == IR_NUM) return -1;
+    return op == OP_LE || op == OP_GE;
+  case OP_NEQ: return op == OP_EQ ? 0 : -1;
+  default: return -1;
+  }
+}
+
+static ir_op negated(ir_op op) {
+  switch (op) {
+  case OP_LT: return OP_GE;
+  case OP_LE: return OP_GT;
+  case OP_GT: return OP_LE;
+  case OP_GE: return OP_LT;
+  case OP_EQ: return OP_NEQ;
+  default: return OP_EQ;
+  }
+}
+
+// folds comparisons of the same operands in the blocks that `to` dominates
+static int fold_implied(iv_pass *p, ir_inst *cond, ir_block *to, ir_op known) {
+  dom_tree *dt = p->lf->dt;
+  ir_inst *a = cond->args[0], *b = cond->args[1];
+  ir_inst **users = uses_of(p->uses, a);
+  int changed = 0;
+  for (uint32_t i = 0, n = use_count(p->uses, a); i < n; i++) {
+    ir_inst *u = users[i];
+    if (u == cond || !u->block || u->op < OP_EQ || u->op > OP_GE || u->nargs != 2) continue;
+    int same = u->args[0] == a && u->args[1] == b, flipped = u->args[0] == b && u->args[1] == a;
+    if (!same && !flipped) continue;
+    if (!dom_reachable(dt, u->block) || !dominates(dt, to, u->block)) continue;
+    int value = implied(known, same ? u->op : swapped(u->op), a->type);
+    if (value < 0) continue;
+    ir_make_const(u, (ir_value){.i = value});
+    changed = 1;
+  }
+  return changed;
+}
+
+// a branch on cond itself further down goes one way; the edge it no longer
+// takes leaves the phis of its target
+static int fold_same_cond(iv_pass *p, ir_inst *cond, ir_block *to, int taken) {
+  dom_tree *dt = p->lf->dt;
+  ir_inst **users = uses_of(p->uses, cond);
+  int changed = 0;
+  for (uint32_t i = 0, n = use_count(p->uses, cond); i < n; i++) {
+    ir_inst *u = users[i];
+    if (u->op != OP_BR || !u->block || u->args[0] != cond) continue;
+    if (u->imm.target[0] == u->imm.target[1]) continue;
+    if (!dom_reachable(dt, u->block) || !dominates(dt, to, u->block)) continue;
+    ir_block *dead = u->imm.target[taken ? 1 : 0];
+    for (ir_inst *phi = dead->first; phi && phi->op == OP_PHI; phi = phi->next) {
+      uint32_t kept = 0;
+      for (uint32_t j = 0; j < phi->nargs; j++) {
+        if (phi->imm.incoming[j] == u->block) continue;
+        phi->args[kept] = phi->args[j];
+        phi->imm.incoming[kept++] = phi->imm.incoming[j];
+      }
+      phi->nargs = kept;
+    }
+    u->op = OP_JMP;
+    u->nargs = 0;
+    u->imm.target[0] = u->imm.target[taken ? 0 : 1];
+    changed = 1;
+  }
+  return changed;
+}
+
+static int fold_branch_implied(iv_pass *p) {
+  dom_tree *dt = p->lf->dt;
+  int changed = 0;
+  for (uint32_t i = 0; i < dt->count; i++) {
+    ir_inst *br = dt->order[i]->last;
+    if (br->op != OP_BR) continue;
+    ir_inst *cond = br->args[0];
+    if (cond->op < OP_EQ || cond->op > OP_GE || cond->args[0] == cond->args[1]) continue;
+    ir_type t = cond->args[0]->type;
+    ir_block *then = br->imm.target[0], *other = br->imm.target[1];
+    if (then == other) continue;
+    if (then->npreds == 1)
+      changed |= fold_same_cond(p, cond, then, 1) | fold_implied(p, cond, then, cond->op);
+    if (other->npreds == 1) changed |= fold_same_cond(p, cond, other, 0);
+    if (other->npreds == 1 && (t == IR_I64 || t == IR_BOOL))
+      changed |= fold_implied(p, cond, other, negated(cond->op));
+  }
+  return changed;
+}
+
+int optimize_induction_variables(ir_func *f) {
+  if (!f->first) return 0;
+  ir_compute_preds(f);
+  loop_forest *lf = create_loop_forest(f);
+  int changed = 0;
+  if (loop_add_preheaders(f, lf)) {
+    destroy_loop_forest(lf);
+    lf = create_loop_forest(f);
+    changed = 1;
+  }
+
+  arena *a = create_arena("iv", 4096);
+  iv_pass p = {.f = f, .lf = lf, .uses = create_use_map(f), .nrepl = f->nvalues};
+  p.repl = arena_calloc(a, f->nvalues, sizeof(ir_inst *));
+  int rewritten = 0;
+  for (uint32_t i = 0; i < lf->count; i++)
+    rewritten |= optimize_loop(&p, lf->loops[i]);
+  if (rewritten)
+    for (ir_block *b = f->first; b; b = b->next)
+      for (ir_inst *inst = b->first; inst; inst = inst->next)
+        for (uint32_t i = 0; i < inst->nargs; i++)
+          inst->args[i] = resolve(&p, inst->args[i]);
+  // the loops are done with, so branches may now lose edges
+  if (fold_branch_implied(&p)) {
+    ir_compute_preds(f);
+    changed = 1;
+  }
+
+  destroy_use_map(p.uses);
+  destroy_loop_forest(lf);
+  destroy_arena(a);
+  return changed | rewritten;
+}
@@ -0,0 +1,55 @@
+#include "jit.h"
+#include "diag.h"
+#include "link.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static size_t page_up(size_t n) {
+  return (n + LINK_PAGE - 1) / LINK_PAGE * LINK_PAGE;
+}
+
+int jit_load(const x86_module *m, jit_program *out) {
+  x86_code code;
+  linked_program p;
+  encode_x86(m, &code);
+  if (link_program(m, &code, 0, &p)) return 1;
+
+  // text, rodata and data each start on a page, so each gets its own protection
+  size_t size = page_up((size_t)p.data + p.data_size + p.bss_size);
+  uint8_t *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    diag_error("error: failed to map the program\n");
+    u8_vec_free(&p.image);
+    return 1;
+  }
+  memcpy(base, p.image.data, p.image.size);
+  u8_vec_free(&p.image);
+  if (mprotect(base, p.rodata, PROT_READ | PROT_EXEC) != 0 ||
+      mprotect(base + p.rodata, p.data - p.rodata, PROT_READ) != 0) {
+    diag_error("error: failed to make the program executable\n");
+    munmap(base, size);
+    return 1;
+  }
+
+  out->base = base;
+  out->size = size;
+  // the usual object-to-function pointer conversion that posix guarantees
+  out->main = __extension__(int64_t(*)(int64_t, char **))(base + p.main);
+  out->flush = __extension__(void (*)(void))(base + p.flush);
+  return 0;
+}
+
+int64_t jit_run(const jit_program *p, int argc, char **argv) {
+  // the runtime writes to the file descriptors directly
+  fflush(stdout);
+  fflush(stderr);
+  int64_t status = p->main(argc, argv);
+  p->flush();
+  return status;
+}
+
+void jit_unload(jit_program *p) {
+  munmap(p->base, p->size);
+  p->base = NULL;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "x86.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// runs a module inside the compiler: the linked image (link.c) goes into an
+// anonymous mapping and main(argc, argv) is called directly, with no
+// executable written and no process started. a runtime error still ends the
+// whole process with status 1, as it would end the program.
+
+typedef struct {
+  uint8_t *base;
+  size_t size;
+  int64_t (*main)(int64_t argc, char **argv);
+  void (*flush)(void);
+} jit_program;
+
+// returns 0 on success; problems are reported through diag_error()
+int jit_load(const x86_module *m, jit_program *out);
+// main's return value, once the program's buffered output has been written
+int64_t jit_run(const jit_program *p, int argc, char **argv);
+void jit_unload(jit_program *p);
@@ -1,11 +1,14 @@
 #include "lexer.h"
+#include "diag.h"
 #include "intern.h"
+#include "scan.h"
 #include "trie.h"
 #include "utils.h"
 #include "vector.h"
-#include <ctype.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define TABS 1
 #define SPACES 2
@@ -14,36 +17,76 @@
 #define MAX_INDENT_LEVEL 32
 #define MAX_STRING_LEN 256
 
+// smallest slice of the file worth handing to its own thread
+#define MIN_CHUNK_SIZE (1u << 20)
+#define MAX_LEX_THREADS 64
+
+// the only state that crosses line boundaries
+typedef struct {
+  int style;
+  int spaces_per_level;
+  int stack[MAX_INDENT_LEVEL];
+  int sp;
+} indent_state;
+
+// leading whitespace of a non-blank line, recorded by chunk lexers so the
+// indentation can be resolved once every chunk is done
 typedef struct {
-  const char *symbol;
-  token_type type;
-} symbol_entry;
+  uint32_t token;   // index of the line's first token in the chunk stream
+  uint32_t offset;  // first non-blank byte of the line
+  uint32_t line;    // line number relative to the chunk
+  uint32_t width;   // bytes of leading whitespace
+  uint32_t spaces;
+  uint32_t tabs;
+} line_mark;
+
+VEC_DECL(line_mark_vec, line_mark)
 
 struct lexer {
-  int indent_style;
-  int spaces_per_level;
   int line;
-  int col;
-  int current_indent;
-  int indent_stack[MAX_INDENT_LEVEL];
-  int indent_sp;
-  vector *tokens;
+  const char *cur;          // scan position inside the source buffer
+  const char *end;          // one past the last byte this lexer scans
+  const char *begin;        // first byte this lexer scans
+  const char *line_start;   // first byte of the current line
+  const char *tok_start;    // first byte of the token being scanned
+  const char *src;          // start of the source buffer
+  indent_state indent;
+  line_mark_vec *marks;     // set for chunk lexers, which defer indentation
+  token_stream *tokens;
   intern_table *interns;
+  symbol_trie symbols;
+  uint32_t keyword_count;
 };
 
-static void add_token_null(lexer *lexer, token_type type) {
-  token new_token = {.type = type, .ident = NULL, .col = lexer->col, .line = lexer->line};
+static const symbol_entry symbols[] = {
+    {"+", ADD},        {"++", ADD_ONE},    {"+=", ADD_EQ},  {"-", SUB},        {"--", SUB_ONE},
+    {"-=", SUB_EQ},    {"*", MUL},         {"*=", MUL_EQ},  {"/", DIV},        {"/=", DIV_EQ},
+    {"//", INT_DIV},   {"//=", INTDIV_EQ}, {"^", CARROT},   {"^=", CARROT_EQ}, {"%", MODULO},
+    {">", GT},         {">=", GTE},        {"<", LT},       {"<=", LTE},       {">>", RBITSHIFT},
+    {"<<", LBITSHIFT}, {"~", BITW_NOT},    {"&", BITW_AND}, {"|", BITW_OR},    {"==", COMP_EQ},
+    {"=", EQ},         {"!=", NOT_EQ},     {"&&", AND},     {"||", OR},        {"!", NOT},
+    {"(", LPAREN},     {")", RPAREN},      {"[", LSQPAREN}, {"]", RSQPAREN},   {",", COMMA}};
+
+static int lexer_col(lexer *lexer, const char *at) {
+  return (int)(at - lexer->line_start) + 1;
+}
 
-  add_element(lexer->tokens, &new_token);
+static void push_token(token_stream *ts, token_type type, uint32_t offset) {
+  u8_vec_push(&ts->types, (uint8_t)type);
+  u32_vec_push(&ts->offsets, offset);
 }
 
-static void add_token_len(lexer *lexer, token_type type, const char *ptr, size_t length) {
-  intern_result result = intern_string(lexer->interns, ptr, length, type);
+static void add_token_null(lexer *lexer, token_type type) {
+  push_token(lexer->tokens, type, (uint32_t)(lexer->tok_start - lexer->src));
+}
 
-  token new_token = {
-      .type = result.value, .ident = result.key, .col = lexer->col, .line = lexer->line};
+static void add_token_interned(lexer *lexer, token_type type, intern_result result) {
+  add_token_null(lexer, type);
+  u32_vec_push(&lexer->tokens->strs, result.id);
+}
 
-  add_element(lexer->tokens, &new_token);
+static void add_token_len(lexer *lexer, token_type type, const char *ptr, size_t length) {
+  add_token_interned(lexer, type, intern_string(lexer->interns, ptr, length, type));
 }
 
 static void add_language_keywords(intern_table *interns) {
@@ -58,93 +101,168 @@ static void add_language_keywords(intern_table *interns) {
   }
 }
 
-static lexer *init_lexer(void) {
+static token_stream *create_token_stream(const source_file *src) {
+  token_stream *ts = malloc(sizeof(token_stream));
+  u8_vec_init(&ts->types, NULL, 1024);
+  u32_vec_init(&ts->offsets, NULL, 1024);
+  u32_vec_init(&ts->strs, NULL, 512);
+  u32_vec_init(&ts->line_starts, NULL, 0);
+  ts->source = src;
+  return ts;
+}
+
+static void destroy_token_stream(token_stream *ts) {
+  u8_vec_free(&ts->types);
+  u32_vec_free(&ts->offsets);
+  u32_vec_free(&ts->strs);
+  u32_vec_free(&ts->line_starts);
+  free(ts);
+}
+
+static void build_line_index(token_stream *ts) {
+  const char *start = ts->source->data, *end = start + ts->source->size;
+  u32_vec_push(&ts->line_starts, 0);
+  for (const char *p = scan_line_end(start, end); p < end; p = scan_line_end(p + 1, end))
+    u32_vec_push(&ts->line_starts, (uint32_t)(p + 1 - start));
+}
+
+source_pos token_position(token_stream *ts, size_t index) {
+  if (!ts->line_starts.size) build_line_index(ts);
+  uint32_t offset = ts->offsets.data[index];
+  uint32_t *starts = ts->line_starts.data;
+
+  // last line that starts at or before the offset
+  size_t lo = 0, hi = ts->line_starts.size;
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if (starts[mid] <= offset)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return (source_pos){(int)lo + 1, (int)(offset - starts[lo]) + 1};
+}
+
+static lexer *init_lexer(const source_file *src, const char *begin, const char *end) {
   lexer *l = malloc(sizeof(lexer));
-  l->indent_style = UNSET;
-  l->col = 0;
   l->line = 1;
-  l->tokens = create_vector(sizeof(token), 128);
-  l->indent_stack[0] = 0;
-  l->current_indent = 0;
-  l->indent_sp = 1;
+  l->cur = begin;
+  l->end = end;
+  l->begin = begin;
+  l->line_start = l->cur;
+  l->tok_start = l->cur;
+  l->src = src->data;
+  l->indent.style = UNSET;
+  l->indent.stack[0] = 0;
+  l->indent.sp = 1;
+  l->marks = NULL;
+  l->tokens = create_token_stream(src);
   l->interns = create_intern_table(128, 0.7);
 
   add_language_keywords(l->interns);
+  l->keyword_count = intern_count(l->interns);
+  build_symbol_trie(&l->symbols, symbols, sizeof(symbols) / sizeof(symbols[0]));
   return l;
 }
 
-static void parse_indent(lexer *lexer, char *buffer) {
-  int spaces = 0, tabs = 0;
-  while (isspace(buffer[lexer->col])) {
-    if (buffer[lexer->col] == ' ') {
-      spaces++;
-    } else if (buffer[lexer->col] == '\t') {
-      tabs++;
-    }
-    lexer->col++;
-  }
+// a chunk lexer only counts lines from its own start, so the absolute line
+// is recovered here, on the error path
+static int lexer_line(lexer *lexer) {
+  int line = lexer->line;
+  for (const char *p = scan_line_end(lexer->src, lexer->begin); p < lexer->begin;
+       p = scan_line_end(p + 1, lexer->begin))
+    line++;
+  return line;
+}
 
-  if (buffer[lexer->col] == ';') {
-    while (buffer[lexer->col] != '\n' && buffer[lexer->col] != '\0')
-      lexer->col++;
-    return;
-  }
+static int at_line_end(lexer *lexer) {
+  return lexer->cur >= lexer->end || *lexer->cur == '\n';
+}
+
+static void skip_comment(lexer *lexer) {
+  lexer->cur = scan_line_end(lexer->cur, lexer->end);
+}
 
-  if (buffer[lexer->col] == '\n' || buffer[lexer->col] == '\0') return;
+// turns one line's leading whitespace into INDENT/DEDENT tokens. line_base is
+// added to the mark's line number for diagnostics.
+static void resolve_indent(indent_state *s, const line_mark *m, int line_base, token_stream *out) {
+  int line = line_base + (int)m->line, col = (int)m->width + 1;
+  int spaces = (int)m->spaces, tabs = (int)m->tabs, current;
 
-  if (lexer->indent_style == UNSET && ((spaces > 0) != (tabs > 0))) {
+  if (s->style == UNSET && ((spaces > 0) != (tabs > 0))) {
     if (spaces > 0) {
-      lexer->indent_style = SPACES;
-      lexer->spaces_per_level = spaces;
+      s->style = SPACES;
+      s->spaces_per_level = spaces;
     } else {
-      lexer->indent_style = TABS;
+      s->style = TABS;
     }
   }
 
   if (spaces > 0 && tabs > 0) {
-    fprintf(stderr, "use of tabs and spaces at %d:%d, which is forbidden.\n", lexer->line,
-            lexer->col);
-    exit(1);
+    diag_fatal("use of tabs and spaces at %d:%d, which is forbidden.\n", line, col);
   }
 
-  if (lexer->indent_style == SPACES) {
-    if (spaces % lexer->spaces_per_level != 0) {
-      fprintf(stderr, "inconsistent space indentation near %d:%d. expected multiple of %d.\n",
-              lexer->line, lexer->col, lexer->spaces_per_level);
-      exit(1);
+  if (s->style == SPACES) {
+    if (spaces % s->spaces_per_level != 0) {
+      diag_fatal("inconsistent space indentation near %d:%d. expected multiple of %d.\n",
+                 line, col, s->spaces_per_level);
     }
-    lexer->current_indent = spaces / lexer->spaces_per_level;
+    current = spaces / s->spaces_per_level;
   } else {
-    lexer->current_indent = tabs;
+    current = tabs;
   }
 
-  if (lexer->current_indent > lexer->indent_stack[lexer->indent_sp - 1]) {
-    if (lexer->current_indent != lexer->indent_stack[lexer->indent_sp - 1] + 1) {
-      fprintf(stderr, "invalid indentation increase at line %d\n", lexer->line);
-      exit(1);
+  if (current > s->stack[s->sp - 1]) {
+    if (current != s->stack[s->sp - 1] + 1) {
+      diag_fatal("invalid indentation increase at line %d\n", line);
     }
-    if (lexer->indent_sp >= MAX_INDENT_LEVEL) {
-      fprintf(stderr, "max indentation depth exceeded at line %d\n", lexer->line);
-      exit(1);
+    if (s->sp >= MAX_INDENT_LEVEL) {
+      diag_fatal("max indentation depth exceeded at line %d\n", line);
     }
-    lexer->indent_stack[lexer->indent_sp] = lexer->current_indent;
-    lexer->indent_sp++;
-
-    add_token_null(lexer, INDENT);
+    s->stack[s->sp++] = current;
+    push_token(out, INDENT, m->offset);
   } else {
-    while (lexer->indent_sp > 1 &&
-           lexer->indent_stack[lexer->indent_sp - 1] > lexer->current_indent) {
-      lexer->indent_sp--;
-      add_token_null(lexer, DEDENT);
+    while (s->sp > 1 && s->stack[s->sp - 1] > current) {
+      s->sp--;
+      push_token(out, DEDENT, m->offset);
     }
 
-    if (lexer->indent_stack[lexer->indent_sp - 1] != lexer->current_indent) {
-      fprintf(stderr, "error: invalid dedent level at line %d\n", lexer->line);
-      exit(1);
+    if (s->stack[s->sp - 1] != current) {
+      diag_fatal("error: invalid dedent level at line %d\n", line);
     }
   }
 }
 
+static void parse_indent(lexer *lexer) {
+  const char *start = lexer->cur;
+  lexer->cur = scan_space(lexer->cur, lexer->end);
+
+  int spaces = 0, tabs = 0;
+  for (const char *p = start; p < lexer->cur; p++) {
+    if (*p == ' ') {
+      spaces++;
+    } else if (*p == '\t') {
+      tabs++;
+    }
+  }
+  lexer->tok_start = lexer->cur;
+
+  if (lexer->cur < lexer->end && *lexer->cur == ';') {
+    skip_comment(lexer);
+    return;
+  }
+
+  if (at_line_end(lexer)) return;
+
+  line_mark mark = {(uint32_t)token_count(lexer->tokens), (uint32_t)(lexer->cur - lexer->src),
+                    (uint32_t)lexer->line, (uint32_t)(lexer->cur - start), (uint32_t)spaces,
+                    (uint32_t)tabs};
+  if (lexer->marks)
+    line_mark_vec_push(lexer->marks, mark);
+  else
+    resolve_indent(&lexer->indent, &mark, 0, lexer->tokens);
+}
+
 const char *token_type_str(token_type t) {
   switch (t) {
   case FN: return "fn";
@@ -207,32 +325,8 @@ const char *token_type_str(token_type t) {
   }
 }
 
-void print_token(const token *token) {
-  printf("%s %s @ %d:%d\n", token_type_str(token->type), token->ident ? token->ident : "",
-         token->line, token->col);
-}
-
-static trie_node *initialize_trie(void) {
-  const symbol_entry symbols[] = {
-      {"+", ADD},        {"++", ADD_ONE},    {"+=", ADD_EQ},  {"-", SUB},        {"--", SUB_ONE},
-      {"-=", SUB_EQ},    {"*", MUL},         {"*=", MUL_EQ},  {"/", DIV},        {"/=", DIV_EQ},
-      {"//", INT_DIV},   {"//=", INTDIV_EQ}, {"^", CARROT},   {"^=", CARROT_EQ}, {"%", MODULO},
-      {">", GT},         {">=", GTE},        {"<", LT},       {"<=", LTE},       {">>", RBITSHIFT},
-      {"<<", LBITSHIFT}, {"~", BITW_NOT},    {"&", BITW_AND}, {"|", BITW_OR},    {"==", COMP_EQ},
-      {"=", EQ},         {"!=", NOT_EQ},     {"&&", AND},     {"||", OR},        {"!", NOT},
-      {"(", LPAREN},     {")", RPAREN},      {"[", LSQPAREN}, {"]", RSQPAREN},   {",", COMMA}};
-
-  trie_node *node = create_trie_node();
-  for (int i = 0; i < (int)(sizeof(symbols) / sizeof(symbol_entry)); i++)
-    insert_symbol(node, symbols[i].symbol, symbols[i].type);
-
-  return node;
-}
-
-static int issymbol(char c) {
-  return c == '%' || c == '+' || c == '-' || c == '*' || c == '/' || c == '=' || c == '!' ||
-         c == '<' || c == '>' || c == '&' || c == '|' || c == '^' || c == '(' || c == ')' ||
-         c == '[' || c == ']' || c == ',';
+void print_token(FILE *out, token_type type, const char *text, source_pos pos) {
+  fprintf(out, "%s %s @ %d:%d\n", token_type_str(type), text ? text : "", pos.line, pos.col);
 }
 
 static char handle_escape_sequence(char c) {
@@ -241,171 +335,253 @@ static char handle_escape_sequence(char c) {
   case 't': return '\t';
   case '\\': return '"';
   case '\'': return '\'';
-  default: fprintf(stderr, "unknown escape sequence '\\%c'\n", c); return '\0';
+  default: diag_error("unknown escape sequence '\\%c'\n", c); return '\0';
   }
 }
 
-static void parse_string(lexer *lexer, char *buffer, size_t bytes_read) {
-  lexer->col++;
+static void parse_string(lexer *lexer) {
+  const char *start = ++lexer->cur;
+  lexer->cur = scan_string(lexer->cur, lexer->end);
+
+  // no escapes: intern straight out of the source buffer
+  if (lexer->cur < lexer->end && *lexer->cur == '"') {
+    add_token_len(lexer, STRING, start, lexer->cur - start);
+    lexer->cur++;
+    return;
+  }
+
   char string_buffer[MAX_STRING_LEN];
   int sb_index = 0;
+  int terminated = 0;
+  lexer->cur = start;
 
-  while (lexer->col < (int)bytes_read) {
-    char c = buffer[lexer->col];
-    if (c == '\\') {
-      lexer->col++;
-      if (lexer->col >= (int)bytes_read) {
-        fprintf(stderr, "unterminated string at line %d\n", lexer->line);
-        exit(1);
-      }
-      char escaped_char = handle_escape_sequence(buffer[lexer->col]);
-      if (sb_index < MAX_STRING_LEN - 1)
-        string_buffer[sb_index++] = escaped_char;
-      else {
-        fprintf(stderr, "string too long\n");
-        exit(1);
-      }
-    } else if (c == '"') {
-      lexer->col++;
+  while (!at_line_end(lexer)) {
+    char c = *lexer->cur++;
+    if (c == '"') {
+      terminated = 1;
       break;
-    } else {
-      if (sb_index < MAX_STRING_LEN - 1)
-        string_buffer[sb_index++] = c;
-      else {
-        fprintf(stderr, "string too long\n");
-        exit(1);
-      }
     }
-    lexer->col++;
-
-    if (lexer->col >= (int)bytes_read && buffer[lexer->col - 1] != '"') {
-      fprintf(stderr, "unterminated string at line %d\n", lexer->line);
-      exit(1);
+    if (c == '\\') {
+      if (at_line_end(lexer)) break;
+      c = handle_escape_sequence(*lexer->cur++);
+    }
+    if (sb_index >= MAX_STRING_LEN - 1) {
+      diag_fatal("string too long\n");
     }
+    string_buffer[sb_index++] = c;
+  }
+
+  if (!terminated) {
+    diag_fatal("unterminated string at line %d\n", lexer_line(lexer));
   }
 
   string_buffer[sb_index] = '\0';
   add_token_len(lexer, STRING, string_buffer, sb_index);
 }
 
-static void parse_number(lexer *lexer, char *buffer, size_t bytes_read) {
-  int start = lexer->col;
-  bool is_float = false;
+static void parse_number(lexer *lexer) {
+  const char *start = lexer->cur;
+  lexer->cur = scan_number(lexer->cur, lexer->end);
 
-  while (lexer->col < (int)bytes_read && buffer[lexer->col] != '\n' &&
-         (isdigit(buffer[lexer->col]) || buffer[lexer->col] == '.')) {
-    if (buffer[lexer->col] == '.') {
-      if (is_float) {
-        fprintf(stderr, "malformed number at line %d:%d\n", lexer->line, lexer->col);
-        exit(1);
-      }
-      is_float = true;
-    }
-    lexer->col++;
+  const char *dot = memchr(start, '.', lexer->cur - start);
+  if (dot && memchr(dot + 1, '.', lexer->cur - dot - 1)) {
+    diag_fatal("malformed number at line %d:%d\n", lexer_line(lexer), lexer_col(lexer, start));
   }
 
-  int length = lexer->col - start;
-
-  add_token_len(lexer, is_float ? FLOAT : INTEGER, buffer + start, length);
+  add_token_len(lexer, dot ? FLOAT : INTEGER, start, lexer->cur - start);
 }
 
-static void parse_symbol(lexer *lexer, trie_node *root, char *buffer, size_t bytes_read) {
-  int start = lexer->col;
-  int best = 0;
-  token_type best_type;
-  char candidate[8];
-  for (int len = 1; start + len <= (int)bytes_read && len < (int)sizeof(candidate); len++) {
-    bool all_symbols = true;
-    for (int i = 0; i < len; i++) {
-      if (!issymbol(buffer[start + i])) {
-        all_symbols = false;
-        break;
-      }
-    }
-    if (!all_symbols) break;
-    memcpy(candidate, buffer + start, len);
-    candidate[len] = '\0';
-    match_result res = search_trie(root, candidate);
-    if (res.length == len) {
-      best = len;
-      best_type = res.type;
-    }
-  }
-  if (best == 0) {
-    fprintf(stderr, "invalid symbol at line %d col %d\n", lexer->line, lexer->col);
-    exit(1);
+static void parse_symbol(lexer *lexer) {
+  match_result res = match_symbol(&lexer->symbols, lexer->cur, lexer->end);
+  if (res.length == 0) {
+    diag_fatal("invalid symbol at line %d col %d\n", lexer_line(lexer),
+               lexer_col(lexer, lexer->cur));
   }
-  add_token_null(lexer, best_type);
-  lexer->col = start + best;
+  add_token_null(lexer, res.type);
+  lexer->cur += res.length;
 }
 
-static void parse_identifier(lexer *lexer, char *buffer, size_t bytes_read) {
-  int start = lexer->col;
-  while (
-      lexer->col < (int)bytes_read &&
-      (isalpha(buffer[lexer->col]) || isdigit(buffer[lexer->col]) || buffer[lexer->col] == '_')) {
-    lexer->col++;
-  }
-  int length = lexer->col - start;
+static void parse_identifier(lexer *lexer) {
+  const char *start = lexer->cur;
+  lexer->cur = scan_ident(lexer->cur, lexer->end);
+  size_t length = lexer->cur - start;
 
-  intern_result res = intern_string(lexer->interns, buffer + start, length, IDENTIFIER);
+  intern_result res = intern_string(lexer->interns, start, length, IDENTIFIER);
 
-  if (res.value == IDENTIFIER) {
-    add_token_len(lexer, res.value, buffer + start, length);
-  } else {
+  // keywords are interned first, so their ids are all below the first user string
+  if (res.id < lexer->keyword_count) {
     add_token_null(lexer, res.value);
+  } else {
+    add_token_interned(lexer, IDENTIFIER, res);
   }
 }
 
-lexer_result *lex(const char *filename) {
-  file_streamer *streamer = create_streamer(filename);
-  lexer *lexer = init_lexer();
-  trie_node *root = initialize_trie();
-
-  char buffer[MAX_LINE];
-  size_t bytes_read;
-
-  while ((bytes_read = stream_line(streamer, buffer)) > 0) {
-    lexer->col = 0;
-    parse_indent(lexer, buffer);
+// lexes every line in the lexer's range. chunk ranges always start on a line
+// boundary, and no token spans a newline, so chunks can be lexed independently.
+static void lex_lines(lexer *lexer) {
+  while (lexer->cur < lexer->end) {
+    lexer->line_start = lexer->cur;
+    parse_indent(lexer);
 
-    if (buffer[lexer->col] == '\n' || buffer[lexer->col] == '\0') {
+    // blank and comment-only lines produce no tokens
+    if (at_line_end(lexer)) {
+      if (lexer->cur < lexer->end) lexer->cur++;
       lexer->line++;
       continue;
     }
 
-    while (lexer->col < (int)bytes_read) {
-      char c = buffer[lexer->col];
+    while (!at_line_end(lexer)) {
+      char c = *lexer->cur;
+      lexer->tok_start = lexer->cur;
 
       if (c == ';') {
-        break;
-      } else if (isspace(c)) {
-        lexer->col++;
-        continue;
-      } else if (isalpha(c) || c == '_') {
-        parse_identifier(lexer, buffer, bytes_read);
-      } else if (isdigit(c)) {
-        parse_number(lexer, buffer, bytes_read);
+        skip_comment(lexer);
+      } else if (char_is(c, CC_SPACE)) {
+        lexer->cur = scan_space(lexer->cur, lexer->end);
+      } else if (char_is(c, CC_ALPHA)) {
+        parse_identifier(lexer);
+      } else if (char_is(c, CC_DIGIT)) {
+        parse_number(lexer);
       } else if (c == '"') {
-        parse_string(lexer, buffer, bytes_read);
-      } else if (issymbol(c)) {
-        parse_symbol(lexer, root, buffer, bytes_read);
+        parse_string(lexer);
+      } else if (char_is(c, CC_SYMBOL)) {
+        parse_symbol(lexer);
       } else {
-        lexer->col++;
+        lexer->cur++;
       }
     }
 
+    lexer->tok_start = lexer->cur;
     add_token_null(lexer, NEWLINE);
+    if (lexer->cur < lexer->end) lexer->cur++;
     lexer->line++;
   }
+}
 
-  add_token_null(lexer, END);
+static void *lex_chunk(void *arg) {
+  lex_lines(arg);
+  return NULL;
+}
 
-  destroy_streamer(streamer);
-  free_trie(root);
+static int lex_thread_count(size_t size, int threads) {
+  if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads > MAX_LEX_THREADS) threads = MAX_LEX_THREADS;
+  size_t chunks = size / MIN_CHUNK_SIZE;
+  if ((size_t)threads > chunks) threads = (int)chunks;
+  return threads < 1 ? 1 : threads;
+}
+
+// appends the later chunks to the first one's stream in file order, resolving
+// their indentation from the recorded line marks as it goes. the first chunk
+// already resolved its own, and its intern table becomes the shared one: the
+// others are merged into it in order, so every string gets the same id a
+// sequential lex would have given it.
+static void splice_chunks(lexer **chunks, int n) {
+  token_stream *out = chunks[0]->tokens;
+  size_t types = token_count(out), strs = out->strs.size;
+  for (int c = 1; c < n; c++) {
+    types += token_count(chunks[c]->tokens) + chunks[c]->marks->size;
+    strs += chunks[c]->tokens->strs.size;
+  }
+  u8_vec_reserve(&out->types, types + 1);
+  u32_vec_reserve(&out->offsets, types + 1);
+  u32_vec_reserve(&out->strs, strs);
+
+  indent_state *indent = &chunks[0]->indent;
+  intern_table *interns = chunks[0]->interns;
+  uint32_t *remap = NULL;
+  int line_base = chunks[0]->line - 1;
+
+  for (int c = 1; c < n; c++) {
+    token_stream *ts = chunks[c]->tokens;
+    line_mark_vec *marks = chunks[c]->marks;
+
+    size_t from = 0;
+    for (size_t i = 0; i < marks->size; i++) {
+      size_t to = marks->data[i].token;
+      u8_vec_push_many(&out->types, ts->types.data + from, to - from);
+      u32_vec_push_many(&out->offsets, ts->offsets.data + from, to - from);
+      resolve_indent(indent, &marks->data[i], line_base, out);
+      from = to;
+    }
+    u8_vec_push_many(&out->types, ts->types.data + from, token_count(ts) - from);
+    u32_vec_push_many(&out->offsets, ts->offsets.data + from, token_count(ts) - from);
+
+    remap = realloc(remap, intern_count(chunks[c]->interns) * sizeof(uint32_t));
+    intern_merge(interns, chunks[c]->interns, chunks[c]->keyword_count, remap);
+    for (size_t i = 0; i < ts->strs.size; i++)
+      u32_vec_push(&out->strs, remap[ts->strs.data[i]]);
+
+    line_base += chunks[c]->line - 1;
+    destroy_intern_table(chunks[c]->interns);
+    destroy_token_stream(ts);
+    line_mark_vec_free(marks);
+    free(marks);
+    free(chunks[c]);
+  }
+
+  free(remap);
+}
+
+lexer_result *lex_parallel(const char *filename, int threads) {
+  source_file *src = open_source(filename);
+  if (!src) return NULL;
+
+  const char *end = src->data + src->size;
+  int n = lex_thread_count(src->size, threads);
+  lexer *chunks[MAX_LEX_THREADS];
+  pthread_t workers[MAX_LEX_THREADS];
+  int started[MAX_LEX_THREADS] = {0};
+
+  // split after the newline that follows each even division of the file
+  const char *begin = src->data;
+  for (int c = 0; c < n; c++) {
+    const char *stop = c == n - 1 ? end : scan_line_end(src->data + src->size / n * (c + 1), end);
+    if (stop < end) stop++;
+    if (stop < begin) stop = begin;
+    chunks[c] = init_lexer(src, begin, stop);
+    begin = stop;
+  }
+
+  if (n > 1) {
+    // all but the first chunk start with unknown indentation, so they only record it
+    for (int c = 1; c < n; c++) {
+      chunks[c]->marks = malloc(sizeof(line_mark_vec));
+      line_mark_vec_init(chunks[c]->marks, NULL, 1024);
+    }
+    for (int c = 1; c < n; c++)
+      started[c] = pthread_create(&workers[c], NULL, lex_chunk, chunks[c]) == 0;
+
+    // the calling thread takes the first chunk, plus any that failed to start
+    for (int c = 0; c < n; c++)
+      if (!started[c]) lex_lines(chunks[c]);
+    for (int c = 1; c < n; c++)
+      if (started[c]) pthread_join(workers[c], NULL);
+
+    splice_chunks(chunks, n);
+  } else {
+    lex_lines(chunks[0]);
+  }
+
+  lexer *lexer = chunks[0];
+  push_token(lexer->tokens, END, (uint32_t)src->size);
+
+  lexer_result *lr = malloc(sizeof(lexer_result));
+  lr->interns = lexer->interns;
+  lr->tokens = lexer->tokens;
+  lr->source = src;
+  free(lexer);
+  return lr;
+}
+
+lexer_result *lex(const char *filename) {
+  return lex_parallel(filename, 1);
+}
 
-  static lexer_result lr;
-  lr.interns = lexer->interns;
-  lr.tokens = lexer->tokens;
-  return &lr;
+void destroy_lexer_result(lexer_result *l) {
+  if (!l) return;
+  destroy_token_stream(l->tokens);
+  destroy_intern_table(l->interns);
+  close_source(l->source);
+  free(l);
 }
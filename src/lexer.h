@@ -1,23 +1,55 @@
 #pragma once
 #include "token.h"
+#include "utils.h"
 #include "vector.h"
+#include <stdint.h>
 
-typedef struct token token;
 typedef struct lexer lexer;
 typedef struct intern_table intern_table;
 
-struct token {
-  token_type type;
-  char *ident;
-  int col;
+// tokens in structure-of-arrays form. the parser mostly looks at types, so
+// those are packed one byte each; text is only stored for the tokens that
+// carry it, in token order. lines and columns are recovered from the offsets.
+typedef struct {
+  u8_vec types;
+  u32_vec offsets;      // byte offset of each token in the source
+  u32_vec strs;         // intern ids of the text-carrying tokens
+  u32_vec line_starts;  // built on first use by token_position()
+  const source_file *source;
+} token_stream;
+
+typedef struct {
   int line;
-};
+  int col;
+} source_pos;
 
 typedef struct {
-  vector *tokens;
+  token_stream *tokens;
   intern_table *interns;
+  source_file *source;
 } lexer_result;
 
-void print_token(const token *token);
+static inline size_t token_count(const token_stream *ts) {
+  return ts->types.size;
+}
+
+static inline token_type token_at(const token_stream *ts, size_t index) {
+  return ts->types.data[index];
+}
+
+static inline uint32_t token_text_id(const token_stream *ts, size_t text_index) {
+  return ts->strs.data[text_index];
+}
+
+static inline int token_has_text(token_type t) {
+  return t == IDENTIFIER || t == STRING || t == INTEGER || t == FLOAT || t == MULTILINE_STR;
+}
+
+source_pos token_position(token_stream *ts, size_t index);
+void print_token(FILE *out, token_type type, const char *text, source_pos pos);
 lexer_result *lex(const char *filename);
+// splits large files at line boundaries and lexes the pieces on up to
+// `threads` threads (0 picks one per core). small files are lexed in place.
+lexer_result *lex_parallel(const char *filename, int threads);
+void destroy_lexer_result(lexer_result *l);
 const char *token_type_str(token_type t);
@@ -0,0 +1,61 @@
+#include "loops.h"
+#include "opt.h"
+
+// loop invariant code motion. loops are visited inner first, so code hoisted
+// out of an inner loop lands in its preheader, which belongs to the loop
+// around it and is looked at again there. an instruction is invariant if it
+// is pure and every operand is defined outside the loop. one that may fail
+// at run time only moves if it is in the header and nothing before it there
+// has an effect: the header runs whenever the preheader does, so the error
+// happens at the same point it would have.
+
+static int is_invariant(const loop_forest *lf, const ir_loop *l, const ir_inst *inst) {
+  if (!ir_is_pure(inst->op) && inst->op != OP_CONST && inst->op != OP_STR) return 0;
+  for (uint32_t i = 0; i < inst->nargs; i++) {
+    ir_inst *arg = inst->args[i];
+    if (arg->op != OP_PARAM && loop_contains(lf, l, arg->block)) return 0;
+  }
+  return 1;
+}
+
+static int hoist_loop(loop_forest *lf, ir_loop *l) {
+  ir_inst *at = l->preheader->last;
+  int hoisted = 0;
+  for (uint32_t i = 0; i < l->nblocks; i++) {
+    ir_block *b = l->blocks[i];
+    int effects = 0;  // something before inst in the header can be observed
+    ir_inst *next;
+    for (ir_inst *inst = b->first; inst; inst = next) {
+      next = inst->next;
+      int may_fail = ir_may_fail(inst);
+      if (is_invariant(lf, l, inst) && (!may_fail || (b == l->header && !effects))) {
+        ir_remove(inst);
+        ir_insert_before(at, inst);
+        hoisted = 1;
+        continue;
+      }
+      effects |= may_fail || ir_has_side_effects(inst->op);
+    }
+  }
+  return hoisted;
+}
+
+int hoist_invariants(ir_func *f) {
+  if (!f->first) return 0;
+  ir_compute_preds(f);
+  loop_forest *lf = create_loop_forest(f);
+  if (!lf->count) {
+    destroy_loop_forest(lf);
+    return 0;
+  }
+  int changed = 0;
+  if (loop_add_preheaders(f, lf)) {
+    destroy_loop_forest(lf);
+    lf = create_loop_forest(f);
+    changed = 1;
+  }
+  for (uint32_t i = 0; i < lf->count; i++)
+    changed |= hoist_loop(lf, lf->loops[i]);
+  destroy_loop_forest(lf);
+  return changed;
+}
@@ -0,0 +1,240 @@
+#include "link.h"
+#include "diag.h"
+#include "utils.h"
+#include <elf.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// runtime/embed.S puts build/runtime.o between these
+extern const unsigned char boop_runtime_object[], boop_runtime_object_end[];
+
+#define LINK_BASE 0x400000
+#define ELF_PHDRS 4  // text, rodata, data + bss, stack
+#define ELF_HEADER_SIZE (sizeof(Elf64_Ehdr) + ELF_PHDRS * sizeof(Elf64_Phdr))
+
+enum { SEG_TEXT, SEG_RODATA, SEG_DATA, SEG_BSS, SEG_NONE };
+
+typedef struct {
+  const Elf64_Ehdr *ehdr;
+  const Elf64_Shdr *shdrs;
+  const Elf64_Sym *syms;
+  size_t nsyms;
+  const char *strtab;
+  uint8_t *segment;   // section -> SEG_*
+  uint32_t *offset;   // section -> offset in its segment
+} object;
+
+static uint32_t align_up(uint32_t v, uint32_t a) {
+  return a > 1 ? (v + a - 1) / a * a : v;
+}
+
+static int read_object(object *o, uint32_t seg_size[4]) {
+  size_t size = (size_t)(boop_runtime_object_end - boop_runtime_object);
+  const Elf64_Ehdr *eh = (const Elf64_Ehdr *)boop_runtime_object;
+  o->segment = NULL;
+  o->offset = NULL;
+  if (size < sizeof(Elf64_Ehdr) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+      eh->e_ident[EI_CLASS] != ELFCLASS64 || eh->e_type != ET_REL || eh->e_machine != EM_X86_64 ||
+      eh->e_shoff + (size_t)eh->e_shnum * sizeof(Elf64_Shdr) > size) {
+    diag_error("error: the embedded runtime is not an x86-64 relocatable object\n");
+    return 1;
+  }
+  o->ehdr = eh;
+  o->shdrs = (const Elf64_Shdr *)(boop_runtime_object + eh->e_shoff);
+  o->segment = calloc(eh->e_shnum, 1);
+  o->offset = calloc(eh->e_shnum, sizeof(uint32_t));
+  o->syms = NULL;
+  for (uint32_t i = 0; i < eh->e_shnum; i++) {
+    const Elf64_Shdr *sh = &o->shdrs[i];
+    o->segment[i] = SEG_NONE;
+    if (sh->sh_type == SHT_SYMTAB) {
+      o->syms = (const Elf64_Sym *)(boop_runtime_object + sh->sh_offset);
+      o->nsyms = sh->sh_size / sizeof(Elf64_Sym);
+      o->strtab = (const char *)boop_runtime_object + o->shdrs[sh->sh_link].sh_offset;
+    }
+    if (!(sh->sh_flags & SHF_ALLOC) || !sh->sh_size) continue;
+    int seg = sh->sh_flags & SHF_EXECINSTR ? SEG_TEXT
+              : sh->sh_type == SHT_NOBITS  ? SEG_BSS
+              : sh->sh_flags & SHF_WRITE   ? SEG_DATA
+                                           : SEG_RODATA;
+    o->segment[i] = (uint8_t)seg;
+    o->offset[i] = align_up(seg_size[seg], (uint32_t)sh->sh_addralign);
+    seg_size[seg] = o->offset[i] + (uint32_t)sh->sh_size;
+  }
+  if (!o->syms) {
+    diag_error("error: the embedded runtime has no symbol table\n");
+    return 1;
+  }
+  return 0;
+}
+
+static void free_object(object *o) {
+  free(o->segment);
+  free(o->offset);
+}
+
+static const Elf64_Sym *find_global(const object *o, const char *name) {
+  for (size_t i = 0; i < o->nsyms; i++) {
+    const Elf64_Sym *s = &o->syms[i];
+    if (ELF64_ST_BIND(s->st_info) != STB_LOCAL && s->st_shndx != SHN_UNDEF &&
+        strcmp(o->strtab + s->st_name, name) == 0)
+      return s;
+  }
+  return NULL;
+}
+
+// stores S + A - P at `at`
+static int patch_pc32(linked_program *p, uint32_t at, int64_t target, int64_t addend) {
+  int64_t v = target + addend - at;
+  if (v < INT32_MIN || v > INT32_MAX) {
+    diag_error("error: relocation out of range\n");
+    return 1;
+  }
+  for (int i = 0; i < 4; i++)
+    p->image.data[at + i] = (uint8_t)((uint64_t)v >> (8 * i));
+  return 0;
+}
+
+int link_program(const x86_module *m, const x86_code *code, uint32_t header_size,
+                 linked_program *out) {
+  // the runtime's sections go after the module's own text and rodata
+  uint32_t seg_size[4] = {(uint32_t)code->text.size, (uint32_t)code->rodata.size, 0, 0};
+  object o;
+  if (read_object(&o, seg_size)) {
+    free_object(&o);
+    return 1;
+  }
+
+  memset(out, 0, sizeof(*out));
+  out->text = align_up(header_size, 16);
+  out->text_size = seg_size[SEG_TEXT];
+  out->rodata = align_up(out->text + out->text_size, LINK_PAGE);
+  out->rodata_size = seg_size[SEG_RODATA];
+  out->data = align_up(out->rodata + out->rodata_size, LINK_PAGE);
+  out->data_size = align_up(seg_size[SEG_DATA], 64);
+  out->bss_size = seg_size[SEG_BSS];
+  uint32_t seg_base[4] = {out->text, out->rodata, out->data, out->data + out->data_size};
+
+  u8_vec_init(&out->image, NULL, out->data + out->data_size);
+  out->image.size = out->data + out->data_size;
+  memset(out->image.data, 0, out->image.size);
+  memcpy(out->image.data + out->text, code->text.data, code->text.size);
+  memcpy(out->image.data + out->rodata, code->rodata.data, code->rodata.size);
+  for (uint32_t i = 0; i < o.ehdr->e_shnum; i++) {
+    const Elf64_Shdr *sh = &o.shdrs[i];
+    if (o.segment[i] == SEG_NONE || o.segment[i] == SEG_BSS) continue;
+    memcpy(out->image.data + seg_base[o.segment[i]] + o.offset[i],
+           boop_runtime_object + sh->sh_offset, sh->sh_size);
+  }
+
+  int failed = 0;
+  const Elf64_Sym *start = find_global(&o, "_start"), *flush = find_global(&o, "boop_rt_flush");
+  ir_func *main = ir_find_func((ir_module *)m->ir, "main");
+  if (!start || !flush || !main) {
+    diag_error("error: cannot link without _start, boop_rt_flush and main\n");
+    failed = 1;
+  } else {
+    out->entry = seg_base[o.segment[start->st_shndx]] + o.offset[start->st_shndx] +
+                 (uint32_t)start->st_value;
+    out->flush = seg_base[o.segment[flush->st_shndx]] + o.offset[flush->st_shndx] +
+                 (uint32_t)flush->st_value;
+    out->main = out->text + code->offset[main->id];
+  }
+
+  // the runtime's own relocations; `main` is its only undefined symbol
+  for (uint32_t i = 0; i < o.ehdr->e_shnum && !failed; i++) {
+    const Elf64_Shdr *sh = &o.shdrs[i];
+    if (sh->sh_type != SHT_RELA || o.segment[sh->sh_info] == SEG_NONE) continue;
+    const Elf64_Rela *rel = (const Elf64_Rela *)(boop_runtime_object + sh->sh_offset);
+    uint32_t place = seg_base[o.segment[sh->sh_info]] + o.offset[sh->sh_info];
+    for (size_t k = 0; k < sh->sh_size / sizeof(Elf64_Rela) && !failed; k++) {
+      uint32_t type = ELF64_R_TYPE(rel[k].r_info);
+      const Elf64_Sym *s = &o.syms[ELF64_R_SYM(rel[k].r_info)];
+      int64_t target;
+      if (type != R_X86_64_PC32 && type != R_X86_64_PLT32) {
+        diag_error("error: unsupported relocation type %u in the runtime\n", type);
+        failed = 1;
+        break;
+      }
+      if (s->st_shndx == SHN_UNDEF) {
+        if (strcmp(o.strtab + s->st_name, "main") != 0) {
+          diag_error("error: undefined symbol %s in the runtime\n", o.strtab + s->st_name);
+          failed = 1;
+          break;
+        }
+        target = out->main;
+      } else {
+        target = seg_base[o.segment[s->st_shndx]] + o.offset[s->st_shndx] + (int64_t)s->st_value;
+      }
+      failed = patch_pc32(out, place + (uint32_t)rel[k].r_offset, target, rel[k].r_addend);
+    }
+  }
+
+  // the module's references to its functions, constants and the runtime
+  for (size_t i = 0; i < code->relocs.size && !failed; i++) {
+    const x86_reloc *r = &code->relocs.data[i];
+    const x86_sym *s = &m->syms.data[r->sym];
+    int64_t target;
+    if (s->kind == XS_FUNC) {
+      target = out->text + code->offset[r->sym];
+    } else if (s->kind == XS_EXTERN) {
+      const Elf64_Sym *rs = find_global(&o, s->name);
+      if (!rs) {
+        diag_error("error: the runtime has no %s\n", s->name);
+        failed = 1;
+        break;
+      }
+      target = seg_base[o.segment[rs->st_shndx]] + o.offset[rs->st_shndx] + (int64_t)rs->st_value;
+    } else {
+      target = out->rodata + code->offset[r->sym];
+    }
+    failed = patch_pc32(out, out->text + r->offset, target, r->addend);
+  }
+
+  free_object(&o);
+  if (failed) u8_vec_free(&out->image);
+  return failed;
+}
+
+static void program_header(Elf64_Phdr *ph, uint32_t type, uint32_t flags, uint64_t offset,
+                           uint64_t filesz, uint64_t memsz) {
+  ph->p_type = type;
+  ph->p_flags = flags;
+  ph->p_offset = offset;
+  ph->p_vaddr = ph->p_paddr = type == PT_LOAD ? LINK_BASE + offset : 0;
+  ph->p_filesz = filesz;
+  ph->p_memsz = memsz;
+  ph->p_align = type == PT_LOAD ? LINK_PAGE : 16;
+}
+
+int write_executable(const char *path, const x86_module *m, const x86_code *code) {
+  linked_program p;
+  if (link_program(m, code, ELF_HEADER_SIZE, &p)) return 1;
+
+  Elf64_Ehdr *eh = (Elf64_Ehdr *)p.image.data;
+  memcpy(eh->e_ident, ELFMAG, SELFMAG);
+  eh->e_ident[EI_CLASS] = ELFCLASS64;
+  eh->e_ident[EI_DATA] = ELFDATA2LSB;
+  eh->e_ident[EI_VERSION] = EV_CURRENT;
+  eh->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  eh->e_type = ET_EXEC;
+  eh->e_machine = EM_X86_64;
+  eh->e_version = EV_CURRENT;
+  eh->e_entry = LINK_BASE + p.entry;
+  eh->e_phoff = sizeof(Elf64_Ehdr);
+  eh->e_ehsize = sizeof(Elf64_Ehdr);
+  eh->e_phentsize = sizeof(Elf64_Phdr);
+  eh->e_phnum = ELF_PHDRS;
+
+  // the headers ride along in the text segment
+  Elf64_Phdr *ph = (Elf64_Phdr *)(p.image.data + sizeof(Elf64_Ehdr));
+  program_header(&ph[0], PT_LOAD, PF_R | PF_X, 0, p.text + p.text_size, p.text + p.text_size);
+  program_header(&ph[1], PT_LOAD, PF_R, p.rodata, p.rodata_size, p.rodata_size);
+  program_header(&ph[2], PT_LOAD, PF_R | PF_W, p.data, p.data_size, p.data_size + p.bss_size);
+  program_header(&ph[3], PT_GNU_STACK, PF_R | PF_W, 0, 0, 0);
+
+  int failed = write_file(path, p.image.data, p.image.size) != 0 || chmod(path, 0755) != 0;
+  if (failed) diag_error("failed to write %s\n", path);
+  u8_vec_free(&p.image);
+  return failed;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "vector.h"
+#include "x86.h"
+#include <stdint.h>
+
+// a minimal static linker: the module's code plus the runtime object that
+// the build embeds in the compiler (runtime/runtime.c), laid out as one
+// image with the text, read-only data and writable data each starting on a
+// page. every relocation is pc-relative, so the image runs wherever it is
+// mapped: at a fixed address in an executable, or in memory for --run.
+
+#define LINK_PAGE 4096
+
+typedef struct {
+  u8_vec image;            // from the start of the mapping; bss isn't included
+  uint32_t text, text_size;
+  uint32_t rodata, rodata_size;
+  uint32_t data, data_size, bss_size;  // bss follows the data
+  uint32_t entry;          // _start
+  uint32_t main;
+  uint32_t flush;          // boop_rt_flush, for callers that return from main
+} linked_program;
+
+// `header_size` bytes are left at the start of the image for the caller.
+// returns 0 on success; problems are reported through diag_error()
+int link_program(const x86_module *m, const x86_code *code, uint32_t header_size,
+                 linked_program *out);
+
+// a static elf64 executable loaded at a fixed address, written with a single
+// write_file()
+int write_executable(const char *path, const x86_module *m, const x86_code *code);
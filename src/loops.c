@@ -0,0 +1,169 @@
+#include "loops.h"
+#include "vector.h"
+
+VEC_DECL(block_vec, ir_block *)
+
+static ir_loop *outermost(ir_loop *l) {
+  while (l->parent)
+    l = l->parent;
+  return l;
+}
+
+// walks back from the latches to the header. blocks of loops found earlier
+// (inner ones, since headers are visited deepest first) keep their innermost
+// loop, and the outermost of those loops gets this one as its parent
+static void find_body(loop_forest *lf, ir_loop *l, uint32_t *seen, uint32_t stamp,
+                      block_vec *stack) {
+  seen[l->header->id] = stamp;
+  lf->loop_of[l->header->id] = l;
+  for (uint32_t i = 0; i < l->nlatches; i++)
+    if (seen[l->latches[i]->id] != stamp) {
+      seen[l->latches[i]->id] = stamp;
+      block_vec_push(stack, l->latches[i]);
+    }
+
+  while (stack->size) {
+    ir_block *b = stack->data[--stack->size];
+    ir_loop *inner = lf->loop_of[b->id];
+    if (!inner)
+      lf->loop_of[b->id] = l;
+    else if ((inner = outermost(inner)) != l)
+      inner->parent = l;
+    for (uint32_t i = 0; i < b->npreds; i++) {
+      ir_block *p = b->preds[i];
+      if (!dom_reachable(lf->dt, p) || seen[p->id] == stamp) continue;
+      seen[p->id] = stamp;
+      block_vec_push(stack, p);
+    }
+  }
+}
+
+static int is_latch(const ir_loop *l, const ir_block *b) {
+  for (uint32_t i = 0; i < l->nlatches; i++)
+    if (l->latches[i] == b) return 1;
+  return 0;
+}
+
+static ir_block *find_preheader(const ir_loop *l) {
+  ir_block *outside = NULL, *succ[2];
+  for (uint32_t i = 0; i < l->header->npreds; i++) {
+    ir_block *p = l->header->preds[i];
+    if (is_latch(l, p)) continue;
+    if (outside) return NULL;
+    outside = p;
+  }
+  return outside && ir_succs(outside, succ) == 1 ? outside : NULL;
+}
+
+loop_forest *create_loop_forest(ir_func *f) {
+  arena *a = create_arena("loops", 16 * 1024);
+  loop_forest *lf = arena_calloc(a, 1, sizeof(loop_forest));
+  lf->arena = a;
+  lf->dt = create_dom_tree(f);
+  dom_tree *dt = lf->dt;
+  lf->loop_of = arena_calloc(a, dt->nblocks, sizeof(ir_loop *));
+  lf->loops = arena_alloc(a, dt->count * sizeof(ir_loop *));
+
+  ir_block **pre = arena_alloc(a, dt->count * sizeof(ir_block *));
+  uint32_t *seen = arena_calloc(a, dt->nblocks, sizeof(uint32_t));
+  block_vec stack;
+  block_vec_init(&stack, a, 16);
+  dom_preorder(dt, pre);
+  for (uint32_t i = dt->count; i-- > 0;) {
+    ir_block *h = pre[i];
+    uint32_t nlatches = 0;
+    for (uint32_t j = 0; j < h->npreds; j++)
+      nlatches += dom_reachable(dt, h->preds[j]) && dominates(dt, h, h->preds[j]);
+    if (!nlatches) continue;
+
+    ir_loop *l = arena_calloc(a, 1, sizeof(ir_loop));
+    l->header = h;
+    l->latches = arena_alloc(a, nlatches * sizeof(ir_block *));
+    for (uint32_t j = 0; j < h->npreds; j++)
+      if (dom_reachable(dt, h->preds[j]) && dominates(dt, h, h->preds[j]))
+        l->latches[l->nlatches++] = h->preds[j];
+    lf->loops[lf->count++] = l;
+    find_body(lf, l, seen, lf->count, &stack);
+  }
+
+  // parents were found after their children
+  for (uint32_t i = lf->count; i-- > 0;) {
+    ir_loop *l = lf->loops[i];
+    l->depth = l->parent ? l->parent->depth + 1 : 1;
+    l->preheader = find_preheader(l);
+  }
+
+  // block lists in reverse postorder: count, then fill
+  for (uint32_t i = 0; i < dt->count; i++)
+    for (ir_loop *l = lf->loop_of[dt->order[i]->id]; l; l = l->parent)
+      l->nblocks++;
+  for (uint32_t i = 0; i < lf->count; i++) {
+    lf->loops[i]->blocks = arena_alloc(a, lf->loops[i]->nblocks * sizeof(ir_block *));
+    lf->loops[i]->nblocks = 0;
+  }
+  for (uint32_t i = 0; i < dt->count; i++)
+    for (ir_loop *l = lf->loop_of[dt->order[i]->id]; l; l = l->parent)
+      l->blocks[l->nblocks++] = dt->order[i];
+  return lf;
+}
+
+void destroy_loop_forest(loop_forest *lf) {
+  if (!lf) return;
+  destroy_dom_tree(lf->dt);
+  destroy_arena(lf->arena);
+}
+
+int loop_contains(const loop_forest *lf, const ir_loop *l, const ir_block *b) {
+  if (b->id >= lf->dt->nblocks) return 0;
+  ir_loop *x = lf->loop_of[b->id];
+  while (x && x != l)
+    x = x->parent;
+  return x == l;
+}
+
+static void add_preheader(ir_func *f, ir_loop *l) {
+  ir_block *h = l->header, *p = ir_add_block_before(f, h);
+  for (ir_inst *phi = h->first; phi && phi->op == OP_PHI; phi = phi->next) {
+    ir_inst *merged = NULL;
+    uint32_t kept = 0, outside = 0;
+    for (uint32_t i = 0; i < phi->nargs; i++)
+      outside += !is_latch(l, phi->imm.incoming[i]);
+    if (outside > 1) {
+      merged = ir_new_inst(f, OP_PHI, phi->type, 0);
+      ir_append(p, merged);
+    }
+    for (uint32_t i = 0; i < phi->nargs; i++) {
+      if (is_latch(l, phi->imm.incoming[i])) {
+        phi->args[kept] = phi->args[i];
+        phi->imm.incoming[kept++] = phi->imm.incoming[i];
+      } else if (merged) {
+        ir_add_incoming(f, merged, phi->args[i], phi->imm.incoming[i]);
+      } else {
+        phi->args[kept] = phi->args[i];
+        phi->imm.incoming[kept++] = p;
+      }
+    }
+    phi->nargs = kept;
+    if (merged) ir_add_incoming(f, phi, merged, p);
+  }
+  ir_emit_jmp(f, p, h);
+
+  for (uint32_t i = 0; i < h->npreds; i++) {
+    ir_inst *t = h->preds[i]->last;
+    if (is_latch(l, h->preds[i])) continue;
+    for (int j = 0; j < (t->op == OP_BR ? 2 : 1); j++)
+      if (t->imm.target[j] == h) t->imm.target[j] = p;
+  }
+  l->preheader = p;
+}
+
+int loop_add_preheaders(ir_func *f, loop_forest *lf) {
+  int added = 0;
+  for (uint32_t i = 0; i < lf->count; i++) {
+    if (lf->loops[i]->preheader) continue;
+    add_preheader(f, lf->loops[i]);
+    added = 1;
+  }
+  if (added) ir_compute_preds(f);
+  return added;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "dom.h"
+#include "ir.h"
+
+// natural loops: a back edge goes to a block that dominates its source, and
+// the loop of a header is the header plus every block that reaches one of
+// its back edges without going through it. loops sharing a header are one
+// loop. irreducible cycles have no back edge and are not loops here.
+
+typedef struct ir_loop ir_loop;
+
+struct ir_loop {
+  ir_block *header;
+  ir_block *preheader;  // the one block outside the loop leading in, if it exists
+  ir_loop *parent;      // innermost loop around this one
+  uint32_t depth;       // 1 for an outermost loop
+  uint32_t nblocks;
+  ir_block **blocks;    // header first, then the body in reverse postorder
+  uint32_t nlatches;
+  ir_block **latches;   // sources of the back edges
+};
+
+typedef struct {
+  arena *arena;
+  dom_tree *dt;
+  uint32_t count;
+  ir_loop **loops;    // inner loops before the loops around them
+  ir_loop **loop_of;  // block id -> innermost loop containing it, NULL outside loops
+} loop_forest;
+
+// needs up to date preds; invalidated by any change to the cfg
+loop_forest *create_loop_forest(ir_func *f);
+void destroy_loop_forest(loop_forest *lf);
+
+int loop_contains(const loop_forest *lf, const ir_loop *l, const ir_block *b);
+
+// how many loops b is nested in, 0 outside loops
+static inline uint32_t loop_depth(const loop_forest *lf, const ir_block *b) {
+  ir_loop *l = b->id < lf->dt->nblocks ? lf->loop_of[b->id] : NULL;
+  return l ? l->depth : 0;
+}
+
+// gives every loop header a preheader: a block outside the loop whose only
+// successor is the header and which is the header's only predecessor from
+// outside. returns nonzero if blocks were added, which invalidates `lf`.
+int loop_add_preheaders(ir_func *f, loop_forest *lf);
@@ -0,0 +1,822 @@
+#include "lower.h"
+#include "diag.h"
+#include "intern.h"
+#include <string.h>
+
+// every variable gets one slot whose type is the join of everything assigned
+// to it, found per function by iterating to a fixpoint before any code is
+// emitted. a function is lowered once for each tuple of argument types its
+// calls pass (an instance), so its parameters have those types and it returns
+// the join of what it returns. instances and their return types are found by
+// a worklist over the whole program: an instance is retyped whenever the
+// return type of something it calls grows.
+typedef struct {
+  str_id name;
+  ir_type type;
+  ir_inst *slot;
+} variable;
+
+VEC_DECL(variable_vec, variable)
+
+// calls with more kinds of argument tuples than this share the generic instance
+#define MAX_INSTANCES 8
+#define NO_INSTANCE UINT32_MAX
+
+// one function for one tuple of parameter types. every function has a generic
+// instance taking `num`s (main takes argc and argv instead) for calls whose
+// arguments are dynamically typed
+typedef struct {
+  const ast_node *fn;
+  ir_type *params;
+  ir_type ret;   // void while nothing it returns is known
+  int fixed;     // main: the types are given, not inferred
+  int used;      // reachable from main, or the only way into its function
+  int reached;   // on a generic instance: some instance of the function is used
+  int queued;
+  uint32_t seen;   // index + 1 of the instance last typed calling it
+  uint32_t next;   // index of the function's next instance, or NO_INSTANCE
+  u32_vec callers;  // instances to retype when ret grows
+  ir_func *f;
+} instance;
+
+VEC_DECL(instance_vec, instance)
+
+typedef struct {
+  const ast *tree;
+  ir_module *module;
+  uint32_t *generic;     // by str_id of the function name: index + 1 into insts, 0 if none
+  uint32_t *var_index;   // by str_id: index + 1 into vars, 0 if not a variable
+  variable_vec vars;
+  instance_vec insts;
+  u32_vec work;     // instances to retype
+  uint32_t inst;    // the instance being typed or lowered
+  int marking;      // typing marks the instances calls reach as used
+  ir_func *func;
+  ir_block *block;  // insertion point, NULL once every path has returned
+  int changed;
+  int errors;
+} lowerer;
+
+// the source name of the function being lowered, whichever instance it is
+static const char *func_name(lowerer *l) {
+  return l->func ? ast_str(l->tree, l->insts.data[l->inst].fn->data.function.name)
+                 : "<top level>";
+}
+
+static void error(lowerer *l, const char *msg, str_id name) {
+  diag_error("%s '%s' in function %s\n", msg, ast_str(l->tree, name), func_name(l));
+  l->errors++;
+}
+
+static const ast_node *node(lowerer *l, node_id id) {
+  return ast_get(l->tree, id);
+}
+
+static const ast_node *child(lowerer *l, const ast_node *n, uint32_t i) {
+  return ast_get(l->tree, ast_child(l->tree, n, i));
+}
+
+static variable *find_var(lowerer *l, str_id name) {
+  uint32_t i = l->var_index[name];
+  return i ? &l->vars.data[i - 1] : NULL;
+}
+
+static variable *declare_var(lowerer *l, str_id name, ir_type type) {
+  variable *v = find_var(l, name);
+  if (v) return v;
+  variable_vec_push(&l->vars, (variable){name, type, NULL});
+  l->var_index[name] = (uint32_t)l->vars.size;
+  return &l->vars.data[l->vars.size - 1];
+}
+
+/* types */
+
+static ir_type join(ir_type a, ir_type b) {
+  if (a == IR_VOID || a == b) return b;
+  if (b == IR_VOID) return a;
+  if ((a == IR_BOOL && b == IR_I64) || (a == IR_I64 && b == IR_BOOL)) return IR_I64;
+  return IR_NUM;
+}
+
+// the type two operands are brought to before an arithmetic op; bools count as
+// ints. void means "not known yet" while the fixpoint is still running.
+static ir_type arith_type(ir_type a, ir_type b) {
+  if (a == IR_VOID || b == IR_VOID) return IR_VOID;
+  if (a == IR_NUM || b == IR_NUM || a == IR_PTR || b == IR_PTR) return IR_NUM;
+  return a == IR_F64 || b == IR_F64 ? IR_F64 : IR_I64;
+}
+
+static int is_comparison(token_type op) {
+  return op == COMP_EQ || op == NOT_EQ || op == LT || op == LTE || op == GT || op == GTE;
+}
+
+static void assign_type(lowerer *l, str_id name, ir_type type) {
+  variable *v = declare_var(l, name, IR_VOID);
+  ir_type joined = join(v->type, type);
+  if (joined != v->type) {
+    v->type = joined;
+    l->changed = 1;
+  }
+}
+
+static ir_type type_of(lowerer *l, node_id id);
+
+// whether running n's statements from `from` on always ends in a return, the
+// way lowering sees it: a loop can always be left
+static int always_returns(lowerer *l, const ast_node *n, uint32_t from) {
+  for (uint32_t i = from; i < n->count; i++) {
+    const ast_node *s = child(l, n, i);
+    if (s->type == NODE_RETURN) return 1;
+    if (s->type != NODE_IF) continue;
+    // an if/elif chain returns if every branch does and it ends in an else
+    for (const ast_node *b = s; always_returns(l, b, 0); b = node(l, b->data.control.else_body))
+      if (!b->data.control.else_body) {
+        if (!b->data.control.condition) return 1;
+        break;
+      }
+  }
+  return 0;
+}
+
+static void enqueue(lowerer *l, uint32_t k) {
+  if (l->insts.data[k].queued) return;
+  l->insts.data[k].queued = 1;
+  u32_vec_push(&l->work, k);
+}
+
+// adds an instance after `last`, the function's last one so far (if any)
+static uint32_t add_instance(lowerer *l, const ast_node *fn, ir_type *params, int fixed,
+                             uint32_t last) {
+  // falling off the end returns a zero int
+  ir_type ret = fixed || !always_returns(l, fn, fn->nparams) ? IR_I64 : IR_VOID;
+  instance inst = {.fn = fn, .params = params, .ret = ret, .fixed = fixed, .next = NO_INSTANCE};
+  u32_vec_init(&inst.callers, NULL, 0);
+  instance_vec_push(&l->insts, inst);
+  uint32_t k = (uint32_t)l->insts.size - 1;
+  if (last != k) l->insts.data[last].next = k;
+  enqueue(l, k);
+  return k;
+}
+
+// the instance of generic instance g's function taking these argument types,
+// added if there is none yet. main, calls with the wrong number of arguments
+// and functions with too many instances already get the generic one
+static uint32_t find_instance(lowerer *l, uint32_t g, uint32_t nargs, const ir_type *args) {
+  const ast_node *fn = l->insts.data[g].fn;
+  if (l->insts.data[g].fixed || nargs != fn->nparams) return g;
+  uint32_t count = 0, last = g;
+  for (uint32_t i = g; i != NO_INSTANCE; last = i, i = l->insts.data[i].next, count++)
+    if (memcmp(l->insts.data[i].params, args, nargs * sizeof(ir_type)) == 0) return i;
+  if (count >= MAX_INSTANCES) return g;
+  ir_type *params = arena_alloc(l->module->arena, (nargs ? nargs : 1) * sizeof(ir_type));
+  if (nargs) memcpy(params, args, nargs * sizeof(ir_type));
+  return add_instance(l, fn, params, 0, last);
+}
+
+static void use(lowerer *l, uint32_t k) {
+  instance *inst = &l->insts.data[k];
+  if (inst->used) return;
+  inst->used = 1;
+  l->insts.data[l->generic[inst->fn->data.function.name] - 1].reached = 1;
+  enqueue(l, k);
+}
+
+// the return type of the call n, recording the typed instance as a caller of
+// the one it reaches. void if an argument's type isn't known yet
+static ir_type type_call(lowerer *l, const ast_node *n) {
+  ir_type *args = malloc((n->count ? n->count : 1) * sizeof(ir_type));
+  int known = 1;
+  for (uint32_t i = 0; i < n->count; i++) {
+    args[i] = type_of(l, ast_child(l->tree, n, i));
+    if (args[i] == IR_VOID) known = 0;
+  }
+  uint32_t g = l->generic[n->data.function.name];
+  ir_type t = IR_VOID;
+  if (g && known) {
+    uint32_t k = find_instance(l, g - 1, n->count, args);
+    instance *inst = &l->insts.data[k];
+    if (inst->seen != l->inst + 1) {
+      inst->seen = l->inst + 1;
+      u32_vec_push(&inst->callers, l->inst);
+    }
+    t = inst->ret;
+    if (l->marking) use(l, k);
+  }
+  free(args);
+  return t;
+}
+
+static ir_type type_of(lowerer *l, node_id id) {
+  const ast_node *n = node(l, id);
+  switch (n->type) {
+  case NODE_NUMBER: return ast_number(l->tree, n).num_type == TYPE_INT ? IR_I64 : IR_F64;
+  case NODE_STRING: return IR_PTR;
+  case NODE_IDENTIFIER: {
+    variable *v = find_var(l, n->data.string);
+    return v ? v->type : IR_VOID;
+  }
+  case NODE_CALL: return type_call(l, n);
+  case NODE_UNARY_OP: {
+    ir_type t = type_of(l, n->data.binary.left);
+    if (n->op == NOT) return IR_BOOL;
+    if (n->op == BITW_NOT) return IR_I64;
+    if (n->op == SUB) return arith_type(t, t);
+    t = arith_type(t, IR_I64);  // ++ and --
+    const ast_node *operand = node(l, n->data.binary.left);
+    if (operand->type == NODE_IDENTIFIER) assign_type(l, operand->data.string, t);
+    return t;
+  }
+  case NODE_BINARY_OP: {
+    ir_type a = type_of(l, n->data.binary.left), b = type_of(l, n->data.binary.right);
+    if (is_comparison(n->op) || n->op == AND || n->op == OR) return IR_BOOL;
+    if (n->op == BITW_AND || n->op == BITW_OR) return IR_I64;
+    return arith_type(a, b);
+  }
+  default: return IR_VOID;
+  }
+}
+
+static void type_block(lowerer *l, const ast_node *n, uint32_t from) {
+  for (uint32_t i = from; i < n->count; i++) {
+    const ast_node *s = child(l, n, i);
+    switch (s->type) {
+    case NODE_ASSIGNMENT:
+      assign_type(l, s->data.assignment.var_name, type_of(l, s->data.assignment.value));
+      break;
+    case NODE_IF:
+      for (; s; s = s->data.control.else_body ? node(l, s->data.control.else_body) : NULL) {
+        if (s->data.control.condition) type_of(l, s->data.control.condition);
+        type_block(l, s, 0);
+      }
+      break;
+    case NODE_WHILE:
+      type_of(l, s->data.control.condition);
+      type_block(l, s, 0);
+      break;
+    case NODE_FOR: {
+      const ast_node *init = node(l, s->data.loop.initializer);
+      str_id name = init->data.assignment.var_name;
+      assign_type(l, name, type_of(l, init->data.assignment.value));
+      type_of(l, s->data.loop.condition);
+      ir_type step = type_of(l, s->data.loop.step);
+      assign_type(l, name, arith_type(find_var(l, name)->type, step));
+      type_block(l, s, 0);
+      break;
+    }
+    case NODE_RETURN: {
+      ir_type t = type_of(l, s->data.expression);
+      instance *inst = &l->insts.data[l->inst];
+      if (!inst->fixed) inst->ret = join(inst->ret, t);
+      break;
+    }
+    case NODE_PRINT: type_of(l, s->data.expression); break;
+    default: type_of(l, ast_child(l->tree, n, i)); break;
+    }
+  }
+}
+
+// types the variables of instance k and joins what it returns into its
+// return type. variables only ever assigned from themselves are ints
+static void type_instance(lowerer *l, uint32_t k) {
+  const ast_node *fn = l->insts.data[k].fn;
+  l->inst = k;
+  for (size_t i = 0; i < l->vars.size; i++)
+    l->var_index[l->vars.data[i].name] = 0;
+  l->vars.size = 0;
+  for (uint32_t i = 0; i < fn->nparams; i++)
+    declare_var(l, child(l, fn, i)->data.string, l->insts.data[k].params[i]);
+
+  for (int unknown = 1; unknown;) {
+    do {
+      l->changed = 0;
+      type_block(l, fn, fn->nparams);
+    } while (l->changed);
+    unknown = 0;
+    for (size_t i = 0; i < l->vars.size; i++)
+      if (l->vars.data[i].type == IR_VOID) {
+        l->vars.data[i].type = IR_I64;
+        unknown = 1;
+      }
+  }
+}
+
+// retypes instances until no return type grows and no new instance turns up.
+// a return type still unknown then belongs to code that can only recurse or
+// loop forever and is taken to be an int
+static void infer_instances(lowerer *l) {
+  for (int unknown = 1; unknown;) {
+    while (l->work.size) {
+      uint32_t k = u32_vec_pop(&l->work);
+      l->insts.data[k].queued = 0;
+      ir_type ret = l->insts.data[k].ret;
+      type_instance(l, k);
+      const instance *inst = &l->insts.data[k];
+      if (inst->ret != ret)
+        for (size_t i = 0; i < inst->callers.size; i++)
+          enqueue(l, inst->callers.data[i]);
+    }
+    unknown = 0;
+    for (uint32_t k = 0; k < l->insts.size; k++) {
+      instance *inst = &l->insts.data[k];
+      if (inst->ret != IR_VOID) continue;
+      inst->ret = IR_I64;
+      for (size_t i = 0; i < inst->callers.size; i++)
+        enqueue(l, inst->callers.data[i]);
+      unknown = 1;
+    }
+  }
+}
+
+static void mark_from(lowerer *l, uint32_t k) {
+  use(l, k);
+  while (l->work.size) {
+    uint32_t i = u32_vec_pop(&l->work);
+    l->insts.data[i].queued = 0;
+    type_instance(l, i);
+  }
+}
+
+// marks what main reaches as used, then the generic instance of each function
+// nothing reaches, so every function is still lowered and checked
+static void mark_instances(lowerer *l, uint32_t ngeneric) {
+  l->marking = 1;
+  for (uint32_t g = 0; g < ngeneric; g++)
+    if (l->insts.data[g].fixed) mark_from(l, g);
+  for (uint32_t g = 0; g < ngeneric; g++)
+    if (!l->insts.data[g].reached) mark_from(l, g);
+  l->marking = 0;
+}
+
+/* emission */
+
+static ir_inst *emit(lowerer *l, ir_op op, ir_type type, ir_inst *a, ir_inst *b) {
+  return ir_emit(l->func, l->block, op, type, a, b);
+}
+
+static ir_inst *const_int(lowerer *l, ir_type type, int64_t value) {
+  return ir_const_int(l->func, l->block, type, value);
+}
+
+static ir_inst *zero(lowerer *l, ir_type type) {
+  switch (type) {
+  case IR_F64: return ir_const_float(l->func, l->block, 0.0);
+  case IR_PTR: {
+    ir_inst *s = emit(l, OP_STR, IR_PTR, NULL, NULL);
+    s->imm.index = ir_add_string(l->module, "", 0);
+    return s;
+  }
+  case IR_NUM: return emit(l, OP_CONV, IR_NUM, const_int(l, IR_I64, 0), NULL);
+  default: return const_int(l, type, 0);
+  }
+}
+
+static ir_inst *convert(lowerer *l, ir_inst *v, ir_type to) {
+  if (v->type == to) return v;
+  if ((to == IR_PTR && v->type != IR_NUM) ||
+      (v->type == IR_PTR && (to == IR_I64 || to == IR_F64))) {
+    diag_error("a %s value is used as %s in function %s\n", ir_type_str(v->type),
+               ir_type_str(to), func_name(l));
+    l->errors++;
+    return zero(l, to);
+  }
+  return emit(l, OP_CONV, to, v, NULL);
+}
+
+static ir_inst *truth(lowerer *l, ir_inst *v) {
+  return convert(l, v, IR_BOOL);
+}
+
+static ir_block *new_block(lowerer *l) {
+  return ir_add_block(l->func);
+}
+
+static void jump(lowerer *l, ir_block *target) {
+  if (l->block) ir_emit_jmp(l->func, l->block, target);
+  l->block = NULL;
+}
+
+static ir_inst *lower_expr(lowerer *l, node_id id);
+
+// && and || only evaluate the right side when they have to
+static ir_inst *lower_logical(lowerer *l, const ast_node *n) {
+  ir_inst *lhs = truth(l, lower_expr(l, n->data.binary.left));
+  ir_inst *shortcut = const_int(l, IR_BOOL, n->op == OR);
+  ir_block *from = l->block, *rhs = new_block(l), *done = new_block(l);
+  if (n->op == AND)
+    ir_emit_br(l->func, l->block, lhs, rhs, done);
+  else
+    ir_emit_br(l->func, l->block, lhs, done, rhs);
+
+  l->block = rhs;
+  ir_inst *value = truth(l, lower_expr(l, n->data.binary.right));
+  ir_block *rhs_end = l->block;
+  jump(l, done);
+
+  l->block = done;
+  ir_inst *phi = emit(l, OP_PHI, IR_BOOL, NULL, NULL);
+  ir_add_incoming(l->func, phi, shortcut, from);
+  ir_add_incoming(l->func, phi, value, rhs_end);
+  return phi;
+}
+
+static ir_op binary_op(token_type t) {
+  switch (t) {
+  case ADD: return OP_ADD;
+  case SUB: return OP_SUB;
+  case MUL: return OP_MUL;
+  case DIV: return OP_DIV;
+  case MODULO: return OP_MOD;
+  case CARROT: return OP_POW;
+  case BITW_AND: return OP_AND;
+  case BITW_OR: return OP_OR;
+  case COMP_EQ: return OP_EQ;
+  case NOT_EQ: return OP_NEQ;
+  case LT: return OP_LT;
+  case LTE: return OP_LE;
+  case GT: return OP_GT;
+  case GTE: return OP_GE;
+  default: return OP_COUNT;
+  }
+}
+
+static ir_inst *lower_binary(lowerer *l, const ast_node *n) {
+  if (n->op == AND || n->op == OR) return lower_logical(l, n);
+
+  ir_inst *a = lower_expr(l, n->data.binary.left);
+  ir_inst *b = lower_expr(l, n->data.binary.right);
+  ir_op op = binary_op(n->op);
+
+  if (op == OP_AND || op == OP_OR)
+    return emit(l, op, IR_I64, convert(l, a, IR_I64), convert(l, b, IR_I64));
+
+  // strings only compare for equality; equal literals share one address
+  int strings = a->type == IR_PTR || b->type == IR_PTR;
+  if (strings && a->type == b->type && (op == OP_EQ || op == OP_NEQ))
+    return emit(l, op, IR_BOOL, a, b);
+  if (strings && a->type != IR_NUM && b->type != IR_NUM) {
+    diag_error("operator %s is not supported on strings in function %s\n",
+               token_type_str(n->op), func_name(l));
+    l->errors++;
+    return zero(l, is_comparison(n->op) ? IR_BOOL : IR_I64);
+  }
+
+  ir_type t = arith_type(a->type, b->type);
+  a = convert(l, a, t);
+  b = convert(l, b, t);
+  return emit(l, op, is_comparison(n->op) ? IR_BOOL : t, a, b);
+}
+
+static ir_inst *lower_unary(lowerer *l, const ast_node *n) {
+  ir_inst *v = lower_expr(l, n->data.binary.left);
+  if (v->type == IR_PTR && n->op != NOT) {
+    diag_error("operator %s is not supported on strings in function %s\n",
+               token_type_str(n->op), func_name(l));
+    l->errors++;
+    return zero(l, IR_I64);
+  }
+
+  switch (n->op) {
+  case NOT: return emit(l, OP_NOT, IR_BOOL, truth(l, v), NULL);
+  case BITW_NOT: return emit(l, OP_NOT, IR_I64, convert(l, v, IR_I64), NULL);
+  case SUB: {
+    ir_type t = arith_type(v->type, v->type);
+    return emit(l, OP_NEG, t, convert(l, v, t), NULL);
+  }
+  default: {
+    // ++x and --x; on a variable they also store the result back
+    ir_type t = arith_type(v->type, IR_I64);
+    ir_inst *one = convert(l, const_int(l, IR_I64, 1), t);
+    ir_inst *r = emit(l, n->op == ADD_ONE ? OP_ADD : OP_SUB, t, convert(l, v, t), one);
+    const ast_node *operand = node(l, n->data.binary.left);
+    if (operand->type == NODE_IDENTIFIER) {
+      variable *var = find_var(l, operand->data.string);
+      emit(l, OP_STORE, IR_VOID, var->slot, convert(l, r, var->type));
+    }
+    return r;
+  }
+  }
+}
+
+static ir_inst *lower_call(lowerer *l, const ast_node *n) {
+  uint32_t g = l->generic[n->data.function.name];
+  if (!g) {
+    error(l, "call to undefined function", n->data.function.name);
+    return zero(l, IR_NUM);
+  }
+  if (l->insts.data[g - 1].fn->nparams != n->count) {
+    error(l, "wrong number of arguments in call to", n->data.function.name);
+    return zero(l, l->insts.data[g - 1].ret);
+  }
+
+  ir_inst **args = arena_alloc(l->module->arena, (n->count ? n->count : 1) * sizeof(ir_inst *));
+  ir_type *types = malloc((n->count ? n->count : 1) * sizeof(ir_type));
+  for (uint32_t i = 0; i < n->count; i++) {
+    args[i] = lower_expr(l, ast_child(l->tree, n, i));
+    types[i] = args[i]->type;
+  }
+  // typing found the same instance unless something was already reported
+  ir_func *callee = l->insts.data[find_instance(l, g - 1, n->count, types)].f;
+  free(types);
+  if (!callee) return zero(l, IR_NUM);
+  for (uint32_t i = 0; i < n->count; i++)
+    args[i] = convert(l, args[i], callee->params[i]->type);
+
+  ir_inst *call = ir_new_inst(l->func, OP_CALL, callee->ret, 0);
+  call->imm.callee = callee;
+  call->args = args;
+  call->nargs = call->cap = n->count;
+  ir_append(l->block, call);
+  return call;
+}
+
+static ir_inst *lower_expr(lowerer *l, node_id id) {
+  const ast_node *n = node(l, id);
+  switch (n->type) {
+  case NODE_NUMBER: {
+    number_value num = ast_number(l->tree, n);
+    if (num.num_type == TYPE_INT) return const_int(l, IR_I64, (int64_t)num.value);
+    return ir_const_float(l->func, l->block, num.value);
+  }
+  case NODE_STRING: {
+    const char *s = ast_str(l->tree, n->data.string);
+    ir_inst *str = emit(l, OP_STR, IR_PTR, NULL, NULL);
+    str->imm.index = ir_add_string(l->module, s, strlen(s));
+    return str;
+  }
+  case NODE_IDENTIFIER: {
+    variable *v = find_var(l, n->data.string);
+    if (!v) {
+      error(l, "unknown variable", n->data.string);
+      return zero(l, IR_I64);
+    }
+    return emit(l, OP_LOAD, v->type, v->slot, NULL);
+  }
+  case NODE_CALL: return lower_call(l, n);
+  case NODE_UNARY_OP: return lower_unary(l, n);
+  case NODE_BINARY_OP: return lower_binary(l, n);
+  default:
+    diag_error("unexpected %s node in an expression in function %s\n",
+               n->type == NODE_FUNCTION ? "function" : "statement", func_name(l));
+    l->errors++;
+    return zero(l, IR_I64);
+  }
+}
+
+static void lower_block(lowerer *l, const ast_node *n, uint32_t from);
+
+// `merge` is shared by a whole if/elif/else chain and created on first use,
+// so a chain where every branch returns leaves nothing behind
+static void lower_if(lowerer *l, const ast_node *n, ir_block **merge) {
+  ir_inst *cond = truth(l, lower_expr(l, n->data.control.condition));
+  ir_block *then = new_block(l), *other;
+  if (n->data.control.else_body) {
+    other = new_block(l);
+  } else {
+    if (!*merge) *merge = new_block(l);
+    other = *merge;
+  }
+  ir_emit_br(l->func, l->block, cond, then, other);
+
+  l->block = then;
+  lower_block(l, n, 0);
+  if (l->block) {
+    if (!*merge) *merge = new_block(l);
+    jump(l, *merge);
+  }
+
+  if (!n->data.control.else_body) return;
+  const ast_node *e = node(l, n->data.control.else_body);
+  l->block = other;
+  if (e->data.control.condition) {
+    lower_if(l, e, merge);
+  } else {
+    lower_block(l, e, 0);
+    if (l->block) {
+      if (!*merge) *merge = new_block(l);
+      jump(l, *merge);
+    }
+  }
+}
+
+static void lower_while(lowerer *l, const ast_node *n) {
+  ir_block *header = new_block(l);
+  jump(l, header);
+  l->block = header;
+  ir_inst *cond = truth(l, lower_expr(l, n->data.control.condition));
+  ir_block *body = new_block(l), *exit = new_block(l);
+  ir_emit_br(l->func, l->block, cond, body, exit);
+
+  l->block = body;
+  lower_block(l, n, 0);
+  jump(l, header);
+  l->block = exit;
+}
+
+// sign of a literal step, 0 if it isn't one
+static int step_sign(lowerer *l, node_id id) {
+  const ast_node *n = node(l, id);
+  int sign = 1;
+  if (n->type == NODE_UNARY_OP && n->op == SUB) {
+    sign = -1;
+    n = node(l, n->data.binary.left);
+  }
+  if (n->type != NODE_NUMBER) return 0;
+  double v = ast_number(l->tree, n).value;
+  return v < 0 ? -sign : sign;
+}
+
+// for i from a to b by s: b and s are evaluated once, b is exclusive
+static void lower_for(lowerer *l, const ast_node *n) {
+  const ast_node *init = node(l, n->data.loop.initializer);
+  variable *var = find_var(l, init->data.assignment.var_name);
+  ir_inst *start = lower_expr(l, init->data.assignment.value);
+  emit(l, OP_STORE, IR_VOID, var->slot, convert(l, start, var->type));
+  ir_inst *end = lower_expr(l, n->data.loop.condition);
+  ir_inst *step = lower_expr(l, n->data.loop.step);
+  int sign = step_sign(l, n->data.loop.step);
+
+  ir_block *header = new_block(l);
+  jump(l, header);
+  l->block = header;
+
+  ir_inst *i = emit(l, OP_LOAD, var->type, var->slot, NULL);
+  ir_type t = arith_type(var->type, end->type);
+  ir_inst *cond;
+  if (sign) {
+    cond = emit(l, sign > 0 ? OP_LT : OP_GT, IR_BOOL, convert(l, i, t),
+                convert(l, end, t));
+  } else {
+    // the direction is only known at run time: (i - end) * step < 0
+    ir_type dt = arith_type(t, step->type);
+    ir_inst *d = emit(l, OP_SUB, t, convert(l, i, t), convert(l, end, t));
+    ir_inst *p = emit(l, OP_MUL, dt, convert(l, d, dt), convert(l, step, dt));
+    cond = emit(l, OP_LT, IR_BOOL, p, convert(l, const_int(l, IR_I64, 0), dt));
+  }
+  ir_block *body = new_block(l), *exit = new_block(l);
+  ir_emit_br(l->func, l->block, cond, body, exit);
+
+  l->block = body;
+  lower_block(l, n, 0);
+  if (l->block) {
+    ir_block *latch = new_block(l);
+    jump(l, latch);
+    l->block = latch;
+    ir_inst *cur = emit(l, OP_LOAD, var->type, var->slot, NULL);
+    ir_type st = arith_type(var->type, step->type);
+    ir_inst *next = emit(l, OP_ADD, st, convert(l, cur, st), convert(l, step, st));
+    emit(l, OP_STORE, IR_VOID, var->slot, convert(l, next, var->type));
+    jump(l, header);
+  }
+  l->block = exit;
+}
+
+static void lower_statement(lowerer *l, const ast_node *s, node_id id) {
+  switch (s->type) {
+  case NODE_ASSIGNMENT: {
+    variable *var = find_var(l, s->data.assignment.var_name);
+    ir_inst *v = lower_expr(l, s->data.assignment.value);
+    emit(l, OP_STORE, IR_VOID, var->slot, convert(l, v, var->type));
+    break;
+  }
+  case NODE_PRINT: emit(l, OP_PRINT, IR_VOID, lower_expr(l, s->data.expression), NULL); break;
+  case NODE_RETURN: {
+    ir_inst *v = convert(l, lower_expr(l, s->data.expression), l->func->ret);
+    emit(l, OP_RET, IR_VOID, v, NULL);
+    l->block = NULL;
+    break;
+  }
+  case NODE_IF: {
+    ir_block *merge = NULL;
+    lower_if(l, s, &merge);
+    l->block = merge;
+    break;
+  }
+  case NODE_WHILE: lower_while(l, s); break;
+  case NODE_FOR: lower_for(l, s); break;
+  default: lower_expr(l, id); break;
+  }
+}
+
+// statements after a return can't run and are dropped
+static void lower_block(lowerer *l, const ast_node *n, uint32_t from) {
+  for (uint32_t i = from; i < n->count && l->block; i++)
+    lower_statement(l, child(l, n, i), ast_child(l->tree, n, i));
+}
+
+static void lower_function(lowerer *l, uint32_t k) {
+  const ast_node *fn = l->insts.data[k].fn;
+  ir_func *f = l->insts.data[k].f;
+  l->func = f;
+  for (uint32_t i = 0; i < fn->nparams; i++)
+    for (uint32_t j = 0; j < i; j++)
+      if (child(l, fn, i)->data.string == child(l, fn, j)->data.string) {
+        error(l, "duplicate parameter", child(l, fn, i)->data.string);
+        break;
+      }
+  type_instance(l, k);
+
+  l->block = new_block(l);
+  for (size_t i = 0; i < l->vars.size; i++) {
+    variable *v = &l->vars.data[i];
+    v->slot = emit(l, OP_ALLOCA, IR_PTR, NULL, NULL);
+    v->slot->imm.slot = v->type;
+  }
+  for (size_t i = 0; i < l->vars.size; i++) {
+    variable *v = &l->vars.data[i];
+    ir_inst *init = i < fn->nparams ? convert(l, f->params[i], v->type) : zero(l, v->type);
+    emit(l, OP_STORE, IR_VOID, v->slot, init);
+  }
+
+  lower_block(l, fn, fn->nparams);
+  if (l->block) emit(l, OP_RET, IR_VOID, zero(l, f->ret), NULL);
+}
+
+// main gets (argc, argv) from the runtime and returns the exit status; the
+// generic instance of every other function takes dynamically typed values
+static int declare_function(lowerer *l, const ast_node *fn) {
+  const char *name = ast_str(l->tree, fn->data.function.name);
+  int fixed = strcmp(name, "main") == 0;
+  if (fixed && fn->nparams > 2) {
+    error(l, "too many parameters (at most argc, argv) for", fn->data.function.name);
+    return 0;
+  }
+  ir_type *types = arena_alloc(l->module->arena, (fn->nparams ? fn->nparams : 1) * sizeof(ir_type));
+  for (uint32_t i = 0; i < fn->nparams; i++)
+    types[i] = fixed ? (i ? IR_PTR : IR_I64) : IR_NUM;
+  return (int)add_instance(l, fn, types, fixed, (uint32_t)l->insts.size) + 1;
+}
+
+// adds the ir functions for the used instances of the function with generic
+// instance g, which keeps the plain name. the others are named after their
+// parameter types, fib.i64, unless there's only one
+static void declare_instances(lowerer *l, uint32_t g) {
+  const ast_node *fn = l->insts.data[g].fn;
+  const char *name = ast_str(l->tree, fn->data.function.name);
+  uint32_t used = 0;
+  for (uint32_t k = g; k != NO_INSTANCE; k = l->insts.data[k].next)
+    used += l->insts.data[k].used;
+
+  char_vec buf;
+  char_vec_init(&buf, NULL, 64);
+  for (uint32_t k = g; k != NO_INSTANCE; k = l->insts.data[k].next) {
+    instance *inst = &l->insts.data[k];
+    if (!inst->used) continue;
+    buf.size = 0;
+    char_vec_push_many(&buf, name, strlen(name));
+    for (uint32_t i = 0; k != g && used > 1 && i < fn->nparams; i++) {
+      const char *t = ir_type_str(inst->params[i]);
+      char_vec_push(&buf, '.');
+      char_vec_push_many(&buf, t, strlen(t));
+    }
+    char_vec_push(&buf, '\0');
+    inst->f = ir_add_func(l->module, buf.data, inst->ret, fn->nparams, inst->params);
+  }
+  char_vec_free(&buf);
+}
+
+ir_module *gen_ir(const ast *tree, arena *arena) {
+  if (!tree) return NULL;
+
+  uint32_t names = intern_count(tree->strings);
+  lowerer l = {.tree = tree, .module = create_ir_module(arena)};
+  l.generic = arena_calloc(arena, names, sizeof(uint32_t));
+  l.var_index = arena_calloc(arena, names, sizeof(uint32_t));
+  variable_vec_init(&l.vars, NULL, 16);
+  instance_vec_init(&l.insts, NULL, 16);
+  u32_vec_init(&l.work, NULL, 16);
+
+  const ast_node *program = ast_get(tree, tree->root);
+  for (uint32_t i = 0; i < program->count; i++) {
+    const ast_node *fn = child(&l, program, i);
+    if (fn->type != NODE_FUNCTION) {
+      diag_error("only function definitions are allowed at the top level\n");
+      l.errors++;
+      continue;
+    }
+    if (l.generic[fn->data.function.name]) {
+      error(&l, "duplicate definition of", fn->data.function.name);
+      continue;
+    }
+    l.generic[fn->data.function.name] = (uint32_t)declare_function(&l, fn);
+  }
+
+  uint32_t ngeneric = (uint32_t)l.insts.size;
+  infer_instances(&l);
+  mark_instances(&l, ngeneric);
+  for (uint32_t g = 0; g < ngeneric; g++)
+    declare_instances(&l, g);
+
+  // an error in a function's body is reported once, not per instance
+  for (uint32_t g = 0; g < ngeneric; g++) {
+    int errors = l.errors;
+    for (uint32_t k = g; k != NO_INSTANCE && l.errors == errors; k = l.insts.data[k].next)
+      if (l.insts.data[k].used) lower_function(&l, k);
+  }
+
+  for (size_t k = 0; k < l.insts.size; k++)
+    u32_vec_free(&l.insts.data[k].callers);
+  instance_vec_free(&l.insts);
+  u32_vec_free(&l.work);
+  variable_vec_free(&l.vars);
+  return l.errors ? NULL : l.module;
+}
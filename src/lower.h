@@ -0,0 +1,9 @@
+#pragma once
+#include "arena.h"
+#include "ast.h"
+#include "ir.h"
+
+// lowers a parsed program to BoopIR allocated from `arena`. variables become
+// alloca slots accessed with load/store; ssa construction promotes them later.
+// returns NULL, after reporting through diag, if the program can't be lowered.
+ir_module *gen_ir(const ast *tree, arena *arena);
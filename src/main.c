@@ -1,85 +1,104 @@
-#include "ast.h"
-#include "ir.h"
-#include "lexer.h"
+#include "driver.h"
 #include "utils.h"
-#include "vector.h"
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-typedef struct {
-  int emit_ast;
-  int emit_tokens;
-  int save_ir;
-  char *filename;
-} compiler_options;
-
 void print_usage(const char *prog_name) {
   fprintf(stderr,
-          "usage: %s version %s [options] <filename>\n\n"
+          "usage: %s version %s [options] <input>...\n\n"
+          "inputs are source files, directories (every .boop file beneath them)\n"
+          "or @manifest files listing one input per line.\n\n"
           "options:\n"
           "  -a, --emit-ast     output the abstract syntax tree\n"
           "  -t, --emit-tokens  output the token stream\n"
-          "  -s, --save-ir      save the intermediate representation\n\n"
+          "  -i, --emit-ir      output the intermediate representation\n"
+          "  -s, --save-ir      save the intermediate representation to <input>.boopir\n"
+          "  -S, --emit-asm     output x86-64 assembly (link with build/runtime.o)\n"
+          "  -c, --compile      write an x86-64 linux executable next to each input\n"
+          "  -r, --run          compile each input into memory and run it\n"
+          "  -x, --interpret    run each input on the bytecode interpreter\n"
+          "  --tiered           interpret, optimizing functions and loops once they get hot\n"
+          "  --tier-threshold N calls or loop iterations that make code hot (default: 1000)\n"
+          "  --emit-bytecode    output the interpreter's bytecode\n"
+          "  --time             report compile and run times\n"
+          "  -m, --mem-stats    report front-end memory usage\n"
+          "  -O N               optimization level, 0 to keep the ir as lowered (default: 2)\n"
+          "  --opt-stats        report time spent and instructions removed per pass\n"
+          "  --inline-threshold N\n"
+          "                     inline calls costing up to N instructions at -O2, -1 for none\n"
+          "  -j, --jobs N       compile up to N files at once (default: one per core)\n"
+          "  --lex-threads N    lex large files on N threads (default: one per core)\n\n"
           "example:\n"
-          "  %s -a source.boop  emit the AST of source.boop\n",
-          prog_name, BOOPLANG_VERSION, prog_name);
+          "  %s -a source.boop  emit the AST of source.boop\n"
+          "  %s -c source.boop  build the executable ./source\n"
+          "  %s -r source.boop  run source.boop without writing anything\n"
+          "  %s -j 8 src/       compile every file under src/ on 8 threads\n",
+          prog_name, BOOPLANG_VERSION, prog_name, prog_name, prog_name, prog_name);
   exit(EXIT_FAILURE);
 }
 
-void print_token_stream(lexer_result *l) {
-  if (!l || !l->tokens) return;
-
-  printf("\n=== token stream ===\n");
-  for (size_t i = 0; i < l->tokens->size; ++i)
-    print_token((token *)get_element(l->tokens, i));
-}
-
-void parse_arguments(int argc, char *argv[], compiler_options *options) {
+int parse_arguments(int argc, char *argv[], compiler_options *options) {
   struct option long_options[] = {{"emit-ast", no_argument, NULL, 'a'},
                                   {"emit-tokens", no_argument, NULL, 't'},
+                                  {"emit-ir", no_argument, NULL, 'i'},
                                   {"save-ir", no_argument, NULL, 's'},
+                                  {"emit-asm", no_argument, NULL, 'S'},
+                                  {"compile", no_argument, NULL, 'c'},
+                                  {"run", no_argument, NULL, 'r'},
+                                  {"interpret", no_argument, NULL, 'x'},
+                                  {"tiered", no_argument, NULL, 'X'},
+                                  {"tier-threshold", required_argument, NULL, 'H'},
+                                  {"emit-bytecode", no_argument, NULL, 'B'},
+                                  {"time", no_argument, NULL, 'T'},
+                                  {"mem-stats", no_argument, NULL, 'm'},
+                                  {"jobs", required_argument, NULL, 'j'},
+                                  {"lex-threads", required_argument, NULL, 'L'},
+                                  {"opt-stats", no_argument, NULL, 'P'},
+                                  {"inline-threshold", required_argument, NULL, 'I'},
                                   {NULL, 0, NULL, 0}};
 
   int opt;
-  while ((opt = getopt_long(argc, argv, "ats", long_options, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "atisScrxmj:O:", long_options, NULL)) != -1) {
     switch (opt) {
     case 'a': options->emit_ast = 1; break;
     case 't': options->emit_tokens = 1; break;
+    case 'i': options->emit_ir = 1; break;
     case 's': options->save_ir = 1; break;
+    case 'S': options->emit_asm = 1; break;
+    case 'c': options->compile = 1; break;
+    case 'r': options->run = 1; break;
+    case 'x': options->interpret = 1; break;
+    case 'X': options->interpret = options->tiered = 1; break;
+    case 'H': options->tier_threshold = atoi(optarg); break;
+    case 'B': options->emit_bytecode = 1; break;
+    case 'T': options->time = 1; break;
+    case 'm': options->mem_stats = 1; break;
+    case 'j': options->jobs = atoi(optarg); break;
+    case 'O': options->opt_level = atoi(optarg); break;
+    case 'L': options->lex_threads = atoi(optarg); break;
+    case 'P': options->opt_stats = 1; break;
+    case 'I': options->inline_threshold = atoi(optarg); break;
     default: print_usage(argv[0]);
     }
   }
 
   if (optind >= argc) print_usage(argv[0]);
 
-  options->filename = argv[optind];
+  return optind;
 }
 
 int main(int argc, char *argv[]) {
-  compiler_options options = {0};
-  parse_arguments(argc, argv, &options);
+  compiler_options options = {.opt_level = 2};
+  int first = parse_arguments(argc, argv, &options);
 
-  lexer_result *l = lex(options.filename);
-  if (!l) {
-    fprintf(stderr, "error: lexing failed.\n");
-    return EXIT_FAILURE;
+  // executables can be written anywhere, but --run needs an x86-64 host
+  if (options.run && check_architecture() != 1) {
+    fprintf(stderr, "--run needs an x86-64 linux host.\n");
+    exit(1);
   }
 
-  if (options.emit_tokens) print_token_stream(l);
-
-  ast_node *program = gen_ast(l->tokens);
-  if (options.emit_ast) pretty_print_ast(program, 0);
-
-  // use LLVM-IR temporarily
-  // this will save an executable directly unless save ir is enabled
-  gen_ir(options.filename, options.save_ir, program);
-
-  // // check architecture before lowering
-  // if (check_architecture() == -1) {
-  //   fprintf(stderr, "aarch64-darwin is currently the only supported architecture.");
-  //   exit(1);
-  // }
+  int failed = compile_inputs(argv + first, argc - first, &options);
 
-  return EXIT_SUCCESS;
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,230 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// runtime semantics of booplang values, shared by the constant folder and
+// everything that executes code, so an expression means the same thing
+// whether it is folded at compile time or computed at run time.
+//
+// a `num` is a NaN-boxed dynamic value: the top 16 bits 0xfffc tag a 48-bit
+// signed integer, 0xfffe a 48-bit pointer, and anything else is the raw bits
+// of a double. every NaN is canonicalized on boxing, so no double can collide
+// with a tag. an integer result outside 48 bits is boxed as a double.
+
+#define NUM_TAG_MASK 0xffff000000000000ull
+#define NUM_TAG_INT 0xfffc000000000000ull
+#define NUM_TAG_PTR 0xfffe000000000000ull
+#define NUM_PAYLOAD 0x0000ffffffffffffull
+#define NUM_CANONICAL_NAN 0x7ff8000000000000ull
+#define NUM_INT_MIN (-(INT64_C(1) << 47))
+#define NUM_INT_MAX ((INT64_C(1) << 47) - 1)
+
+/* integer arithmetic: 64-bit, wrapping */
+
+static inline int64_t boop_add(int64_t a, int64_t b) {
+  return (int64_t)((uint64_t)a + (uint64_t)b);
+}
+
+static inline int64_t boop_sub(int64_t a, int64_t b) {
+  return (int64_t)((uint64_t)a - (uint64_t)b);
+}
+
+static inline int64_t boop_mul(int64_t a, int64_t b) {
+  return (int64_t)((uint64_t)a * (uint64_t)b);
+}
+
+// division truncates; callers check for a zero divisor, which is a runtime
+// error. INT64_MIN / -1 wraps instead of trapping.
+static inline int64_t boop_div(int64_t a, int64_t b) {
+  return b == -1 ? boop_sub(0, a) : a / b;
+}
+
+// the remainder takes the sign of the dividend, as in c
+static inline int64_t boop_mod(int64_t a, int64_t b) {
+  return b == -1 ? 0 : a % b;
+}
+
+// a negative exponent gives the truncated reciprocal: 0 unless |a| is 1
+static inline int64_t boop_pow(int64_t a, int64_t e) {
+  if (e < 0) return a == 1 ? 1 : a == -1 ? (e & 1 ? -1 : 1) : 0;
+  uint64_t r = 1, x = (uint64_t)a;
+  for (; e; e >>= 1) {
+    if (e & 1) r *= x;
+    x *= x;
+  }
+  return (int64_t)r;
+}
+
+// float to integer truncates; NaN and out of range values give INT64_MIN,
+// which is what cvttsd2si produces
+static inline int64_t boop_ftoi(double d) {
+  return d >= -9223372036854775808.0 && d < 9223372036854775808.0 ? (int64_t)d : INT64_MIN;
+}
+
+/* float math. on x86-64 pow and fmod run on the x87 unit instead of calling
+   libm, so generated code and its runtime, which have no libc, compute the
+   same bits as the constant folder. */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// exact, as fmod is: fprem reduces in steps until it clears C2
+static inline double boop_fmod(double x, double y) {
+  long double r;
+  __asm__("1: fprem\n\tfnstsw %%ax\n\ttestw $0x400, %%ax\n\tjnz 1b"
+          : "=t"(r)
+          : "0"((long double)x), "u"((long double)y)
+          : "ax", "cc");
+  return (double)r;
+}
+
+// x ^ y for finite x > 0 as 2 ^ (y * log2 x), in extended precision
+static inline double boop_exp2_log2(double x, double y) {
+  long double t, n, r;
+  __asm__("fyl2x" : "=t"(t) : "0"((long double)x), "u"((long double)y) : "st(1)");
+  if (t > 2000) return INFINITY;
+  if (t < -2000) return 0.0;
+  __asm__("frndint" : "=t"(n) : "0"(t));
+  __asm__("f2xm1" : "=t"(r) : "0"(t - n));
+  __asm__("fscale" : "=t"(r) : "0"(r + 1), "u"(n));
+  return (double)r;
+}
+#else
+static inline double boop_fmod(double x, double y) {
+  return fmod(x, y);
+}
+
+static inline double boop_exp2_log2(double x, double y) {
+  return pow(x, y);
+}
+#endif
+
+// small integer exponents are multiplied out, so `x ^ 2` is exactly `x * x`
+// whether it is folded, strength reduced or computed at run time. the special
+// cases are c's pow.
+static inline double boop_fpow(double x, double y) {
+  if (y == 2.0) return x * x;
+  if (y == 3.0) return x * x * x;
+  if (y == 4.0) {
+    double x2 = x * x;
+    return x2 * x2;
+  }
+  if (y == 0.0 || x == 1.0) return 1.0;
+  if (x != x || y != y) return x + y;
+  double ay = y < 0 ? -y : y, ax = x < 0 ? -x : x;
+  int integral = ay >= 0x1p53 || (double)(int64_t)y == y;
+  int odd = ay < 0x1p53 && integral && ((int64_t)y & 1);
+  if (ay == INFINITY) return ax == 1.0 ? 1.0 : (ax < 1.0) == (y < 0) ? INFINITY : 0.0;
+  if (x == 0.0) return y < 0 ? (odd ? 1 / x : INFINITY) : odd ? x : 0.0;
+  if (ax == INFINITY) {
+    double r = y < 0 ? 0.0 : INFINITY;
+    return x < 0 && odd ? -r : r;
+  }
+  if (x < 0) {
+    if (!integral) return NAN;
+    double r = boop_exp2_log2(ax, y);
+    return odd ? -r : r;
+  }
+  return boop_exp2_log2(x, y);
+}
+
+/* boxing */
+
+static inline uint64_t num_from_float(double d) {
+  uint64_t bits;
+  if (d != d) return NUM_CANONICAL_NAN;
+  memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+static inline uint64_t num_from_int(int64_t i) {
+  if (i < NUM_INT_MIN || i > NUM_INT_MAX) return num_from_float((double)i);
+  return NUM_TAG_INT | ((uint64_t)i & NUM_PAYLOAD);
+}
+
+static inline uint64_t num_from_ptr(const void *p) {
+  return NUM_TAG_PTR | ((uint64_t)(uintptr_t)p & NUM_PAYLOAD);
+}
+
+static inline int num_is_int(uint64_t n) {
+  return (n & NUM_TAG_MASK) == NUM_TAG_INT;
+}
+
+static inline int num_is_ptr(uint64_t n) {
+  return (n & NUM_TAG_MASK) == NUM_TAG_PTR;
+}
+
+static inline int num_is_float(uint64_t n) {
+  return !num_is_int(n) && !num_is_ptr(n);
+}
+
+// the payload of an int, sign extended from 48 bits
+static inline int64_t num_int(uint64_t n) {
+  return (int64_t)(n << 16) >> 16;
+}
+
+static inline double num_float_bits(uint64_t n) {
+  double d;
+  memcpy(&d, &n, sizeof(d));
+  return d;
+}
+
+static inline const void *num_ptr(uint64_t n) {
+  return (const void *)(uintptr_t)(n & NUM_PAYLOAD);
+}
+
+// the numeric value of an int or float as a double
+static inline double num_to_float(uint64_t n) {
+  return num_is_int(n) ? (double)num_int(n) : num_float_bits(n);
+}
+
+static inline int64_t num_to_int(uint64_t n) {
+  return num_is_int(n) ? num_int(n) : boop_ftoi(num_float_bits(n));
+}
+
+static inline int num_truthy(uint64_t n) {
+  if (num_is_int(n)) return num_int(n) != 0;
+  return num_is_ptr(n) || num_float_bits(n) != 0.0;
+}
+
+/* arithmetic on boxed numbers: integer if both sides are ints, else float.
+   callers rule out pointers and integer division by zero first. */
+
+#define NUM_ARITH(name, int_op, float_op)                                                          \
+  static inline uint64_t name(uint64_t a, uint64_t b) {                                            \
+    if (num_is_int(a) && num_is_int(b)) {                                                          \
+      int64_t x = num_int(a), y = num_int(b);                                                      \
+      return num_from_int(int_op);                                                                 \
+    }                                                                                              \
+    double x = num_to_float(a), y = num_to_float(b);                                               \
+    return num_from_float(float_op);                                                               \
+  }
+
+NUM_ARITH(num_add, boop_add(x, y), x + y)
+NUM_ARITH(num_sub, boop_sub(x, y), x - y)
+NUM_ARITH(num_mul, boop_mul(x, y), x * y)
+NUM_ARITH(num_div, boop_div(x, y), x / y)
+NUM_ARITH(num_mod, boop_mod(x, y), boop_fmod(x, y))
+NUM_ARITH(num_pow, boop_pow(x, y), boop_fpow(x, y))
+
+#undef NUM_ARITH
+
+static inline uint64_t num_neg(uint64_t a) {
+  return num_is_int(a) ? num_from_int(boop_sub(0, num_int(a))) : num_from_float(-num_float_bits(a));
+}
+
+// integer division by zero is the one arithmetic runtime error
+static inline int num_div_by_zero(uint64_t a, uint64_t b) {
+  return num_is_int(a) && num_is_int(b) && num_int(b) == 0;
+}
+
+// pointers are only equal to the same pointer; ordering them is an error
+static inline int num_equal(uint64_t a, uint64_t b) {
+  if (num_is_ptr(a) || num_is_ptr(b)) return a == b;
+  if (num_is_int(a) && num_is_int(b)) return a == b;
+  return num_to_float(a) == num_to_float(b);
+}
+
+static inline int num_less(uint64_t a, uint64_t b) {
+  if (num_is_int(a) && num_is_int(b)) return num_int(a) < num_int(b);
+  return num_to_float(a) < num_to_float(b);
+}
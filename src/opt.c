@@ -0,0 +1,128 @@
+#include "opt.h"
+#include <time.h>
+
+typedef struct {
+  const char *name;
+  int (*run)(ir_func *f);
+  int level;  // lowest -O level that runs it
+} opt_pass;
+
+static const opt_pass pipeline[] = {
+    {"dse", eliminate_dead_stores, 1},
+    {"ssa", promote_allocas, 1},
+    {"sccp", propagate_constants, 1},
+    {"peephole", peephole, 1},
+    {"tailrec", eliminate_tail_calls, 1},
+    {"gvn", number_values, 2},
+    {"licm", hoist_invariants, 2},
+    {"iv", optimize_induction_variables, 2},
+    {"dce", eliminate_dead_code, 1},
+    {"simplify-cfg", simplify_cfg, 1},
+};
+
+#define PIPELINE_LENGTH (sizeof(pipeline) / sizeof(pipeline[0]))
+#define INLINE_LEVEL 2
+#define INLINE_STATS 0  // the inliner's slot in opt_stats; the pipeline's follow it
+_Static_assert(PIPELINE_LENGTH + 1 <= OPT_MAX_PASSES, "raise OPT_MAX_PASSES");
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t count_insts(const ir_func *f) {
+  uint64_t n = 0;
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      n++;
+  return n;
+}
+
+static void record(opt_pass_stats *stats, const ir_func *f, uint64_t before, uint64_t start,
+                   int changed) {
+  stats->ns += now_ns() - start;
+  stats->runs++;
+  stats->changed += changed != 0;
+  stats->removed += (int64_t)before - (int64_t)count_insts(f);
+}
+
+static void run_pipeline(ir_func *f, const opt_options *options) {
+  opt_stats *stats = options->stats;
+  for (uint32_t i = 0; i < PIPELINE_LENGTH; i++) {
+    if (options->level < pipeline[i].level) continue;
+    if (!stats) {
+      pipeline[i].run(f);
+      continue;
+    }
+    uint64_t before = count_insts(f), start = now_ns();
+    int changed = pipeline[i].run(f);
+    record(&stats->pass[i + 1], f, before, start, changed);
+  }
+}
+
+static int run_inliner(ir_func *f, const call_graph *cg, const opt_options *options) {
+  int threshold = options->inline_threshold ? options->inline_threshold : OPT_INLINE_THRESHOLD;
+  if (!options->stats) return inline_calls(f, cg, threshold);
+  uint64_t before = count_insts(f), start = now_ns();
+  int changed = inline_calls(f, cg, threshold);
+  record(&options->stats->pass[INLINE_STATS], f, before, start, changed);
+  return changed;
+}
+
+static void name_passes(opt_stats *stats) {
+  if (!stats || stats->npasses) return;
+  stats->pass[INLINE_STATS].name = "inline";
+  for (uint32_t i = 0; i < PIPELINE_LENGTH; i++)
+    stats->pass[i + 1].name = pipeline[i].name;
+  stats->npasses = PIPELINE_LENGTH + 1;
+}
+
+static void optimize_func(ir_func *f, const call_graph *cg, const opt_options *options) {
+  opt_stats *stats = options->stats;
+  if (stats) stats->insts_before += count_insts(f);
+  run_pipeline(f, options);
+  // calls copied in come out a level deeper each round, so this ends at the
+  // inliner's depth limit if not before
+  if (cg)
+    while (run_inliner(f, cg, options))
+      run_pipeline(f, options);
+  ir_renumber(f);
+  if (stats) stats->insts_after += count_insts(f);
+}
+
+void optimize_module(ir_module *m, const opt_options *options) {
+  if (options->level <= 0) return;
+  name_passes(options->stats);
+  if (options->level < INLINE_LEVEL || options->inline_threshold < 0) {
+    for (ir_func *f = m->first; f; f = f->next)
+      optimize_func(f, NULL, options);
+    return;
+  }
+  call_graph *cg = create_call_graph(m);
+  for (uint32_t i = 0; i < cg->count; i++)
+    optimize_func(cg->order[i], cg, options);
+  destroy_call_graph(cg);
+}
+
+void optimize_function(ir_func *f, const call_graph *cg, const opt_options *options) {
+  if (options->level <= 0) return;
+  name_passes(options->stats);
+  int inlining = options->level >= INLINE_LEVEL && options->inline_threshold >= 0;
+  optimize_func(f, inlining ? cg : NULL, options);
+}
+
+void print_opt_stats(FILE *out, const opt_stats *stats) {
+  fprintf(out, "\n=== optimizer ===\n");
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < stats->npasses; i++) {
+    const opt_pass_stats *p = &stats->pass[i];
+    if (!p->runs) continue;
+    total += p->ns;
+    fprintf(out, "  %-12s %6u runs %6u changed %8lld removed %10.3f ms\n", p->name, p->runs,
+            p->changed, (long long)p->removed, p->ns / 1e6);
+  }
+  fprintf(out, "  %-12s %llu -> %llu instructions %10.3f ms\n", "total",
+          (unsigned long long)stats->insts_before, (unsigned long long)stats->insts_after,
+          total / 1e6);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "calls.h"
+#include "ir.h"
+#include <stdio.h>
+
+#define OPT_MAX_PASSES 16
+
+// what one pass did across every function it ran on
+typedef struct {
+  const char *name;
+  uint32_t runs;
+  uint32_t changed;  // runs that changed the function
+  int64_t removed;   // instructions removed, net of the ones added
+  uint64_t ns;
+} opt_pass_stats;
+
+typedef struct {
+  uint32_t npasses;
+  opt_pass_stats pass[OPT_MAX_PASSES];  // in pipeline order
+  uint64_t insts_before, insts_after;
+} opt_stats;
+
+#define OPT_INLINE_THRESHOLD 40
+
+typedef struct {
+  int level;             // 0 keeps the ir exactly as lowered
+  int inline_threshold;  // see inline_calls(); 0 for OPT_INLINE_THRESHOLD, negative for none
+  opt_stats *stats;      // accumulated into if not NULL; costs a scan of the function per pass
+} opt_options;
+
+// runs the pass pipeline for `options->level` over every function. at level 2
+// functions go callees first, and each one is inlined into and optimized again
+// until inlining stops finding calls worth it
+void optimize_module(ir_module *m, const opt_options *options);
+// the same for one function, which can be a copy outside the module (see
+// ir_clone_func()). inlining, at level 2, takes callee bodies from wherever
+// the calls point, with `cg` built for the module
+void optimize_function(ir_func *f, const call_graph *cg, const opt_options *options);
+void print_opt_stats(FILE *out, const opt_stats *stats);
+
+// individual passes; each returns nonzero if it changed the function
+
+// inline.c: inlines the calls in f whose callee costs at most `threshold`
+// instructions, less what the call site saves. calls that came in with an
+// inlined body are only considered by the next call
+int inline_calls(ir_func *f, const call_graph *cg, int threshold);
+
+// ssa.c: promotes alloca slots that are only loaded and stored to ssa values
+// with pruned phis, and drops unreachable blocks
+int promote_allocas(ir_func *f);
+
+// sccp.c: sparse conditional constant propagation; folds constants through
+// phis, turns decided branches into jumps and drops unreachable blocks
+int propagate_constants(ir_func *f);
+
+// peephole.c: algebraic identities, constant folding, strength reduction of
+// multiplies by powers of two and of `^` with small constant exponents
+int peephole(ir_func *f);
+
+// tailrec.c: turns calls a function returns the result of, directly or
+// combined with integer `+`, `*` or bitwise ops, into a loop
+int eliminate_tail_calls(ir_func *f);
+
+// gvn.c: replaces pure instructions with an equal one that dominates them
+int number_values(ir_func *f);
+
+// licm.c: moves loop invariant computations into loop preheaders
+int hoist_invariants(ir_func *f);
+
+// iv.c: strength reduces multiplies of induction variables, runs float and
+// num counters with integer steps in i64, and folds comparisons a dominating
+// branch already decided
+int optimize_induction_variables(ir_func *f);
+
+// cfg.c: folds branches on constants, drops unreachable blocks, merges
+// straight-line blocks and bypasses blocks that only jump
+int simplify_cfg(ir_func *f);
+
+// dce.c: deletes instructions nothing live depends on, and stores to stack
+// slots that are overwritten or never loaded before they die
+int eliminate_dead_code(ir_func *f);
+int eliminate_dead_stores(ir_func *f);
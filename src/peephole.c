@@ -0,0 +1,300 @@
+#include "fold.h"
+#include "num.h"
+#include "opt.h"
+
+// local algebraic simplification. every rule keeps the exact runtime
+// semantics of num.h: most identities only hold for i64, since floats have
+// -0.0 and NaN, and hardly any hold for num, which may hold either kind of
+// number or a string whose type error must still happen.
+
+typedef struct {
+  ir_func *f;
+  arena *arena;
+  ir_inst **repl;  // value id -> value that replaces it
+  uint32_t nrepl;
+} simplifier;
+
+static ir_inst *resolve(const simplifier *s, ir_inst *v) {
+  while (v->id < s->nrepl && s->repl[v->id])
+    v = s->repl[v->id];
+  return v;
+}
+
+// identity operands; never for num, where x + 0 must still fail on a string
+static int is_zero(const ir_inst *v) {
+  if (v->op != OP_CONST || v->type == IR_NUM) return 0;
+  return v->imm.i == 0;  // for f64 that is +0.0 only
+}
+
+static int is_one(const ir_inst *v) {
+  if (v->op != OP_CONST || v->type == IR_NUM) return 0;
+  return v->type == IR_F64 ? v->imm.f == 1.0 : v->imm.i == 1;
+}
+
+// a small integral exponent. a num exponent has to be an int: with a float
+// exponent, num_pow() computes in floats even for an int base
+static int int_exponent(const ir_inst *v, int64_t *out) {
+  if (v->op != OP_CONST) return 0;
+  if (v->type == IR_NUM) {
+    if (!num_is_int((uint64_t)v->imm.i)) return 0;
+    *out = num_int((uint64_t)v->imm.i);
+    return 1;
+  }
+  if (v->type == IR_F64) {
+    if (v->imm.f != (double)(int64_t)v->imm.f || v->imm.f < -64 || v->imm.f > 64) return 0;
+    *out = (int64_t)v->imm.f;
+    return 1;
+  }
+  *out = v->imm.i;
+  return 1;
+}
+
+static ir_inst *emit_before(simplifier *s, ir_inst *at, ir_op op, ir_type type, ir_inst *a,
+                            ir_inst *c) {
+  ir_inst *inst = ir_new_inst(s->f, op, type, c ? 2 : 1);
+  inst->args[0] = a;
+  if (c) inst->args[1] = c;
+  ir_insert_before(at, inst);
+  return inst;
+}
+
+static ir_inst *const_before(simplifier *s, ir_inst *at, ir_type type, int64_t i) {
+  ir_inst *inst = ir_new_inst(s->f, OP_CONST, type, 0);
+  inst->imm.i = i;
+  ir_insert_before(at, inst);
+  return inst;
+}
+
+// x ^ n as a chain of multiplies: square and multiply for wrapping integers,
+// the exact sequence boop_fpow() uses for floats, and only x * x for num,
+// where an intermediate result may overflow into a float
+static ir_inst *expand_pow(simplifier *s, ir_inst *inst, ir_inst *x, int64_t n) {
+  ir_type t = inst->type;
+  if (t == IR_I64 && n >= 2 && n <= 16) {
+    ir_inst *result = NULL, *square = x;
+    for (;;) {
+      if (n & 1) result = result ? emit_before(s, inst, OP_MUL, t, result, square) : square;
+      n >>= 1;
+      if (!n) return result;
+      square = emit_before(s, inst, OP_MUL, t, square, square);
+    }
+  }
+  if (n == 2 && (t == IR_F64 || t == IR_NUM)) return emit_before(s, inst, OP_MUL, t, x, x);
+  if (t == IR_F64 && n == 3)
+    return emit_before(s, inst, OP_MUL, t, emit_before(s, inst, OP_MUL, t, x, x), x);
+  if (t == IR_F64 && n == 4) {
+    ir_inst *x2 = emit_before(s, inst, OP_MUL, t, x, x);
+    return emit_before(s, inst, OP_MUL, t, x2, x2);
+  }
+  return NULL;
+}
+
+static ir_inst *simplify_phi(ir_inst *phi) {
+  ir_inst *same = NULL;
+  for (uint32_t i = 0; i < phi->nargs; i++) {
+    ir_inst *v = phi->args[i];
+    if (v == phi || v == same) continue;
+    if (same) return NULL;
+    same = v;
+  }
+  return same;
+}
+
+static int boxed_float(const ir_inst *v) {
+  return v->op == OP_CONV && v->args[0]->type == IR_F64;
+}
+
+// a num that can't hold a string: a boxed number or a constant
+static int holds_number(const ir_inst *v) {
+  if (v->op == OP_CONV) return v->args[0]->type != IR_PTR;
+  return v->op == OP_CONST;
+}
+
+// num v read as an f64 right before `at`
+static ir_inst *float_before(simplifier *s, ir_inst *at, ir_inst *v) {
+  if (v->op == OP_CONST) {
+    ir_inst *c = const_before(s, at, IR_F64, 0);
+    c->imm.f = num_to_float((uint64_t)v->imm.i);
+    return c;
+  }
+  if (v->op == OP_CONV && v->args[0]->type != IR_PTR) v = v->args[0];
+  return v->type == IR_F64 ? v : emit_before(s, at, OP_CONV, IR_F64, v, NULL);
+}
+
+// num arithmetic with a float operand is done in floats whatever the other
+// operand holds, and a string fails unboxing the same way, so it can run on
+// f64s. so can ordering; equality only if neither side can be a string, since
+// a string compares unequal instead of failing. a float constant would do as
+// well, but it takes a boxed f64 operand for the unboxing to pay for itself
+static ir_inst *unbox_floats(simplifier *s, ir_inst *inst) {
+  ir_inst *a = inst->args[0], *c = inst->nargs > 1 ? inst->args[1] : NULL;
+  if (a->type != IR_NUM || (c && c->type != IR_NUM)) return NULL;
+  if (!boxed_float(a) && !(c && boxed_float(c))) return NULL;
+  if ((inst->op == OP_EQ || inst->op == OP_NEQ) && !(holds_number(a) && holds_number(c)))
+    return NULL;
+  ir_inst *x = float_before(s, inst, a), *y = c ? float_before(s, inst, c) : NULL;
+  if (inst->type == IR_BOOL) return emit_before(s, inst, inst->op, IR_BOOL, x, y);
+  ir_inst *r = emit_before(s, inst, inst->op, IR_F64, x, y);
+  return emit_before(s, inst, OP_CONV, IR_NUM, r, NULL);
+}
+
+// conv T2 (conv num (x: T1)) reads x as T2 directly, except that boxing an
+// i64 outside 48 bits makes it a float, so i64 -> num -> i64 is lossy
+static ir_inst *simplify_conv(ir_inst *inst) {
+  ir_inst *x = inst->args[0];
+  if (x->type == inst->type) return x;
+  if (x->op != OP_CONV) return NULL;
+  ir_inst *inner = x->args[0];
+  ir_type from = inner->type, to = inst->type;
+  if (x->type == IR_NUM && from != IR_PTR && to != IR_PTR && !(from == IR_I64 && to == IR_I64)) {
+    if (from == to) return inner;
+    inst->args[0] = inner;
+    return inst;
+  }
+  if (to == IR_BOOL && from == IR_BOOL) return inner;
+  return NULL;
+}
+
+// returns the value inst is equivalent to: NULL if nothing applies, inst
+// itself if it was rewritten in place
+static ir_inst *simplify(simplifier *s, ir_inst *inst) {
+  ir_value folded;
+  if (inst->op == OP_PHI) return simplify_phi(inst);
+  if (fold_inst(inst, &folded)) {
+    ir_make_const(inst, folded);
+    return inst;
+  }
+  if (!ir_is_pure(inst->op)) return NULL;
+
+  ir_type t = inst->type;
+  ir_inst *a = inst->args[0], *c = inst->nargs > 1 ? inst->args[1] : NULL;
+  int exact = t == IR_I64 || t == IR_BOOL;  // no -0.0, NaN or int/float mixing
+  if (c && ir_is_commutative(inst->op) && a->op == OP_CONST && c->op != OP_CONST) {
+    inst->args[0] = c;
+    inst->args[1] = a;
+    a = inst->args[0];
+    c = inst->args[1];
+  }
+
+  if (inst->op <= OP_NEG || (inst->op >= OP_EQ && inst->op <= OP_GE)) {
+    ir_inst *v = unbox_floats(s, inst);
+    if (v) return v;
+  }
+
+  int64_t n;
+  switch (inst->op) {
+  case OP_ADD:
+    if (exact && is_zero(c)) return a;
+    break;
+  case OP_SUB:
+    if (is_zero(c)) return a;
+    if (exact && a == c) return const_before(s, inst, t, 0);
+    break;
+  case OP_MUL:
+    if (is_one(c)) return a;
+    if (!exact || c->op != OP_CONST) break;
+    if (c->imm.i == 0) return c;
+    if (c->imm.i == -1) return emit_before(s, inst, OP_NEG, t, a, NULL);
+    if (c->imm.i > 0 && !(c->imm.i & (c->imm.i - 1)))
+      return emit_before(s, inst, OP_SHL, t, a,
+                         const_before(s, inst, IR_I64, __builtin_ctzll((uint64_t)c->imm.i)));
+    break;
+  case OP_DIV:
+    if (is_one(c)) return a;
+    break;
+  case OP_MOD:
+    if (exact && c->op == OP_CONST && (c->imm.i == 1 || c->imm.i == -1))
+      return const_before(s, inst, t, 0);
+    break;
+  case OP_POW:
+    if (!int_exponent(c, &n)) break;
+    if (n == 1 && t != IR_NUM) return a;
+    if (n == 0 && t != IR_NUM) {
+      ir_value one = {.i = 1};
+      if (t == IR_F64) one.f = 1.0;
+      ir_make_const(inst, one);
+      return inst;
+    }
+    return expand_pow(s, inst, a, n);
+  case OP_AND:
+  case OP_OR:
+    if (a == c) return a;
+    if (c->op != OP_CONST) break;
+    if (c->imm.i == (inst->op == OP_AND ? (t == IR_BOOL ? 1 : -1) : 0)) return a;
+    if (c->imm.i == (inst->op == OP_AND ? 0 : (t == IR_BOOL ? 1 : -1))) return c;
+    break;
+  case OP_XOR:
+  case OP_SHL:
+  case OP_SHR:
+    if (is_zero(c)) return a;
+    break;
+  case OP_NEG:
+  case OP_NOT:
+    if (a->op == inst->op && t != IR_NUM) return a->args[0];
+    break;
+  case OP_EQ:
+  case OP_NEQ:
+  case OP_LT:
+  case OP_LE:
+  case OP_GT:
+  case OP_GE:
+    if (a == c && (a->type == IR_I64 || a->type == IR_BOOL)) {
+      ir_make_const(inst, (ir_value){.i = inst->op == OP_EQ || inst->op == OP_LE ||
+                                          inst->op == OP_GE});
+      return inst;
+    }
+    break;
+  case OP_CONV: return simplify_conv(inst);
+  default: break;
+  }
+  return NULL;
+}
+
+// br (not c), a, b is br c, b, a
+static int simplify_branch(ir_inst *br) {
+  int changed = 0;
+  while (br->args[0]->op == OP_NOT && br->args[0]->type == IR_BOOL) {
+    ir_block *t = br->imm.target[0];
+    br->imm.target[0] = br->imm.target[1];
+    br->imm.target[1] = t;
+    br->args[0] = br->args[0]->args[0];
+    changed = 1;
+  }
+  return changed;
+}
+
+int peephole(ir_func *f) {
+  simplifier s = {.f = f, .arena = create_arena("peephole", 4096), .nrepl = f->nvalues};
+  s.repl = arena_calloc(s.arena, f->nvalues, sizeof(ir_inst *));
+  int changed = 0;
+
+  for (ir_block *b = f->first; b; b = b->next) {
+    ir_inst *next;
+    for (ir_inst *inst = b->first; inst; inst = next) {
+      next = inst->next;
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        inst->args[i] = resolve(&s, inst->args[i]);
+      if (inst->op == OP_BR) changed |= simplify_branch(inst);
+      if (inst->type == IR_VOID || inst->op == OP_CONST) continue;
+
+      ir_inst *v = simplify(&s, inst);
+      if (!v) continue;
+      changed = 1;
+      if (v != inst) {
+        if (inst->id < s.nrepl) s.repl[inst->id] = v;
+        ir_remove(inst);
+      }
+    }
+  }
+
+  // uses that come before their definition in layout order, such as phis
+  // on loop back edges
+  if (changed)
+    for (ir_block *b = f->first; b; b = b->next)
+      for (ir_inst *inst = b->first; inst; inst = inst->next)
+        for (uint32_t i = 0; i < inst->nargs; i++)
+          inst->args[i] = resolve(&s, inst->args[i]);
+
+  destroy_arena(s.arena);
+  return changed;
+}
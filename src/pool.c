@@ -0,0 +1,101 @@
+#include "pool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// the indices one worker still has to run. the owner takes from head, thieves
+// take from tail.
+typedef struct {
+  pthread_mutex_t lock;
+  size_t head;
+  size_t tail;
+} task_range;
+
+typedef struct {
+  task_range *ranges;
+  int workers;
+  pool_task task;
+  void *ctx;
+} pool;
+
+typedef struct {
+  pool *pool;
+  int id;
+} worker_arg;
+
+static int take(task_range *r, size_t *index) {
+  pthread_mutex_lock(&r->lock);
+  int found = r->head < r->tail;
+  if (found) *index = r->head++;
+  pthread_mutex_unlock(&r->lock);
+  return found;
+}
+
+// moves the back half of the first non-empty victim into self, then takes one
+static int steal(pool *p, int self, size_t *index) {
+  for (int i = 1; i < p->workers; i++) {
+    task_range *victim = &p->ranges[(self + i) % p->workers];
+
+    pthread_mutex_lock(&victim->lock);
+    size_t left = victim->tail - victim->head;
+    size_t half = (left + 1) / 2;
+    size_t from = victim->tail - half, to = victim->tail;
+    victim->tail = from;
+    pthread_mutex_unlock(&victim->lock);
+    if (!half) continue;
+
+    task_range *mine = &p->ranges[self];
+    pthread_mutex_lock(&mine->lock);
+    mine->head = from + 1;
+    mine->tail = to;
+    pthread_mutex_unlock(&mine->lock);
+    *index = from;
+    return 1;
+  }
+  return 0;
+}
+
+static void *worker_main(void *arg) {
+  worker_arg *w = arg;
+  pool *p = w->pool;
+  size_t index;
+  while (take(&p->ranges[w->id], &index) || steal(p, w->id, &index))
+    p->task(p->ctx, index, w->id);
+  return NULL;
+}
+
+void run_pool(size_t count, int workers, pool_task task, void *ctx) {
+  if (workers < 1) workers = 1;
+  if ((size_t)workers > count) workers = count ? (int)count : 1;
+
+  pool p = {malloc(workers * sizeof(task_range)), workers, task, ctx};
+  pthread_t *threads = malloc(workers * sizeof(pthread_t));
+  worker_arg *args = malloc(workers * sizeof(worker_arg));
+  int *started = calloc(workers, sizeof(int));
+  if (!p.ranges || !threads || !args || !started) {
+    fprintf(stderr, "failed to allocate the thread pool\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_init(&p.ranges[i].lock, NULL);
+    p.ranges[i].head = count * i / workers;
+    p.ranges[i].tail = count * (i + 1) / workers;
+    args[i] = (worker_arg){&p, i};
+  }
+
+  // worker 0 is the calling thread. a worker that fails to start leaves its
+  // range to be stolen.
+  for (int i = 1; i < workers; i++)
+    started[i] = pthread_create(&threads[i], NULL, worker_main, &args[i]) == 0;
+  worker_main(&args[0]);
+  for (int i = 1; i < workers; i++)
+    if (started[i]) pthread_join(threads[i], NULL);
+
+  for (int i = 0; i < workers; i++)
+    pthread_mutex_destroy(&p.ranges[i].lock);
+  free(started);
+  free(args);
+  free(threads);
+  free(p.ranges);
+}
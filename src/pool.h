@@ -0,0 +1,10 @@
+#pragma once
+#include <stddef.h>
+
+// runs task(ctx, i, worker) for every i in [0, count) on `workers` threads.
+// each worker starts with a contiguous run of indices and works through it
+// front to back; a worker that runs dry steals the back half of someone
+// else's run. worker is in [0, workers), so callers can keep per-thread state.
+typedef void (*pool_task)(void *ctx, size_t index, int worker);
+
+void run_pool(size_t count, int workers, pool_task task, void *ctx);
@@ -0,0 +1,559 @@
+#include "x86.h"
+#include <stdlib.h>
+
+// linear scan register allocation. instructions are numbered in layout
+// order, uses of instruction k at 2k and its definitions at 2k + 1, so a
+// value last read by an instruction can share a register with the one it
+// defines. each virtual register's interval is the list of ranges where it
+// is live, holes included, so a value that only lives around a loop can
+// reuse the registers of a call laid out in the middle of it. physical
+// registers that isel names directly (arguments, division, shifts, calls
+// clobbering everything caller-saved) get ranges the same way, which an
+// interval must not overlap. what doesn't fit is spilled to a stack slot and
+// used straight from memory where the instruction takes one, through r10/r11
+// or xmm14/xmm15 otherwise.
+
+static const uint32_t gpr_order[] = {RAX, RCX, RDX, RSI, RDI, R8, R9, RBX, R12, R13, R14, R15};
+static const uint32_t xmm_order[] = {XMM0, XMM1, XMM2,  XMM3,  XMM4,  XMM5,  XMM6,
+                                     XMM7, XMM8, XMM9, XMM10, XMM11, XMM12, XMM13};
+static const uint32_t callee_saved[] = {RBX, R12, R13, R14, R15};
+static const uint32_t call_args[] = {RDI, RSI, RDX, RCX, R8, R9};
+static const uint32_t scratch[2][2] = {{R10, R11}, {XMM14, XMM15}};
+
+#define NO_REG UINT32_MAX
+
+/* operands */
+
+enum { USE = 1, DEF = 2 };
+
+typedef struct {
+  uint32_t reg;
+  uint8_t role;
+} reg_ref;
+
+// what op does with a register in its first operand
+static int first_role(const x86_inst *in) {
+  switch (in->op) {
+  case X_MOV:
+  case X_LEA:
+  case X_SETCC:
+  case X_MOVZB:
+  case X_CVTSI2SD:
+  case X_CVTTSD2SI:
+  case X_POP: return DEF;
+  case X_CMP:
+  case X_TEST:
+  case X_UCOMISD:
+  case X_PUSH:
+  case X_IDIV: return USE;
+  case X_XOR:
+  case X_XORPD:
+    // zeroing doesn't read the old value
+    if (in->a[1].kind == XO_REG && in->a[0].reg == in->a[1].reg) return DEF;
+    return USE | DEF;
+  default: return USE | DEF;
+  }
+}
+
+// every register in reads or writes, explicit or not; returns how many
+static int registers(const x86_func *f, const x86_inst *in, reg_ref out[48]) {
+  int n = 0;
+  for (int i = 0; i < 2; i++) {
+    const x86_operand *o = &in->a[i];
+    if (o->kind == XO_MEM)
+      out[n++] = (reg_ref){o->reg, USE};
+    else if (o->kind == XO_REG)
+      out[n++] = (reg_ref){o->reg, (uint8_t)(i ? USE : first_role(in))};
+  }
+  switch (in->op) {
+  case X_CQO:
+    out[n++] = (reg_ref){RAX, USE};
+    out[n++] = (reg_ref){RDX, DEF};
+    break;
+  case X_IDIV:
+    out[n++] = (reg_ref){RAX, USE | DEF};
+    out[n++] = (reg_ref){RDX, USE | DEF};
+    break;
+  case X_CALL:
+    for (int i = 0; i < in->gpr_args; i++)
+      out[n++] = (reg_ref){call_args[i], USE};
+    for (int i = 0; i < in->xmm_args; i++)
+      out[n++] = (reg_ref){XMM0 + (uint32_t)i, USE};
+    for (uint32_t r = 0; r < X86_NREGS; r++)
+      if (r >= XMM0 || r == RAX || r == RCX || r == RDX || r == RSI || r == RDI || r == R8 ||
+          r == R9 || r == R10 || r == R11)
+        out[n++] = (reg_ref){r, DEF};
+    break;
+  case X_RET:
+    if (f->ret_class != X86_NO_CLASS)
+      out[n++] = (reg_ref){f->ret_class == X86_XMM ? XMM0 : RAX, USE};
+    break;
+  default: break;
+  }
+  return n;
+}
+
+// whether operand i of op may be memory, as long as the other one isn't
+static int takes_memory(const x86_inst *in, int i) {
+  switch (in->op) {
+  case X_MOV: return !(in->a[1 - i].kind == XO_IMM && !x86_fits_imm32(in->a[1 - i].imm));
+  case X_ADD:
+  case X_SUB:
+  case X_AND:
+  case X_OR:
+  case X_XOR:
+  case X_CMP: return 1;
+  case X_TEST:
+  case X_SHL:
+  case X_SAR:
+  case X_NEG:
+  case X_NOT:
+  case X_PUSH:
+  case X_POP:
+  case X_IDIV:
+  case X_SETCC: return i == 0;
+  case X_IMUL:
+  case X_MOVZB:
+  case X_ADDSD:
+  case X_SUBSD:
+  case X_MULSD:
+  case X_DIVSD:
+  case X_UCOMISD:
+  case X_CVTSI2SD:
+  case X_CVTTSD2SI: return i == 1;
+  default: return 0;
+  }
+}
+
+static int is_memory(const x86_operand *o) {
+  return o->kind == XO_MEM || o->kind == XO_SLOT || o->kind == XO_SYM;
+}
+
+/* liveness */
+
+typedef struct {
+  uint32_t start, end;  // instruction indices
+  uint64_t *use, *def, *in, *out;
+  uint32_t succ[2];
+  int nsucc;
+} block_info;
+
+typedef struct {
+  uint32_t start, end;  // positions, both included
+} range;
+
+VEC_DECL(range_vec, range)
+
+typedef struct {
+  uint32_t vreg;
+  uint32_t start, end;  // of the first and last range
+} interval;
+
+typedef struct {
+  x86_func *f;
+  arena *a;
+  uint32_t nvregs, words;
+  block_info *blocks;
+  range_vec *ranges;    // register -> where it holds a value, sorted and disjoint
+  interval *ivs;        // by vreg
+  uint32_t *hint_phys;  // vreg -> physical register it is moved from or to
+  uint32_t *hint_vreg;  // vreg -> virtual register it is moved from or to
+  uint32_t *assigned;   // vreg -> physical register, NO_REG when spilled
+  uint32_t *slot;       // vreg -> spill slot
+} allocator;
+
+static void set_bit(uint64_t *s, uint32_t i) {
+  s[i / 64] |= UINT64_C(1) << (i % 64);
+}
+
+static int has_bit(const uint64_t *s, uint32_t i) {
+  return (int)(s[i / 64] >> (i % 64) & 1);
+}
+
+// live in and out sets of virtual registers per block
+static void compute_liveness(allocator *ra) {
+  x86_func *f = ra->f;
+  uint32_t nblocks = (uint32_t)f->blocks.size, index = 0;
+  reg_ref refs[48];
+  for (uint32_t b = 0; b < nblocks; b++) {
+    block_info *bi = &ra->blocks[b];
+    const x86_inst_vec *insts = &f->blocks.data[b].insts;
+    bi->use = arena_calloc(ra->a, ra->words * 4, sizeof(uint64_t));
+    bi->def = bi->use + ra->words;
+    bi->in = bi->def + ra->words;
+    bi->out = bi->in + ra->words;
+    bi->start = index;
+    for (size_t k = 0; k < insts->size; k++, index++) {
+      const x86_inst *in = &insts->data[k];
+      int n = registers(f, in, refs);
+      for (int r = 0; r < n; r++) {
+        if (!x86_is_vreg(refs[r].reg)) continue;
+        uint32_t v = refs[r].reg - X86_FIRST_VREG;
+        if ((refs[r].role & USE) && !has_bit(bi->def, v)) set_bit(bi->use, v);
+        if (refs[r].role & DEF) set_bit(bi->def, v);
+      }
+      if ((in->op == X_JMP || in->op == X_JCC) && bi->nsucc < 2)
+        bi->succ[bi->nsucc++] = in->a[0].index;
+    }
+    bi->end = index;
+  }
+
+  for (int changed = 1; changed;) {
+    changed = 0;
+    for (uint32_t b = nblocks; b-- > 0;) {
+      block_info *bi = &ra->blocks[b];
+      for (uint32_t w = 0; w < ra->words; w++) {
+        uint64_t out = 0;
+        for (int s = 0; s < bi->nsucc; s++)
+          out |= ra->blocks[bi->succ[s]].in[w];
+        uint64_t in = bi->use[w] | (out & ~bi->def[w]);
+        changed |= in != bi->in[w] || out != bi->out[w];
+        bi->in[w] = in;
+        bi->out[w] = out;
+      }
+    }
+  }
+}
+
+static int compare_ranges(const void *a, const void *b) {
+  const range *x = a, *y = b;
+  return x->start < y->start ? -1 : x->start > y->start;
+}
+
+// the ranges of every register, physical ones included, from a backwards
+// scan of each block starting with what is live out of it. a definition
+// nobody reads still takes its register for a moment
+static void build_ranges(allocator *ra) {
+  x86_func *f = ra->f;
+  uint32_t nregs = X86_FIRST_VREG + ra->nvregs;
+  uint32_t *live_end = arena_alloc(ra->a, nregs * sizeof(uint32_t));
+  reg_ref refs[48];
+  ra->ranges = arena_alloc(ra->a, nregs * sizeof(range_vec));
+  for (uint32_t r = 0; r < nregs; r++) {
+    live_end[r] = NO_REG;
+    range_vec_init(&ra->ranges[r], ra->a, 0);
+  }
+  for (uint32_t b = 0; b < f->blocks.size; b++) {
+    block_info *bi = &ra->blocks[b];
+    for (uint32_t w = 0; w < ra->words; w++)
+      for (uint64_t m = bi->out[w]; m; m &= m - 1)
+        live_end[X86_FIRST_VREG + 64 * w + (uint32_t)__builtin_ctzll(m)] = 2 * bi->end - 1;
+    for (uint32_t index = bi->end; index-- > bi->start;) {
+      int n = registers(f, &f->blocks.data[b].insts.data[index - bi->start], refs);
+      for (int i = 0; i < n; i++) {
+        uint32_t r = refs[i].reg;
+        if (!(refs[i].role & DEF)) continue;
+        uint32_t end = live_end[r] == NO_REG ? 2 * index + 1 : live_end[r];
+        range_vec_push(&ra->ranges[r], (range){2 * index + 1, end});
+        live_end[r] = NO_REG;
+      }
+      for (int i = 0; i < n; i++)
+        if ((refs[i].role & USE) && live_end[refs[i].reg] == NO_REG)
+          live_end[refs[i].reg] = 2 * index;
+    }
+    // what is still open is live in, or a physical register set before the function
+    for (uint32_t r = 0; r < X86_NREGS; r++)
+      if (live_end[r] != NO_REG) {
+        range_vec_push(&ra->ranges[r], (range){2 * bi->start, live_end[r]});
+        live_end[r] = NO_REG;
+      }
+    for (uint32_t w = 0; w < ra->words; w++)
+      for (uint64_t m = bi->in[w]; m; m &= m - 1) {
+        uint32_t r = X86_FIRST_VREG + 64 * w + (uint32_t)__builtin_ctzll(m);
+        range_vec_push(&ra->ranges[r], (range){2 * bi->start, live_end[r]});
+        live_end[r] = NO_REG;
+      }
+  }
+
+  for (uint32_t r = 0; r < nregs; r++) {
+    range_vec *v = &ra->ranges[r];
+    qsort(v->data, v->size, sizeof(range), compare_ranges);
+    size_t n = 0;
+    for (size_t i = 0; i < v->size; i++) {
+      if (n && v->data[i].start <= v->data[n - 1].end + 1) {
+        if (v->data[i].end > v->data[n - 1].end) v->data[n - 1].end = v->data[i].end;
+      } else {
+        v->data[n++] = v->data[i];
+      }
+    }
+    v->size = n;
+    if (r >= X86_FIRST_VREG && n) {
+      interval *iv = &ra->ivs[r - X86_FIRST_VREG];
+      iv->start = v->data[0].start;
+      iv->end = v->data[n - 1].end;
+    }
+  }
+}
+
+static int intersects(const range_vec *x, const range_vec *y) {
+  size_t i = 0, j = 0;
+  while (i < x->size && j < y->size) {
+    if (x->data[i].end < y->data[j].start)
+      i++;
+    else if (y->data[j].end < x->data[i].start)
+      j++;
+    else
+      return 1;
+  }
+  return 0;
+}
+
+static int covers(const range_vec *v, uint32_t pos) {
+  size_t lo = 0, hi = v->size;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (v->data[mid].end < pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo < v->size && v->data[lo].start <= pos;
+}
+
+/* linear scan */
+
+static int compare_intervals(const void *a, const void *b) {
+  const interval *x = *(const interval *const *)a, *y = *(const interval *const *)b;
+  if (x->start != y->start) return x->start < y->start ? -1 : 1;
+  return x->vreg < y->vreg ? -1 : x->vreg > y->vreg;
+}
+
+static void spill(allocator *ra, uint32_t vreg) {
+  uint32_t v = vreg - X86_FIRST_VREG;
+  ra->assigned[v] = NO_REG;
+  ra->slot[v] = ra->f->nslots++;
+  ra->f->spills++;
+}
+
+// whether iv can have register r, given the intervals in a lifetime hole
+static int fits(const allocator *ra, uint32_t r, const interval *iv, interval *const *inactive,
+                uint32_t ninactive) {
+  const range_vec *ranges = &ra->ranges[iv->vreg];
+  if (intersects(&ra->ranges[r], ranges)) return 0;
+  for (uint32_t j = 0; j < ninactive; j++)
+    if (ra->assigned[inactive[j]->vreg - X86_FIRST_VREG] == r &&
+        intersects(&ra->ranges[inactive[j]->vreg], ranges))
+      return 0;
+  return 1;
+}
+
+// intervals are active while they cover the current position and inactive
+// in a hole, where their register can go to something that fits in the hole
+static void linear_scan(allocator *ra) {
+  x86_func *f = ra->f;
+  uint32_t nv = ra->nvregs ? ra->nvregs : 1;
+  interval **order = arena_alloc(ra->a, nv * sizeof(interval *));
+  interval **active = arena_alloc(ra->a, nv * sizeof(interval *));
+  interval **inactive = arena_alloc(ra->a, nv * sizeof(interval *));
+  uint32_t n = 0, nactive = 0, ninactive = 0;
+  for (uint32_t v = 0; v < ra->nvregs; v++)
+    if (ra->ivs[v].end != NO_REG) order[n++] = &ra->ivs[v];
+  qsort(order, n, sizeof(interval *), compare_intervals);
+
+  for (uint32_t i = 0; i < n; i++) {
+    interval *iv = order[i];
+    uint32_t pos = iv->start, kept = 0, nstill = 0;
+    for (uint32_t j = 0; j < ninactive; j++) {
+      interval *x = inactive[j];
+      if (x->end < pos) continue;
+      if (covers(&ra->ranges[x->vreg], pos))
+        active[nactive++] = x;
+      else
+        inactive[nstill++] = x;
+    }
+    ninactive = nstill;
+    for (uint32_t j = 0; j < nactive; j++) {
+      interval *x = active[j];
+      if (x->end < pos) continue;
+      if (covers(&ra->ranges[x->vreg], pos))
+        active[kept++] = x;
+      else
+        inactive[ninactive++] = x;
+    }
+    nactive = kept;
+
+    int busy[X86_NREGS] = {0};
+    for (uint32_t j = 0; j < nactive; j++)
+      busy[ra->assigned[active[j]->vreg - X86_FIRST_VREG]] = 1;
+    uint32_t v = iv->vreg - X86_FIRST_VREG, reg = NO_REG;
+    int xmm = x86_reg_class(f, iv->vreg) == X86_XMM;
+    const uint32_t *regs = xmm ? xmm_order : gpr_order;
+    uint32_t nregs = xmm ? sizeof(xmm_order) / sizeof(*xmm_order)
+                         : sizeof(gpr_order) / sizeof(*gpr_order);
+
+    uint32_t hints[2] = {ra->hint_phys[v], NO_REG};
+    if (ra->hint_vreg[v] != NO_REG) hints[1] = ra->assigned[ra->hint_vreg[v] - X86_FIRST_VREG];
+    for (int h = 0; h < 2 && reg == NO_REG; h++)
+      for (uint32_t k = 0; k < nregs && reg == NO_REG; k++)
+        if (regs[k] == hints[h] && !busy[regs[k]] && fits(ra, regs[k], iv, inactive, ninactive))
+          reg = regs[k];
+    for (uint32_t k = 0; k < nregs && reg == NO_REG; k++)
+      if (!busy[regs[k]] && fits(ra, regs[k], iv, inactive, ninactive)) reg = regs[k];
+
+    if (reg == NO_REG) {
+      // take the register of whatever lives longest, if it can hold this
+      interval *victim = NULL;
+      uint32_t at = 0;
+      for (uint32_t j = 0; j < nactive; j++) {
+        interval *a = active[j];
+        uint32_t r = ra->assigned[a->vreg - X86_FIRST_VREG];
+        if (a->end <= iv->end || (r >= XMM0) != xmm || (victim && a->end <= victim->end) ||
+            !fits(ra, r, iv, inactive, ninactive))
+          continue;
+        victim = a;
+        at = j;
+      }
+      if (!victim) {
+        spill(ra, iv->vreg);
+        continue;
+      }
+      reg = ra->assigned[victim->vreg - X86_FIRST_VREG];
+      spill(ra, victim->vreg);
+      active[at] = active[--nactive];
+    }
+    ra->assigned[v] = reg;
+    active[nactive++] = iv;
+  }
+}
+
+/* rewriting */
+
+static x86_operand slot_operand(uint32_t ncs, uint32_t slot) {
+  return x86_mem(RBP, -8 * (int64_t)(ncs + 1 + slot));
+}
+
+static void rewrite(allocator *ra, uint32_t ncs, const uint32_t *saved) {
+  x86_func *f = ra->f;
+  for (uint32_t b = 0; b < f->blocks.size; b++) {
+    x86_inst_vec *old = &f->blocks.data[b].insts, insts;
+    x86_inst_vec_init(&insts, old->arena, old->size + 8);
+    if (b == 0) {
+      x86_inst_vec_push(&insts, (x86_inst){.op = X_PUSH, .a = {x86_reg_op(RBP)}});
+      x86_inst_vec_push(&insts, (x86_inst){.op = X_MOV, .a = {x86_reg_op(RBP), x86_reg_op(RSP)}});
+      for (uint32_t i = 0; i < ncs; i++)
+        x86_inst_vec_push(&insts, (x86_inst){.op = X_PUSH, .a = {x86_reg_op(saved[i])}});
+      // the stack stays 16-byte aligned
+      uint32_t frame = f->nslots + ((ncs + f->nslots) & 1);
+      if (frame)
+        x86_inst_vec_push(&insts,
+                          (x86_inst){.op = X_SUB, .a = {x86_reg_op(RSP), x86_imm(8 * frame)}});
+    }
+
+    for (size_t k = 0; k < old->size; k++) {
+      x86_inst in = old->data[k];
+      if (in.op == X_RET) {
+        if (ncs)
+          x86_inst_vec_push(&insts,
+                            (x86_inst){.op = X_LEA,
+                                       .a = {x86_reg_op(RSP), x86_mem(RBP, -8 * (int64_t)ncs)}});
+        else
+          x86_inst_vec_push(&insts,
+                            (x86_inst){.op = X_MOV, .a = {x86_reg_op(RSP), x86_reg_op(RBP)}});
+        for (uint32_t i = ncs; i-- > 0;)
+          x86_inst_vec_push(&insts, (x86_inst){.op = X_POP, .a = {x86_reg_op(saved[i])}});
+        x86_inst_vec_push(&insts, (x86_inst){.op = X_POP, .a = {x86_reg_op(RBP)}});
+        x86_inst_vec_push(&insts, in);
+        continue;
+      }
+
+      x86_inst after[2];
+      int nafter = 0, role = first_role(&in);
+      uint32_t spilled[2] = {NO_REG, NO_REG};
+      for (int i = 0; i < 2; i++) {
+        x86_operand *o = &in.a[i];
+        if (o->kind == XO_SLOT) {
+          *o = slot_operand(ncs, o->index);
+          continue;
+        }
+        if ((o->kind != XO_REG && o->kind != XO_MEM) || !x86_is_vreg(o->reg)) continue;
+        uint32_t v = o->reg - X86_FIRST_VREG;
+        if (ra->assigned[v] != NO_REG) {
+          o->reg = ra->assigned[v];
+          continue;
+        }
+        x86_operand mem = slot_operand(ncs, ra->slot[v]);
+        uint32_t s = scratch[x86_reg_class(f, o->reg) == X86_XMM][i];
+        if (o->kind == XO_MEM) {
+          // the address itself was spilled
+          x86_inst_vec_push(&insts, (x86_inst){.op = X_MOV, .a = {x86_reg_op(s), mem}});
+          o->reg = s;
+          continue;
+        }
+        // the same register twice: read through the first scratch if that is loaded
+        if (i == 1 && spilled[0] == o->reg && in.a[0].kind == XO_REG &&
+            (role & USE || in.op == X_XOR || in.op == X_XORPD)) {
+          o->reg = in.a[0].reg;
+          continue;
+        }
+        spilled[i] = o->reg;
+        if (takes_memory(&in, i) && !is_memory(&in.a[1 - i])) {
+          *o = mem;
+          continue;
+        }
+        int r = i ? USE : role;
+        if (r & USE) x86_inst_vec_push(&insts, (x86_inst){.op = X_MOV, .a = {x86_reg_op(s), mem}});
+        if (r & DEF) after[nafter++] = (x86_inst){.op = X_MOV, .a = {mem, x86_reg_op(s)}};
+        o->reg = s;
+      }
+      if (in.op == X_MOV && in.a[0].kind == XO_REG && in.a[1].kind == XO_REG &&
+          in.a[0].reg == in.a[1].reg)
+        continue;
+      x86_inst_vec_push(&insts, in);
+      for (int i = 0; i < nafter; i++)
+        x86_inst_vec_push(&insts, after[i]);
+    }
+    *old = insts;
+  }
+}
+
+void allocate_registers(x86_func *f, arena *a, int naive) {
+  allocator ra = {.f = f, .a = a, .nvregs = (uint32_t)f->vregs.size};
+  ra.words = (ra.nvregs + 63) / 64;
+  if (!ra.words) ra.words = 1;
+  uint32_t nv = ra.nvregs ? ra.nvregs : 1;
+  ra.blocks = arena_calloc(a, f->blocks.size ? f->blocks.size : 1, sizeof(block_info));
+  ra.ivs = arena_alloc(a, nv * sizeof(interval));
+  ra.hint_phys = arena_alloc(a, nv * sizeof(uint32_t));
+  ra.hint_vreg = arena_alloc(a, nv * sizeof(uint32_t));
+  ra.assigned = arena_alloc(a, nv * sizeof(uint32_t));
+  ra.slot = arena_alloc(a, nv * sizeof(uint32_t));
+  for (uint32_t v = 0; v < ra.nvregs; v++) {
+    ra.ivs[v] = (interval){X86_FIRST_VREG + v, NO_REG, NO_REG};
+    ra.hint_phys[v] = ra.hint_vreg[v] = ra.assigned[v] = NO_REG;
+  }
+
+  if (naive) {
+    // every value lives in memory and is loaded for each instruction
+    for (uint32_t v = 0; v < ra.nvregs; v++)
+      spill(&ra, X86_FIRST_VREG + v);
+  } else {
+    for (uint32_t b = 0; b < f->blocks.size; b++) {
+      const x86_inst_vec *insts = &f->blocks.data[b].insts;
+      for (size_t k = 0; k < insts->size; k++) {
+        const x86_inst *in = &insts->data[k];
+        if (in->op != X_MOV || in->a[0].kind != XO_REG || in->a[1].kind != XO_REG) continue;
+        uint32_t d = in->a[0].reg, s = in->a[1].reg;
+        if (x86_is_vreg(d) && x86_is_vreg(s)) {
+          ra.hint_vreg[d - X86_FIRST_VREG] = s;
+          ra.hint_vreg[s - X86_FIRST_VREG] = d;
+        } else if (x86_is_vreg(d)) {
+          ra.hint_phys[d - X86_FIRST_VREG] = s;
+        } else if (x86_is_vreg(s)) {
+          ra.hint_phys[s - X86_FIRST_VREG] = d;
+        }
+      }
+    }
+    compute_liveness(&ra);
+    build_ranges(&ra);
+    linear_scan(&ra);
+  }
+
+  uint32_t saved[5], ncs = 0;
+  for (uint32_t i = 0; i < sizeof(callee_saved) / sizeof(*callee_saved); i++) {
+    int used = 0;
+    for (uint32_t v = 0; v < ra.nvregs && !used; v++)
+      used = ra.assigned[v] == callee_saved[i];
+    if (used) saved[ncs++] = callee_saved[i];
+  }
+  rewrite(&ra, ncs, saved);
+}
@@ -0,0 +1,169 @@
+#include "scan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_SSE2 1
+#endif
+
+// generated from the CC_* definitions in scan.h
+const uint8_t char_class[256] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x08, 0x08, 0x08, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x08, 0x10, 0x00, 0x00, 0x00, 0x10, 0x10, 0x00, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x20, 0x10,
+    0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x00, 0x00, 0x10, 0x10, 0x10, 0x00,
+    0x00, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x10, 0x00, 0x10, 0x10, 0x03,
+    0x00, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x00, 0x10, 0x00, 0x10, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+const char *scan_ident_scalar(const char *p, const char *end) {
+  while (p < end && char_is(*p, CC_IDENT))
+    p++;
+  return p;
+}
+
+const char *scan_number_scalar(const char *p, const char *end) {
+  while (p < end && char_is(*p, CC_NUMBER))
+    p++;
+  return p;
+}
+
+const char *scan_space_scalar(const char *p, const char *end) {
+  while (p < end && char_is(*p, CC_SPACE))
+    p++;
+  return p;
+}
+
+const char *scan_line_end_scalar(const char *p, const char *end) {
+  while (p < end && *p != '\n')
+    p++;
+  return p;
+}
+
+const char *scan_string_scalar(const char *p, const char *end) {
+  while (p < end && *p != '"' && *p != '\\' && *p != '\n')
+    p++;
+  return p;
+}
+
+#if defined(SCAN_AVX2) || defined(SCAN_SSE2)
+
+#if defined(SCAN_AVX2)
+#define VEC_WIDTH 32
+typedef __m256i vec;
+typedef uint32_t vec_mask;
+#define vload(p) _mm256_loadu_si256((const __m256i *)(p))
+#define vsplat(c) _mm256_set1_epi8((char)(c))
+#define veq(a, b) _mm256_cmpeq_epi8(a, b)
+#define vgt(a, b) _mm256_cmpgt_epi8(a, b)
+#define vand(a, b) _mm256_and_si256(a, b)
+#define vor(a, b) _mm256_or_si256(a, b)
+#define vmask(v) ((vec_mask)_mm256_movemask_epi8(v))
+#define VEC_ALL 0xffffffffu
+#else
+#define VEC_WIDTH 16
+typedef __m128i vec;
+typedef uint32_t vec_mask;
+#define vload(p) _mm_loadu_si128((const __m128i *)(p))
+#define vsplat(c) _mm_set1_epi8((char)(c))
+#define veq(a, b) _mm_cmpeq_epi8(a, b)
+#define vgt(a, b) _mm_cmpgt_epi8(a, b)
+#define vand(a, b) _mm_and_si128(a, b)
+#define vor(a, b) _mm_or_si128(a, b)
+#define vmask(v) ((vec_mask)_mm_movemask_epi8(v))
+#define VEC_ALL 0xffffu
+#endif
+
+// signed byte compares are fine here: every class member is ascii, and bytes
+// >= 0x80 are negative so they never land inside a range
+static inline vec in_range(vec v, char lo, char hi) {
+  return vand(vgt(v, vsplat(lo - 1)), vgt(vsplat(hi + 1), v));
+}
+
+// a mask bit is set for every byte that is still inside the run
+static inline vec_mask ident_mask(vec v) {
+  vec alpha = in_range(vor(v, vsplat(0x20)), 'a', 'z');
+  vec digit = in_range(v, '0', '9');
+  return vmask(vor(vor(alpha, digit), veq(v, vsplat('_'))));
+}
+
+static inline vec_mask number_mask(vec v) {
+  return vmask(vor(in_range(v, '0', '9'), veq(v, vsplat('.'))));
+}
+
+static inline vec_mask space_mask(vec v) {
+  // ' ', '\t', and '\v' through '\r' (11-13), but not '\n'
+  vec blank = vor(veq(v, vsplat(' ')), veq(v, vsplat('\t')));
+  return vmask(vor(blank, in_range(v, '\v', '\r')));
+}
+
+static inline vec_mask line_mask(vec v) {
+  return ~vmask(veq(v, vsplat('\n'))) & VEC_ALL;
+}
+
+static inline vec_mask string_mask(vec v) {
+  vec stop = vor(vor(veq(v, vsplat('"')), veq(v, vsplat('\\'))), veq(v, vsplat('\n')));
+  return ~vmask(stop) & VEC_ALL;
+}
+
+#define DEFINE_SCAN(name, mask_fn)                                                                 \
+  const char *scan_##name(const char *p, const char *end) {                                        \
+    while (end - p >= VEC_WIDTH) {                                                                 \
+      vec_mask m = mask_fn(vload(p));                                                              \
+      if (m != VEC_ALL) return p + __builtin_ctz(~m);                                              \
+      p += VEC_WIDTH;                                                                              \
+    }                                                                                              \
+    return scan_##name##_scalar(p, end);                                                           \
+  }
+
+DEFINE_SCAN(ident, ident_mask)
+DEFINE_SCAN(number, number_mask)
+DEFINE_SCAN(space, space_mask)
+DEFINE_SCAN(line_end, line_mask)
+DEFINE_SCAN(string, string_mask)
+
+#else
+
+const char *scan_ident(const char *p, const char *end) {
+  return scan_ident_scalar(p, end);
+}
+
+const char *scan_number(const char *p, const char *end) {
+  return scan_number_scalar(p, end);
+}
+
+const char *scan_space(const char *p, const char *end) {
+  return scan_space_scalar(p, end);
+}
+
+const char *scan_line_end(const char *p, const char *end) {
+  return scan_line_end_scalar(p, end);
+}
+
+const char *scan_string(const char *p, const char *end) {
+  return scan_string_scalar(p, end);
+}
+
+#endif
+
+const char *scan_impl_name(void) {
+#if defined(SCAN_AVX2)
+  return "avx2";
+#elif defined(SCAN_SSE2)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// character classes used by the lexer. a byte can be in several classes.
+#define CC_IDENT 0x01   // [A-Za-z0-9_], continues an identifier
+#define CC_ALPHA 0x02   // [A-Za-z_], starts an identifier
+#define CC_DIGIT 0x04   // [0-9]
+#define CC_SPACE 0x08   // horizontal whitespace, never '\n'
+#define CC_SYMBOL 0x10  // bytes that can start an operator
+#define CC_NUMBER 0x20  // [0-9.], continues a number literal
+
+extern const uint8_t char_class[256];
+
+static inline int char_is(char c, uint8_t cls) {
+  return char_class[(unsigned char)c] & cls;
+}
+
+// each scanner returns the first byte in [p, end) that ends the run, or end.
+// the vector paths are picked at compile time (AVX2, then SSE2) and fall back
+// to the class table for the tail and on other targets.
+const char *scan_ident(const char *p, const char *end);
+const char *scan_number(const char *p, const char *end);
+const char *scan_space(const char *p, const char *end);
+const char *scan_line_end(const char *p, const char *end);
+const char *scan_string(const char *p, const char *end);  // next '"', '\\' or '\n'
+
+// the scalar versions, kept around so bench/ can compare against them
+const char *scan_ident_scalar(const char *p, const char *end);
+const char *scan_number_scalar(const char *p, const char *end);
+const char *scan_space_scalar(const char *p, const char *end);
+const char *scan_line_end_scalar(const char *p, const char *end);
+const char *scan_string_scalar(const char *p, const char *end);
+
+const char *scan_impl_name(void);
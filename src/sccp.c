@@ -0,0 +1,224 @@
+#include "fold.h"
+#include "opt.h"
+#include "uses.h"
+#include "vector.h"
+
+// sparse conditional constant propagation (wegman and zadeck). values start
+// out unknown and only move down the lattice, blocks are only evaluated once
+// an executable edge reaches them, so constants flow through phis and across
+// branches that always go one way. afterwards constant values are rewritten
+// into constants in place, decided branches become jumps and blocks that
+// were never reached are dropped.
+
+enum { TOP, CONSTANT, BOTTOM };
+
+typedef struct {
+  uint8_t state;
+  ir_value value;
+} lattice;
+
+VEC_DECL(inst_vec, ir_inst *)
+VEC_DECL(block_vec, ir_block *)
+
+typedef struct {
+  ir_func *f;
+  arena *arena;
+  lattice *cell;        // value id -> lattice value
+  uint8_t *reached;     // block id -> some executable edge leads here
+  uint32_t *edge_base;  // block id -> index of its first incoming edge in `edges`
+  uint8_t *edges;       // executable flag per incoming edge, in preds order
+  use_map *uses;
+  inst_vec values;      // instructions whose lattice value dropped
+  block_vec blocks;     // blocks reached for the first time
+} solver;
+
+static uint8_t *edge(solver *s, ir_block *to, ir_block *from) {
+  for (uint32_t i = 0; i < to->npreds; i++)
+    if (to->preds[i] == from) return &s->edges[s->edge_base[to->id] + i];
+  return NULL;
+}
+
+static void set(solver *s, ir_inst *inst, lattice value) {
+  lattice *old = &s->cell[inst->id];
+  if (old->state == value.state && (value.state != CONSTANT || old->value.i == value.value.i))
+    return;
+  *old = value;
+  inst_vec_push(&s->values, inst);
+}
+
+static void visit(solver *s, ir_inst *inst);
+
+static void mark_edge(solver *s, ir_block *from, ir_block *to) {
+  uint8_t *e = edge(s, to, from);
+  if (*e) return;
+  *e = 1;
+  if (!s->reached[to->id]) {
+    s->reached[to->id] = 1;
+    block_vec_push(&s->blocks, to);
+    return;
+  }
+  // a new way into a block that was already evaluated only affects its phis
+  for (ir_inst *phi = to->first; phi && phi->op == OP_PHI; phi = phi->next)
+    visit(s, phi);
+}
+
+// constants are compared by bits, so 0.0 and -0.0 don't meet to a constant
+static lattice meet(lattice a, lattice b) {
+  if (a.state == TOP) return b;
+  if (b.state == TOP) return a;
+  if (a.state == BOTTOM || b.state == BOTTOM || a.value.i != b.value.i)
+    return (lattice){BOTTOM, {0}};
+  return a;
+}
+
+static lattice evaluate(solver *s, ir_inst *inst) {
+  lattice result = {TOP, {0}};
+  if (inst->op == OP_CONST) return (lattice){CONSTANT, ir_const_value(inst)};
+  if (inst->op == OP_PHI) {
+    for (uint32_t i = 0; i < inst->nargs; i++)
+      if (*edge(s, inst->block, inst->imm.incoming[i]))
+        result = meet(result, s->cell[inst->args[i]->id]);
+    return result;
+  }
+  if (!ir_is_pure(inst->op)) return (lattice){BOTTOM, {0}};
+
+  ir_value args[2];
+  int unknown = 0;
+  for (uint32_t i = 0; i < inst->nargs; i++) {
+    lattice a = s->cell[inst->args[i]->id];
+    if (a.state == BOTTOM) return a;
+    unknown |= a.state == TOP;
+    args[i] = a.value;
+  }
+  if (unknown) return result;
+  if (!fold_op(inst->op, inst->type, inst->args[0]->type, args, &result.value))
+    return (lattice){BOTTOM, {0}};
+  result.state = CONSTANT;
+  return result;
+}
+
+static void visit(solver *s, ir_inst *inst) {
+  ir_block *b = inst->block;
+  switch (inst->op) {
+  case OP_JMP: mark_edge(s, b, inst->imm.target[0]); return;
+  case OP_BR: {
+    lattice c = s->cell[inst->args[0]->id];
+    if (c.state == TOP) return;
+    if (c.state == BOTTOM || c.value.i) mark_edge(s, b, inst->imm.target[0]);
+    if (c.state == BOTTOM || !c.value.i) mark_edge(s, b, inst->imm.target[1]);
+    return;
+  }
+  case OP_RET:
+  case OP_STORE:
+  case OP_PRINT: return;
+  default: break;
+  }
+  if (s->cell[inst->id].state == BOTTOM) return;
+  set(s, inst, evaluate(s, inst));
+}
+
+static void solve(solver *s) {
+  ir_block *entry = s->f->first;
+  s->reached[entry->id] = 1;
+  block_vec_push(&s->blocks, entry);
+  for (uint32_t i = 0; i < s->f->nparams; i++)
+    s->cell[s->f->params[i]->id].state = BOTTOM;
+
+  while (s->values.size || s->blocks.size) {
+    while (s->values.size) {
+      ir_inst *inst = s->values.data[--s->values.size];
+      ir_inst **users = uses_of(s->uses, inst);
+      for (uint32_t i = 0, n = use_count(s->uses, inst); i < n; i++)
+        if (s->reached[users[i]->block->id]) visit(s, users[i]);
+    }
+    if (s->blocks.size) {
+      ir_block *b = s->blocks.data[--s->blocks.size];
+      for (ir_inst *inst = b->first; inst; inst = inst->next)
+        visit(s, inst);
+    }
+  }
+}
+
+static int rewrite(solver *s) {
+  ir_func *f = s->f;
+  int changed = 0;
+  ir_block *next_block;
+  for (ir_block *b = f->first; b; b = b->next) {
+    if (!s->reached[b->id]) continue;
+    ir_inst *next;
+    for (ir_inst *inst = b->first; inst; inst = next) {
+      next = inst->next;
+      if (inst->op == OP_CONST || inst->type == IR_VOID) continue;
+      if (s->cell[inst->id].state != CONSTANT) continue;
+      int was_phi = inst->op == OP_PHI;
+      ir_make_const(inst, s->cell[inst->id].value);
+      changed = 1;
+      if (!was_phi) continue;
+      // constants can't sit among the phis
+      ir_remove(inst);
+      ir_inst *at = b->first;
+      while (at && at->op == OP_PHI)
+        at = at->next;
+      if (at)
+        ir_insert_before(at, inst);
+      else
+        ir_append(b, inst);
+    }
+
+    ir_inst *br = b->last;
+    if (br->op != OP_BR || br->imm.target[0] == br->imm.target[1]) continue;
+    int taken0 = *edge(s, br->imm.target[0], b), taken1 = *edge(s, br->imm.target[1], b);
+    if (taken0 == taken1) continue;
+    br->op = OP_JMP;
+    br->nargs = 0;
+    if (taken1) br->imm.target[0] = br->imm.target[1];
+    changed = 1;
+  }
+
+  // phis drop the edges that were never taken, then unreached blocks go
+  for (ir_block *b = f->first; b; b = b->next) {
+    if (!s->reached[b->id]) continue;
+    for (ir_inst *phi = b->first; phi && phi->op == OP_PHI; phi = phi->next) {
+      uint32_t kept = 0;
+      for (uint32_t i = 0; i < phi->nargs; i++) {
+        if (!*edge(s, b, phi->imm.incoming[i])) continue;
+        phi->args[kept] = phi->args[i];
+        phi->imm.incoming[kept++] = phi->imm.incoming[i];
+      }
+      changed |= kept != phi->nargs;
+      phi->nargs = kept;
+    }
+  }
+  for (ir_block *b = f->first; b; b = next_block) {
+    next_block = b->next;
+    if (s->reached[b->id]) continue;
+    ir_remove_block(f, b);
+    changed = 1;
+  }
+  return changed;
+}
+
+int propagate_constants(ir_func *f) {
+  if (!f->first) return 0;
+  ir_compute_preds(f);
+  solver s = {.f = f, .arena = create_arena("sccp", 16 * 1024)};
+  s.cell = arena_calloc(s.arena, f->nvalues, sizeof(lattice));
+  s.reached = arena_calloc(s.arena, f->nblocks, 1);
+  s.edge_base = arena_alloc(s.arena, f->nblocks * sizeof(uint32_t));
+  uint32_t nedges = 0;
+  for (ir_block *b = f->first; b; b = b->next) {
+    s.edge_base[b->id] = nedges;
+    nedges += b->npreds;
+  }
+  s.edges = arena_calloc(s.arena, nedges + 1, 1);
+  inst_vec_init(&s.values, s.arena, 64);
+  block_vec_init(&s.blocks, s.arena, 16);
+
+  s.uses = create_use_map(f);
+  solve(&s);
+  int changed = rewrite(&s);
+  if (changed) ir_compute_preds(f);
+  destroy_use_map(s.uses);
+  destroy_arena(s.arena);
+  return changed;
+}
@@ -0,0 +1,326 @@
+#include "dom.h"
+#include "opt.h"
+#include <stdlib.h>
+#include <string.h>
+
+// promotes alloca slots to ssa values: phis go on the iterated dominance
+// frontier of a slot's stores, restricted to blocks the slot is live into,
+// then loads and stores are renamed away in one walk of the dominator tree.
+
+VEC_DECL(block_vec, ir_block *)
+
+typedef struct {
+  ir_inst *slot;
+  ir_inst *top;     // reaching definition during renaming
+  ir_inst *undef;   // what a load sees before any store, created on demand
+  block_vec defs;   // blocks that store to the slot
+  block_vec uses;   // blocks that load the slot before storing to it
+} variable;
+
+// one entry per definition made while renaming, so leaving a dominator
+// subtree can restore what was reaching before it
+typedef struct {
+  uint32_t var;
+  ir_inst *top;
+} undo;
+
+VEC_DECL(undo_vec, undo)
+
+typedef struct {
+  ir_inst *phi;
+  uint32_t var;
+} placed_phi;
+
+VEC_DECL(phi_vec, placed_phi)
+
+typedef struct {
+  ir_func *f;
+  arena *arena;
+  dom_tree *dt;
+  variable *vars;
+  uint32_t nvars;
+  uint32_t nvalues_before;  // f->nvalues before any phi was placed
+  uint32_t *var_of;  // value id -> 1 + variable index, for allocas and the phis placed for them
+  ir_inst **repl;    // value id -> what a promoted load was replaced with
+  phi_vec phis;
+  undo_vec log;
+} promoter;
+
+static variable *slot_var(promoter *p, const ir_inst *addr) {
+  if (addr->op != OP_ALLOCA || !p->var_of[addr->id]) return NULL;
+  return &p->vars[p->var_of[addr->id] - 1];
+}
+
+// a slot is promotable if its address is only ever loaded from or stored to
+static void find_slots(promoter *p) {
+  ir_func *f = p->f;
+  uint8_t *escaped = arena_calloc(p->arena, f->nvalues, 1);
+  uint32_t count = 0;
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      if (inst->op == OP_ALLOCA) count++;
+      for (uint32_t i = 0; i < inst->nargs; i++) {
+        int addr = i == 0 && (inst->op == OP_LOAD || inst->op == OP_STORE);
+        if (inst->args[i]->op == OP_ALLOCA && !addr) escaped[inst->args[i]->id] = 1;
+      }
+    }
+
+  p->vars = arena_calloc(p->arena, count ? count : 1, sizeof(variable));
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      if (inst->op != OP_ALLOCA || escaped[inst->id]) continue;
+      variable *v = &p->vars[p->nvars++];
+      v->slot = inst;
+      block_vec_init(&v->defs, p->arena, 0);
+      block_vec_init(&v->uses, p->arena, 0);
+      p->var_of[inst->id] = p->nvars;
+    }
+}
+
+// one scan records, per slot, the blocks that store to it and the blocks
+// where it is read before being written
+static void collect_blocks(promoter *p) {
+  uint32_t *stored = arena_alloc(p->arena, (p->nvars ? p->nvars : 1) * sizeof(uint32_t));
+  uint32_t *loaded = arena_alloc(p->arena, (p->nvars ? p->nvars : 1) * sizeof(uint32_t));
+  memset(stored, 0, p->nvars * sizeof(uint32_t));
+  memset(loaded, 0, p->nvars * sizeof(uint32_t));
+
+  for (uint32_t i = 0; i < p->dt->count; i++) {
+    ir_block *b = p->dt->order[i];
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      if (inst->op != OP_LOAD && inst->op != OP_STORE) continue;
+      variable *v = slot_var(p, inst->args[0]);
+      if (!v) continue;
+      uint32_t n = (uint32_t)(v - p->vars);
+      if (stored[n] == b->id) continue;
+      if (inst->op == OP_STORE) {
+        stored[n] = b->id;
+        block_vec_push(&v->defs, b);
+      } else if (loaded[n] != b->id) {
+        loaded[n] = b->id;
+        block_vec_push(&v->uses, b);
+      }
+    }
+  }
+}
+
+// blocks the variable is live into: walk backwards from the upward exposed
+// uses, stopping at blocks that store to it
+static uint32_t live_in_blocks(promoter *p, variable *v, uint32_t *is_def, uint32_t *is_live,
+                               uint32_t stamp, ir_block **live) {
+  uint32_t n = 0;
+  for (size_t i = 0; i < v->defs.size; i++)
+    is_def[v->defs.data[i]->id] = stamp;
+  for (size_t i = 0; i < v->uses.size; i++) {
+    is_live[v->uses.data[i]->id] = stamp;
+    live[n++] = v->uses.data[i];
+  }
+
+  for (uint32_t i = 0; i < n; i++) {
+    ir_block *b = live[i];
+    for (uint32_t j = 0; j < b->npreds; j++) {
+      ir_block *pred = b->preds[j];
+      if (!dom_reachable(p->dt, pred)) continue;
+      if (is_def[pred->id] == stamp || is_live[pred->id] == stamp) continue;
+      is_live[pred->id] = stamp;
+      live[n++] = pred;
+    }
+  }
+  return n;
+}
+
+static void place_phis(promoter *p) {
+  uint32_t nblocks = p->f->nblocks;
+  uint32_t *is_def = arena_calloc(p->arena, nblocks, sizeof(uint32_t));
+  uint32_t *is_live = arena_calloc(p->arena, nblocks, sizeof(uint32_t));
+  ir_block **live = arena_alloc(p->arena, nblocks * sizeof(ir_block *));
+  ir_block **frontier = arena_alloc(p->arena, nblocks * sizeof(ir_block *));
+
+  for (uint32_t i = 0; i < p->nvars; i++) {
+    variable *v = &p->vars[i];
+    if (!v->uses.size) continue;  // never read, every store is dead
+    uint32_t nlive = live_in_blocks(p, v, is_def, is_live, i + 1, live);
+    uint32_t n = dom_iterated_frontier(p->dt, v->defs.data, (uint32_t)v->defs.size, live, nlive,
+                                       frontier);
+    for (uint32_t j = 0; j < n; j++) {
+      ir_block *b = frontier[j];
+      ir_inst *phi = ir_new_inst(p->f, OP_PHI, v->slot->imm.slot, 0);
+      if (b->first)
+        ir_insert_before(b->first, phi);
+      else
+        ir_append(b, phi);
+      phi_vec_push(&p->phis, (placed_phi){phi, i});
+    }
+  }
+
+  // the new phis have ids past the end of var_of
+  uint32_t *var_of = arena_calloc(p->arena, p->f->nvalues, sizeof(uint32_t));
+  memcpy(var_of, p->var_of, p->nvalues_before * sizeof(uint32_t));
+  for (size_t i = 0; i < p->phis.size; i++)
+    var_of[p->phis.data[i].phi->id] = p->phis.data[i].var + 1;
+  p->var_of = var_of;
+}
+
+static ir_inst *undef_value(promoter *p, variable *v) {
+  if (v->undef) return v->undef;
+  ir_func *f = p->f;
+  ir_block *entry = f->first;
+  ir_type type = v->slot->imm.slot;
+  ir_inst *value;
+  if (type == IR_PTR) {
+    value = ir_new_inst(f, OP_STR, IR_PTR, 0);
+    value->imm.index = ir_add_string(f->module, "", 0);
+  } else {
+    value = ir_new_inst(f, OP_CONST, type == IR_NUM ? IR_I64 : type, 0);
+    if (type == IR_F64) value->imm.f = 0.0;
+  }
+  if (entry->first)
+    ir_insert_before(entry->first, value);
+  else
+    ir_append(entry, value);
+  if (type == IR_NUM) {
+    ir_inst *boxed = ir_new_inst(f, OP_CONV, IR_NUM, 1);
+    boxed->args[0] = value;
+    ir_insert_after(value, boxed);
+    value = boxed;
+  }
+  return v->undef = value;
+}
+
+static void define(promoter *p, variable *v, ir_inst *value) {
+  undo_vec_push(&p->log, (undo){(uint32_t)(v - p->vars), v->top});
+  v->top = value;
+}
+
+static ir_inst *reaching(promoter *p, variable *v) {
+  return v->top ? v->top : undef_value(p, v);
+}
+
+static ir_inst *resolve(promoter *p, ir_inst *value) {
+  ir_inst *r = value->id < p->nvalues_before ? p->repl[value->id] : NULL;
+  return r ? r : value;
+}
+
+static void rename_block(promoter *p, ir_block *b) {
+  ir_inst *next;
+  for (ir_inst *inst = b->first; inst; inst = next) {
+    next = inst->next;
+    switch (inst->op) {
+    case OP_PHI:
+      if (p->var_of[inst->id]) define(p, &p->vars[p->var_of[inst->id] - 1], inst);
+      break;
+    case OP_LOAD: {
+      variable *v = slot_var(p, inst->args[0]);
+      if (!v) break;
+      p->repl[inst->id] = reaching(p, v);
+      ir_remove(inst);
+      break;
+    }
+    case OP_STORE: {
+      variable *v = slot_var(p, inst->args[0]);
+      if (!v) break;
+      define(p, v, resolve(p, inst->args[1]));
+      ir_remove(inst);
+      break;
+    }
+    case OP_ALLOCA:
+      if (slot_var(p, inst)) ir_remove(inst);
+      break;
+    default: break;
+    }
+  }
+
+  ir_block *succ[2];
+  int n = ir_succs(b, succ);
+  for (int i = 0; i < n; i++)
+    for (ir_inst *phi = succ[i]->first; phi && phi->op == OP_PHI; phi = phi->next)
+      if (p->var_of[phi->id])
+        ir_add_incoming(p->f, phi, reaching(p, &p->vars[p->var_of[phi->id] - 1]), b);
+}
+
+// preorder walk of the dominator tree; each block's definitions are undone
+// when its subtree is finished
+static void rename_values(promoter *p) {
+  dom_tree *dt = p->dt;
+  typedef struct {
+    ir_block *block;
+    size_t mark;  // log size to restore, or SIZE_MAX to enter the block
+  } frame;
+  frame *stack = arena_alloc(p->arena, 2 * dt->count * sizeof(frame));
+  uint32_t sp = 0;
+  stack[sp++] = (frame){dt->order[0], SIZE_MAX};
+
+  while (sp) {
+    frame top = stack[--sp];
+    if (top.mark != SIZE_MAX) {
+      while (p->log.size > top.mark) {
+        undo u = p->log.data[--p->log.size];
+        p->vars[u.var].top = u.top;
+      }
+      continue;
+    }
+    stack[sp++] = (frame){top.block, p->log.size};
+    rename_block(p, top.block);
+    for (ir_block *c = dt->child[top.block->id]; c; c = dt->sibling[c->id])
+      stack[sp++] = (frame){c, SIZE_MAX};
+  }
+
+  // values defined by loads can be used anywhere they dominate, including
+  // phis in blocks that were renamed first
+  for (ir_block *b = p->f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        inst->args[i] = resolve(p, inst->args[i]);
+}
+
+// blocks the entry can't reach are dropped first; nothing in them can be
+// renamed, and phis in live blocks forget the edges they contributed
+static int remove_unreachable(ir_func *f, dom_tree *dt) {
+  int removed = 0;
+  ir_block *next;
+  for (ir_block *b = f->first; b; b = next) {
+    next = b->next;
+    if (dom_reachable(dt, b)) continue;
+    ir_remove_block(f, b);
+    removed = 1;
+  }
+  if (!removed) return 0;
+
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *phi = b->first; phi && phi->op == OP_PHI; phi = phi->next) {
+      uint32_t kept = 0;
+      for (uint32_t i = 0; i < phi->nargs; i++) {
+        if (!dom_reachable(dt, phi->imm.incoming[i])) continue;
+        phi->args[kept] = phi->args[i];
+        phi->imm.incoming[kept++] = phi->imm.incoming[i];
+      }
+      phi->nargs = kept;
+    }
+  ir_compute_preds(f);
+  return 1;
+}
+
+int promote_allocas(ir_func *f) {
+  if (!f->first) return 0;
+  ir_compute_preds(f);
+  promoter p = {.f = f, .arena = create_arena("ssa", 16 * 1024)};
+  p.dt = create_dom_tree(f);
+  int changed = remove_unreachable(f, p.dt);
+
+  p.nvalues_before = f->nvalues;
+  p.var_of = arena_calloc(p.arena, f->nvalues, sizeof(uint32_t));
+  find_slots(&p);
+  if (p.nvars) {
+    collect_blocks(&p);
+    phi_vec_init(&p.phis, p.arena, 0);
+    place_phis(&p);
+    p.repl = arena_calloc(p.arena, f->nvalues, sizeof(ir_inst *));
+    undo_vec_init(&p.log, p.arena, 64);
+    rename_values(&p);
+    changed = 1;
+  }
+
+  destroy_dom_tree(p.dt);
+  destroy_arena(p.arena);
+  return changed;
+}
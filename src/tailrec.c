@@ -0,0 +1,148 @@
+#include "opt.h"
+#include "vector.h"
+
+// tail recursion. a function that returns the result of calling itself
+// jumps back to its start instead: the old entry becomes a loop header with
+// a phi per parameter, and each tail call feeds it the call's arguments.
+//
+// returning `x op f(...)` is handled too when op is associative and
+// commutative, which only wrapping integer and boolean arithmetic is: a phi
+// accumulates `acc op x` on the way down and the other returns give
+// `acc op value`. floats round differently in the other order, and num
+// arithmetic turns into float arithmetic once an int overflows 48 bits, so
+// those keep their recursion.
+
+VEC_DECL(inst_vec, ir_inst *)
+
+typedef struct {
+  ir_inst *ret;
+  ir_inst *call;
+  ir_inst *x;  // what the result of the call is combined with, NULL for a plain tail call
+} tail_site;
+
+VEC_DECL(site_vec, tail_site)
+
+static int accumulates(ir_op op, ir_type type) {
+  if (type == IR_I64) return op == OP_ADD || op == OP_MUL || op == OP_AND || op == OP_OR ||
+                             op == OP_XOR;
+  return type == IR_BOOL && (op == OP_AND || op == OP_OR || op == OP_XOR);
+}
+
+static int64_t identity(ir_op op, ir_type type) {
+  if (op == OP_MUL) return 1;
+  if (op == OP_AND) return type == IR_BOOL ? 1 : -1;
+  return 0;
+}
+
+// the instruction before inst, constants skipped since they do nothing
+static ir_inst *before(ir_inst *inst) {
+  do
+    inst = inst->prev;
+  while (inst && (inst->op == OP_CONST || inst->op == OP_STR));
+  return inst;
+}
+
+static int is_self_call(const ir_func *f, const ir_inst *inst) {
+  return inst && inst->op == OP_CALL && inst->imm.callee == f;
+}
+
+// `call; ret call` or `call; t = op x, call; ret t`, with only constants in between
+static int match(ir_func *f, ir_block *b, tail_site *site, ir_op *op) {
+  ir_inst *ret = ir_terminator(b);
+  if (!ret || ret->op != OP_RET || !ret->nargs) return 0;
+  ir_inst *last = before(ret);
+  *site = (tail_site){ret, NULL, NULL};
+  if (is_self_call(f, last) && ret->args[0] == last) {
+    site->call = last;
+    return 1;
+  }
+  if (!last || last != ret->args[0] || last->nargs != 2 || !accumulates(last->op, last->type))
+    return 0;
+  ir_inst *call = before(last);
+  if (!is_self_call(f, call)) return 0;
+  int left = last->args[0] == call, right = last->args[1] == call;
+  if (left == right) return 0;
+  if (*op != OP_COUNT && *op != last->op) return 0;
+  *op = last->op;
+  site->call = call;
+  site->x = last->args[left ? 1 : 0];
+  return 1;
+}
+
+int eliminate_tail_calls(ir_func *f) {
+  if (!f->first) return 0;
+  arena *a = create_arena("tailrec", 4096);
+  site_vec sites;
+  site_vec_init(&sites, a, 4);
+  inst_vec rets;
+  inst_vec_init(&rets, a, 4);
+  ir_op op = OP_COUNT;
+  for (ir_block *b = f->first; b; b = b->next) {
+    tail_site site;
+    ir_op seen = op;
+    if (match(f, b, &site, &seen)) {
+      op = seen;
+      site_vec_push(&sites, site);
+    } else if (b->last && b->last->op == OP_RET) {
+      inst_vec_push(&rets, b->last);
+    }
+  }
+  if (!sites.size) {
+    destroy_arena(a);
+    return 0;
+  }
+
+  // a new entry block leads into the old one, which becomes the loop header
+  ir_compute_preds(f);
+  ir_block *header = f->first, *entry = ir_add_block_before(f, header);
+  ir_inst **phis = arena_alloc(a, (f->nparams ? f->nparams : 1) * sizeof(ir_inst *));
+  ir_inst *at = header->first;
+  for (uint32_t i = 0; i < f->nparams; i++) {
+    phis[i] = ir_new_inst(f, OP_PHI, f->params[i]->type, 0);
+    ir_insert_before(at, phis[i]);
+  }
+  for (ir_block *b = header; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        if (inst->args[i]->op == OP_PARAM) inst->args[i] = phis[inst->args[i]->imm.index];
+  for (uint32_t i = 0; i < f->nparams; i++) {
+    ir_add_incoming(f, phis[i], f->params[i], entry);
+    // the header was already the target of a loop, where parameters don't change
+    for (uint32_t j = 0; j < header->npreds; j++)
+      ir_add_incoming(f, phis[i], phis[i], header->preds[j]);
+  }
+
+  ir_inst *acc = NULL;
+  if (op != OP_COUNT) {
+    acc = ir_new_inst(f, OP_PHI, f->ret, 0);
+    ir_insert_before(at, acc);
+    ir_add_incoming(f, acc, ir_const_int(f, entry, f->ret, identity(op, f->ret)), entry);
+    for (uint32_t j = 0; j < header->npreds; j++)
+      ir_add_incoming(f, acc, acc, header->preds[j]);
+    for (size_t i = 0; i < rets.size; i++) {
+      ir_inst *ret = rets.data[i];
+      ir_inst *value = ir_new_inst(f, op, f->ret, 2);
+      value->args[0] = acc;
+      value->args[1] = ret->args[0];
+      ir_insert_before(ret, value);
+      ret->args[0] = value;
+    }
+  }
+  ir_emit_jmp(f, entry, header);
+
+  for (size_t i = 0; i < sites.size; i++) {
+    tail_site *s = &sites.data[i];
+    ir_block *b = s->ret->block;
+    if (s->x) ir_remove(s->ret->args[0]);
+    ir_remove(s->ret);
+    ir_remove(s->call);
+    for (uint32_t j = 0; j < f->nparams; j++)
+      ir_add_incoming(f, phis[j], s->call->args[j], b);
+    ir_inst *x = s->x && s->x->op == OP_PARAM ? phis[s->x->imm.index] : s->x;
+    if (acc) ir_add_incoming(f, acc, x ? ir_emit(f, b, op, f->ret, acc, x) : acc, b);
+    ir_emit_jmp(f, b, header);
+  }
+  ir_compute_preds(f);
+  destroy_arena(a);
+  return 1;
+}
@@ -0,0 +1,271 @@
+#include "tier.h"
+#include <time.h>
+
+// a hot function is copied and the copy optimized on its own, with its calls
+// pointed at the optimized copies of whatever callees are hot already, so
+// the inliner copies in optimized bodies where it can. a loop is entered
+// through a copy of its function that starts with a new entry block: it
+// takes the contents of every stack slot and each value computed before the
+// loop that the loop reads as parameters, stores the slots and jumps to the
+// header. the slots and constants move into that block, and everything that
+// led to the loop becomes unreachable, so once the copy is optimized what's
+// left is the loop and the code after it. a function whose stack slots have
+// their address taken can't move its frame and is never entered this way. a
+// specialization is one more copy whose float parameters are f64s, boxed
+// again on entry so the body is unchanged; the optimizer then unboxes the
+// float arithmetic done on them.
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+tier *create_tier(ir_module *ir, arena *a, const opt_options *opt, uint32_t threshold) {
+  tier *t = arena_calloc(a, 1, sizeof(tier));
+  uint32_t n = ir->nfuncs ? ir->nfuncs : 1;
+  t->ir = ir;
+  t->arena = a;
+  t->opt = *opt;
+  t->threshold = threshold ? threshold : TIER_THRESHOLD;
+  t->funcs = arena_calloc(a, n, sizeof(ir_func *));
+  t->optimized = arena_calloc(a, n, sizeof(ir_func *));
+  t->code = arena_calloc(a, n, sizeof(bc_func *));
+  t->specs = arena_calloc(a, n, sizeof(tier_spec *));
+  for (ir_func *f = ir->first; f; f = f->next)
+    t->funcs[f->id] = f;
+  tier_entry_vec_init(&t->entries, a, 8);
+  t->bc = gen_bytecode(ir, a, 1);
+  t->bc->tier = t;
+  return t;
+}
+
+void destroy_tier(tier *t) {
+  if (t->cg) destroy_call_graph(t->cg);
+}
+
+// points f's calls at the optimized copies of their callees, and calls to
+// the function `self` is a copy of at `self`
+static void retarget_calls(tier *t, ir_func *f, ir_func *self) {
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      if (inst->op != OP_CALL) continue;
+      ir_func *g = inst->imm.callee;
+      if (self && g == t->funcs[self->id])
+        inst->imm.callee = self;
+      else if (t->optimized[g->id])
+        inst->imm.callee = t->optimized[g->id];
+    }
+}
+
+// optimizes f and lowers it to bytecode
+static const bc_func *compile(tier *t, ir_func *f, uint32_t specializing) {
+  if (!t->cg) t->cg = create_call_graph(t->ir);
+  optimize_function(f, t->cg, &t->opt);
+  bc_func *code = arena_calloc(t->arena, 1, sizeof(bc_func));
+  gen_bytecode_func(t->ir, f, t->arena, code);
+  code->specializing = specializing;
+  return code;
+}
+
+// the parameters of f whose kind picks a specialization, one bit each
+static uint32_t num_params(const ir_func *f) {
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < f->nparams && i < TIER_SPEC_PARAMS; i++)
+    if (f->params[i]->type == IR_NUM) mask |= 1u << i;
+  return mask;
+}
+
+const bc_func *tier_optimize(tier *t, uint32_t id) {
+  if (t->code[id]) return t->code[id];
+  uint64_t start = now_ns();
+  ir_func *f = ir_clone_func(t->funcs[id], NULL, NULL);
+  retarget_calls(t, f, f);
+  t->code[id] = compile(t, f, num_params(f));
+  t->optimized[id] = f;
+  t->nfuncs++;
+  t->ns += now_ns() - start;
+  return t->code[id];
+}
+
+// whether every stack slot of f is only ever loaded from and stored to
+static int slots_stay_put(const ir_func *f) {
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        if (inst->args[i]->op == OP_ALLOCA &&
+            !(i == 0 && (inst->op == OP_LOAD || inst->op == OP_STORE)))
+          return 0;
+  return 1;
+}
+
+// marks the blocks reachable from h, by id
+static uint8_t *reachable_from(arena *a, const ir_func *f, ir_block *h) {
+  uint8_t *seen = arena_calloc(a, f->nblocks, 1);
+  ir_block **stack = arena_alloc(a, f->nblocks * sizeof(ir_block *)), *succ[2];
+  uint32_t n = 0;
+  seen[h->id] = 1;
+  stack[n++] = h;
+  while (n) {
+    int k = ir_succs(stack[--n], succ);
+    for (int i = 0; i < k; i++)
+      if (!seen[succ[i]->id]) {
+        seen[succ[i]->id] = 1;
+        stack[n++] = succ[i];
+      }
+  }
+  return seen;
+}
+
+// the values the code from h on needs from the frame, in parameter order:
+// stack slots (their contents), the header's phis, and the parameters and
+// values computed before the loop that it reads. returns how many
+static uint32_t loop_inputs(arena *a, const ir_func *f, ir_block *h, ir_inst **inputs) {
+  uint8_t *region = reachable_from(a, f, h);
+  uint8_t *taken = arena_calloc(a, f->nvalues, 1);
+  uint32_t n = 0;
+  for (ir_block *b = f->first; b; b = b->next) {
+    if (!region[b->id]) continue;
+    for (ir_inst *inst = b->first; inst; inst = inst->next) {
+      if (inst->op == OP_PHI && b == h && !taken[inst->id]) {
+        taken[inst->id] = 1;
+        inputs[n++] = inst;
+      }
+      for (uint32_t i = 0; i < inst->nargs; i++) {
+        ir_inst *v = inst->args[i];
+        if (inst->op == OP_PHI && !region[inst->imm.incoming[i]->id]) continue;
+        if (taken[v->id] || v->op == OP_CONST || v->op == OP_STR) continue;
+        if (v->op == OP_ALLOCA || v->op == OP_PARAM || !region[v->block->id]) {
+          taken[v->id] = 1;
+          inputs[n++] = v;
+        }
+      }
+    }
+  }
+  return n;
+}
+
+static void build_entry(tier *t, tier_entry *e) {
+  ir_func *f = t->funcs[e->func];
+  ir_block *h = f->first;
+  while (h && h->id != e->header)
+    h = h->next;
+  if (!h || !slots_stay_put(f)) return;
+
+  arena *a = create_arena("tier", 16 * 1024);
+  ir_inst **inputs = arena_alloc(a, f->nvalues * sizeof(ir_inst *));
+  uint32_t n = loop_inputs(a, f, h, inputs);
+  ir_inst **value = arena_alloc(a, f->nvalues * sizeof(ir_inst *));
+  ir_block **block = arena_alloc(a, f->nblocks * sizeof(ir_block *));
+  ir_func *g = ir_clone_func(f, value, block);
+  retarget_calls(t, g, NULL);
+
+  ir_block *entry = ir_add_block_before(g, g->first);
+  for (ir_block *b = entry->next; b; b = b->next)
+    for (ir_inst *inst = b->first, *next; inst; inst = next) {
+      next = inst->next;
+      if (inst->op != OP_ALLOCA && inst->op != OP_CONST && inst->op != OP_STR) continue;
+      ir_remove(inst);
+      ir_append(entry, inst);
+    }
+
+  const uint32_t *regs = t->bc->funcs[e->func].regs;
+  uint32_t *from = arena_alloc(t->arena, (n ? n : 1) * sizeof(uint32_t));
+  g->nparams = n;
+  g->params = arena_alloc(t->arena, (n ? n : 1) * sizeof(ir_inst *));
+  uint32_t nold = g->nvalues;
+  ir_inst **repl = arena_calloc(a, nold, sizeof(ir_inst *));
+  for (uint32_t i = 0; i < n; i++) {
+    ir_inst *v = inputs[i], *c = value[v->id];
+    ir_inst *p = ir_new_inst(g, OP_PARAM, v->op == OP_ALLOCA ? v->imm.slot : v->type, 0);
+    p->imm.index = i;
+    g->params[i] = p;
+    from[i] = regs[v->id];
+    if (v->op == OP_ALLOCA) {
+      ir_inst *store = ir_new_inst(g, OP_STORE, IR_VOID, 2);
+      store->args[0] = c;
+      store->args[1] = p;
+      ir_append(entry, store);
+    } else if (v->op == OP_PHI) {
+      ir_add_incoming(g, c, p, entry);
+    } else {
+      repl[c->id] = p;
+    }
+  }
+  for (ir_block *b = entry->next; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        if (inst->args[i]->id < nold && repl[inst->args[i]->id])
+          inst->args[i] = repl[inst->args[i]->id];
+  ir_emit_jmp(g, entry, block[h->id]);
+  destroy_arena(a);
+
+  e->code = compile(t, g, 0);
+  e->nargs = n;
+  e->from = from;
+  t->nloops++;
+}
+
+const tier_entry *tier_enter_loop(tier *t, uint32_t id, uint32_t header) {
+  for (size_t i = 0; i < t->entries.size; i++) {
+    tier_entry *e = t->entries.data[i];
+    if (e->func == id && e->header == header) return e;
+  }
+  uint64_t start = now_ns();
+  tier_entry *e = arena_calloc(t->arena, 1, sizeof(tier_entry));
+  e->func = id;
+  e->header = header;
+  build_entry(t, e);
+  tier_entry_vec_push(&t->entries, e);
+  t->ns += now_ns() - start;
+  return e;
+}
+
+// a copy of function `id` taking the parameters set in `floats` as f64s
+static const bc_func *specialize(tier *t, uint32_t id, uint32_t floats) {
+  ir_func *f = ir_clone_func(t->funcs[id], NULL, NULL);
+  retarget_calls(t, f, NULL);
+  arena *a = create_arena("tier", 4096);
+  uint32_t n = f->nvalues;
+  ir_inst **boxed = arena_calloc(a, n, sizeof(ir_inst *));
+  ir_inst *at = f->first->first;
+  while (at->op == OP_ALLOCA)
+    at = at->next;
+  for (uint32_t i = 0; i < f->nparams; i++) {
+    ir_inst *p = f->params[i];
+    if (i >= TIER_SPEC_PARAMS || !(floats >> i & 1)) continue;
+    boxed[p->id] = ir_new_inst(f, OP_CONV, IR_NUM, 1);
+    boxed[p->id]->args[0] = p;
+    ir_insert_before(at, boxed[p->id]);
+    p->type = IR_F64;
+  }
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      for (uint32_t i = 0; i < inst->nargs; i++) {
+        ir_inst *v = inst->args[i];
+        if (v->id < n && boxed[v->id] && boxed[v->id] != inst) inst->args[i] = boxed[v->id];
+      }
+  destroy_arena(a);
+  return compile(t, f, 0);
+}
+
+const bc_func *tier_specialize(tier *t, uint32_t id, uint32_t floats) {
+  tier_spec *s = t->specs[id];
+  uint32_t n = 0;
+  for (; s && s->floats != floats; s = s->next)
+    n++;
+  if (!s) {
+    if (n >= TIER_MAX_SPECS) return NULL;
+    s = arena_calloc(t->arena, 1, sizeof(tier_spec));
+    s->floats = floats;
+    s->next = t->specs[id];
+    t->specs[id] = s;
+  }
+  if (!s->code && ++s->count >= t->threshold) {
+    uint64_t start = now_ns();
+    s->code = specialize(t, id, floats);
+    t->nspecs++;
+    t->ns += now_ns() - start;
+  }
+  return s->code;
+}
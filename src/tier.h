@@ -0,0 +1,74 @@
+#pragma once
+#include "bytecode.h"
+#include "calls.h"
+#include "opt.h"
+
+// tiered execution on the bytecode interpreter. every function starts out as
+// counting bytecode for the ir as lowered, which is quick to make. when a
+// function has been called `threshold` times it is optimized on its own and
+// later calls run the optimized code; when a loop has gone round `threshold`
+// times, the running call moves into code optimized from the top of the loop
+// on (on-stack replacement). code that never gets hot is never optimized.
+// a call to the optimized code of a function with `num` parameters first
+// checks what its arguments hold: once a tuple with floats in it has been
+// seen `threshold` times, the function gets a copy taking those floats as
+// f64s, and later calls with the same kinds run that. ints stay boxed, since
+// num int arithmetic overflows into floats past 48 bits and i64 doesn't.
+
+#define TIER_THRESHOLD 1000
+#define TIER_MAX_SPECS 4     // tuples tracked per function; calls with others stay generic
+#define TIER_SPEC_PARAMS 32  // parameters past these are never specialized
+
+// a way into the middle of a function: code for the rest of it from the top
+// of a loop, whose arguments are the registers `from` of the counting frame
+typedef struct {
+  uint32_t func;    // ir function id
+  uint32_t header;  // block id in the counting code's ir
+  const bc_func *code;  // NULL if the loop can't be entered this way
+  uint32_t nargs;
+  const uint32_t *from;
+} tier_entry;
+
+VEC_DECL(tier_entry_vec, tier_entry *)
+
+// a copy of a function for calls whose `num` arguments hold floats exactly
+// where `floats` has a bit set
+typedef struct tier_spec {
+  uint32_t floats;      // bit i: parameter i is an f64
+  uint32_t count;       // calls seen with these kinds
+  const bc_func *code;  // NULL until count reaches the threshold
+  struct tier_spec *next;
+} tier_spec;
+
+typedef struct tier {
+  ir_module *ir;       // as lowered; the counting code's
+  bc_module *bc;       // counting code; its tier points here
+  arena *arena;        // the module's, which the new code and ir go in too
+  call_graph *cg;
+  opt_options opt;     // for hot code
+  uint32_t threshold;
+  ir_func **funcs;       // function id -> the module's function
+  ir_func **optimized;   // function id -> its optimized copy, once hot
+  const bc_func **code;  // function id -> the optimized copy's code
+  tier_entry_vec entries;
+  tier_spec **specs;     // function id -> the kinds its calls were seen with
+  uint32_t nfuncs, nloops, nspecs;  // optimized so far, loops entered and specializations
+  uint64_t ns;              // time spent optimizing
+} tier;
+
+// counting code for a module that hasn't been optimized, all in `a`. opt is
+// copied, and its level applies to hot code
+tier *create_tier(ir_module *ir, arena *a, const opt_options *opt, uint32_t threshold);
+void destroy_tier(tier *t);
+
+// the optimized code for function `id`
+const bc_func *tier_optimize(tier *t, uint32_t id);
+
+// a way into function `id` at the top of the loop headed by block `header`;
+// its code is NULL if there is none
+const tier_entry *tier_enter_loop(tier *t, uint32_t id, uint32_t header);
+
+// the code specialized for calls to function `id` whose arguments hold floats
+// where `floats` has a bit set, if there is some by now; NULL to carry on in
+// the generic code
+const bc_func *tier_specialize(tier *t, uint32_t id, uint32_t floats);
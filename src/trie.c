@@ -1,86 +1,58 @@
 #include "trie.h"
-#include "token.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// +, -, *, /, |, =, &, >, <, %, !, ^, (, ), [, ], , "
-#define SYMBOL_COUNT 19
-
-// used to determine the index of each char
-static const char SYMBOL_LIST[SYMBOL_COUNT] = {'+', '-', '*', '/', '|', '=', '&', '>', '<', '%',
-                                               '!', '"', '^', '(', ')', '[', ']', ',', '~'};
-
-struct trie_node {
-  struct trie_node *children[SYMBOL_COUNT];
-  int is_end;  // is this the end of a word
-  token_type token_type;
-};
-
-static int symbol_to_index(const char *sym) {
-  for (int i = 0; i < SYMBOL_COUNT; i++) {
-    if (*sym == SYMBOL_LIST[i]) return i;
-  }
-  return -1;
-}
-
-trie_node *create_trie_node(void) {
-  trie_node *node = malloc(sizeof(trie_node));
-  if (node) {
-    node->is_end = 0;
-    node->token_type = -1;
-    memset(node->children, 0, sizeof(node->children));
+static int class_index(symbol_trie *t, unsigned char c) {
+  if (!t->class_of[c]) {
+    if (t->classes >= TRIE_MAX_CLASSES) {
+      fprintf(stderr, "error: too many distinct symbol characters\n");
+      exit(EXIT_FAILURE);
+    }
+    t->class_of[c] = t->classes++;
   }
-  return node;
+  return t->class_of[c];
 }
 
-void insert_symbol(trie_node *root, const char *sym, token_type type) {
-  trie_node *cur = root;
-  while (*sym) {
-    int index = symbol_to_index(sym);
-    if (index == -1) {
-      fprintf(stderr, "error: invalid character %c in pattern\n", *sym);
-      return;
-    }
-    if (!cur->children[index]) {
-      cur->children[index] = create_trie_node();
+static void insert_symbol(symbol_trie *t, const char *sym, token_type type) {
+  int state = 0;
+  for (; *sym; sym++) {
+    int cls = class_index(t, (unsigned char)*sym);
+    if (!t->next[state][cls]) {
+      if (t->states >= TRIE_MAX_STATES) {
+        fprintf(stderr, "error: symbol table exceeds %d trie states\n", TRIE_MAX_STATES);
+        exit(EXIT_FAILURE);
+      }
+      t->accept[t->states] = -1;
+      t->next[state][cls] = t->states++;
     }
-    cur = cur->children[index];
-    sym++;
+    state = t->next[state][cls];
   }
+  t->accept[state] = type;
+}
 
-  cur->is_end = 1;
-  cur->token_type = type;
+void build_symbol_trie(symbol_trie *t, const symbol_entry *symbols, int count) {
+  memset(t, 0, sizeof(*t));
+  t->states = 1;
+  t->classes = 1;  // class 0 is every byte that can't appear in a symbol
+  t->accept[0] = -1;
+  for (int i = 0; i < count; i++)
+    insert_symbol(t, symbols[i].symbol, symbols[i].type);
 }
 
-match_result search_trie(trie_node *root, const char *sym) {
-  trie_node *cur = root;
+match_result match_symbol(const symbol_trie *t, const char *p, const char *end) {
   match_result longest = {-1, 0};
-  int pos = 0;
-
-  // walk through the trie following the input symbol sequence
-  while (sym[pos]) {
-    int index = symbol_to_index(&sym[pos]);
-    // if there's no path for this character, symbol isn't in trie
-    if (index == -1 || !cur->children[index]) break;  // end of match
-
-    cur = cur->children[index];
-    pos++;
-
-    if (cur->is_end) {
-      longest.type = cur->token_type;
-      longest.length = pos;
+  int state = 0;
+
+  // follow transitions until the dfa dies, remembering the last accepting state
+  for (const char *s = p; s < end; s++) {
+    state = t->next[state][t->class_of[(unsigned char)*s]];
+    if (!state) break;
+    if (t->accept[state] >= 0) {
+      longest.type = t->accept[state];
+      longest.length = (int)(s - p) + 1;
     }
   }
 
-  // return the longest possible match
   return longest;
 }
-
-void free_trie(trie_node *root) {
-  if (!root) return;
-  for (int i = 0; i < SYMBOL_COUNT; i++) {
-    if (root->children[i]) free_trie(root->children[i]);
-  }
-  free(root);
-}
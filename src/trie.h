@@ -1,14 +1,30 @@
 #pragma once
 #include "token.h"
+#include <stdint.h>
 
-typedef struct trie_node trie_node;
+#define TRIE_MAX_STATES 64
+#define TRIE_MAX_CLASSES 24
+
+typedef struct {
+  const char *symbol;
+  token_type type;
+} symbol_entry;
 
 typedef struct {
   token_type type;
   int length;
 } match_result;
 
-trie_node *create_trie_node(void);
-void insert_symbol(trie_node *root, const char *symbol, token_type type);
-match_result search_trie(trie_node *root, const char *sym);
-void free_trie(trie_node *root);
+// the operator trie flattened into a dfa. bytes are first mapped to a small
+// class id so each row only has one column per distinct operator character.
+// state 0 is the start state and doubles as "no transition".
+typedef struct {
+  uint8_t class_of[256];
+  uint8_t next[TRIE_MAX_STATES][TRIE_MAX_CLASSES];
+  int16_t accept[TRIE_MAX_STATES];  // token_type, or -1 if not a complete symbol
+  int states;
+  int classes;
+} symbol_trie;
+
+void build_symbol_trie(symbol_trie *t, const symbol_entry *symbols, int count);
+match_result match_symbol(const symbol_trie *t, const char *p, const char *end);
@@ -0,0 +1,31 @@
+#include "uses.h"
+#include <string.h>
+
+use_map *create_use_map(ir_func *f) {
+  arena *a = create_arena("uses", 16 * 1024);
+  use_map *u = arena_calloc(a, 1, sizeof(use_map));
+  u->arena = a;
+  u->nvalues = f->nvalues;
+  u->start = arena_calloc(a, f->nvalues + 1, sizeof(uint32_t));
+
+  // count, prefix sum, fill
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        u->start[inst->args[i]->id + 1]++;
+  for (uint32_t i = 0; i < f->nvalues; i++)
+    u->start[i + 1] += u->start[i];
+
+  uint32_t *fill = arena_alloc(a, f->nvalues * sizeof(uint32_t));
+  memcpy(fill, u->start, f->nvalues * sizeof(uint32_t));
+  u->users = arena_alloc(a, (u->start[f->nvalues] + 1) * sizeof(ir_inst *));
+  for (ir_block *b = f->first; b; b = b->next)
+    for (ir_inst *inst = b->first; inst; inst = inst->next)
+      for (uint32_t i = 0; i < inst->nargs; i++)
+        u->users[fill[inst->args[i]->id]++] = inst;
+  return u;
+}
+
+void destroy_use_map(use_map *u) {
+  if (u) destroy_arena(u->arena);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "ir.h"
+
+// def-use chains for one function, built in one linear scan: the users of a
+// value are users[start[id], start[id + 1]), one entry per operand, so an
+// instruction using a value twice is listed twice. it describes the function
+// as it was when built; deleting instructions keeps it usable as long as the
+// caller skips users that were removed (their block is NULL).
+typedef struct {
+  arena *arena;
+  uint32_t nvalues;
+  uint32_t *start;
+  ir_inst **users;
+} use_map;
+
+use_map *create_use_map(ir_func *f);
+void destroy_use_map(use_map *u);
+
+static inline uint32_t use_count(const use_map *u, const ir_inst *v) {
+  return v->id < u->nvalues ? u->start[v->id + 1] - u->start[v->id] : 0;
+}
+
+static inline ir_inst **uses_of(const use_map *u, const ir_inst *v) {
+  return &u->users[v->id < u->nvalues ? u->start[v->id] : 0];
+}
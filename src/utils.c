@@ -1,65 +1,117 @@
 #include "utils.h"
+#include "diag.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-file_streamer *create_streamer(const char *filename) {
-  file_streamer *streamer = malloc(sizeof(file_streamer));
+#define READ_CHUNK 65536
 
-  streamer->file = fopen(filename, "rb");
-  if (!streamer->file) {
-    perror("failed to open file");
-    free(streamer);
-    exit(1);
+// fallback for stdin, pipes and anything else that can't be mapped
+static int read_all(FILE *file, source_file *src) {
+  size_t capacity = READ_CHUNK, size = 0;
+  char *data = malloc(capacity);
+  if (!data) return -1;
+
+  size_t n;
+  while ((n = fread(data + size, 1, capacity - size, file)) > 0) {
+    size += n;
+    if (size == capacity) {
+      capacity *= 2;
+      char *grown = realloc(data, capacity);
+      if (!grown) {
+        free(data);
+        return -1;
+      }
+      data = grown;
+    }
+  }
+
+  if (ferror(file)) {
+    free(data);
+    return -1;
   }
 
-  return streamer;
+  src->data = data;
+  src->size = size;
+  src->mapped = 0;
+  return 0;
 }
 
-size_t stream_line(file_streamer *streamer, char *buffer) {
-  if (!streamer || !streamer->file || !buffer) {
-    return 0;
-  }
+source_file *open_source(const char *filename) {
+  source_file *src = malloc(sizeof(source_file));
+  if (!src) return NULL;
 
-  if (fgets(buffer, MAX_LINE, streamer->file)) {
-    return strlen(buffer);
+  if (strcmp(filename, "-") == 0) {
+    if (read_all(stdin, src) == -1) {
+      diag_error("error reading stdin: %s\n", strerror(errno));
+      free(src);
+      return NULL;
+    }
+    return src;
   }
 
-  if (feof(streamer->file)) {
-    return 0;
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    diag_error("failed to open %s: %s\n", filename, strerror(errno));
+    free(src);
+    return NULL;
   }
 
-  else if (ferror(streamer->file)) {
-    perror("error reading file");
-    exit(1);
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      close(fd);
+      src->data = map;
+      src->size = st.st_size;
+      src->mapped = 1;
+      return src;
+    }
   }
 
-  return 0;
+  // empty files, fifos and character devices can't be mapped
+  FILE *file = fdopen(fd, "rb");
+  if (!file || read_all(file, src) == -1) {
+    diag_error("error reading %s: %s\n", filename, strerror(errno));
+    if (file)
+      fclose(file);
+    else
+      close(fd);
+    free(src);
+    return NULL;
+  }
+  fclose(file);
+  return src;
 }
 
-void destroy_streamer(file_streamer *streamer) {
-  if (!streamer) {
-    return;
-  }
-  if (streamer->file) {
-    fclose(streamer->file);
-  }
-  free(streamer);
+void close_source(source_file *src) {
+  if (!src) return;
+  if (src->mapped)
+    munmap((void *)src->data, src->size);
+  else
+    free((void *)src->data);
+  free(src);
 }
 
-int write_file(const char *filename, vector *buffer) {
+int write_file(const char *filename, const void *data, size_t size) {
   FILE *file = fopen(filename, "wb");
   if (!file) return -1;
-  size_t size = buffer->size;
-  size_t written = fwrite(buffer->data, 1, size, file);
+  size_t written = fwrite(data, 1, size, file);
   fclose(file);
   return (written == size) ? 0 : -1;
 }
 
+// 1 where the code generator's output runs natively: x86-64
 int check_architecture(void) {
-#if defined(__aarch64__) || defined(_M_ARM64)
+#if defined(__x86_64__) || defined(_M_X64)
   return 1;
-#elif defined(__x86_64__) || defined(_M_X64)
+#elif defined(__aarch64__) || defined(_M_ARM64)
   return -1;
 #elif defined(__i386__) || defined(_M_IX86)
   return -1;
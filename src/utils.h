@@ -1,17 +1,18 @@
 #pragma once
-#include "vector.h"
 #include <stdbool.h>
 #include <stdio.h>
 
-#define MAX_LINE 256
 #define BOOPLANG_VERSION "0.0.1"
 
+// the whole source file as one contiguous, read-only buffer. regular files are
+// mmap'd, stdin and pipes are read in one go. there is no trailing NUL.
 typedef struct {
-  FILE *file;
-} file_streamer;
+  const char *data;
+  size_t size;
+  int mapped;
+} source_file;
 
-file_streamer *create_streamer(const char *filename);
-size_t stream_line(file_streamer *streamer, char *buffer);
-void destroy_streamer(file_streamer *streamer);
-int write_file(const char *filename, vector *buffer);
+source_file *open_source(const char *filename);
+void close_source(source_file *src);
+int write_file(const char *filename, const void *data, size_t size);
 int check_architecture(void);
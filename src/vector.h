@@ -1,14 +1,90 @@
 #pragma once
+#include "arena.h"
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-typedef struct {
-  void *data;
-  size_t size;
-  size_t capacity;
-  size_t elem_size;
-} vector;
-
-vector *create_vector(size_t elem_size, int initial_size);
-void add_element(vector *arr, void *element);
-void *get_element(vector *arr, size_t index);
-void free_vector(vector *arr);
+// growth policies, called with the current capacity and the capacity that is
+// needed; they must return something >= need
+#define VEC_GROW_DOUBLE(cap, need) ((cap) * 2 > (need) ? (cap) * 2 : (need))
+#define VEC_GROW_HALF(cap, need) ((cap) + (cap) / 2 > (need) ? (cap) + (cap) / 2 : (need))
+
+#ifndef VEC_DEFAULT_GROWTH
+#define VEC_DEFAULT_GROWTH VEC_GROW_DOUBLE
+#endif
+
+#define VEC_MIN_CAPACITY 8
+
+// VEC_DECL(name, T) declares a vector of T called `name` with inline
+// name_push/name_get/... helpers. storage comes from the heap, or from an
+// arena if one is passed to name_init(); arena storage is never freed
+// individually, old buffers stay in the arena until it is torn down.
+#define VEC_DECL(name, T) VEC_DECL_GROWTH(name, T, VEC_DEFAULT_GROWTH)
+
+#define VEC_DECL_GROWTH(name, T, growth)                                                           \
+  typedef struct {                                                                                 \
+    T *data;                                                                                       \
+    size_t size;                                                                                   \
+    size_t capacity;                                                                               \
+    arena *arena;                                                                                  \
+  } name;                                                                                          \
+                                                                                                   \
+  static void name##_grow(name *v, size_t need) __attribute__((noinline, unused));                 \
+  static void name##_grow(name *v, size_t need) {                                                  \
+    size_t cap = v->capacity < VEC_MIN_CAPACITY ? VEC_MIN_CAPACITY : v->capacity;                  \
+    cap = growth(cap, need);                                                                       \
+    if (v->arena) {                                                                                \
+      T *data = arena_alloc(v->arena, cap * sizeof(T));                                            \
+      if (v->size) memcpy(data, v->data, v->size * sizeof(T));                                     \
+      v->data = data;                                                                              \
+    } else {                                                                                       \
+      v->data = realloc(v->data, cap * sizeof(T));                                                 \
+      if (!v->data) {                                                                              \
+        fprintf(stderr, "failed to resize " #name "\n");                                           \
+        exit(EXIT_FAILURE);                                                                        \
+      }                                                                                            \
+    }                                                                                              \
+    v->capacity = cap;                                                                             \
+  }                                                                                                \
+                                                                                                   \
+  static inline __attribute__((unused)) void name##_init(name *v, arena *a, size_t capacity) {     \
+    v->data = NULL;                                                                                \
+    v->size = 0;                                                                                   \
+    v->capacity = 0;                                                                               \
+    v->arena = a;                                                                                  \
+    if (capacity) name##_grow(v, capacity);                                                        \
+  }                                                                                                \
+                                                                                                   \
+  static inline __attribute__((unused)) void name##_reserve(name *v, size_t capacity) {            \
+    if (capacity > v->capacity) name##_grow(v, capacity);                                          \
+  }                                                                                                \
+                                                                                                   \
+  static inline __attribute__((unused)) void name##_push(name *v, T x) {                           \
+    if (__builtin_expect(v->size == v->capacity, 0)) name##_grow(v, v->size + 1);                  \
+    v->data[v->size++] = x;                                                                        \
+  }                                                                                                \
+                                                                                                   \
+  static inline __attribute__((unused)) void name##_push_many(name *v, const T *xs, size_t n) {    \
+    if (v->size + n > v->capacity) name##_grow(v, v->size + n);                                    \
+    if (n) memcpy(v->data + v->size, xs, n * sizeof(T));                                           \
+    v->size += n;                                                                                  \
+  }                                                                                                \
+                                                                                                   \
+  static inline __attribute__((unused)) T *name##_get(const name *v, size_t i) {                   \
+    return &v->data[i];                                                                            \
+  }                                                                                                \
+                                                                                                   \
+  static inline __attribute__((unused)) T name##_pop(name *v) {                                    \
+    return v->data[--v->size];                                                                     \
+  }                                                                                                \
+                                                                                                   \
+  static inline __attribute__((unused)) void name##_free(name *v) {                                \
+    if (!v->arena) free(v->data);                                                                  \
+    v->data = NULL;                                                                                \
+    v->size = v->capacity = 0;                                                                     \
+  }
+
+VEC_DECL(u8_vec, uint8_t)
+VEC_DECL(u32_vec, uint32_t)
+VEC_DECL(char_vec, char)
@@ -0,0 +1,272 @@
+#include "x86.h"
+#include <inttypes.h>
+#include <string.h>
+
+const char *const x86_runtime_names[RT_COUNT] = {
+    [RT_PRINT_I64] = "boop_rt_print_i64", [RT_PRINT_F64] = "boop_rt_print_f64",
+    [RT_PRINT_STR] = "boop_rt_print_str", [RT_PRINT_NUM] = "boop_rt_print_num",
+    [RT_DIV_I64] = "boop_rt_div_i64",     [RT_MOD_I64] = "boop_rt_mod_i64",
+    [RT_POW_I64] = "boop_rt_pow_i64",     [RT_MOD_F64] = "boop_rt_mod_f64",
+    [RT_POW_F64] = "boop_rt_pow_f64",     [RT_NUM_ADD] = "boop_rt_num_add",
+    [RT_NUM_SUB] = "boop_rt_num_sub",     [RT_NUM_MUL] = "boop_rt_num_mul",
+    [RT_NUM_DIV] = "boop_rt_num_div",     [RT_NUM_MOD] = "boop_rt_num_mod",
+    [RT_NUM_POW] = "boop_rt_num_pow",     [RT_NUM_NEG] = "boop_rt_num_neg",
+    [RT_NUM_EQ] = "boop_rt_num_eq",       [RT_NUM_LT] = "boop_rt_num_lt",
+    [RT_NUM_LE] = "boop_rt_num_le",       [RT_BOX_I64] = "boop_rt_box_i64",
+    [RT_BOX_F64] = "boop_rt_box_f64",     [RT_BOX_PTR] = "boop_rt_box_ptr",
+    [RT_TRUTHY] = "boop_rt_truthy",       [RT_UNBOX_I64] = "boop_rt_unbox_i64",
+    [RT_UNBOX_F64] = "boop_rt_unbox_f64", [RT_UNBOX_PTR] = "boop_rt_unbox_ptr",
+};
+
+x86_module *create_x86_module(ir_module *ir, arena *a) {
+  x86_module *m = arena_calloc(a, 1, sizeof(x86_module));
+  m->arena = a;
+  m->ir = ir;
+  m->nfuncs = ir->nfuncs;
+  m->funcs = arena_calloc(a, ir->nfuncs ? ir->nfuncs : 1, sizeof(x86_func *));
+  m->string_syms = arena_calloc(a, ir->strings.size ? ir->strings.size : 1, sizeof(uint32_t));
+  m->float_mask = 15;
+  m->float_table = arena_calloc(a, m->float_mask + 1, sizeof(uint32_t));
+  x86_sym_vec_init(&m->syms, a, ir->nfuncs + RT_COUNT + 16);
+  for (ir_func *f = ir->first; f; f = f->next)
+    x86_sym_vec_push(&m->syms, (x86_sym){XS_FUNC, f->name, 0});
+  for (int i = 0; i < RT_COUNT; i++)
+    x86_sym_vec_push(&m->syms, (x86_sym){XS_EXTERN, x86_runtime_names[i], 0});
+  return m;
+}
+
+uint32_t x86_string_sym(x86_module *m, uint32_t index) {
+  if (!m->string_syms[index]) {
+    x86_sym_vec_push(&m->syms, (x86_sym){XS_STRING, m->ir->strings.data[index], index});
+    m->string_syms[index] = (uint32_t)m->syms.size;
+  }
+  return m->string_syms[index] - 1;
+}
+
+static uint32_t hash_bits(uint64_t bits) {
+  bits *= 0x9e3779b97f4a7c15ull;
+  return (uint32_t)(bits >> 32);
+}
+
+uint32_t x86_float_sym(x86_module *m, uint64_t bits) {
+  uint32_t i = hash_bits(bits) & m->float_mask;
+  for (; m->float_table[i]; i = (i + 1) & m->float_mask)
+    if (m->syms.data[m->float_table[i] - 1].value == bits) return m->float_table[i] - 1;
+  x86_sym_vec_push(&m->syms, (x86_sym){XS_FLOAT, NULL, bits});
+  m->float_table[i] = (uint32_t)m->syms.size;
+
+  // keep the table at most half full
+  if (++m->nfloats * 2 > m->float_mask) {
+    uint32_t *old = m->float_table, old_size = m->float_mask + 1;
+    m->float_mask = old_size * 2 - 1;
+    m->float_table = arena_calloc(m->arena, old_size * 2, sizeof(uint32_t));
+    for (uint32_t j = 0; j < old_size; j++) {
+      if (!old[j]) continue;
+      uint32_t k = hash_bits(m->syms.data[old[j] - 1].value) & m->float_mask;
+      while (m->float_table[k])
+        k = (k + 1) & m->float_mask;
+      m->float_table[k] = old[j];
+    }
+  }
+  return (uint32_t)m->syms.size - 1;
+}
+
+uint32_t x86_new_vreg(x86_func *f, x86_class c) {
+  u8_vec_push(&f->vregs, (uint8_t)c);
+  return X86_FIRST_VREG + (uint32_t)f->vregs.size - 1;
+}
+
+x86_class x86_reg_class(const x86_func *f, uint32_t reg) {
+  if (x86_is_vreg(reg)) return f->vregs.data[reg - X86_FIRST_VREG];
+  return reg >= XMM0 && reg < X86_NREGS ? X86_XMM : X86_GPR;
+}
+
+x86_module *gen_x86(ir_module *ir, arena *a, int naive) {
+  x86_module *m = create_x86_module(ir, a);
+  arena *scratch = create_arena("regalloc", 64 * 1024);
+  for (ir_func *f = ir->first; f; f = f->next) {
+    if (!f->first) continue;
+    x86_func *mf = select_instructions(m, f);
+    allocate_registers(mf, scratch, naive);
+    reset_arena(scratch);
+    m->funcs[f->id] = mf;
+  }
+  destroy_arena(scratch);
+  return m;
+}
+
+/* at&t syntax output */
+
+static const char *const reg64[16] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                                      "r8",  "r9",  "r10", "r11", "r12", "r13", "r14", "r15"};
+static const char *const reg32[16] = {"eax", "ecx", "edx",  "ebx",  "esp",  "ebp",  "esi",  "edi",
+                                      "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+static const char *const reg8[16] = {"al",  "cl",  "dl",   "bl",   "spl",  "bpl",  "sil",  "dil",
+                                     "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+static const char *const cc_names[16] = {"o", "no", "b", "ae", "e",  "ne", "be", "a",
+                                         "s", "ns", "p", "np", "l", "ge", "le", "g"};
+
+static const char *const mnemonics[X_OP_COUNT] = {
+    [X_LEA] = "leaq",       [X_ADD] = "addq",         [X_SUB] = "subq",
+    [X_IMUL] = "imulq",     [X_AND] = "andq",         [X_OR] = "orq",
+    [X_XOR] = "xorq",       [X_SHL] = "shlq",         [X_SAR] = "sarq",
+    [X_NEG] = "negq",       [X_NOT] = "notq",         [X_CMP] = "cmpq",
+    [X_TEST] = "testq",     [X_IDIV] = "idivq",       [X_ADDSD] = "addsd",
+    [X_SUBSD] = "subsd",    [X_MULSD] = "mulsd",      [X_DIVSD] = "divsd",
+    [X_XORPD] = "xorpd",    [X_UCOMISD] = "ucomisd",  [X_CVTSI2SD] = "cvtsi2sdq",
+    [X_CVTTSD2SI] = "cvttsd2siq", [X_PUSH] = "pushq", [X_POP] = "popq",
+};
+
+static void print_sym(FILE *out, const x86_module *m, uint32_t index) {
+  const x86_sym *s = &m->syms.data[index];
+  switch (s->kind) {
+  case XS_STRING: fprintf(out, ".Lstr%u", index); break;
+  case XS_FLOAT: fprintf(out, ".Lfp%u", index); break;
+  default: fputs(s->name, out);
+  }
+}
+
+static int is_xmm(const x86_operand *o) {
+  return o->kind == XO_REG && o->reg >= XMM0 && o->reg < X86_NREGS;
+}
+
+// `bytes` picks the register name: 8, 4 or 1
+static void print_operand(FILE *out, const x86_module *m, const x86_func *f, const x86_operand *o,
+                          int bytes) {
+  switch (o->kind) {
+  case XO_REG:
+    if (o->reg >= XMM0)
+      fprintf(out, "%%xmm%u", o->reg - XMM0);
+    else
+      fprintf(out, "%%%s", bytes == 1 ? reg8[o->reg] : bytes == 4 ? reg32[o->reg] : reg64[o->reg]);
+    break;
+  case XO_IMM: fprintf(out, "$%" PRId64, o->imm); break;
+  case XO_MEM:
+    if (o->imm) fprintf(out, "%" PRId64, o->imm);
+    fprintf(out, "(%%%s)", reg64[o->reg]);
+    break;
+  case XO_SLOT: fprintf(out, "slot%u", o->index); break;
+  case XO_SYM:
+    print_sym(out, m, o->index);
+    fputs("(%rip)", out);
+    break;
+  case XO_BLOCK: fprintf(out, ".L%s.%u", f->name, o->index); break;
+  default: break;
+  }
+}
+
+static void print_two(FILE *out, const x86_module *m, const x86_func *f, const char *name,
+                      const x86_inst *in, int src_bytes, int dst_bytes) {
+  fprintf(out, "\t%s ", name);
+  print_operand(out, m, f, &in->a[1], src_bytes);
+  fputs(", ", out);
+  print_operand(out, m, f, &in->a[0], dst_bytes);
+  fputc('\n', out);
+}
+
+static void print_mov(FILE *out, const x86_module *m, const x86_func *f, const x86_inst *in) {
+  const x86_operand *d = &in->a[0], *s = &in->a[1];
+  if (d->kind == XO_REG && s->kind == XO_REG && d->reg == s->reg) return;
+  const char *name = "movq";
+  if (is_xmm(d) && is_xmm(s))
+    name = "movapd";
+  else if ((is_xmm(d) && s->kind != XO_REG) || (is_xmm(s) && d->kind != XO_REG))
+    name = "movsd";
+  else if (s->kind == XO_IMM && !x86_fits_imm32(s->imm))
+    name = "movabsq";
+  print_two(out, m, f, name, in, 8, 8);
+}
+
+static void print_inst(FILE *out, const x86_module *m, const x86_func *f, const x86_inst *in,
+                       uint32_t next_block) {
+  switch (in->op) {
+  case X_MOV: print_mov(out, m, f, in); return;
+  case X_IMUL:
+    if (in->a[1].kind == XO_IMM) {
+      fprintf(out, "\timulq $%" PRId64 ", ", in->a[1].imm);
+      print_operand(out, m, f, &in->a[0], 8);
+      fputs(", ", out);
+      print_operand(out, m, f, &in->a[0], 8);
+      fputc('\n', out);
+      return;
+    }
+    break;
+  case X_SHL:
+  case X_SAR: print_two(out, m, f, mnemonics[in->op], in, 1, 8); return;
+  case X_SETCC:
+    fprintf(out, "\tset%s ", cc_names[in->cc]);
+    print_operand(out, m, f, &in->a[0], 1);
+    fputc('\n', out);
+    return;
+  case X_MOVZB: print_two(out, m, f, "movzbl", in, 1, 4); return;
+  case X_CQO: fputs("\tcqto\n", out); return;
+  case X_CALL:
+    fputs("\tcall ", out);
+    print_sym(out, m, in->a[0].index);
+    fputc('\n', out);
+    return;
+  case X_JMP:
+    if (in->a[0].index == next_block) return;
+    fputs("\tjmp ", out);
+    print_operand(out, m, f, &in->a[0], 8);
+    fputc('\n', out);
+    return;
+  case X_JCC:
+    fprintf(out, "\tj%s ", cc_names[in->cc]);
+    print_operand(out, m, f, &in->a[0], 8);
+    fputc('\n', out);
+    return;
+  case X_RET: fputs("\tret\n", out); return;
+  default: break;
+  }
+  if (in->a[1].kind == XO_NONE) {
+    fprintf(out, "\t%s ", mnemonics[in->op]);
+    print_operand(out, m, f, &in->a[0], 8);
+    fputc('\n', out);
+    return;
+  }
+  print_two(out, m, f, mnemonics[in->op], in, 8, 8);
+}
+
+static void print_string(FILE *out, const char *s) {
+  fputs("\t.string \"", out);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\')
+      fprintf(out, "\\%c", c);
+    else if (c >= 0x20 && c < 0x7f)
+      fputc(c, out);
+    else
+      fprintf(out, "\\%03o", c);
+  }
+  fputs("\"\n", out);
+}
+
+void print_x86(FILE *out, const x86_module *m) {
+  fputs("\t.text\n", out);
+  for (uint32_t i = 0; i < m->nfuncs; i++) {
+    const x86_func *f = m->funcs[i];
+    if (!f) continue;
+    if (strcmp(f->name, "main") == 0) fputs("\t.globl main\n", out);
+    fprintf(out, "%s:\n", f->name);
+    for (uint32_t b = 0; b < f->blocks.size; b++) {
+      fprintf(out, ".L%s.%u:\n", f->name, b);
+      const x86_inst_vec *insts = &f->blocks.data[b].insts;
+      for (size_t k = 0; k < insts->size; k++)
+        print_inst(out, m, f, &insts->data[k], b + 1);
+    }
+  }
+
+  fputs("\t.section .rodata\n", out);
+  for (uint32_t i = m->nfuncs + RT_COUNT; i < m->syms.size; i++) {
+    const x86_sym *s = &m->syms.data[i];
+    if (s->kind == XS_FLOAT) fputs("\t.p2align 3\n", out);
+    print_sym(out, m, i);
+    fputs(":\n", out);
+    if (s->kind == XS_STRING)
+      print_string(out, s->name);
+    else
+      fprintf(out, "\t.quad %" PRIu64 "\n", s->value);
+  }
+  fputs("\t.section .note.GNU-stack,\"\",@progbits\n", out);
+}
@@ -0,0 +1,289 @@
+#pragma once
+#include "arena.h"
+#include "ir.h"
+#include "vector.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// x86-64 machine code between instruction selection (isel.c) and output.
+// registers below X86_NREGS are physical, in encoding order; anything from
+// X86_FIRST_VREG up is a virtual register until allocate_registers() assigns
+// it a physical one or a stack slot. operands are stored in intel order,
+// destination first.
+
+typedef enum {
+  RAX,
+  RCX,
+  RDX,
+  RBX,
+  RSP,
+  RBP,
+  RSI,
+  RDI,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15,
+  XMM0,
+  XMM1,
+  XMM2,
+  XMM3,
+  XMM4,
+  XMM5,
+  XMM6,
+  XMM7,
+  XMM8,
+  XMM9,
+  XMM10,
+  XMM11,
+  XMM12,
+  XMM13,
+  XMM14,
+  XMM15,
+  X86_NREGS
+} x86_reg;
+
+#define X86_FIRST_VREG 64
+
+typedef enum { X86_GPR, X86_XMM, X86_NO_CLASS } x86_class;
+
+static inline int x86_is_vreg(uint32_t r) {
+  return r >= X86_FIRST_VREG;
+}
+
+typedef enum {
+  X_MOV,  // any register or memory to any other of one class, gpr <-> xmm, or an immediate
+  X_LEA,
+  X_ADD,
+  X_SUB,
+  X_IMUL,
+  X_AND,
+  X_OR,
+  X_XOR,
+  X_SHL,  // count is an immediate or RCX
+  X_SAR,
+  X_NEG,
+  X_NOT,
+  X_CMP,
+  X_TEST,
+  X_SETCC,  // writes the low byte only
+  X_MOVZB,  // zero extends the low byte
+  X_CQO,
+  X_IDIV,
+  X_ADDSD,
+  X_SUBSD,
+  X_MULSD,
+  X_DIVSD,
+  X_XORPD,
+  X_UCOMISD,
+  X_CVTSI2SD,
+  X_CVTTSD2SI,
+  X_PUSH,
+  X_POP,
+  X_CALL,  // uses the argument registers in `args`, clobbers every caller-saved one
+  X_JMP,
+  X_JCC,
+  X_RET,  // the epilogue is added by register allocation
+  X_OP_COUNT
+} x86_op;
+
+// condition codes, in encoding order so `cc ^ 1` negates
+typedef enum {
+  CC_O,
+  CC_NO,
+  CC_B,
+  CC_AE,
+  CC_E,
+  CC_NE,
+  CC_BE,
+  CC_A,
+  CC_S,
+  CC_NS,
+  CC_P,
+  CC_NP,
+  CC_L,
+  CC_GE,
+  CC_LE,
+  CC_G
+} x86_cc;
+
+typedef enum {
+  XO_NONE,
+  XO_REG,
+  XO_IMM,
+  XO_MEM,    // [reg + imm]
+  XO_SLOT,   // stack slot `index`, turned into XO_MEM off rbp once the frame is laid out
+  XO_SYM,    // symbol `index`: the address for calls, [rip + symbol] otherwise
+  XO_BLOCK,  // block `index` of the function
+} x86_operand_kind;
+
+typedef struct {
+  uint8_t kind;
+  uint32_t reg;
+  uint32_t index;
+  int64_t imm;
+} x86_operand;
+
+typedef struct {
+  uint8_t op;
+  uint8_t cc;
+  uint8_t gpr_args, xmm_args;  // X_CALL: arguments passed in registers
+  x86_operand a[2];
+} x86_inst;
+
+VEC_DECL(x86_inst_vec, x86_inst)
+
+typedef struct {
+  x86_inst_vec insts;
+} x86_block;
+
+VEC_DECL(x86_block_vec, x86_block)
+
+typedef struct {
+  const char *name;
+  uint32_t sym;
+  uint8_t ret_class;        // x86_class of the return value
+  x86_block_vec blocks;     // in layout order; jumps name blocks by position
+  u8_vec vregs;             // x86_class of each virtual register, from X86_FIRST_VREG
+  uint32_t nslots;          // 8-byte stack slots: allocas, then spills
+  uint32_t spills;          // virtual registers that didn't get a register
+} x86_func;
+
+// functions of the runtime (runtime/runtime.c) that generated code calls
+typedef enum {
+  RT_PRINT_I64,
+  RT_PRINT_F64,
+  RT_PRINT_STR,
+  RT_PRINT_NUM,
+  RT_DIV_I64,
+  RT_MOD_I64,
+  RT_POW_I64,
+  RT_MOD_F64,
+  RT_POW_F64,
+  RT_NUM_ADD,
+  RT_NUM_SUB,
+  RT_NUM_MUL,
+  RT_NUM_DIV,
+  RT_NUM_MOD,
+  RT_NUM_POW,
+  RT_NUM_NEG,
+  RT_NUM_EQ,
+  RT_NUM_LT,
+  RT_NUM_LE,
+  RT_BOX_I64,
+  RT_BOX_F64,
+  RT_BOX_PTR,
+  RT_TRUTHY,
+  RT_UNBOX_I64,
+  RT_UNBOX_F64,
+  RT_UNBOX_PTR,
+  RT_COUNT
+} x86_runtime;
+
+extern const char *const x86_runtime_names[RT_COUNT];
+
+typedef enum {
+  XS_FUNC,    // a function of the module
+  XS_EXTERN,  // a runtime function
+  XS_STRING,  // module string `value`
+  XS_FLOAT,   // an 8-byte constant with the bits in `value`
+} x86_sym_kind;
+
+typedef struct {
+  uint8_t kind;
+  const char *name;
+  uint64_t value;
+} x86_sym;
+
+VEC_DECL(x86_sym_vec, x86_sym)
+
+// symbols: the module's functions by id, then the runtime functions, then
+// strings and float constants as they are used
+typedef struct {
+  arena *arena;
+  const ir_module *ir;
+  x86_sym_vec syms;
+  x86_func **funcs;  // by function id
+  uint32_t nfuncs;
+  uint32_t *string_syms;  // module string -> symbol + 1, 0 while unused
+  uint32_t *float_table;  // open addressed, symbol + 1
+  uint32_t float_mask;
+  uint32_t nfloats;
+} x86_module;
+
+static inline uint32_t x86_runtime_sym(const x86_module *m, x86_runtime rt) {
+  return m->nfuncs + rt;
+}
+
+// instruction selection, then register allocation. `naive` keeps every value
+// in a stack slot of its own, the way an -O0 compiler does
+x86_module *gen_x86(ir_module *ir, arena *a, int naive);
+
+// isel.c: machine code with virtual registers for one function
+x86_func *select_instructions(x86_module *m, ir_func *f);
+
+// regalloc.c: linear scan over live intervals, spilling what doesn't fit,
+// then the prologue and epilogue
+void allocate_registers(x86_func *f, arena *a, int naive);
+
+// a 32-bit pc-relative reference to symbol `sym` at `offset` in the text:
+// the linker stores S + addend - P there
+typedef struct {
+  uint32_t offset;
+  uint32_t sym;
+  int32_t addend;
+} x86_reloc;
+
+VEC_DECL(x86_reloc_vec, x86_reloc)
+
+// machine code for a module, not yet linked; lives in the module's arena
+typedef struct {
+  u8_vec text;       // every function, 16-byte aligned
+  u8_vec rodata;     // strings and float constants
+  uint32_t *offset;  // symbol -> offset in text (functions) or rodata (strings, floats)
+  x86_reloc_vec relocs;
+} x86_code;
+
+// encode.c: encodes the allocated functions, picking the short form of each
+// jump that reaches
+void encode_x86(const x86_module *m, x86_code *out);
+
+// x86.c
+x86_module *create_x86_module(ir_module *ir, arena *a);
+uint32_t x86_string_sym(x86_module *m, uint32_t index);
+uint32_t x86_float_sym(x86_module *m, uint64_t bits);
+uint32_t x86_new_vreg(x86_func *f, x86_class c);
+x86_class x86_reg_class(const x86_func *f, uint32_t reg);
+void print_x86(FILE *out, const x86_module *m);
+
+static inline x86_operand x86_reg_op(uint32_t reg) {
+  return (x86_operand){.kind = XO_REG, .reg = reg};
+}
+
+static inline x86_operand x86_imm(int64_t imm) {
+  return (x86_operand){.kind = XO_IMM, .imm = imm};
+}
+
+static inline x86_operand x86_mem(uint32_t base, int64_t disp) {
+  return (x86_operand){.kind = XO_MEM, .reg = base, .imm = disp};
+}
+
+static inline x86_operand x86_slot(uint32_t index) {
+  return (x86_operand){.kind = XO_SLOT, .index = index};
+}
+
+static inline x86_operand x86_sym_op(uint32_t index) {
+  return (x86_operand){.kind = XO_SYM, .index = index};
+}
+
+static inline x86_operand x86_block_op(uint32_t index) {
+  return (x86_operand){.kind = XO_BLOCK, .index = index};
+}
+
+static inline int x86_fits_imm32(int64_t v) {
+  return v >= INT32_MIN && v <= INT32_MAX;
+}